@@ -0,0 +1,96 @@
+// download rate and seek latency of the http input against a loopback server
+// usage: http_input_bench [file MB] [seeks], run from the source directory for the plugin config
+
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <algorithm>
+
+#include "tests/http_input_client.h"
+
+namespace
+{
+	using namespace mprt;
+	using namespace mprt::test;
+
+	using clock_type = std::chrono::steady_clock;
+
+	double msecs(clock_type::duration dur)
+	{
+		return std::chrono::duration<double, std::milli>(dur).count();
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	size_type file_mb = argc > 1 ? std::atoll(argv[1]) : 64;
+	int seeks = argc > 2 ? std::atoi(argv[2]) : 50;
+	if (file_mb <= 0 || seeks <= 0)
+	{
+		std::fprintf(stderr, "usage: %s [file MB] [seeks]\n", argv[0]);
+		return 1;
+	}
+
+	// the cache buffer of the ffmpeg decoder, max_memory_size_per_file and max_chunk_read_size
+	http_input_client client(4096 * 1024, 128 * 1024);
+	http_loopback_server server(file_mb * 1024 * 1024);
+
+	auto nothing = [](size_type, buffer_elem_t const*, size_type) { return true; };
+
+	// the whole file with the consumer taking every chunk at once
+	{
+		auto start = clock_type::now();
+		auto s = client.open(server.url("/file"));
+		if (!s.ok() || !client.read(s, 0, server._file_size, nothing))
+		{
+			std::fprintf(stderr, "download failed\n");
+			return 1;
+		}
+		auto secs = msecs(clock_type::now() - start) / 1000.;
+		client.close(s);
+
+		std::printf("download %lld MB: %10.1f MB/s\n", static_cast<long long>(file_mb), secs > 0. ? file_mb / secs : 0.);
+	}
+
+	// from the seek callback to the first chunk at the new position
+	{
+		auto s = client.open(server.url("/file"));
+		if (!s.ok() || !client.read(s, 0, 64 * 1024, nothing))
+		{
+			std::fprintf(stderr, "open failed\n");
+			return 1;
+		}
+
+		std::mt19937_64 rng(42);
+		std::uniform_int_distribution<size_type> point(0, server._file_size - 1);
+		std::vector<double> latencies;
+
+		for (int i = 0; i != seeks; ++i)
+		{
+			auto seek_point = point(rng);
+			auto start = clock_type::now();
+			client.seek(s, seek_point);
+			if (!client.wait_seek(s, seek_point))
+			{
+				std::fprintf(stderr, "seek to %lld failed\n", static_cast<long long>(seek_point));
+				return 1;
+			}
+			latencies.push_back(msecs(clock_type::now() - start));
+		}
+		client.close(s);
+
+		std::sort(latencies.begin(), latencies.end());
+		double sum = 0.;
+		for (auto latency : latencies)
+		{
+			sum += latency;
+		}
+
+		std::printf("seek x%d: mean %.2f ms, median %.2f ms, max %.2f ms\n",
+			seeks, sum / latencies.size(), latencies[latencies.size() / 2], latencies.back());
+	}
+
+	return 0;
+}
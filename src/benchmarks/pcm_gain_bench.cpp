@@ -0,0 +1,118 @@
+// samples per second of the software gain kernels, for the numbers quoted for the output gain stage
+// usage: pcm_gain_bench [seconds per kernel]
+
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <functional>
+
+#include "common/pcm_gain.h"
+
+namespace
+{
+	using clock_type = std::chrono::steady_clock;
+
+	// a period of stereo at 48 kHz times a few, as the outputs hand them over
+	constexpr std::size_t _BLOCK_SAMPLES_ = 8192;
+
+	template <typename T>
+	std::vector<T> make_block(T amplitude)
+	{
+		std::vector<T> block(_BLOCK_SAMPLES_);
+		uint32_t s = 0x12345678u;
+		for (auto & sample : block)
+		{
+			s ^= s << 13;
+			s ^= s >> 17;
+			s ^= s << 5;
+			sample = static_cast<T>(static_cast<double>(s) / 4294967296. * 2. * amplitude - amplitude);
+		}
+
+		return block;
+	}
+
+	// the kernel runs over the same block until the time is up, the block is restored
+	// from a copy every round so the gain does not walk the samples to zero
+	template <typename T>
+	void run(char const* name, std::vector<T> const& source, double seconds, std::function<void (T *, std::size_t)> kernel)
+	{
+		auto block = source;
+		std::size_t samples = 0;
+		clock_type::duration busy(0);
+		auto end = clock_type::now() + std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double>(seconds));
+
+		while (clock_type::now() < end)
+		{
+			std::copy(source.begin(), source.end(), block.begin());
+
+			auto start = clock_type::now();
+			kernel(block.data(), block.size());
+			busy += clock_type::now() - start;
+			samples += block.size();
+		}
+
+		auto secs = std::chrono::duration<double>(busy).count();
+		std::printf("%-28s %10.1f Msamples/s\n", name, secs > 0. ? samples / secs / 1e6 : 0.);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	using namespace mprt;
+
+	double seconds = argc > 1 ? std::atof(argv[1]) : 1.;
+	if (seconds <= 0.)
+	{
+		std::fprintf(stderr, "usage: %s [seconds per kernel]\n", argv[0]);
+		return 1;
+	}
+
+#if defined(MPRT_PCM_SSE2)
+	std::printf("kernels: sse2\n");
+#else
+	std::printf("kernels: scalar\n");
+#endif
+
+	const float gain = 0.7f;
+	pcm_gain::dither_state dither;
+
+	auto s16 = make_block<int16_t>(30000);
+	auto s32 = make_block<int32_t>(2000000000);
+	auto flt = make_block<float>(0.9f);
+
+	run<float>("flt", flt, seconds, [gain](float * data, std::size_t count)
+	{
+		pcm_gain::scale_flt(data, count, gain);
+	});
+	run<int16_t>("s16", s16, seconds, [gain](int16_t * data, std::size_t count)
+	{
+		pcm_gain::scale_s16(data, count, gain, nullptr);
+	});
+	run<int16_t>("s16 dither", s16, seconds, [gain, &dither](int16_t * data, std::size_t count)
+	{
+		pcm_gain::scale_s16(data, count, gain, &dither);
+	});
+	run<int32_t>("s32 dither (24 valid bits)", s32, seconds, [gain, &dither](int32_t * data, std::size_t count)
+	{
+		pcm_gain::scale_s32(data, count, gain, &dither, pcm_gain::dither_step(32, 24));
+	});
+	run<int32_t>("s32 dither (32 valid bits)", s32, seconds, [gain, &dither](int32_t * data, std::size_t count)
+	{
+		pcm_gain::scale_s32(data, count, gain, &dither, pcm_gain::dither_step(32, 32));
+	});
+
+	// the stage as the outputs use it, stereo and a gain change ramped over 10 ms
+	pcm_gain_stage stage;
+	stage.set_ramp_frames(480);
+	stage.set_valid_bits(16);
+	bool flip = false;
+	run<int16_t>("stage s16 ramped", s16, seconds, [&stage, &flip](int16_t * data, std::size_t count)
+	{
+		stage.set_gain((flip = !flip) ? 0.5f : 0.7f);
+		stage.process(data, count / 2, 2, 16, false);
+	});
+
+	return 0;
+}
@@ -0,0 +1,270 @@
+#ifndef adaptive_resampler_h__
+#define adaptive_resampler_h__
+
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+#include "pcm_convert.h"
+
+namespace mprt
+{
+	namespace adaptive_resampling
+	{
+		// the sample formats an output writes, counts are in samples (not frames)
+		inline bool is_supported(std::size_t bps, bool is_float)
+		{
+			return is_float ? bps == 32 : (bps == 16 || bps == 32);
+		}
+
+		inline void to_float(void const* in, std::size_t bps, bool is_float, float * out, std::size_t count)
+		{
+			if (is_float)
+			{
+				std::memcpy(out, in, count * sizeof(float));
+			}
+			else if (bps == 16)
+			{
+				auto samples = static_cast<int16_t const*>(in);
+				for (std::size_t i = 0; i != count; ++i)
+				{
+					out[i] = samples[i] * (1.f / 32768.f);
+				}
+			}
+			else
+			{
+				auto samples = static_cast<int32_t const*>(in);
+				for (std::size_t i = 0; i != count; ++i)
+				{
+					out[i] = static_cast<float>(samples[i]) * (1.f / 2147483648.f);
+				}
+			}
+		}
+
+		inline void from_float(float const* in, void * out, std::size_t bps, bool is_float, std::size_t count)
+		{
+			if (is_float)
+			{
+				std::memcpy(out, in, count * sizeof(float));
+			}
+			else if (bps == 16)
+			{
+				auto samples = static_cast<int16_t*>(out);
+				for (std::size_t i = 0; i != count; ++i)
+				{
+					samples[i] = static_cast<int16_t>(std::lrint(std::min(std::max(in[i] * 32768.f, -32768.f), 32767.f)));
+				}
+			}
+			else
+			{
+				// the largest float under 2^31
+				auto samples = static_cast<int32_t*>(out);
+				for (std::size_t i = 0; i != count; ++i)
+				{
+					samples[i] = static_cast<int32_t>(std::lrint(std::min(std::max(in[i] * 2147483648.f, -2147483648.f), 2147483520.f)));
+				}
+			}
+		}
+
+		inline float dot(float const* a, float const* b, std::size_t count)
+		{
+			std::size_t i = 0;
+			float sum = 0.f;
+#if defined(MPRT_PCM_SSE2)
+			auto acc0 = _mm_setzero_ps();
+			auto acc1 = _mm_setzero_ps();
+			for (; i + 8 <= count; i += 8)
+			{
+				acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+				acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+			}
+			auto acc = _mm_add_ps(acc0, acc1);
+			acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+			acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+			sum = _mm_cvtss_f32(acc);
+#endif
+			for (auto rest = count - i; rest != 0; --rest, ++i)
+			{
+				sum += a[i] * b[i];
+			}
+			return sum;
+		}
+	}
+
+	// a polyphase windowed sinc resampler for ratios close to 1 (the clock drift of two devices).
+	// the ratio can change at any time without a click, the input is interleaved float and is
+	// kept per channel so that the filter runs over contiguous samples
+	class adaptive_resampler
+	{
+	private:
+		// taps of one phase, the group delay is half of it
+		constexpr static std::size_t _TAPS_ = 32;
+		// the coefficients of the fractional positions in between are interpolated
+		constexpr static std::size_t _PHASES_ = 128;
+		// of the input nyquist, the drift ratios do not need an anti alias filter under it
+		constexpr static double _CUTOFF_ = 0.92;
+		constexpr static double _KAISER_BETA_ = 8.;
+		// the consumed history is moved down after this many frames
+		constexpr static std::size_t _COMPACT_FRAMES_ = 4096;
+
+		std::size_t _channels;
+		std::vector<float> _filter; // (_PHASES_ + 1) * _TAPS_
+		std::vector<std::vector<float>> _history; // per channel
+		std::size_t _frames; // in the history
+		double _position; // of the next output frame in the history
+		double _step; // input frames per output frame
+		float _coefs[_TAPS_];
+
+		static double bessel_i0(double x)
+		{
+			double sum = 1., term = 1.;
+			for (int k = 1; k < 32; ++k)
+			{
+				term *= (x / (2. * k)) * (x / (2. * k));
+				sum += term;
+			}
+			return sum;
+		}
+
+		void build_filter()
+		{
+			constexpr double pi = 3.14159265358979323846;
+			constexpr double half = _TAPS_ / 2.;
+
+			_filter.assign((_PHASES_ + 1) * _TAPS_, 0.f);
+			for (std::size_t phase = 0; phase <= _PHASES_; ++phase)
+			{
+				auto frac = static_cast<double>(phase) / _PHASES_;
+				auto row = &_filter[phase * _TAPS_];
+				double sum = 0.;
+				for (std::size_t k = 0; k != _TAPS_; ++k)
+				{
+					// the distance of the output position to the input sample of the tap
+					auto d = frac + half - 1. - static_cast<double>(k);
+					auto x = d / half;
+					auto window = std::abs(x) < 1. ? bessel_i0(_KAISER_BETA_ * std::sqrt(1. - x * x)) / bessel_i0(_KAISER_BETA_) : 0.;
+					auto sinc = d == 0. ? 1. : std::sin(pi * _CUTOFF_ * d) / (pi * _CUTOFF_ * d);
+					row[k] = static_cast<float>(_CUTOFF_ * sinc * window);
+					sum += row[k];
+				}
+
+				// no gain at dc
+				for (std::size_t k = 0; k != _TAPS_; ++k)
+				{
+					row[k] = static_cast<float>(row[k] / sum);
+				}
+			}
+		}
+
+		void compact()
+		{
+			auto first = static_cast<std::size_t>(_position) - (_TAPS_ / 2 - 1);
+			if (first < _COMPACT_FRAMES_)
+				return;
+
+			for (auto & channel : _history)
+			{
+				std::memmove(channel.data(), channel.data() + first, (_frames - first) * sizeof(float));
+			}
+			_frames -= first;
+			_position -= static_cast<double>(first);
+		}
+
+	public:
+		adaptive_resampler()
+			: _channels(0)
+			, _frames(0)
+			, _position(0.)
+			, _step(1.)
+		{
+			build_filter();
+		}
+
+		void configure(std::size_t channels)
+		{
+			_channels = channels;
+			_history.assign(channels, std::vector<float>());
+			reset();
+		}
+
+		std::size_t channels() const { return _channels; }
+
+		// silence before the first input, the next output is the first input frame
+		void reset()
+		{
+			_frames = _TAPS_ / 2 - 1;
+			for (auto & channel : _history)
+			{
+				channel.assign(_frames, 0.f);
+			}
+			_position = static_cast<double>(_frames);
+		}
+
+		// output frames per input frame
+		void set_ratio(double ratio)
+		{
+			_step = ratio > 0. ? 1. / ratio : 1.;
+		}
+
+		// the input frames taken but not sent out yet, part of the delay of the output
+		double pending_frames() const
+		{
+			return static_cast<double>(_frames) - _position;
+		}
+
+		void push(float const* in, std::size_t frames)
+		{
+			for (std::size_t ch = 0; ch != _channels; ++ch)
+			{
+				auto & channel = _history[ch];
+				channel.resize(_frames + frames);
+				auto dest = channel.data() + _frames;
+				for (std::size_t i = 0; i != frames; ++i)
+				{
+					dest[i] = in[i * _channels + ch];
+				}
+			}
+			_frames += frames;
+		}
+
+		// interleaved, as many as the input allows up to max_frames
+		std::size_t pull(float * out, std::size_t max_frames)
+		{
+			std::size_t produced = 0;
+			while (produced < max_frames)
+			{
+				auto index = static_cast<std::size_t>(_position);
+				// the last tap has to be in the history
+				if (index + _TAPS_ / 2 >= _frames)
+					break;
+
+				auto phase_pos = (_position - static_cast<double>(index)) * _PHASES_;
+				auto phase = std::min(static_cast<std::size_t>(phase_pos), _PHASES_ - 1);
+				auto alpha = static_cast<float>(phase_pos - static_cast<double>(phase));
+				auto row = &_filter[phase * _TAPS_];
+				auto next_row = row + _TAPS_;
+				for (std::size_t k = 0; k != _TAPS_; ++k)
+				{
+					_coefs[k] = row[k] + alpha * (next_row[k] - row[k]);
+				}
+
+				auto first = index - (_TAPS_ / 2 - 1);
+				for (std::size_t ch = 0; ch != _channels; ++ch)
+				{
+					*out++ = adaptive_resampling::dot(_coefs, _history[ch].data() + first, _TAPS_);
+				}
+
+				_position += _step;
+				++produced;
+			}
+
+			compact();
+			return produced;
+		}
+	};
+}
+
+#endif // adaptive_resampler_h__
@@ -136,6 +136,11 @@ namespace mprt
 			return _ready;
 		}
 
+		// for the asio objects of a plugin, their handlers run on its job thread
+		boost::asio::io_context & get_io_context() {
+			return _io;
+		}
+
 		template<typename Func>
 		timer_type_shared add_async_job_thread_internal(Func f, timer_type::duration dur) {
 			return create_get_timer<Func>(f, dur);
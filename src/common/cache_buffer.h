@@ -2,8 +2,10 @@
 #define cache_buffer_h__
 
 #include <cstdint>
+#include <algorithm>
 #include <memory>
 #include <thread>
+#include <functional>
 
 #include <boost/circular_buffer_fwd.hpp>
 #include <boost/log/trivial.hpp>
@@ -22,6 +24,7 @@ class cache_buffer {
 public:
 	using value_type = typename Container::value_type;
 	using Container_shared = typename std::shared_ptr<Container>;
+	using data_notify_t = std::function<void()>;
 
 private:
 	using rotate_func_t = void (cache_buffer<Container>::*)();
@@ -36,6 +39,10 @@ private:
 
 	size_type _cache_last_size;
 	size_type _data_last_size;
+	size_type _cache_reserved;
+
+	// wakes up a consumer waiting for data, called on the producer thread
+	std::shared_ptr<data_notify_t const> _data_notify;
 
 	constexpr static bool _is_empty_check = true;
 
@@ -84,6 +91,11 @@ private:
 		if (read_ok && !val->second.empty())
 		{
 			_data_buffer->write(val);
+
+			if (auto notify = std::atomic_load(&_data_notify))
+			{
+				(*notify)();
+			}
 		}
 	}
 
@@ -136,6 +148,7 @@ public:
 		, _data_buffer(std::make_shared<Container>(static_cast<std::size_t>(_buffer_size_count + 1)))
 		, _cache_buffer(std::make_shared<Container>(static_cast<std::size_t>(_buffer_size_count + 1)))
 		, _total_bytes_in_buffer(0)
+		, _cache_reserved(0)
 
 	{
 		init_cache_buffer();
@@ -149,7 +162,14 @@ public:
 	// producer
 	value_type* get_cache_ptr()
 	{
-		return get_gen_prt(_cache_buffer, _cache_last_size);
+		auto cache_ptr = get_gen_prt(_cache_buffer, _cache_last_size);
+		if (cache_ptr)
+		{
+			// reserved bytes are not counted yet
+			_cache_last_size -= _cache_reserved;
+		}
+
+		return cache_ptr;
 	}
 
 	void put_cache_ptr(bool rotate)
@@ -157,7 +177,65 @@ public:
 		put_gen_ptr(_cache_buffer->frontPtr(), _cache_last_size, &cache_buffer<Container>::rotate_cache, rotate, !_is_empty_check);
 	}
 
+	// producer, for reads which finish later: the front chunk grows by up to size bytes at once
+	// (size is set to the reserved count), they are counted and handed over by commit_cache_ptr
+	buffer_elem_t* reserve_cache_ptr(size_type & size, size_type byte_pos)
+	{
+		auto cache_ptr = get_cache_ptr();
+		if (!cache_ptr || _cache_reserved != 0)
+			return nullptr;
+
+		auto & chunk = (*cache_ptr)->second;
+		size = std::min<size_type>(size, static_cast<size_type>(chunk.reserve()));
+		if (size <= 0)
+			return nullptr;
+
+		if (chunk.empty())
+		{
+			(*cache_ptr)->first = byte_pos;
+		}
+
+		auto old_size = static_cast<size_type>(chunk.size());
+		chunk.resize(static_cast<std::size_t>(old_size + size));
+		_cache_reserved = size;
+
+		return chunk.linearize() + old_size;
+	}
+
+	// used bytes from the start of the reserved ones are kept, the rest is dropped
+	void commit_cache_ptr(size_type used, bool rotate)
+	{
+		if (auto cache_ptr = get_cache_ptr())
+		{
+			(*cache_ptr)->second.erase_end(static_cast<std::size_t>(_cache_reserved - used));
+			_cache_reserved = 0;
+			put_cache_ptr(rotate);
+		}
+	}
+
+	// the front chunk is swapped for an empty one and given back, the reads still
+	// running into its reserved bytes cannot touch the buffer any more
+	value_type detach_cache_ptr()
+	{
+		value_type detached;
+		if (auto cache_ptr = get_cache_ptr())
+		{
+			detached = *cache_ptr;
+			*cache_ptr = std::make_shared<typename value_type::element_type>(std::make_pair(0, static_cast<std::size_t>(_elem_size)));
+			_total_bytes_in_buffer -= _cache_last_size;
+		}
+
+		_cache_reserved = 0;
+		return detached;
+	}
+
 	// consumer part
+	// called for every chunk handed over, the consumer keeps it cheap when it is not waiting
+	void set_data_notify(data_notify_t notify)
+	{
+		std::atomic_store(&_data_notify, notify ? std::make_shared<data_notify_t const>(std::move(notify)) : std::shared_ptr<data_notify_t const>());
+	}
+
 	value_type* get_data_ptr()
 	{
 		return get_gen_prt(_data_buffer, _data_last_size);
@@ -256,6 +334,8 @@ public:
 			(*cache_ptr)->second.clear();
 			put_cache_ptr(false);
 		}
+
+		_cache_reserved = 0;
 	}
 
 	void sync_cache()
@@ -0,0 +1,215 @@
+#ifndef crossfade_mixer_h__
+#define crossfade_mixer_h__
+
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <algorithm>
+
+#include "common_defs.h"
+#include "pcm_convert.h"
+
+namespace mprt
+{
+	enum class crossfade_mode
+	{
+		off,
+		always,
+		not_album // not between the items which follow each other on an album
+	};
+
+	enum class crossfade_curve
+	{
+		linear,
+		equal_power, // the sum of the powers stays the same, for unrelated items
+		s_curve
+	};
+
+	// mixing kernels, the incoming item is added into the outgoing one in place,
+	// counts are in samples (not frames)
+	namespace crossfade
+	{
+		inline crossfade_mode mode_from_string(std::string const& name)
+		{
+			return
+				name == "always" ? crossfade_mode::always :
+				name == "not_album" ? crossfade_mode::not_album :
+				crossfade_mode::off;
+		}
+
+		inline crossfade_curve curve_from_string(std::string const& name)
+		{
+			return
+				name == "linear" ? crossfade_curve::linear :
+				name == "s_curve" ? crossfade_curve::s_curve :
+				crossfade_curve::equal_power;
+		}
+
+		// the gains at x in [0, 1] of the fade
+		inline void curve_gains(crossfade_curve curve, float x, float & out_gain, float & in_gain)
+		{
+			x = std::min(std::max(x, 0.f), 1.f);
+			switch (curve)
+			{
+			case crossfade_curve::linear:
+				in_gain = x;
+				break;
+			case crossfade_curve::s_curve:
+				in_gain = x * x * (3.f - 2.f * x);
+				break;
+			case crossfade_curve::equal_power:
+				in_gain = std::sin(x * 1.5707963f);
+				out_gain = std::cos(x * 1.5707963f);
+				return;
+			}
+			out_gain = 1.f - in_gain;
+		}
+
+		inline void mix_flt(float * dest, float const* in, std::size_t count, float out_gain, float in_gain)
+		{
+			std::size_t i = 0;
+#if defined(MPRT_PCM_SSE2)
+			auto const go = _mm_set1_ps(out_gain);
+			auto const gi = _mm_set1_ps(in_gain);
+			for (; i + 4 <= count; i += 4)
+			{
+				_mm_storeu_ps(dest + i, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(dest + i), go), _mm_mul_ps(_mm_loadu_ps(in + i), gi)));
+			}
+#endif
+			for (; i != count; ++i)
+			{
+				dest[i] = dest[i] * out_gain + in[i] * in_gain;
+			}
+		}
+
+		inline void mix_s16(int16_t * dest, int16_t const* in, std::size_t count, float out_gain, float in_gain)
+		{
+			std::size_t i = 0;
+#if defined(MPRT_PCM_SSE2)
+			auto const go = _mm_set1_ps(out_gain);
+			auto const gi = _mm_set1_ps(in_gain);
+			for (; i + 8 <= count; i += 8)
+			{
+				auto d = _mm_loadu_si128(reinterpret_cast<__m128i const*>(dest + i));
+				auto s = _mm_loadu_si128(reinterpret_cast<__m128i const*>(in + i));
+				// sign extended by the arithmetic shift
+				auto lo = _mm_add_ps(
+					_mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(d, d), 16)), go),
+					_mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16)), gi));
+				auto hi = _mm_add_ps(
+					_mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(d, d), 16)), go),
+					_mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16)), gi));
+				// rounds to the nearest, the pack saturates
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i), _mm_packs_epi32(_mm_cvtps_epi32(lo), _mm_cvtps_epi32(hi)));
+			}
+#endif
+			for (; i != count; ++i)
+			{
+				auto v = std::lrint(dest[i] * out_gain + in[i] * in_gain);
+				dest[i] = static_cast<int16_t>(std::min<long>(std::max<long>(v, -32768), 32767));
+			}
+		}
+
+		inline void mix_s32(int32_t * dest, int32_t const* in, std::size_t count, float out_gain, float in_gain)
+		{
+			// the largest float under 2^31
+			constexpr float s32_min = -2147483648.f, s32_max = 2147483520.f;
+
+			std::size_t i = 0;
+#if defined(MPRT_PCM_SSE2)
+			auto const go = _mm_set1_ps(out_gain);
+			auto const gi = _mm_set1_ps(in_gain);
+			auto const vmin = _mm_set1_ps(s32_min);
+			auto const vmax = _mm_set1_ps(s32_max);
+			for (; i + 4 <= count; i += 4)
+			{
+				auto v = _mm_add_ps(
+					_mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<__m128i const*>(dest + i))), go),
+					_mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<__m128i const*>(in + i))), gi));
+				v = _mm_min_ps(_mm_max_ps(v, vmin), vmax);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i), _mm_cvtps_epi32(v));
+			}
+#endif
+			for (; i != count; ++i)
+			{
+				auto v = std::min(std::max(static_cast<float>(dest[i]) * out_gain + static_cast<float>(in[i]) * in_gain, s32_min), s32_max);
+				dest[i] = static_cast<int32_t>(std::lrint(v));
+			}
+		}
+
+		inline void mix_s8(int8_t * dest, int8_t const* in, std::size_t count, float out_gain, float in_gain)
+		{
+			for (std::size_t i = 0; i != count; ++i)
+			{
+				auto v = std::lrint(dest[i] * out_gain + in[i] * in_gain);
+				dest[i] = static_cast<int8_t>(std::min<long>(std::max<long>(v, -128), 127));
+			}
+		}
+	}
+
+	// mixes the end of an item with the start of the next one, both in the same format.
+	// the position in the fade is given with every call, the writes to the device may be short
+	class crossfade_mixer
+	{
+	private:
+		// the gains are held over this many frames, a step is far under a hearable one
+		constexpr static std::size_t _BLOCK_FRAMES_ = 64;
+
+		crossfade_curve _curve;
+		size_type _total_frames;
+
+		template <typename T, typename Func>
+		void mix_blocks(T * dest, T const* in, std::size_t frames, std::size_t channels, size_type position, float in_gain, Func mix_func)
+		{
+			for (std::size_t done = 0; done < frames;)
+			{
+				auto count = std::min(_BLOCK_FRAMES_, frames - done);
+				// the middle of the block
+				auto x = (position + static_cast<size_type>(done + count / 2)) / static_cast<float>(_total_frames);
+
+				float out_gain, block_in_gain;
+				crossfade::curve_gains(_curve, x, out_gain, block_in_gain);
+				mix_func(dest + done * channels, in + done * channels, count * channels, out_gain, block_in_gain * in_gain);
+
+				done += count;
+			}
+		}
+
+	public:
+		crossfade_mixer()
+			: _curve(crossfade_curve::equal_power)
+			, _total_frames(0)
+		{}
+
+		void set_curve(crossfade_curve curve) { _curve = curve; }
+
+		void start(size_type total_frames) { _total_frames = std::max<size_type>(total_frames, 1); }
+		size_type total_frames() const { return _total_frames; }
+
+		// the frames [position, position + frames) of the fade, in_gain scales the incoming item
+		// against the outgoing one (their replaygain may differ), bps 8, 16 or 32 integer or 32 float
+		void mix(void * dest, void const* in, std::size_t frames, std::size_t channels, std::size_t bps, bool is_float,
+			size_type position, float in_gain)
+		{
+			if (is_float)
+			{
+				mix_blocks(reinterpret_cast<float*>(dest), reinterpret_cast<float const*>(in), frames, channels, position, in_gain, crossfade::mix_flt);
+			}
+			else if (bps == 16)
+			{
+				mix_blocks(reinterpret_cast<int16_t*>(dest), reinterpret_cast<int16_t const*>(in), frames, channels, position, in_gain, crossfade::mix_s16);
+			}
+			else if (bps == 32)
+			{
+				mix_blocks(reinterpret_cast<int32_t*>(dest), reinterpret_cast<int32_t const*>(in), frames, channels, position, in_gain, crossfade::mix_s32);
+			}
+			else if (bps == 8)
+			{
+				mix_blocks(reinterpret_cast<int8_t*>(dest), reinterpret_cast<int8_t const*>(in), frames, channels, position, in_gain, crossfade::mix_s8);
+			}
+		}
+	};
+}
+
+#endif // crossfade_mixer_h__
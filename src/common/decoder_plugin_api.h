@@ -203,6 +203,12 @@ namespace mprt {
 		virtual void init_api() = 0;
 		virtual void seek_duration(size_type duration_ms) = 0;
 
+		// check whole files in the background, outside of the playback pipeline
+		virtual void verify_integrity(std::shared_ptr<std::vector<std::string>> /*urls*/) {}
+
+		// the decoder opens the url on its own, the input plugin does not read it
+		virtual bool reads_url_itself(std::string const& /*url*/) { return false; }
+
 		void set_decoder_plugin_manager(decoder_plugins_manager * decoder_plug_man)
 		{
 			_decoder_plugins_manager = decoder_plug_man;
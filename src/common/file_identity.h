@@ -0,0 +1,99 @@
+#ifndef file_identity_h__
+#define file_identity_h__
+
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <sstream>
+#include <iomanip>
+
+#include <boost/filesystem.hpp>
+
+#include "common/common_defs.h"
+
+namespace mprt
+{
+	// identifies the exact contents of a local file for the persistent caches,
+	// any change in size or modification time makes the cached data stale
+	struct file_identity
+	{
+		std::string _path;
+		size_type _size;
+		std::time_t _mtime;
+		bool _ok;
+
+		file_identity()
+			: _path("")
+			, _size(-1)
+			, _mtime(0)
+			, _ok(false)
+		{}
+
+		static file_identity from_path(std::string const& path)
+		{
+			file_identity ident;
+			boost::system::error_code ec;
+
+			ident._path = path;
+
+			auto file_size = boost::filesystem::file_size(path, ec);
+			if (ec)
+				return ident;
+
+			auto mtime = boost::filesystem::last_write_time(path, ec);
+			if (ec)
+				return ident;
+
+			ident._size = static_cast<size_type>(file_size);
+			ident._mtime = mtime;
+			ident._ok = true;
+
+			return ident;
+		}
+
+		bool operator==(file_identity const& other) const
+		{
+			return
+				_ok && other._ok &&
+				_size == other._size &&
+				_mtime == other._mtime &&
+				_path == other._path;
+		}
+
+		// stable across runs and platforms (fnv-1a), std::hash is not guaranteed to be
+		uint64_t hash() const
+		{
+			uint64_t h = 14695981039346656037ULL;
+			auto mix = [&h](const void *data, std::size_t len)
+			{
+				auto p = static_cast<const unsigned char *>(data);
+				for (std::size_t i = 0; i < len; ++i)
+				{
+					h ^= p[i];
+					h *= 1099511628211ULL;
+				}
+			};
+
+			int64_t mtime = static_cast<int64_t>(_mtime);
+			mix(_path.data(), _path.size());
+			mix(&_size, sizeof(_size));
+			mix(&mtime, sizeof(mtime));
+
+			return h;
+		}
+
+		std::string cache_file_name(std::string const& suffix) const
+		{
+			std::ostringstream o;
+			o << std::hex << std::setw(16) << std::setfill('0') << hash() << suffix;
+			return o.str();
+		}
+
+		boost::filesystem::path cache_file_path(boost::filesystem::path const& cache_dir, std::string const& suffix) const
+		{
+			return cache_dir / cache_file_name(suffix);
+		}
+	};
+}
+
+#endif // file_identity_h__
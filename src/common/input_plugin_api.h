@@ -6,6 +6,7 @@
 #include <memory>
 #include <chrono>
 #include <unordered_map>
+#include <vector>
 
 #include <boost/log/trivial.hpp>
 #include <boost/circular_buffer.hpp>
@@ -25,6 +26,7 @@ namespace mprt {
 		std::atomic<size_type> _url_id;
 		async_tasker::timer_type_shared _file_read_timer;
 		input_opened_register_func_t _input_opened_register_func;
+		input_metadata_register_func_t _input_metadata_register_func; // streams which carry their own tags
 
 		virtual bool is_no_job() = 0;
 
@@ -41,11 +43,14 @@ namespace mprt {
 		}
 
 		void set_input_opened_cb(input_opened_register_func_t func) { _input_opened_register_func = func; }
+		void set_input_metadata_cb(input_metadata_register_func_t func) { _input_metadata_register_func = func; }
 
 		// job functions
 		virtual url_id_t add_input_item(std::string filename) = 0;
 		virtual url_id_t add_input_item(std::string filename, url_id_t url_id) = 0;
 		virtual void remove_input_item(url_id_t url_id) = 0;
+		// the items played after the current one, in order. only a hint, nothing is queued
+		virtual void prefetch_input_items(std::vector<std::string> urls) {}
 
 		virtual void decoder_finish(std::string plugin_name, url_id_t) = 0;
 		virtual void set_cache_buffer(url_id_t url_id, cache_buffer_shared cache_buf) = 0;
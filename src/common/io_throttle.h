@@ -0,0 +1,68 @@
+#ifndef io_throttle_h__
+#define io_throttle_h__
+
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#include "common/common_defs.h"
+
+namespace mprt
+{
+	// token bucket shared by background readers, caps their total bytes per second
+	class io_throttle {
+	private:
+		using clock_type = std::chrono::steady_clock;
+
+		std::mutex _mutex;
+		size_type _bytes_per_sec;
+		double _tokens;
+		clock_type::time_point _last_refill;
+
+	public:
+		// bytes_per_sec <= 0 means unlimited
+		io_throttle(size_type bytes_per_sec)
+			: _bytes_per_sec(bytes_per_sec)
+			, _tokens(static_cast<double>(bytes_per_sec))
+			, _last_refill(clock_type::now())
+		{}
+
+		void set_rate(size_type bytes_per_sec)
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_bytes_per_sec = bytes_per_sec;
+		}
+
+		// blocks the calling thread until bytes may be read
+		void consume(size_type bytes)
+		{
+			std::chrono::microseconds wait_time(0);
+
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				if (_bytes_per_sec <= 0)
+					return;
+
+				auto now = clock_type::now();
+				auto elapsed = std::chrono::duration<double>(now - _last_refill).count();
+				_last_refill = now;
+
+				// at most one second of burst
+				_tokens = std::min<double>(_tokens + elapsed * _bytes_per_sec, static_cast<double>(_bytes_per_sec));
+				_tokens -= static_cast<double>(bytes);
+
+				if (_tokens < 0)
+				{
+					wait_time = std::chrono::microseconds(static_cast<int64_t>(-_tokens * 1e6 / _bytes_per_sec));
+				}
+			}
+
+			if (wait_time.count() > 0)
+			{
+				std::this_thread::sleep_for(wait_time);
+			}
+		}
+	};
+}
+
+#endif // io_throttle_h__
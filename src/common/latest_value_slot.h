@@ -0,0 +1,103 @@
+#ifndef latest_value_slot_h__
+#define latest_value_slot_h__
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace mprt
+{
+	// the last value of one writer for any number of readers, a sequence lock: the writer never
+	// waits, a reader reads again when a store came in between. the value is kept in atomic words
+	// so that a torn read is not a data race, only thrown away
+	template <typename T>
+	class latest_value_slot
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "the value is copied word by word");
+
+	private:
+		static constexpr std::size_t _WORDS_ = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+		std::atomic<uint64_t> _sequence; // odd while a store is going on
+		std::atomic<uint64_t> _words[_WORDS_];
+
+		uint64_t load_versioned(T & value) const
+		{
+			uint64_t words[_WORDS_];
+			for (;;)
+			{
+				auto before = _sequence.load(std::memory_order_acquire);
+				if (before & 1)
+				{
+					continue;
+				}
+
+				for (std::size_t i = 0; i != _WORDS_; ++i)
+				{
+					words[i] = _words[i].load(std::memory_order_relaxed);
+				}
+
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if (_sequence.load(std::memory_order_relaxed) == before)
+				{
+					std::memcpy(&value, words, sizeof(T));
+					return before / 2;
+				}
+			}
+		}
+
+	public:
+		latest_value_slot()
+			: _sequence(0)
+		{
+			store(T());
+		}
+
+		latest_value_slot(latest_value_slot const&) = delete;
+		latest_value_slot& operator=(latest_value_slot const&) = delete;
+
+		// one writer only
+		void store(T const& value)
+		{
+			uint64_t words[_WORDS_] = {};
+			std::memcpy(words, &value, sizeof(T));
+
+			auto seq = _sequence.load(std::memory_order_relaxed);
+			_sequence.store(seq + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+
+			for (std::size_t i = 0; i != _WORDS_; ++i)
+			{
+				_words[i].store(words[i], std::memory_order_relaxed);
+			}
+
+			_sequence.store(seq + 2, std::memory_order_release);
+		}
+
+		// changes with every store
+		uint64_t version() const
+		{
+			return _sequence.load(std::memory_order_acquire) / 2;
+		}
+
+		T load() const
+		{
+			T value;
+			load_versioned(value);
+			return value;
+		}
+
+		// false if nothing was stored since the version seen, otherwise the value and its version
+		bool load_if_newer(uint64_t & seen_version, T & value) const
+		{
+			if (version() == seen_version)
+				return false;
+
+			seen_version = load_versioned(value);
+			return true;
+		}
+	};
+}
+
+#endif // latest_value_slot_h__
@@ -1,24 +1,183 @@
 #ifndef output_plugin_h__
 #define output_plugin_h__
 
+#include <cmath>
 #include <utility>
 #include <memory>
 #include <unordered_map>
 #include <chrono>
+#include <mutex>
+#include <limits>
+#include <vector>
+#include <atomic>
+#include <algorithm>
 
 #include <boost/log/trivial.hpp>
 #include <boost/circular_buffer.hpp>
 
 #include "type_defs.h"
+#include "refcounting_plugin_api.h"
 #include "cache_buffer.h"
 #include "utils.h"
 #include "sound_plugin_api.h"
 #include "async_task.h"
+#include "latest_value_slot.h"
 
 namespace mprt {
 
 	class decoder_plugin_api;
 
+	// when the device is open with another format, the decoder may convert into it
+	// instead of having the device set up again (a drain and a gap between the items)
+	enum class open_format_policy
+	{
+		off,
+		format, // only to a sample format at least as precise, the rate and the channels are the same
+		all // resampled and remixed too
+	};
+
+	// what an output device can play, the decoders convert into one of these
+	// so that the device does not have to (or cannot) do it
+	struct output_format_caps
+	{
+		bool _valid; // false: not probed, everything is accepted
+		bool _s16;
+		bool _s32;
+		bool _float;
+		size_type _min_rate;
+		size_type _max_rate;
+		size_type _min_channels;
+		size_type _max_channels;
+		bool _continuous_rates; // every rate in the range, otherwise only the ones in _rates
+		std::vector<size_type> _rates;
+		std::vector<size_type> _channel_counts; // empty: every count in the range
+		std::chrono::microseconds _min_buffer_time;
+		std::chrono::microseconds _max_buffer_time;
+		std::chrono::microseconds _min_period_time;
+		std::chrono::microseconds _max_period_time;
+
+		// the format the device is set up with now
+		open_format_policy _open_policy;
+		bool _open_valid;
+		size_type _open_bps;
+		bool _open_is_float;
+		size_type _open_rate;
+		size_type _open_channels;
+
+		output_format_caps()
+			: _valid(false)
+			, _s16(true)
+			, _s32(true)
+			, _float(true)
+			, _min_rate(0)
+			, _max_rate(std::numeric_limits<size_type>::max())
+			, _min_channels(1)
+			, _max_channels(std::numeric_limits<size_type>::max())
+			, _continuous_rates(true)
+			, _min_buffer_time(0)
+			, _max_buffer_time(0)
+			, _min_period_time(0)
+			, _max_period_time(0)
+			, _open_policy(open_format_policy::off)
+			, _open_valid(false)
+			, _open_bps(0)
+			, _open_is_float(false)
+			, _open_rate(0)
+			, _open_channels(0)
+		{}
+
+		bool accepts_format(size_type bps, bool is_float) const
+		{
+			return !_valid || (is_float ? _float : (bps == 16 ? _s16 : bps == 32 && _s32));
+		}
+
+		bool accepts_rate(size_type sample_rate) const
+		{
+			return !_valid ||
+				(sample_rate >= _min_rate && sample_rate <= _max_rate &&
+				(_continuous_rates || std::find(_rates.begin(), _rates.end(), sample_rate) != _rates.end()));
+		}
+
+		bool accepts_channels(size_type channels) const
+		{
+			return !_valid ||
+				(channels >= _min_channels && channels <= _max_channels &&
+				(_channel_counts.empty() || std::find(_channel_counts.begin(), _channel_counts.end(), channels) != _channel_counts.end()));
+		}
+
+		bool accepts(size_type bps, bool is_float, size_type sample_rate, size_type channels) const
+		{
+			return accepts_format(bps, is_float) && accepts_rate(sample_rate) && accepts_channels(channels);
+		}
+
+		// a native format which is better played as the open format, see open_format_policy
+		bool prefers_open_format(size_type bps, bool is_float, size_type sample_rate, size_type channels) const
+		{
+			if (_open_policy == open_format_policy::off || !_open_valid)
+				return false;
+
+			bool same_format = _open_bps == bps && _open_is_float == is_float;
+			bool same_layout = _open_rate == sample_rate && _open_channels == channels;
+			if (same_format && same_layout)
+				return false;
+
+			// 16 bits fit in the others without a loss, 32 bits only in themselves
+			bool wider_format = same_format || (bps == 16 && !is_float);
+			return _open_policy == open_format_policy::all || (same_layout && wider_format);
+		}
+	};
+
+	// what is heard, the samples queued in the device are taken off the written ones.
+	// between two reports the position moves on with the clock while playing
+	struct playback_position
+	{
+		url_id_t _url_id;
+		size_type _position_ms; // at the time stamp
+		size_type _max_position_ms; // written to the device, the interpolation stops there
+		int64_t _time_stamp_us; // steady clock
+		bool _playing;
+
+		playback_position()
+			: _url_id(_INVALID_URL_ID_)
+			, _position_ms(0)
+			, _max_position_ms(0)
+			, _time_stamp_us(0)
+			, _playing(false)
+		{}
+
+		size_type position_ms_at(std::chrono::steady_clock::time_point now) const
+		{
+			if (!_playing)
+				return _position_ms;
+
+			auto elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count() - _time_stamp_us;
+			return std::min(_position_ms + std::max<int64_t>(elapsed_us, 0) / 1000, _max_position_ms);
+		}
+	};
+
+	// the frames a device has played against the steady clock, for the sync of the outputs. the
+	// epoch changes when the count is not continuous any more (an xrun, a pause, a new setup)
+	struct device_clock
+	{
+		bool _valid; // published while the device runs only
+		uint64_t _epoch;
+		size_type _sample_rate; // nominal
+		int64_t _device_frames; // played by the device at the time stamp, silence included
+		int64_t _time_stamp_us; // steady clock
+		url_id_t _url_id; // heard at the time stamp
+		double _item_frames; // of that item heard at the time stamp
+
+		device_clock()
+			: _valid(false)
+			, _epoch(0)
+			, _sample_rate(0)
+			, _device_frames(0)
+			, _time_stamp_us(0)
+			, _url_id(_INVALID_URL_ID_)
+			, _item_frames(0.)
+		{}
+	};
+
 	class output_plugin_api : public refcounting_plugin_api, public sound_plugin_api, public async_task
 	{
 	protected:
@@ -28,6 +187,23 @@ namespace mprt {
 		std::unordered_map<std::string, progress_callback_register_func_t> _progress_func_call_list;
 		bool _use_duration;
 		async_tasker::timer_type_shared _play_timer;
+		std::mutex _format_caps_mutex;
+		output_format_caps _format_caps;
+		bool _enabled; // the enable config key, a disabled output is not given any item
+
+		// written by the job thread, read from anywhere
+		latest_value_slot<playback_position> _position;
+		// the progress callbacks are called at most this often, an item change goes out at once
+		std::chrono::milliseconds _progress_interval;
+		std::chrono::steady_clock::time_point _last_progress_call;
+		url_id_t _last_progress_url_id;
+
+		// written by the job thread, read by the output sync
+		latest_value_slot<device_clock> _device_clock;
+		uint64_t _device_clock_epoch;
+		// set by the output sync, taken by the job thread
+		std::atomic<double> _rate_correction; // output frames per item frame, 0: off
+		std::atomic<int64_t> _position_step; // item frames to skip, negative: silence to put in
 
 		virtual void play() = 0;
 		virtual void pause_play_internal() = 0;
@@ -64,6 +240,22 @@ namespace mprt {
 			// @TODO: to be implemented
 		}
 
+		void set_format_caps(output_format_caps const& caps)
+		{
+			std::lock_guard<std::mutex> lock(_format_caps_mutex);
+			_format_caps = caps;
+		}
+
+		void set_open_format(sound_details const& sound_dets)
+		{
+			std::lock_guard<std::mutex> lock(_format_caps_mutex);
+			_format_caps._open_valid = true;
+			_format_caps._open_bps = sound_dets._bps;
+			_format_caps._open_is_float = sound_dets._is_float;
+			_format_caps._open_rate = sound_dets._sample_rate;
+			_format_caps._open_channels = sound_dets._channels;
+		}
+
 		void update_total_samples_internal(url_id_t url_id, size_type total_samples)
 		{
 			for (auto & sound_dets : _sound_details_queue) {
@@ -74,6 +266,85 @@ namespace mprt {
 			}
 		}
 
+		// the progress_rate_hz config key, 0: every report
+		void set_progress_rate(double rate_hz)
+		{
+			_progress_interval = std::chrono::milliseconds(rate_hz > 0. ? static_cast<size_type>(1000. / rate_hz) : 0);
+		}
+
+		// a position report is worth the work of finding it
+		bool is_progress_due(url_id_t url_id) const
+		{
+			return url_id != _last_progress_url_id ||
+				std::chrono::steady_clock::now() - _last_progress_call >= _progress_interval;
+		}
+
+		void publish_position(url_id_t url_id, size_type position_ms, size_type max_position_ms, bool playing)
+		{
+			auto now = std::chrono::steady_clock::now();
+
+			playback_position pos;
+			pos._url_id = url_id;
+			pos._position_ms = std::max<size_type>(position_ms, 0);
+			pos._max_position_ms = std::max(pos._position_ms, max_position_ms);
+			pos._time_stamp_us = std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count();
+			pos._playing = playing;
+			_position.store(pos);
+
+			if (is_progress_due(url_id))
+			{
+				_last_progress_call = now;
+				_last_progress_url_id = url_id;
+				call_callback_funcs(_progress_func_call_list, url_id, pos._position_ms);
+			}
+		}
+
+		// paused, the position stays where the interpolation got to
+		void hold_position()
+		{
+			auto pos = _position.load();
+			if (pos._playing)
+			{
+				auto now = std::chrono::steady_clock::now();
+				pos._position_ms = pos.position_ms_at(now);
+				pos._time_stamp_us = std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count();
+				pos._playing = false;
+				_position.store(pos);
+			}
+		}
+
+		// time_stamp_us is the steady clock time the device had played device_frames at
+		void publish_device_clock(size_type sample_rate, int64_t device_frames, int64_t time_stamp_us, url_id_t url_id, double item_frames)
+		{
+			device_clock clock;
+			clock._valid = true;
+			clock._epoch = _device_clock_epoch;
+			clock._sample_rate = sample_rate;
+			clock._device_frames = device_frames;
+			clock._time_stamp_us = time_stamp_us;
+			clock._url_id = url_id;
+			clock._item_frames = item_frames;
+			_device_clock.store(clock);
+		}
+
+		// the device stopped or started again, the frames before do not count for its rate
+		void restart_device_clock()
+		{
+			device_clock clock;
+			clock._epoch = ++_device_clock_epoch;
+			_device_clock.store(clock);
+		}
+
+		double rate_correction() const
+		{
+			return _rate_correction.load(std::memory_order_relaxed);
+		}
+
+		int64_t take_position_step()
+		{
+			return _position_step.exchange(0, std::memory_order_relaxed);
+		}
+
 		double get_soft_vol_gain(int vol_pos)
 		{
 			// vol pos should be 0 and 200, we accept that 0 is -100db, 200 is 0db, we allow 0.5db x_rements
@@ -118,6 +389,11 @@ namespace mprt {
 			}
 			_prev_sound_details = sound_details();
 			clear_queue(_sound_details_queue);
+
+			_position.store(playback_position());
+			_last_progress_url_id = _INVALID_URL_ID_;
+			_position_step = 0;
+			restart_device_clock();
 		}
 		
 		void clear_play_data_internal(url_id_t url_id)
@@ -148,6 +424,12 @@ namespace mprt {
 	public:
 		output_plugin_api()
 			: _init_api(false)
+			, _enabled(true)
+			, _progress_interval(100)
+			, _last_progress_url_id(_INVALID_URL_ID_)
+			, _device_clock_epoch(0)
+			, _rate_correction(0.)
+			, _position_step(0)
 		{}
 
 		virtual ~output_plugin_api() {
@@ -178,10 +460,66 @@ namespace mprt {
 			auto const& sound_dets = sound_details_top();
 			return
 				_prev_sound_details._bps == sound_dets._bps &&
+				_prev_sound_details._is_float == sound_dets._is_float &&
 				_prev_sound_details._channels == sound_dets._channels &&
 				_prev_sound_details._sample_rate == sound_dets._sample_rate;
 		}
 
+		bool is_enabled() const
+		{
+			return _enabled;
+		}
+
+		// how much earlier than usual the next item has to be decoded, the crossfade length
+		virtual std::chrono::milliseconds next_item_lead_time() const
+		{
+			return std::chrono::milliseconds(0);
+		}
+
+		// can be called from any thread, polled by the clients instead of the progress callbacks
+		playback_position position() const
+		{
+			return _position.load();
+		}
+
+		// false if nothing new was published since the version seen
+		bool position_if_newer(uint64_t & seen_version, playback_position & pos) const
+		{
+			return _position.load_if_newer(seen_version, pos);
+		}
+
+		// can be called from any thread, the output sync measures the drift of the devices with it
+		device_clock get_device_clock() const
+		{
+			return _device_clock.load();
+		}
+
+		// the output can play at a corrected rate and move its position, see set_rate_correction
+		virtual bool supports_rate_correction() const
+		{
+			return false;
+		}
+
+		// can be called from any thread, taken by the next write. ratio is the output frames per
+		// item frame, above 1 the item is played slower. 0 turns the correction off
+		void set_rate_correction(double ratio)
+		{
+			_rate_correction.store(ratio, std::memory_order_relaxed);
+		}
+
+		// can be called from any thread, item frames to skip or (negative) to hold back with silence
+		void step_position(int64_t frames)
+		{
+			_position_step.fetch_add(frames, std::memory_order_relaxed);
+		}
+
+		// can be called from the decoder threads
+		output_format_caps format_caps()
+		{
+			std::lock_guard<std::mutex> lock(_format_caps_mutex);
+			return _format_caps;
+		}
+
 		// job thread functions
 		virtual void set_volume(size_type volume) = 0; // 0 to 100
 		virtual size_type get_volume() = 0; // 0 to 100
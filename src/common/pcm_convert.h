@@ -0,0 +1,234 @@
+#ifndef pcm_convert_h__
+#define pcm_convert_h__
+
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MPRT_PCM_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace mprt
+{
+	// sample format conversion and interleave kernels, all of them write straight
+	// into the destination memory, counts are in samples (not bytes, not frames)
+	namespace pcm_convert
+	{
+		// unsigned 8 bit to signed 16 bit
+		inline void u8_to_s16(uint8_t const* in, int16_t * out, std::size_t count)
+		{
+			std::size_t i = 0;
+#if defined(MPRT_PCM_SSE2)
+			auto const zero = _mm_setzero_si128();
+			auto const bias = _mm_set1_epi8(static_cast<char>(0x80));
+			for (; i + 16 <= count; i += 16)
+			{
+				// flipping the top bit makes it signed, then put it in the high byte
+				auto v = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<__m128i const*>(in + i)), bias);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_unpacklo_epi8(zero, v));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 8), _mm_unpackhi_epi8(zero, v));
+			}
+#endif
+			for (; i != count; ++i)
+			{
+				out[i] = static_cast<int16_t>((static_cast<int>(in[i]) - 128) * 256);
+			}
+		}
+
+		inline void dbl_to_flt(double const* in, float * out, std::size_t count)
+		{
+			std::size_t i = 0;
+#if defined(MPRT_PCM_SSE2)
+			for (; i + 4 <= count; i += 4)
+			{
+				auto lo = _mm_cvtpd_ps(_mm_loadu_pd(in + i));
+				auto hi = _mm_cvtpd_ps(_mm_loadu_pd(in + i + 2));
+				_mm_storeu_ps(out + i, _mm_movelh_ps(lo, hi));
+			}
+#endif
+			for (; i != count; ++i)
+			{
+				out[i] = static_cast<float>(in[i]);
+			}
+		}
+
+		// keeps the most significant 32 bits
+		inline void s64_to_s32(int64_t const* in, int32_t * out, std::size_t count)
+		{
+			std::size_t i = 0;
+#if defined(MPRT_PCM_SSE2)
+			for (; i + 4 <= count; i += 4)
+			{
+				auto a = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<__m128i const*>(in + i)));
+				auto b = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<__m128i const*>(in + i + 2)));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))));
+			}
+#endif
+			for (; i != count; ++i)
+			{
+				out[i] = static_cast<int32_t>(in[i] >> 32);
+			}
+		}
+
+		namespace detail
+		{
+			template <typename T>
+			inline void interleave_scalar(void const* const* planes, std::size_t first_channel, std::size_t last_channel,
+				std::size_t channels, std::size_t first_sample, std::size_t samples, void * out)
+			{
+				auto pout = reinterpret_cast<T*>(out);
+				for (std::size_t ch = first_channel; ch != last_channel; ++ch)
+				{
+					auto pin = reinterpret_cast<T const*>(planes[ch]);
+					for (std::size_t i = first_sample; i != samples; ++i)
+					{
+						pout[i * channels + ch] = pin[i];
+					}
+				}
+			}
+		}
+
+		// planar to packed for 32 bit samples (s32 and float), any channel count
+		inline void interleave_32(void const* const* planes, std::size_t channels, std::size_t samples, void * out)
+		{
+			if (channels == 1)
+			{
+				std::memcpy(out, planes[0], samples * 4);
+				return;
+			}
+
+			std::size_t ch = 0;
+#if defined(MPRT_PCM_SSE2)
+			auto pout = reinterpret_cast<float*>(out);
+			std::size_t const vec_samples = samples & ~std::size_t(3);
+
+			// four channels at a time: a 4x4 transpose gives one row per sample
+			for (; ch + 4 <= channels; ch += 4)
+			{
+				auto p0 = reinterpret_cast<float const*>(planes[ch]);
+				auto p1 = reinterpret_cast<float const*>(planes[ch + 1]);
+				auto p2 = reinterpret_cast<float const*>(planes[ch + 2]);
+				auto p3 = reinterpret_cast<float const*>(planes[ch + 3]);
+
+				for (std::size_t i = 0; i != vec_samples; i += 4)
+				{
+					auto r0 = _mm_loadu_ps(p0 + i);
+					auto r1 = _mm_loadu_ps(p1 + i);
+					auto r2 = _mm_loadu_ps(p2 + i);
+					auto r3 = _mm_loadu_ps(p3 + i);
+					_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+					_mm_storeu_ps(pout + i * channels + ch, r0);
+					_mm_storeu_ps(pout + (i + 1) * channels + ch, r1);
+					_mm_storeu_ps(pout + (i + 2) * channels + ch, r2);
+					_mm_storeu_ps(pout + (i + 3) * channels + ch, r3);
+				}
+			}
+
+			// remaining pair (stereo, 5.1 lfe/side ...)
+			if (ch + 2 <= channels)
+			{
+				auto p0 = reinterpret_cast<float const*>(planes[ch]);
+				auto p1 = reinterpret_cast<float const*>(planes[ch + 1]);
+
+				if (channels == 2)
+				{
+					for (std::size_t i = 0; i != vec_samples; i += 4)
+					{
+						auto a = _mm_loadu_ps(p0 + i);
+						auto b = _mm_loadu_ps(p1 + i);
+						_mm_storeu_ps(pout + 2 * i, _mm_unpacklo_ps(a, b));
+						_mm_storeu_ps(pout + 2 * i + 4, _mm_unpackhi_ps(a, b));
+					}
+				}
+				else
+				{
+					for (std::size_t i = 0; i != vec_samples; i += 4)
+					{
+						auto a = _mm_loadu_ps(p0 + i);
+						auto b = _mm_loadu_ps(p1 + i);
+						auto lo = _mm_unpacklo_ps(a, b);
+						auto hi = _mm_unpackhi_ps(a, b);
+						_mm_storel_pi(reinterpret_cast<__m64*>(pout + i * channels + ch), lo);
+						_mm_storeh_pi(reinterpret_cast<__m64*>(pout + (i + 1) * channels + ch), lo);
+						_mm_storel_pi(reinterpret_cast<__m64*>(pout + (i + 2) * channels + ch), hi);
+						_mm_storeh_pi(reinterpret_cast<__m64*>(pout + (i + 3) * channels + ch), hi);
+					}
+				}
+				ch += 2;
+			}
+
+			// vector tails of the channels done above
+			detail::interleave_scalar<uint32_t>(planes, 0, ch, channels, vec_samples, samples, out);
+#endif
+			detail::interleave_scalar<uint32_t>(planes, ch, channels, channels, 0, samples, out);
+		}
+
+		// planar to packed for 16 bit samples, any channel count
+		inline void interleave_16(void const* const* planes, std::size_t channels, std::size_t samples, void * out)
+		{
+			if (channels == 1)
+			{
+				std::memcpy(out, planes[0], samples * 2);
+				return;
+			}
+
+			std::size_t ch = 0;
+#if defined(MPRT_PCM_SSE2)
+			auto pout = reinterpret_cast<int16_t*>(out);
+			std::size_t const vec_samples = samples & ~std::size_t(3);
+
+			if (channels == 2)
+			{
+				auto p0 = reinterpret_cast<int16_t const*>(planes[0]);
+				auto p1 = reinterpret_cast<int16_t const*>(planes[1]);
+				std::size_t const vec8_samples = samples & ~std::size_t(7);
+
+				for (std::size_t i = 0; i != vec8_samples; i += 8)
+				{
+					auto a = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p0 + i));
+					auto b = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p1 + i));
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(pout + 2 * i), _mm_unpacklo_epi16(a, b));
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(pout + 2 * i + 8), _mm_unpackhi_epi16(a, b));
+				}
+
+				detail::interleave_scalar<int16_t>(planes, 0, 2, 2, vec8_samples, samples, out);
+				return;
+			}
+
+			// four channels, four samples at a time
+			for (; ch + 4 <= channels; ch += 4)
+			{
+				auto p0 = reinterpret_cast<int16_t const*>(planes[ch]);
+				auto p1 = reinterpret_cast<int16_t const*>(planes[ch + 1]);
+				auto p2 = reinterpret_cast<int16_t const*>(planes[ch + 2]);
+				auto p3 = reinterpret_cast<int16_t const*>(planes[ch + 3]);
+
+				for (std::size_t i = 0; i != vec_samples; i += 4)
+				{
+					auto a = _mm_unpacklo_epi16(
+						_mm_loadl_epi64(reinterpret_cast<__m128i const*>(p0 + i)),
+						_mm_loadl_epi64(reinterpret_cast<__m128i const*>(p1 + i)));
+					auto b = _mm_unpacklo_epi16(
+						_mm_loadl_epi64(reinterpret_cast<__m128i const*>(p2 + i)),
+						_mm_loadl_epi64(reinterpret_cast<__m128i const*>(p3 + i)));
+					auto lo = _mm_unpacklo_epi32(a, b);
+					auto hi = _mm_unpackhi_epi32(a, b);
+
+					_mm_storel_epi64(reinterpret_cast<__m128i*>(pout + i * channels + ch), lo);
+					_mm_storel_epi64(reinterpret_cast<__m128i*>(pout + (i + 1) * channels + ch), _mm_srli_si128(lo, 8));
+					_mm_storel_epi64(reinterpret_cast<__m128i*>(pout + (i + 2) * channels + ch), hi);
+					_mm_storel_epi64(reinterpret_cast<__m128i*>(pout + (i + 3) * channels + ch), _mm_srli_si128(hi, 8));
+				}
+			}
+
+			detail::interleave_scalar<int16_t>(planes, 0, ch, channels, vec_samples, samples, out);
+#endif
+			detail::interleave_scalar<int16_t>(planes, ch, channels, channels, 0, samples, out);
+		}
+	}
+}
+
+#endif // pcm_convert_h__
@@ -0,0 +1,364 @@
+#ifndef pcm_gain_h__
+#define pcm_gain_h__
+
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+#include <algorithm>
+
+#include "pcm_convert.h"
+
+namespace mprt
+{
+	// software gain kernels, the samples are scaled in place, counts are in samples (not frames)
+	// integer samples get tpdf dither of one step of the valid bits, 24 bit samples travel
+	// in the 32 bit container so the 32 bit kernels take the step of the valid bits
+	namespace pcm_gain
+	{
+		// xorshift32 lanes, the scalar loops use the first one
+		struct dither_state
+		{
+			uint32_t _lanes[4];
+
+			dither_state()
+				: _lanes{ 0x9e3779b9u, 0x7f4a7c15u, 0x85ebca6bu, 0xc2b2ae35u }
+			{}
+		};
+
+		namespace detail
+		{
+			inline uint32_t next_random(uint32_t & s)
+			{
+				s ^= s << 13;
+				s ^= s >> 17;
+				s ^= s << 5;
+				return s;
+			}
+
+			// triangular in (-1, 1), the sum of the two 16 bit halves of one draw
+			inline float tpdf(dither_state * dither)
+			{
+				if (!dither)
+				{
+					return 0.f;
+				}
+
+				auto r = next_random(dither->_lanes[0]);
+				return static_cast<float>((r & 0xffff) + (r >> 16)) * (1.f / 65536.f) - 1.f;
+			}
+
+			template <typename T> struct int_range;
+			template <> struct int_range<int8_t> { static constexpr float min = -128.f, max = 127.f; };
+			template <> struct int_range<int16_t> { static constexpr float min = -32768.f, max = 32767.f; };
+			// the largest float under 2^31
+			template <> struct int_range<int32_t> { static constexpr float min = -2147483648.f, max = 2147483520.f; };
+
+			template <typename T>
+			inline T scale_int(T sample, float gain, dither_state * dither, float dither_step)
+			{
+				auto v = static_cast<float>(sample) * gain + tpdf(dither) * dither_step;
+				v = std::min(std::max(v, int_range<T>::min), int_range<T>::max);
+				return static_cast<T>(std::lrint(v));
+			}
+
+#if defined(MPRT_PCM_SSE2)
+			inline __m128 tpdf4(__m128i & s)
+			{
+				s = _mm_xor_si128(s, _mm_slli_epi32(s, 13));
+				s = _mm_xor_si128(s, _mm_srli_epi32(s, 17));
+				s = _mm_xor_si128(s, _mm_slli_epi32(s, 5));
+				auto lo = _mm_cvtepi32_ps(_mm_and_si128(s, _mm_set1_epi32(0xffff)));
+				auto hi = _mm_cvtepi32_ps(_mm_srli_epi32(s, 16));
+				return _mm_sub_ps(_mm_mul_ps(_mm_add_ps(lo, hi), _mm_set1_ps(1.f / 65536.f)), _mm_set1_ps(1.f));
+			}
+
+			inline __m128i load_lanes(dither_state * dither)
+			{
+				return dither ? _mm_loadu_si128(reinterpret_cast<__m128i const*>(dither->_lanes)) : _mm_setzero_si128();
+			}
+
+			inline void store_lanes(dither_state * dither, __m128i s)
+			{
+				if (dither)
+				{
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(dither->_lanes), s);
+				}
+			}
+#endif
+		}
+
+		// one step of the lowest valid bit in a container of container_bits
+		inline float dither_step(std::size_t container_bits, std::size_t valid_bits)
+		{
+			return valid_bits > 0 && valid_bits < container_bits ?
+				static_cast<float>(uint32_t(1) << (container_bits - valid_bits)) : 1.f;
+		}
+
+		inline void scale_flt(float * data, std::size_t count, float gain)
+		{
+			std::size_t i = 0;
+#if defined(MPRT_PCM_SSE2)
+			auto const g = _mm_set1_ps(gain);
+			for (; i + 8 <= count; i += 8)
+			{
+				_mm_storeu_ps(data + i, _mm_mul_ps(_mm_loadu_ps(data + i), g));
+				_mm_storeu_ps(data + i + 4, _mm_mul_ps(_mm_loadu_ps(data + i + 4), g));
+			}
+#endif
+			for (; i != count; ++i)
+			{
+				data[i] *= gain;
+			}
+		}
+
+		inline void scale_s16(int16_t * data, std::size_t count, float gain, dither_state * dither)
+		{
+			std::size_t i = 0;
+#if defined(MPRT_PCM_SSE2)
+			auto const g = _mm_set1_ps(gain);
+			auto s = detail::load_lanes(dither);
+			for (; i + 8 <= count; i += 8)
+			{
+				auto v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(data + i));
+				// sign extended by the arithmetic shift
+				auto lo = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16)), g);
+				auto hi = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16)), g);
+				if (dither)
+				{
+					lo = _mm_add_ps(lo, detail::tpdf4(s));
+					hi = _mm_add_ps(hi, detail::tpdf4(s));
+				}
+				// rounds to the nearest, the pack saturates
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), _mm_packs_epi32(_mm_cvtps_epi32(lo), _mm_cvtps_epi32(hi)));
+			}
+			detail::store_lanes(dither, s);
+#endif
+			for (; i != count; ++i)
+			{
+				data[i] = detail::scale_int(data[i], gain, dither, 1.f);
+			}
+		}
+
+		// step is the dither step of the valid bits, see dither_step
+		inline void scale_s32(int32_t * data, std::size_t count, float gain, dither_state * dither, float step)
+		{
+			std::size_t i = 0;
+#if defined(MPRT_PCM_SSE2)
+			auto const g = _mm_set1_ps(gain);
+			auto const vstep = _mm_set1_ps(step);
+			auto const vmin = _mm_set1_ps(detail::int_range<int32_t>::min);
+			auto const vmax = _mm_set1_ps(detail::int_range<int32_t>::max);
+			auto s = detail::load_lanes(dither);
+			for (; i + 4 <= count; i += 4)
+			{
+				auto v = _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<__m128i const*>(data + i))), g);
+				if (dither)
+				{
+					v = _mm_add_ps(v, _mm_mul_ps(detail::tpdf4(s), vstep));
+				}
+				v = _mm_min_ps(_mm_max_ps(v, vmin), vmax);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), _mm_cvtps_epi32(v));
+			}
+			detail::store_lanes(dither, s);
+#endif
+			for (; i != count; ++i)
+			{
+				data[i] = detail::scale_int(data[i], gain, dither, step);
+			}
+		}
+
+		inline void scale_s8(int8_t * data, std::size_t count, float gain, dither_state * dither)
+		{
+			for (std::size_t i = 0; i != count; ++i)
+			{
+				data[i] = detail::scale_int(data[i], gain, dither, 1.f);
+			}
+		}
+
+		// the gain moves by step on every frame, ramps are short so they stay scalar
+		template <typename T>
+		inline float ramp_int(T * data, std::size_t frames, std::size_t channels, float gain, float step, dither_state * dither, float dither_step)
+		{
+			for (std::size_t f = 0; f != frames; ++f, gain += step)
+			{
+				for (std::size_t ch = 0; ch != channels; ++ch, ++data)
+				{
+					*data = detail::scale_int(*data, gain, dither, dither_step);
+				}
+			}
+
+			return gain;
+		}
+
+		inline float ramp_flt(float * data, std::size_t frames, std::size_t channels, float gain, float step)
+		{
+			for (std::size_t f = 0; f != frames; ++f, gain += step)
+			{
+				for (std::size_t ch = 0; ch != channels; ++ch, ++data)
+				{
+					*data *= gain;
+				}
+			}
+
+			return gain;
+		}
+	}
+
+	// the gain of one output, a new gain is reached with a linear ramp so that volume
+	// changes do not click, unity gain leaves the samples untouched
+	class pcm_gain_stage
+	{
+	private:
+		using clock_type = std::chrono::steady_clock;
+
+		float _current;
+		float _target;
+		float _step;
+		std::size_t _ramp_left; // frames
+		std::size_t _ramp_frames;
+		bool _dither;
+		pcm_gain::dither_state _dither_state;
+		std::size_t _valid_bits; // of the integer samples, 0 when all the bits are
+
+		// what the processing costs, reported by the output
+		std::size_t _processed_samples;
+		clock_type::duration _busy;
+
+		template <typename T>
+		void process_int(T * data, std::size_t frames, std::size_t channels)
+		{
+			auto dither = _dither ? &_dither_state : nullptr;
+			if (_ramp_left)
+			{
+				auto n = std::min(frames, _ramp_left);
+				_current = pcm_gain::ramp_int(data, n, channels, _current, _step, dither, pcm_gain::dither_step(sizeof(T) * 8, _valid_bits));
+				data += n * channels;
+				frames -= n;
+				_ramp_left -= n;
+				if (!_ramp_left)
+				{
+					_current = _target;
+				}
+			}
+
+			if (frames && _current != 1.f)
+			{
+				scale(data, frames * channels, dither);
+			}
+		}
+
+		void scale(int8_t * data, std::size_t count, pcm_gain::dither_state * dither) { pcm_gain::scale_s8(data, count, _current, dither); }
+		void scale(int16_t * data, std::size_t count, pcm_gain::dither_state * dither) { pcm_gain::scale_s16(data, count, _current, dither); }
+		void scale(int32_t * data, std::size_t count, pcm_gain::dither_state * dither) { pcm_gain::scale_s32(data, count, _current, dither, pcm_gain::dither_step(32, _valid_bits)); }
+
+		void process_flt(float * data, std::size_t frames, std::size_t channels)
+		{
+			if (_ramp_left)
+			{
+				auto n = std::min(frames, _ramp_left);
+				_current = pcm_gain::ramp_flt(data, n, channels, _current, _step);
+				data += n * channels;
+				frames -= n;
+				_ramp_left -= n;
+				if (!_ramp_left)
+				{
+					_current = _target;
+				}
+			}
+
+			if (frames && _current != 1.f)
+			{
+				pcm_gain::scale_flt(data, frames * channels, _current);
+			}
+		}
+
+	public:
+		pcm_gain_stage()
+			: _current(1.f)
+			, _target(1.f)
+			, _step(0.f)
+			, _ramp_left(0)
+			, _ramp_frames(0)
+			, _dither(true)
+			, _valid_bits(0)
+			, _processed_samples(0)
+			, _busy(clock_type::duration::zero())
+		{}
+
+		void set_dither(bool dither) { _dither = dither; }
+		void set_ramp_frames(std::size_t frames) { _ramp_frames = frames; }
+		// 24 bit samples in the 32 bit container are dithered at their own lowest bit
+		void set_valid_bits(std::size_t bits) { _valid_bits = bits; }
+
+		// reached over the ramp from the current gain
+		void set_gain(float gain)
+		{
+			if (gain == _target)
+			{
+				return;
+			}
+
+			_target = gain;
+			_ramp_left = _ramp_frames;
+			if (!_ramp_left)
+			{
+				_current = _target;
+				return;
+			}
+
+			_step = (_target - _current) / static_cast<float>(_ramp_left);
+		}
+
+		// no ramp, when nothing is playing
+		void reset_gain(float gain)
+		{
+			_current = _target = gain;
+			_ramp_left = 0;
+		}
+
+		bool is_unity() const { return !_ramp_left && _current == 1.f; }
+
+		// bps 8, 16 or 32 integer or 32 float, as the output device takes them
+		void process(void * data, std::size_t frames, std::size_t channels, std::size_t bps, bool is_float)
+		{
+			if (is_unity())
+			{
+				return;
+			}
+
+			auto start = clock_type::now();
+			if (is_float)
+			{
+				process_flt(reinterpret_cast<float*>(data), frames, channels);
+			}
+			else if (bps == 16)
+			{
+				process_int(reinterpret_cast<int16_t*>(data), frames, channels);
+			}
+			else if (bps == 32)
+			{
+				process_int(reinterpret_cast<int32_t*>(data), frames, channels);
+			}
+			else if (bps == 8)
+			{
+				process_int(reinterpret_cast<int8_t*>(data), frames, channels);
+			}
+
+			_busy += clock_type::now() - start;
+			_processed_samples += frames * channels;
+		}
+
+		// processed samples per second of processing time, the counters are cleared
+		double take_samples_per_second()
+		{
+			auto secs = std::chrono::duration<double>(_busy).count();
+			auto rate = secs > 0. ? _processed_samples / secs : 0.;
+			_processed_samples = 0;
+			_busy = clock_type::duration::zero();
+			return rate;
+		}
+	};
+}
+
+#endif // pcm_gain_h__
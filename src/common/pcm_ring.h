@@ -0,0 +1,140 @@
+#ifndef pcm_ring_h__
+#define pcm_ring_h__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+namespace mprt
+{
+	// single producer, single consumer ring of float samples between the output job thread
+	// and a realtime callback. the consumer side does not lock, allocate or wait.
+	// the capacity is a power of two, the positions only grow and are masked on access
+	class pcm_ring
+	{
+	private:
+		std::vector<float> _data;
+		std::size_t _mask;
+
+		// on their own cache lines, each is written by one side only
+		alignas(64) std::atomic<std::size_t> _write_pos;
+		alignas(64) std::atomic<std::size_t> _read_pos;
+		alignas(64) std::atomic_bool _flush;
+
+		void copy_in(std::size_t pos, float const* in, std::size_t count)
+		{
+			auto start = pos & _mask;
+			auto first = std::min(count, _data.size() - start);
+			std::memcpy(_data.data() + start, in, first * sizeof(float));
+			std::memcpy(_data.data(), in + first, (count - first) * sizeof(float));
+		}
+
+		void copy_out(std::size_t pos, float * out, std::size_t count) const
+		{
+			auto start = pos & _mask;
+			auto first = std::min(count, _data.size() - start);
+			std::memcpy(out, _data.data() + start, first * sizeof(float));
+			std::memcpy(out + first, _data.data(), (count - first) * sizeof(float));
+		}
+
+	public:
+		pcm_ring()
+			: _mask(0)
+			, _write_pos(0)
+			, _read_pos(0)
+			, _flush(false)
+		{}
+
+		// neither side may be running
+		void allocate(std::size_t min_samples)
+		{
+			std::size_t capacity = 1;
+			while (capacity < min_samples)
+			{
+				capacity <<= 1;
+			}
+
+			_data.assign(capacity, 0.f);
+			_mask = capacity - 1;
+			reset();
+		}
+
+		// neither side may be running
+		void reset()
+		{
+			_write_pos.store(0, std::memory_order_relaxed);
+			_read_pos.store(0, std::memory_order_relaxed);
+			_flush.store(false, std::memory_order_relaxed);
+		}
+
+		std::size_t capacity() const { return _data.size(); }
+
+		// producer side
+
+		std::size_t writable() const
+		{
+			return _data.size() -
+				(_write_pos.load(std::memory_order_relaxed) - _read_pos.load(std::memory_order_acquire));
+		}
+
+		// returns the samples written, nothing while a flush is pending
+		std::size_t write(float const* in, std::size_t count)
+		{
+			if (_flush.load(std::memory_order_acquire))
+			{
+				return 0;
+			}
+
+			count = std::min(count, writable());
+			auto pos = _write_pos.load(std::memory_order_relaxed);
+			copy_in(pos, in, count);
+			_write_pos.store(pos + count, std::memory_order_release);
+
+			return count;
+		}
+
+		// the consumer drops everything written so far on its next read
+		void request_flush()
+		{
+			_flush.store(true, std::memory_order_release);
+		}
+
+		bool is_flushing() const
+		{
+			return _flush.load(std::memory_order_acquire);
+		}
+
+		// both sides
+
+		std::size_t readable() const
+		{
+			return _write_pos.load(std::memory_order_acquire) - _read_pos.load(std::memory_order_acquire);
+		}
+
+		// consumer side, returns the samples read
+		std::size_t read(float * out, std::size_t count)
+		{
+			// the flag first: a flush acquired here sees every write made before it was requested,
+			// the other way round the ones in between would be played after the flush
+			if (_flush.load(std::memory_order_acquire))
+			{
+				_read_pos.store(_write_pos.load(std::memory_order_acquire), std::memory_order_release);
+				_flush.store(false, std::memory_order_release);
+				return 0;
+			}
+
+			auto write_pos = _write_pos.load(std::memory_order_acquire);
+			auto pos = _read_pos.load(std::memory_order_relaxed);
+			count = std::min(count, write_pos - pos);
+			copy_out(pos, out, count);
+			_read_pos.store(pos + count, std::memory_order_release);
+
+			return count;
+		}
+	};
+}
+
+#endif // pcm_ring_h__
@@ -0,0 +1,127 @@
+#ifndef replay_gain_h__
+#define replay_gain_h__
+
+#include <cmath>
+#include <cctype>
+#include <cstdlib>
+#include <string>
+#include <algorithm>
+
+#include "type_defs.h"
+
+namespace mprt
+{
+	enum class replay_gain_mode
+	{
+		off,
+		track,
+		album
+	};
+
+	namespace replay_gain
+	{
+		// r128 gains are relative to -23 LUFS, replaygain 2 uses -18 LUFS
+		constexpr double _R128_TO_RG_DB_ = 5.;
+
+		inline replay_gain_mode mode_from_string(std::string const& mode)
+		{
+			return
+				mode == "track" ? replay_gain_mode::track :
+				mode == "album" ? replay_gain_mode::album :
+				replay_gain_mode::off;
+		}
+
+		inline bool parse_double(std::string const& value, double & out)
+		{
+			char * end = nullptr;
+			auto val = std::strtod(value.c_str(), &end);
+			if (end == value.c_str() || !std::isfinite(val))
+			{
+				return false;
+			}
+
+			out = val;
+			return true;
+		}
+
+		// fills the info from a vorbis comment / id3 txxx / ffmpeg metadata entry,
+		// false if the tag is not a gain tag or it cannot be read
+		inline bool parse_tag(std::string name, std::string const& value, replay_gain_info & info)
+		{
+			std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return static_cast<char>(std::toupper(c)); });
+
+			double val;
+			if (!parse_double(value, val))
+			{
+				return false;
+			}
+
+			// "-6.52 dB", the unit is skipped by strtod
+			if (name == "REPLAYGAIN_TRACK_GAIN")
+			{
+				info._has_track = true;
+				info._track_gain_db = val;
+			}
+			else if (name == "REPLAYGAIN_ALBUM_GAIN")
+			{
+				info._has_album = true;
+				info._album_gain_db = val;
+			}
+			else if (name == "REPLAYGAIN_TRACK_PEAK")
+			{
+				info._track_peak = val;
+			}
+			else if (name == "REPLAYGAIN_ALBUM_PEAK")
+			{
+				info._album_peak = val;
+			}
+			// q7.8 fixed point db (opus)
+			else if (name == "R128_TRACK_GAIN")
+			{
+				info._has_track = true;
+				info._track_gain_db = val / 256. + _R128_TO_RG_DB_;
+			}
+			else if (name == "R128_ALBUM_GAIN")
+			{
+				info._has_album = true;
+				info._album_gain_db = val / 256. + _R128_TO_RG_DB_;
+			}
+			else
+			{
+				return false;
+			}
+
+			return true;
+		}
+
+		// linear gain for the mode, the missing album gain falls back to the track gain and the other way around,
+		// with prevent_clip the gain is limited so that the peak stays under the full scale
+		inline double linear_gain(replay_gain_info const& info, replay_gain_mode mode, double preamp_db,
+			double no_gain_preamp_db, bool prevent_clip)
+		{
+			if (mode == replay_gain_mode::off)
+			{
+				return 1.;
+			}
+
+			bool use_album = (mode == replay_gain_mode::album && info._has_album) || !info._has_track;
+			if (!info._has_album && !info._has_track)
+			{
+				return std::pow(10., no_gain_preamp_db / 20.);
+			}
+
+			auto gain_db = (use_album ? info._album_gain_db : info._track_gain_db) + preamp_db;
+			auto peak = use_album ? info._album_peak : info._track_peak;
+			auto gain = std::pow(10., gain_db / 20.);
+
+			if (prevent_clip && peak > 0. && gain * peak > 1.)
+			{
+				gain = 1. / peak;
+			}
+
+			return gain;
+		}
+	}
+}
+
+#endif // replay_gain_h__
@@ -0,0 +1,221 @@
+#ifndef seek_index_h__
+#define seek_index_h__
+
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <algorithm>
+
+#include <boost/filesystem.hpp>
+#include <boost/log/trivial.hpp>
+
+#include "common/common_defs.h"
+#include "common/file_identity.h"
+
+namespace mprt
+{
+	// sample -> byte offset table of frame starts, so a seek is a single jump in the input
+	class seek_index
+	{
+	public:
+		struct seek_point
+		{
+			size_type _sample;
+			size_type _byte_pos;
+		};
+
+	private:
+		constexpr static uint32_t _MAGIC_ = 0x4958534d; // "MSXI"
+		constexpr static uint32_t _VERSION_ = 1;
+
+		std::vector<seek_point> _points;
+		size_type _min_sample_distance;
+		size_type _total_samples;
+		bool _complete;
+		bool _dirty;
+
+		template <typename T>
+		static void write_val(std::ofstream & os, T const& val)
+		{
+			os.write(reinterpret_cast<const char *>(&val), sizeof(T));
+		}
+
+		template <typename T>
+		static bool read_val(std::ifstream & is, T & val)
+		{
+			is.read(reinterpret_cast<char *>(&val), sizeof(T));
+			return static_cast<bool>(is);
+		}
+
+	public:
+		seek_index(size_type min_sample_distance = 0)
+			: _min_sample_distance(min_sample_distance)
+			, _total_samples(-1)
+			, _complete(false)
+			, _dirty(false)
+		{}
+
+		void set_min_sample_distance(size_type min_sample_distance)
+		{
+			_min_sample_distance = min_sample_distance;
+		}
+
+		// points may come in any order (seeks), they are kept sorted by sample
+		void add_point(size_type sample, size_type byte_pos)
+		{
+			auto iter = std::lower_bound(_points.begin(), _points.end(), sample,
+				[](seek_point const& p, size_type s) { return p._sample < s; });
+
+			if (iter != _points.end() && (iter->_sample == sample || iter->_sample - sample < _min_sample_distance))
+				return;
+			if (iter != _points.begin() && sample - std::prev(iter)->_sample < _min_sample_distance)
+				return;
+
+			_points.insert(iter, seek_point{ sample, byte_pos });
+			_dirty = true;
+		}
+
+		// the last indexed frame which starts at or before sample
+		bool find_point(size_type sample, seek_point & point) const
+		{
+			auto iter = std::upper_bound(_points.begin(), _points.end(), sample,
+				[](size_type s, seek_point const& p) { return s < p._sample; });
+
+			if (iter == _points.begin())
+				return false;
+
+			point = *std::prev(iter);
+			return true;
+		}
+
+		// true if sample is covered, ie. there is no unindexed gap bigger than max_gap before it
+		bool covers(size_type sample, size_type max_gap) const
+		{
+			seek_point point;
+			if (!find_point(sample, point))
+				return false;
+
+			return (sample - point._sample <= max_gap) || _complete;
+		}
+
+		void set_complete(size_type total_samples)
+		{
+			if (!_complete || _total_samples != total_samples)
+			{
+				_complete = true;
+				_total_samples = total_samples;
+				_dirty = true;
+			}
+		}
+
+		bool is_complete() const { return _complete; }
+		size_type total_samples() const { return _total_samples; }
+		bool is_dirty() const { return _dirty; }
+		bool empty() const { return _points.empty(); }
+		std::size_t size() const { return _points.size(); }
+		std::vector<seek_point> const& points() const { return _points; }
+
+		void clear()
+		{
+			_points.clear();
+			_total_samples = -1;
+			_complete = false;
+			_dirty = false;
+		}
+
+		bool load(boost::filesystem::path const& index_path, file_identity const& ident)
+		{
+			std::ifstream is(index_path.string(), std::ios::binary);
+			if (!is)
+				return false;
+
+			uint32_t magic, version;
+			uint64_t path_len, count;
+			size_type file_size, total_samples;
+			int64_t mtime;
+			uint8_t complete;
+
+			if (!read_val(is, magic) || magic != _MAGIC_ ||
+				!read_val(is, version) || version != _VERSION_ ||
+				!read_val(is, path_len))
+			{
+				return false;
+			}
+
+			std::string path(static_cast<std::size_t>(path_len), '\0');
+			is.read(&path[0], static_cast<std::streamsize>(path_len));
+
+			if (!is ||
+				!read_val(is, file_size) ||
+				!read_val(is, mtime) ||
+				!read_val(is, total_samples) ||
+				!read_val(is, complete) ||
+				!read_val(is, count))
+			{
+				return false;
+			}
+
+			// hash collision or the file has changed since
+			if (path != ident._path || file_size != ident._size || mtime != static_cast<int64_t>(ident._mtime))
+				return false;
+
+			std::vector<seek_point> points(static_cast<std::size_t>(count));
+			is.read(reinterpret_cast<char *>(points.data()), static_cast<std::streamsize>(count * sizeof(seek_point)));
+			if (!is)
+				return false;
+
+			_points.swap(points);
+			_total_samples = total_samples;
+			_complete = (complete != 0);
+			_dirty = false;
+
+			return true;
+		}
+
+		bool save(boost::filesystem::path const& index_path, file_identity const& ident)
+		{
+			boost::system::error_code ec;
+			boost::filesystem::create_directories(index_path.parent_path(), ec);
+
+			// write aside and rename, a half written index must never be picked up
+			auto tmp_path = index_path;
+			tmp_path += ".tmp";
+
+			{
+				std::ofstream os(tmp_path.string(), std::ios::binary | std::ios::trunc);
+				if (!os)
+				{
+					BOOST_LOG_TRIVIAL(error) << "cannot create seek index: " << tmp_path;
+					return false;
+				}
+
+				write_val(os, _MAGIC_);
+				write_val(os, _VERSION_);
+				write_val(os, static_cast<uint64_t>(ident._path.size()));
+				os.write(ident._path.data(), static_cast<std::streamsize>(ident._path.size()));
+				write_val(os, ident._size);
+				write_val(os, static_cast<int64_t>(ident._mtime));
+				write_val(os, _total_samples);
+				write_val(os, static_cast<uint8_t>(_complete ? 1 : 0));
+				write_val(os, static_cast<uint64_t>(_points.size()));
+				os.write(reinterpret_cast<const char *>(_points.data()), static_cast<std::streamsize>(_points.size() * sizeof(seek_point)));
+
+				if (!os)
+					return false;
+			}
+
+			boost::filesystem::rename(tmp_path, index_path, ec);
+			if (ec)
+			{
+				BOOST_LOG_TRIVIAL(error) << "cannot save seek index: " << index_path << " " << ec.message();
+				return false;
+			}
+
+			_dirty = false;
+			return true;
+		}
+	};
+}
+
+#endif // seek_index_h__
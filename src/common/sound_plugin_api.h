@@ -1,6 +1,8 @@
 #ifndef sound_plugin_api_h__
 #define sound_plugin_api_h__
 
+#include <cmath>
+
 #include <boost/log/trivial.hpp>
 
 #include "cache_manage.h"
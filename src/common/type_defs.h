@@ -31,17 +31,39 @@ namespace mprt
 	using decoder_finish_callback_register_func_t = std::function<void (std::string plugin_name, url_id_t)>;
 	using seek_callback_register_func_t = std::function<void (url_id_t, size_type seek_point)>;
 	using input_opened_register_func_t = std::function<void (std::shared_ptr<current_decoder_details>)>;
+	using input_metadata_register_func_t = std::function<void (url_id_t, std::string tag_name, std::string tag_value)>;
 
 	// decoder callbacks
 	using decoder_opened_callback_register_func_t = std::function<void(sound_details)>;
 	using set_output_buffer_callback_register_func_t = std::function<void (url_id_t, cache_buffer_shared)>;
 	using play_finished_callback_register_func_t = std::function<void (url_id_t)>;
 	using decoder_seek_finished_callback_register_func_t = std::function<void ()>;
+	using decoder_duration_resolved_callback_register_func_t = std::function<void (url_id_t, size_type duration_ms)>;
 
 	// output callbacks
 	using progress_callback_register_func_t = std::function<void (url_id_t, size_type current_position_ms)>;
 	using output_opened_callback_register_func_t = std::function<void(bool output_opened)>;
 
+	// replaygain values found in the tags, r128 gains are converted to the replaygain reference
+	struct replay_gain_info
+	{
+		bool _has_track;
+		bool _has_album;
+		double _track_gain_db;
+		double _track_peak; // 1.0 is the full scale
+		double _album_gain_db;
+		double _album_peak;
+
+		replay_gain_info()
+			: _has_track(false)
+			, _has_album(false)
+			, _track_gain_db(0.)
+			, _track_peak(1.)
+			, _album_gain_db(0.)
+			, _album_peak(1.)
+		{}
+	};
+
 	struct sound_details {
 		bool _ok;
 		size_type _total_samples;
@@ -52,10 +74,12 @@ namespace mprt
 		size_type _bps;
 		size_type _orig_bps;
 		url_id_t _url_id;
+		replay_gain_info _replay_gain;
 		cache_buffer_shared _current_cache_buffer;
 		set_output_buffer_callback_register_func_t _decoder_set_output_buffer_callback;
 		play_finished_callback_register_func_t _decoder_play_finished_callback;
 		bool _stop;
+		bool _continues_album; // the next track of the same album as the item before, set by the playlist
 
 		sound_details()
 			: _ok(false)
@@ -68,10 +92,21 @@ namespace mprt
 			, _orig_bps(-1)
 			, _url_id(_INVALID_URL_ID_)
 			, _stop(false)
+			, _continues_album(false)
 		{
 		}
 	};
 
+	// an input the decoder reads in place, without the chunks of the cache buffer
+	class input_view
+	{
+	public:
+		virtual ~input_view() {}
+
+		// up to size bytes from pos into dest, fewer at the end, -1 on an error
+		virtual size_type read(size_type pos, buffer_elem_t * dest, size_type size) = 0;
+	};
+
 	class decoder_plugin_api;
 	struct current_decoder_details
 	{
@@ -89,6 +124,7 @@ namespace mprt
 		decoder_finish_callback_register_func_t _decoder_finish_callback;
 		set_input_cache_buf_callback_register_func_t _set_input_cache_buf_callback;
 		seek_callback_register_func_t _seek_callback;
+		std::shared_ptr<input_view> _input_view; // set by the inputs which can be read in place
 		std::shared_ptr<decoder_plugin_api> _current_decoder_plugin;
 		sound_details _sound_details;
 
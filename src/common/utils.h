@@ -1,7 +1,9 @@
 #ifndef utils_h__
 #define utils_h__
 
+#include <cctype>
 #include <chrono>
+#include <algorithm>
 #include <tuple>
 #include <string>
 #include <iomanip>
@@ -101,6 +103,14 @@ T get_ext(T const& url_name, T const& sep_char = ".")
 	return file_ext;
 }
 
+// scheme://... urls are streamed, they are not paths of the playlist directory
+inline bool is_stream_url(std::string const& url)
+{
+	auto scheme_end = url.find("://");
+	return scheme_end != std::string::npos && scheme_end > 1 &&
+		std::all_of(url.begin(), url.begin() + scheme_end, [](char ch) { return std::isalpha(static_cast<unsigned char>(ch)) != 0; });
+}
+
 template<typename T>
 T get_pair_cantor(T const& a, T const& b)
 {
@@ -0,0 +1,126 @@
+#ifndef worker_pool_h__
+#define worker_pool_h__
+
+#include <vector>
+#include <thread>
+#include <atomic>
+
+#include <boost/asio.hpp>
+#include <boost/log/trivial.hpp>
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__linux__)
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace mprt
+{
+	// a few threads sharing one io_context, for background jobs that must not
+	// block the single threaded plugin taskers (verification, scanning, blocking io)
+	class worker_pool {
+	private:
+		boost::asio::io_context _io;
+		boost::asio::executor_work_guard<boost::asio::io_context::executor_type> _work_guard;
+		std::vector<std::thread> _threads;
+		std::atomic_bool _stopped;
+
+		static void lower_thread_priority()
+		{
+#if defined(_WIN32)
+			SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+#elif defined(__linux__)
+			// nice value and io priority are per thread on linux
+			constexpr int ioprio_who_process = 1;
+			constexpr int ioprio_class_idle = 3;
+			constexpr int ioprio_class_shift = 13;
+
+			(void)setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 19);
+			(void)syscall(SYS_ioprio_set, ioprio_who_process, 0, ioprio_class_idle << ioprio_class_shift);
+#endif
+		}
+
+		void process_events(bool low_priority)
+		{
+			if (low_priority)
+			{
+				lower_thread_priority();
+			}
+
+			for (;;) {
+				try
+				{
+					_io.run();
+					break;
+				}
+				catch (std::exception const &e)
+				{
+					BOOST_LOG_TRIVIAL(error) << "worker_pool job error: " << e.what();
+				}
+				catch (...)
+				{
+					BOOST_LOG_TRIVIAL(error) << "worker_pool job produced an unknown error";
+				}
+			}
+		}
+
+	public:
+		worker_pool(std::size_t thread_count, bool low_priority = false)
+			: _work_guard(boost::asio::make_work_guard(_io))
+			, _stopped(false)
+		{
+			thread_count = std::max<std::size_t>(thread_count, 1);
+			for (std::size_t i = 0; i != thread_count; ++i)
+			{
+				_threads.emplace_back([this, low_priority] { process_events(low_priority); });
+			}
+		}
+
+		~worker_pool()
+		{
+			stop();
+		}
+
+		worker_pool(worker_pool const&) = delete;
+		worker_pool & operator=(worker_pool const&) = delete;
+
+		template <typename Func>
+		void post(Func f)
+		{
+			if (!_stopped)
+			{
+				boost::asio::post(_io, f);
+			}
+		}
+
+		bool is_stopped() const
+		{
+			return _stopped;
+		}
+
+		std::size_t thread_count() const
+		{
+			return _threads.size();
+		}
+
+		// pending jobs are dropped, running ones are waited for
+		void stop()
+		{
+			if (_stopped.exchange(true))
+				return;
+
+			_work_guard.reset();
+			_io.stop();
+
+			for (auto & th : _threads)
+			{
+				if (th.joinable())
+					th.join();
+			}
+		}
+	};
+}
+
+#endif // worker_pool_h__
@@ -119,7 +119,16 @@ namespace mprt
 		decoder_dets->_current_decoder_plugin = get_decoder_plugin(decoder_dets->_url_ext);
 		auto cache_buf = decoder_dets->_current_decoder_plugin->get_cache_put_buf(decoder_dets->_sound_details._url_id);
 
-		decoder_dets->_set_input_cache_buf_callback(decoder_dets->_sound_details._url_id, cache_buf);
+		if (decoder_dets->_current_decoder_plugin->reads_url_itself(decoder_dets->_url))
+		{
+			// nothing is read from the input plugin, give the url back now and only once
+			decoder_dets->_decoder_finish_callback(decoder_dets->_current_decoder_plugin->plugin_name(), decoder_dets->_sound_details._url_id);
+			decoder_dets->_decoder_finish_callback = [](std::string, url_id_t) {};
+		}
+		else if (!decoder_dets->_input_view)
+		{
+			decoder_dets->_set_input_cache_buf_callback(decoder_dets->_sound_details._url_id, cache_buf);
+		}
 
 		if (plugin_states::play == _current_state && was_no_job)
 		{
@@ -133,6 +142,13 @@ namespace mprt
 
 		if (seek_point < 0 || seek_point > dec_det->_stream_length)
 			return false;
+
+		// read in place, nothing is buffered which could go stale
+		if (dec_det->_input_view)
+		{
+			dec_det->_current_stream_pos = seek_point;
+			return true;
+		}
 		
 		auto need_pos = seek_point - dec_det->_current_stream_pos;
 		if (need_pos < 0)
@@ -310,6 +326,25 @@ namespace mprt
 		_last_read_buffer.clear();
 
 		auto max_buf_size = std::min(buf_size, decoder_dets->_stream_length - decoder_dets->_current_stream_pos);
+		if (decoder_dets->_input_view)
+		{
+			auto read_bytes = max_buf_size > 0 ? decoder_dets->_input_view->read(decoder_dets->_current_stream_pos, buffer, max_buf_size) : 0;
+			if (read_bytes < 0)
+			{
+				return std::make_pair(-1, decoder_dets->_sound_details._url_id);
+			}
+
+			decoder_dets->_current_stream_pos += read_bytes;
+			if (read_bytes < max_buf_size)
+			{
+				// cut short since it was opened
+				decoder_dets->_stream_length = decoder_dets->_current_stream_pos;
+			}
+			decoder_dets->_last_read_empty = read_bytes == 0;
+
+			return std::make_pair(read_bytes, decoder_dets->_sound_details._url_id);
+		}
+
 		if (decoder_dets->_current_stream_pos < decoder_dets->_stream_length)
 		{
 			auto total_buf_data = decoder_dets->_current_cache_buf->total_bytes_in_buffer_guess();
@@ -394,6 +429,33 @@ namespace mprt
 		return std::shared_ptr<mprt::decoder_plugin_api>();
 	}
 
+	void decoder_plugins_manager::verify_integrity(std::shared_ptr<std::vector<std::string>> urls)
+	{
+		add_job([this, urls]
+		{
+			std::unordered_map<std::shared_ptr<decoder_plugin_api>, std::shared_ptr<std::vector<std::string>>> plugin_urls;
+
+			for (auto & url : *urls)
+			{
+				auto dec_plugin = get_decoder_plugin(get_ext(url));
+				if (dec_plugin)
+				{
+					auto & dec_urls = plugin_urls[dec_plugin];
+					if (!dec_urls)
+					{
+						dec_urls = std::make_shared<std::vector<std::string>>();
+					}
+					dec_urls->push_back(url);
+				}
+			}
+
+			for (auto & dec_urls : plugin_urls)
+			{
+				dec_urls.first->verify_integrity(dec_urls.second);
+			}
+		});
+	}
+
 	void decoder_plugins_manager::stop_internal()
 	{
 		BOOST_LOG_TRIVIAL(debug) << "decoder_plugins_manager::stop_internal() called";
@@ -439,6 +501,33 @@ namespace mprt
 		}
 	}
 
+	void decoder_plugins_manager::duration_resolved(url_id_t url_id, size_type total_samples, size_type sample_rate)
+	{
+		add_job([this, url_id, total_samples, sample_rate]
+		{
+			auto decoder_dets = get_current_dec_details(url_id);
+			if (!decoder_dets)
+			{
+				decoder_dets = get_finished_decoder_details(url_id);
+			}
+
+			if (!decoder_dets || sample_rate <= 0 || decoder_dets->_sound_details._sample_rate <= 0)
+			{
+				return;
+			}
+
+			auto out_rate = decoder_dets->_sound_details._sample_rate;
+			auto resolved_samples = (out_rate == sample_rate) ? total_samples : total_samples * out_rate / sample_rate;
+
+			// the outputs still take the length from the end of decoding, a resolved length which is
+			// a few samples short (encoder padding) would cut the track there
+			if (_decoder_duration_resolved_cb)
+			{
+				_decoder_duration_resolved_cb(url_id, resolved_samples * 1000 / out_rate);
+			}
+		});
+	}
+
 	mprt::set_output_buffer_callback_register_func_t decoder_plugins_manager::set_output_buf_callback()
 	{
 		return _set_output_buf_callback;
@@ -34,6 +34,7 @@ namespace mprt
 		decoder_det_list_t _decoder_detail_list;
 		finished_decoder_list_t _finished_decoder_detail_list;
 		decoder_seek_finished_callback_register_func_t _decoder_seek_finished_cb;
+		decoder_duration_resolved_callback_register_func_t _decoder_duration_resolved_cb;
 
 		chunk_buffer_type::second_type _last_read_buffer;
 
@@ -179,6 +180,12 @@ namespace mprt
 
 		void finish_decode_internal_single(url_id_t url_id);
 
+		// decoders which learn the exact length ahead of the end of the stream report it here,
+		// total_samples is at the rate given in sample_rate
+		void duration_resolved(url_id_t url_id, size_type total_samples, size_type sample_rate);
+
+		void verify_integrity(std::shared_ptr<std::vector<std::string>> urls);
+
 		size_type decoder_tell()
 		{
 			auto const& cur_decoder_det = get_current_decoder_details();
@@ -234,6 +241,11 @@ namespace mprt
 		{
 			_decoder_seek_finished_cb = func;
 		}
+
+		void set_decoder_duration_resolved_cb(decoder_duration_resolved_callback_register_func_t func)
+		{
+			_decoder_duration_resolved_cb = func;
+		}
 	};
 }
 
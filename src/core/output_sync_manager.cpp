@@ -0,0 +1,257 @@
+#include <cmath>
+#include <algorithm>
+
+#include <boost/log/trivial.hpp>
+
+#include "config.h"
+#include "../common/output_plugin_api.h"
+
+#include "output_sync_manager.h"
+
+namespace mprt
+{
+	namespace
+	{
+		int64_t steady_now_us()
+		{
+			return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+
+		// seconds of the item heard at now_us
+		double heard_secs(device_clock const& clock, int64_t now_us)
+		{
+			return clock._item_frames / clock._sample_rate + (now_us - clock._time_stamp_us) * 1e-6;
+		}
+	}
+
+	output_sync_manager::output_sync_manager()
+		: _interval(500)
+		, _max_correction(1e-3)
+		, _phase_gain(0.1)
+		, _step_threshold(20)
+		, _drift_window(120)
+		, _min_drift_window(10)
+	{
+	}
+
+	output_sync_manager::~output_sync_manager()
+	{
+
+	}
+
+	bool output_sync_manager::init(std::vector<std::shared_ptr<output_plugin_api>> const& outputs)
+	{
+		bool enabled = false;
+		std::size_t max_free_timer_count = 1;
+		try
+		{
+			config::instance().init("../config/config.xml");
+			auto pt = config::instance().get_ptree_node("mprt.plugin_configs.output_sync");
+
+			enabled = (pt.get<std::string>("enable", "false") == "true");
+			max_free_timer_count = pt.get<std::size_t>("max_free_timer_count", 1);
+			_master_name = pt.get<std::string>("master", "");
+			_interval = std::chrono::milliseconds(std::max<size_type>(pt.get<size_type>("interval_msecs", 500), 10));
+			_max_correction = pt.get<double>("max_correction_ppm", 1000.) * 1e-6;
+			_phase_gain = pt.get<double>("phase_gain", 0.1);
+			_step_threshold = std::chrono::milliseconds(pt.get<size_type>("step_msecs", 20));
+			_drift_window = std::chrono::seconds(pt.get<size_type>("drift_window_secs", 120));
+			_min_drift_window = std::chrono::seconds(pt.get<size_type>("min_drift_window_secs", 10));
+		}
+		catch (std::exception const& e) {
+			BOOST_LOG_TRIVIAL(debug) << "no output sync config: " << e.what();
+			return false;
+		}
+
+		if (!enabled || outputs.size() < 2)
+			return false;
+
+		// the named one, or the first one
+		auto master_iter = std::find_if(outputs.begin(), outputs.end(), [this](std::shared_ptr<output_plugin_api> const& output)
+		{
+			return output->plugin_name() == _master_name;
+		});
+		if (master_iter == outputs.end())
+		{
+			master_iter = outputs.begin();
+		}
+		_master._output = *master_iter;
+
+		for (auto & output : outputs)
+		{
+			if (output == _master._output)
+				continue;
+
+			if (!output->supports_rate_correction())
+			{
+				BOOST_LOG_TRIVIAL(info) << "output cannot follow the master clock: " << output->plugin_name();
+				continue;
+			}
+
+			synced_output slave;
+			slave._output = output;
+			_slaves.push_back(slave);
+		}
+
+		if (_slaves.empty())
+			return false;
+
+		_async_task = std::make_shared<async_tasker>(max_free_timer_count);
+		while (!_async_task->is_ready()) {
+			std::this_thread::yield();
+		}
+
+		BOOST_LOG_TRIVIAL(info) << "output sync master: " << _master._output->plugin_name() << " slaves: " << _slaves.size();
+
+		return true;
+	}
+
+	void output_sync_manager::take_sample(synced_output & out, int64_t now_us, std::chrono::seconds window)
+	{
+		auto clock = out._output->get_device_clock();
+		if (clock._epoch != out._epoch)
+		{
+			out._epoch = clock._epoch;
+			out._samples.clear();
+		}
+
+		if (!clock._valid || (!out._samples.empty() && out._samples.back()._time_stamp_us == clock._time_stamp_us))
+			return;
+
+		out._samples.push_back({ clock._time_stamp_us, clock._device_frames });
+
+		auto window_us = std::chrono::duration_cast<std::chrono::microseconds>(window).count();
+		while (out._samples.size() > 2 && now_us - out._samples.front()._time_stamp_us > window_us)
+		{
+			out._samples.pop_front();
+		}
+	}
+
+	double output_sync_manager::measured_rate(synced_output const& out) const
+	{
+		if (out._samples.size() < 2)
+			return 0.;
+
+		auto const& first = out._samples.front();
+		auto span_us = out._samples.back()._time_stamp_us - first._time_stamp_us;
+		if (span_us < std::chrono::duration_cast<std::chrono::microseconds>(_min_drift_window).count())
+			return 0.;
+
+		// least squares, a late wakeup in one report does not move the slope much
+		double count = static_cast<double>(out._samples.size());
+		double sum_t = 0., sum_f = 0.;
+		for (auto const& sample : out._samples)
+		{
+			sum_t += static_cast<double>(sample._time_stamp_us - first._time_stamp_us);
+			sum_f += static_cast<double>(sample._device_frames - first._device_frames);
+		}
+
+		double mean_t = sum_t / count, mean_f = sum_f / count;
+		double cov = 0., var = 0.;
+		for (auto const& sample : out._samples)
+		{
+			auto t = static_cast<double>(sample._time_stamp_us - first._time_stamp_us) - mean_t;
+			auto f = static_cast<double>(sample._device_frames - first._device_frames) - mean_f;
+			cov += t * f;
+			var += t * t;
+		}
+
+		return var > 0. ? cov / var * 1e6 : 0.;
+	}
+
+	void output_sync_manager::update_speed(synced_output & out, int64_t now_us)
+	{
+		take_sample(out, now_us, _drift_window);
+
+		auto rate = measured_rate(out);
+		auto sample_rate = out._output->get_device_clock()._sample_rate;
+		if (rate > 0. && sample_rate > 0)
+		{
+			out._speed = rate / sample_rate;
+		}
+	}
+
+	void output_sync_manager::sync()
+	{
+		_STATE_CHECK_(plugin_states::play);
+
+		auto now_us = steady_now_us();
+
+		update_speed(_master, now_us);
+		for (auto & slave : _slaves)
+		{
+			update_speed(slave, now_us);
+			sync_slave(slave, now_us);
+		}
+
+		_sync_timer = add_job_thread_internal([this]() { sync(); }, _interval);
+	}
+
+	void output_sync_manager::sync_slave(synced_output & slave, int64_t now_us)
+	{
+		auto master_clock = _master._output->get_device_clock();
+		auto slave_clock = slave._output->get_device_clock();
+		if (!master_clock._valid || !slave_clock._valid || master_clock._sample_rate <= 0 || slave_clock._sample_rate <= 0)
+			return;
+
+		// faster than the master: more frames out of every item frame
+		auto ratio = slave._speed / _master._speed;
+		double error_secs = 0.;
+		auto now = clock_type::now();
+		if (slave_clock._url_id == master_clock._url_id && now >= slave._settle_until)
+		{
+			// ahead of the master when positive
+			error_secs = heard_secs(slave_clock, now_us) - heard_secs(master_clock, now_us);
+			if (std::abs(error_secs) * 1000. > _step_threshold.count())
+			{
+				auto frames = static_cast<int64_t>(std::llround(-error_secs * slave_clock._sample_rate));
+				BOOST_LOG_TRIVIAL(info) << "output sync: " << slave._output->plugin_name()
+					<< " is " << error_secs * 1000. << " ms off, stepping " << frames << " frames";
+
+				slave._output->step_position(frames);
+				// the step shows in the position of the next reports
+				slave._settle_until = now + _interval * 3;
+			}
+			else
+			{
+				ratio *= 1. + _phase_gain * error_secs;
+			}
+		}
+
+		ratio = std::min(std::max(ratio, 1. - _max_correction), 1. + _max_correction);
+		if (ratio != slave._ratio)
+		{
+			slave._ratio = ratio;
+			slave._output->set_rate_correction(ratio);
+		}
+
+		BOOST_LOG_TRIVIAL(debug) << "output sync: " << slave._output->plugin_name()
+			<< " drift: " << (slave._speed / _master._speed - 1.) * 1e6 << " ppm"
+			<< " phase: " << error_secs * 1e6 << " us"
+			<< " ratio: " << ratio;
+	}
+
+	void output_sync_manager::stop_internal()
+	{
+	}
+
+	void output_sync_manager::pause_internal()
+	{
+	}
+
+	void output_sync_manager::cont_internal()
+	{
+		if (_sync_timer && is_active_timer(_sync_timer))
+			return;
+
+		sync();
+	}
+
+	void output_sync_manager::quit_internal()
+	{
+		for (auto & slave : _slaves)
+		{
+			slave._output->set_rate_correction(0.);
+		}
+	}
+}
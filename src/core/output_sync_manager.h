@@ -0,0 +1,81 @@
+#ifndef output_sync_manager_h__
+#define output_sync_manager_h__
+
+#include <vector>
+#include <memory>
+#include <deque>
+#include <string>
+#include <chrono>
+
+#include "../common/async_task.h"
+#include "../common/type_defs.h"
+
+namespace mprt
+{
+	class output_plugin_api;
+
+	// keeps the outputs playing the same frame at the same time. one of them is the master, the
+	// clock of every other device is measured against it: the drift of the two crystals becomes a
+	// resampling ratio for the slave, a phase error on top of it is pulled in slowly or, when it is
+	// large (a start, a seek), stepped over at once
+	class output_sync_manager : public async_task
+	{
+	private:
+		using clock_type = std::chrono::steady_clock;
+
+		struct clock_sample
+		{
+			int64_t _time_stamp_us;
+			int64_t _device_frames;
+		};
+
+		struct synced_output
+		{
+			std::shared_ptr<output_plugin_api> _output;
+			uint64_t _epoch;
+			std::deque<clock_sample> _samples; // of the epoch, the oldest first
+			double _speed; // device frames of a nominal second per steady second, kept over a restart
+			double _ratio; // given to the output, 0: none yet
+			clock_type::time_point _settle_until; // after a step the position is not trusted
+
+			synced_output()
+				: _epoch(0)
+				, _speed(1.)
+				, _ratio(0.)
+			{}
+		};
+
+		std::chrono::milliseconds _interval;
+		double _max_correction; // of the ratio, from max_correction_ppm
+		double _phase_gain; // 1/s, the part of the phase error pulled in per second
+		std::chrono::milliseconds _step_threshold;
+		std::chrono::seconds _drift_window;
+		std::chrono::seconds _min_drift_window; // the drift is not used before it is measured over this
+		std::string _master_name;
+
+		synced_output _master;
+		std::vector<synced_output> _slaves;
+		async_tasker::timer_type_shared _sync_timer;
+
+		static void take_sample(synced_output & out, int64_t now_us, std::chrono::seconds window);
+		// the device frames per steady second over the samples, 0 if not measured long enough
+		double measured_rate(synced_output const& out) const;
+		void update_speed(synced_output & out, int64_t now_us);
+		void sync();
+		void sync_slave(synced_output & slave, int64_t now_us);
+
+		virtual void stop_internal() override;
+		virtual void pause_internal() override;
+		virtual void cont_internal() override;
+		virtual void quit_internal() override;
+
+	public:
+		output_sync_manager();
+		~output_sync_manager();
+
+		// false if there is nothing to sync, fewer than two outputs with a clock
+		bool init(std::vector<std::shared_ptr<output_plugin_api>> const& outputs);
+	};
+}
+
+#endif // output_sync_manager_h__
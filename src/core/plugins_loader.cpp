@@ -12,6 +12,7 @@
 #include "common/input_plugin_api.h"
 #include "common/ui_plugin_api.h"
 #include "core/decoder_plugins_manager.h"
+#include "core/output_sync_manager.h"
 #include "plugins/core_plugins/playlist_management_plugin/playlist_management_plugin.h"
 
 #include "plugins_loader.h"
@@ -85,6 +86,11 @@ namespace mprt
 					{
 						auto out_plug_api{ std::dynamic_pointer_cast<output_plugin_api>(plugin) };
 						out_plug_api->init();
+						if (!out_plug_api->is_enabled())
+						{
+							BOOST_LOG_TRIVIAL(info) << "output plugin is disabled: " << out_plug_api->plugin_name();
+							break;
+						}
 						output_plugins->push_back(out_plug_api);
 					}
 					break;
@@ -133,6 +139,14 @@ namespace mprt
 		_decoder_plugins_manager->add_decoder_plugins(decoder_plugins);
 		_decoder_plugins_manager->add_output_plugins(output_plugins);
 
+		// the outputs play together, on the clock of one of them
+		auto output_sync = std::make_shared<output_sync_manager>();
+		if (output_sync->init(*output_plugins))
+		{
+			_output_sync_manager = output_sync;
+			_output_sync_manager->cont();
+		}
+
 		_playlist_management_plugin->set_input_plugins(input_plugins);
 		_playlist_management_plugin->set_decoder_plugins_manager(_decoder_plugins_manager);
 		_playlist_management_plugin->set_output_plugins(output_plugins);
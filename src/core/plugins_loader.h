@@ -11,6 +11,7 @@ namespace mprt
 	class server_plugin_api;
 	class ui_plugin_api;
 	class playlist_management_plugin;
+	class output_sync_manager;
 
 	class plugins_loader
 	{
@@ -18,6 +19,7 @@ namespace mprt
 		std::vector<std::shared_ptr<ui_plugin_api>> _ui_plugins;
 		std::shared_ptr<decoder_plugins_manager> _decoder_plugins_manager;
 		std::shared_ptr<playlist_management_plugin> _playlist_management_plugin;
+		std::shared_ptr<output_sync_manager> _output_sync_manager;
 
 		void search_for_symbols(void *args);
 		bool is_shared_library(const boost::filesystem::path& p);
@@ -43,8 +43,18 @@ namespace mprt
 	{
 		auto pl_item = std::make_shared<playlist_item_t>();
 		_tag_parser->clear();
-		_tag_parser->set_filename(_base_path + url);
-		if (_tag_parser->read_metadata())
+		_tag_parser->set_filename(item_url(url));
+
+		if (is_stream_url(url))
+		{
+			// nothing to read before it is played, the stream may send its own title
+			_tag_parser->set_tag_val("TITLE", url);
+			pl_item->_playlist_item_id = _playlist_id_counter++;
+			pl_item->_url = url;
+			pl_item->_tags = _tag_parser->get_tags();
+			pl_item->_duration = std::chrono::microseconds(0);
+		}
+		else if (_tag_parser->read_metadata())
 		{
 			pl_item->_playlist_item_id = _playlist_id_counter++;
 			pl_item->_url = url;
@@ -336,6 +346,11 @@ namespace mprt
 		return _base_path;
 	}
 
+	std::string playlist::item_url(std::string const& url)
+	{
+		return is_stream_url(url) ? url : _base_path + url;
+	}
+
 	void playlist::set_album_art(std::shared_ptr<album_art> alb_art)
 	{
 		_album_art = alb_art;
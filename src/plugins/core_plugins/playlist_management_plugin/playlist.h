@@ -173,6 +173,8 @@ namespace mprt
 		std::shared_ptr<playlist_item_shr_list_t> load_playlist(std::string filename, bool reverse_insert);
 		bool save_playlist(std::string const& filename);
 		std::string base_path();
+		// the path or url the input plugin is given for an item
+		std::string item_url(std::string const& url);
 		void set_album_art(std::shared_ptr<album_art> alb_art);
 
 	};
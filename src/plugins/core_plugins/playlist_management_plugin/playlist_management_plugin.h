@@ -94,6 +94,9 @@ namespace mprt
 		virtual void unregister_seek_finished_callback(std::string plug_name) = 0;
 
 		virtual album_art_list const& get_album_art(album_name_t const& album_name) = 0;
+
+		// integrity check of every item in every playlist, runs in the background
+		virtual void verify_library() = 0;
 	};
 
 }
@@ -8,6 +8,7 @@
 #include "common/output_plugin_api.h"
 #include "common/input_plugin_api.h"
 #include "common/ui_plugin_api.h"
+#include "common/utils.h"
 #include "core/decoder_plugins_manager.h"
 #include "tag_lib_parser.h"
 
@@ -82,6 +83,7 @@ namespace mprt
 		for (auto & ip : *_input_plugins)
 		{
 			ip->set_input_opened_cb(std::bind(&playlist_management_plugin_imp::input_opened_cb, this, std::placeholders::_1));
+			ip->set_input_metadata_cb(std::bind(&playlist_management_plugin_imp::input_metadata_cb, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
 		}
 	}
 
@@ -91,6 +93,7 @@ namespace mprt
 
 		_decoder_plugins_manager->set_decoder_opened_cb(std::bind(&playlist_management_plugin_imp::decoder_opened_cb, this, std::placeholders::_1));
 		_decoder_plugins_manager->set_decoder_seek_finish_cb(std::bind(&playlist_management_plugin_imp::decoder_seek_finished_cb, this));
+		_decoder_plugins_manager->set_decoder_duration_resolved_cb(std::bind(&playlist_management_plugin_imp::decoder_duration_resolved_cb, this, std::placeholders::_1, std::placeholders::_2));
 	}
 
 	playlist_management_plugin_imp::playlist_management_plugin_imp()
@@ -105,6 +108,9 @@ namespace mprt
 
 		_async_task = std::make_shared<async_tasker>(pt.get<std::size_t>("max_free_timer_count", 10));
 		_min_wait_next_song = std::chrono::milliseconds(pt.get<std::size_t>("min_wait_next_song_msecs", 10000));
+		_input_plugin_name = pt.get<std::string>("input_plugin", "input_file_plugin");
+		_stream_input_plugin_name = pt.get<std::string>("stream_input_plugin", "input_http_plugin");
+		_prefetch_items = pt.get<size_type>("prefetch_items", 3);
 
 		_added_next_song = false;
 
@@ -168,6 +174,43 @@ namespace mprt
 		}
 	}
 
+	std::shared_ptr<input_plugin_api> playlist_management_plugin_imp::input_plugin_for(std::string const& url)
+	{
+		auto const& plugin_name = is_stream_url(url) ? _stream_input_plugin_name : _input_plugin_name;
+
+		for (auto & inp_plugi : *_input_plugins)
+		{
+			if (inp_plugi->plugin_name() == plugin_name)
+				return inp_plugi;
+		}
+
+		// the configured one is not built or not loaded
+		return _input_plugins->at(0);
+	}
+
+	void playlist_management_plugin_imp::prefetch_next_items(playlist_item_id_t playlist_item_id)
+	{
+		auto iter = _playlist_list.find(_current_playing_list_id);
+		if (_prefetch_items <= 0 || iter == _playlist_list.end())
+			return;
+
+		std::vector<std::string> urls;
+		for (size_type i = 0; i < _prefetch_items; ++i)
+		{
+			playlist_item_id = iter->second->get_next_item_id(playlist_item_id);
+			auto pl_item_shr = iter->second->get_playlist_item_with_item_id(playlist_item_id);
+			if (!pl_item_shr)
+				break;
+
+			urls.push_back(iter->second->item_url(pl_item_shr->_url));
+		}
+
+		if (!urls.empty())
+		{
+			input_plugin_for(urls.front())->prefetch_input_items(urls);
+		}
+	}
+
 	void playlist_management_plugin_imp::cont_play_internal(playlist_item_id_t playlist_item_id)
 	{
 		auto iter = _playlist_list.find(_current_playing_list_id);
@@ -178,10 +221,10 @@ namespace mprt
 
 			if (pl_item_shr)
 			{
-				// @TODO: this _input_plugins part will be updated ...
-				auto inp_plug = _input_plugins->at(0);
+				auto url = iter->second->item_url(pl_item_shr->_url);
+				auto inp_plug = input_plugin_for(url);
 				//auto url_id = inp_plug->add_input_item(pl_item_shr->_url, get_pair_cantor(_current_playing_list_id, playlist_item_id));
-				auto url_id = inp_plug->add_input_item(iter->second->base_path() + pl_item_shr->_url);
+				auto url_id = inp_plug->add_input_item(url);
 				iter->second->update_url_id(playlist_item_id, url_id);
 
 				auto dur_iter = pl_item_shr->_tags->find(std::string(_AUDIO_PROP_DURATION_MS_));
@@ -226,10 +269,20 @@ namespace mprt
 					{
 						_added_next_song = false;
 						_current_playing_item_id = pl_item_shr->_playlist_item_id;
+
+						// the next tracks have the whole length of this one to come off a sleeping disk
+						prefetch_next_items(_current_playing_item_id);
 					}
 					
+					// a crossfade starts before the end, the next song is decoded earlier for it
+					auto lead_time = _min_wait_next_song;
+					for (auto & out_plug : *_output_plugins)
+					{
+						lead_time = std::max(lead_time, _min_wait_next_song + out_plug->next_item_lead_time());
+					}
+
 					if (
-						pl_item_shr->_duration - std::chrono::milliseconds(current_position_ms) <= _min_wait_next_song
+						pl_item_shr->_duration - std::chrono::milliseconds(current_position_ms) <= lead_time
 						&&
 						!_added_next_song)
 					{
@@ -375,12 +428,51 @@ namespace mprt
 		});
 	}
 
+	bool playlist_management_plugin_imp::is_next_album_track(url_id_t url_id)
+	{
+		auto iter = _playlist_list.find(_current_playing_list_id);
+		if (iter == _playlist_list.end())
+			return false;
+
+		auto prev_item = iter->second->get_playlist_item_with_item_id(_current_playing_item_id);
+		auto item = iter->second->get_playlist_item_with_url_id(url_id);
+		if (!prev_item || !item || prev_item == item || !prev_item->_tags || !item->_tags)
+			return false;
+
+		auto tag_of = [](playlist_item_shr_t const& pl_item, std::string const& name)
+		{
+			auto tag_iter = pl_item->_tags->find(name);
+			return tag_iter == pl_item->_tags->end() ? std::string() : tag_iter->second;
+		};
+
+		auto album = tag_of(item, std::string(_ALBUM_TAG_NAME));
+		if (album.empty() ||
+			album != tag_of(prev_item, std::string(_ALBUM_TAG_NAME)) ||
+			tag_of(item, "Disc No") != tag_of(prev_item, "Disc No"))
+		{
+			return false;
+		}
+
+		try
+		{
+			return std::stoll(tag_of(item, "Track No")) == std::stoll(tag_of(prev_item, "Track No")) + 1;
+		}
+		catch (std::exception const&)
+		{
+			return false;
+		}
+	}
+
 	void playlist_management_plugin_imp::decoder_opened_cb(sound_details sound_det)
 	{
-		add_job([this, sound_det]
+		add_job([this, opened_sound_det = sound_det]
 		{
+			auto sound_det = opened_sound_det;
 			if (sound_det._ok)
 			{
+				// the outputs do not crossfade into it when they are told so
+				sound_det._continues_album = is_next_album_track(sound_det._url_id);
+
 				for_each(_output_plugins->begin(), _output_plugins->end(), [sound_det](std::shared_ptr<output_plugin_api> & out_plug)
 				{
 					out_plug->add_sound_details(sound_det);
@@ -402,6 +494,55 @@ namespace mprt
 		});
 	}
 
+	void playlist_management_plugin_imp::decoder_duration_resolved_cb(url_id_t url_id, size_type duration_ms)
+	{
+		add_job([this, url_id, duration_ms]
+		{
+			auto iter = _playlist_list.find(_current_playing_list_id);
+			if (iter == _playlist_list.end())
+			{
+				return;
+			}
+
+			auto pl_item_shr = iter->second->get_playlist_item_with_url_id(url_id);
+			if (!pl_item_shr || !pl_item_shr->_tags)
+			{
+				return;
+			}
+
+			// the next song is queued by this length, the tag one is often only an estimate
+			pl_item_shr->_duration = std::chrono::milliseconds(duration_ms);
+
+			// copy on write, the old tags may still be in use by the ui
+			auto tags = std::make_shared<tag_parser_abstract::tag_text_cnt>(*pl_item_shr->_tags);
+			(*tags)[std::string(_AUDIO_PROP_DURATION_MS_)] = std::to_string(duration_ms);
+			pl_item_shr->_tags = tags;
+		});
+	}
+
+	void playlist_management_plugin_imp::input_metadata_cb(url_id_t url_id, std::string tag_name, std::string tag_value)
+	{
+		add_job([this, url_id, tag_name, tag_value]
+		{
+			auto iter = _playlist_list.find(_current_playing_list_id);
+			if (iter == _playlist_list.end())
+			{
+				return;
+			}
+
+			auto pl_item_shr = iter->second->get_playlist_item_with_url_id(url_id);
+			if (!pl_item_shr || !pl_item_shr->_tags)
+			{
+				return;
+			}
+
+			// copy on write, the old tags may still be in use by the ui
+			auto tags = std::make_shared<tag_parser_abstract::tag_text_cnt>(*pl_item_shr->_tags);
+			(*tags)[_tag_parser->get_tag_col(tag_name)] = tag_value;
+			pl_item_shr->_tags = tags;
+		});
+	}
+
 	void playlist_management_plugin_imp::sound_opened_cb(bool sound_opened)
 	{
 		add_job([this, sound_opened]
@@ -719,6 +860,35 @@ namespace mprt
 		return _album_art->get_album_art(album_name);
 	}
 
+	void playlist_management_plugin_imp::verify_library()
+	{
+		add_job([this]
+		{
+			auto urls = std::make_shared<std::vector<std::string>>();
+
+			for (auto & pl : _playlist_list)
+			{
+				auto base_path = pl.second->base_path();
+				std::for_each(pl.second->get_seq_cbegin(), pl.second->get_seq_cend(), [&urls, &base_path](playlist_item_shr_t const& pl_item)
+				{
+					// streams have no file to verify
+					if (!is_stream_url(pl_item->_url))
+					{
+						urls->push_back(base_path + pl_item->_url);
+					}
+				});
+			}
+
+			// same file may be in more than one playlist
+			std::sort(urls->begin(), urls->end());
+			urls->erase(std::unique(urls->begin(), urls->end()), urls->end());
+
+			BOOST_LOG_TRIVIAL(debug) << "verifying library, items: " << urls->size();
+
+			_decoder_plugins_manager->verify_integrity(urls);
+		});
+	}
+
 }
 
 // Factory method. Returns *simple pointer
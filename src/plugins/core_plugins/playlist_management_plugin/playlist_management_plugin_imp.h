@@ -29,6 +29,9 @@ namespace mprt
 		playlist_id_t _current_playing_list_id;
 		playlist_item_id_t _current_playing_item_id;
 		bool _added_next_song;
+		std::string _input_plugin_name;
+		std::string _stream_input_plugin_name; // for http and other urls
+		size_type _prefetch_items;
 
 		std::unordered_map<std::string, add_playlist_callback_t> _add_playlist_cb_list;
 		std::unordered_map<std::string, add_playlist_item_callback_t> _add_playlist_item_cb_list;
@@ -49,12 +52,16 @@ namespace mprt
 		virtual void set_input_plugins(std::shared_ptr<std::vector<std::shared_ptr<input_plugin_api>>> input_plugins) override;
 		virtual void set_decoder_plugins_manager(std::shared_ptr<decoder_plugins_manager > decoder_plugins_manager) override;
 
+		std::shared_ptr<input_plugin_api> input_plugin_for(std::string const& url);
+		void prefetch_next_items(playlist_item_id_t playlist_item_id);
+
 		void start_play_internal(playlist_id_t playlist_id, playlist_item_id_t playlist_item_id);
 		void stop_play_internal();
 		void cont_play_internal(playlist_item_id_t playlist_item_id);
 		void seek_duration_internal(playlist_id_t playlist_id, playlist_item_id_t playlist_item_id, size_type duration_ms);
 
 		void progress_callback(url_id_t url_id, size_type current_position_ms);
+		bool is_next_album_track(url_id_t url_id);
 		virtual void add_playlist_items_internal(playlist_id_t playlist_id, playlist_item_id_t from_playlist_item_id, std::shared_ptr<std::vector<std::string>> urls);
 		virtual void add_playlist_directory_internal(playlist_id_t playlist_id, playlist_item_id_t from_playlist_item_id, std::string dirname);
 		virtual std::shared_ptr<std::vector<std::string>> add_playlist_directory_builder(std::string dirname);
@@ -62,6 +69,8 @@ namespace mprt
 		void input_opened_cb(std::shared_ptr<current_decoder_details> cur_det);
 		void decoder_opened_cb(sound_details sound_det);
 		void decoder_seek_finished_cb();
+		void decoder_duration_resolved_cb(url_id_t url_id, size_type duration_ms);
+		void input_metadata_cb(url_id_t url_id, std::string tag_name, std::string tag_value);
 		void sound_opened_cb(bool sound_opened);
 
 	protected:
@@ -121,6 +130,8 @@ namespace mprt
 
 		virtual album_art_list const& get_album_art(album_name_t const& album_name) override;
 
+		virtual void verify_library() override;
+
 	};
 }
 
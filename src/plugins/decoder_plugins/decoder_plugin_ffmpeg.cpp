@@ -2,6 +2,8 @@
 #define BOOST_DLL_FORCE_ALIAS_INSTANTIATION
 
 #include <cmath>
+#include <cstring>
+#include <algorithm>
 #include <iostream>
 
 #include <boost/dll/runtime_symbol_info.hpp>
@@ -12,6 +14,7 @@
 #include "common/input_plugin_api.h"
 #include "common/output_plugin_api.h"
 #include "common/scope_exit.h"
+#include "common/replay_gain.h"
 
 #include "core/decoder_plugins_manager.h"
 
@@ -81,6 +84,32 @@ namespace mprt {
 		_ffmpeg_buffer_size = pt.get<size_type>("ffmpeg_buffer_size", 4) * 1024;
 		_ffmpeg_probe_size = pt.get<size_type>("ffmpeg_probe_size", 32) * 1024;
 		_use_seek_file = pt.get<std::string>("use_seek_file", "true") == "true";
+		_use_direct_io = pt.get<std::string>("use_direct_io", "false") == "true";
+		_direct_io_use_mmap = pt.get<std::string>("direct_io_use_mmap", "true") == "true";
+		_direct_io_buffer_size = pt.get<size_type>("direct_io_buffer_size", 256) * 1024;
+		_use_demux_thread = pt.get<std::string>("use_demux_thread", "true") == "true";
+		_demux_queue_packets = pt.get<size_type>("demux_queue_packets", 64);
+		_decode_threads = pt.get<size_type>("decode_threads", 0);
+		_use_probe_cache = pt.get<std::string>("use_probe_cache", "true") == "true";
+		_probe_cache.set_cache_dir(pt.get<std::string>("probe_cache_dir", "../cache/ffmpeg_probe"));
+		_use_duration_resolver = pt.get<std::string>("use_duration_resolver", "true") == "true";
+		_duration_resolver_threads = pt.get<size_type>("duration_resolver_threads", 1);
+		_duration_cache_dir = pt.get<std::string>("duration_cache_dir", "../cache/ffmpeg_duration");
+		_use_frame_index = pt.get<std::string>("use_frame_index", "true") == "true";
+		_frame_index_dir = pt.get<std::string>("frame_index_dir", "../cache/seek_index");
+		_frame_index_preroll_frames = pt.get<size_type>("frame_index_preroll_frames", 3);
+
+		auto thread_type = pt.get<std::string>("decode_thread_type", "frame_slice");
+		_decode_thread_type =
+			thread_type == "frame" ? FF_THREAD_FRAME :
+			thread_type == "slice" ? FF_THREAD_SLICE :
+			FF_THREAD_FRAME | FF_THREAD_SLICE;
+
+		auto resample_mode = pt.get<std::string>("resample_mode", "auto");
+		_resample_mode =
+			resample_mode == "off" ? resample_modes::off :
+			resample_mode == "always" ? resample_modes::always :
+			resample_modes::automatic;
 		_priority = pt.get<size_type>("priority", 1);
 
 		auto file_extensions = pt.get_child("file_extensions");
@@ -95,7 +124,7 @@ namespace mprt {
 				&decoder_plugin_ffmpeg::play_finished_callback<ffmpeg_cache_man_t, finish_flac_dec_func_t>,
 				this,
 				std::ref(_decoders),
-				[](ffmpeg_cache_man_t::cache_item_t /*decoder*/) {}, std::placeholders::_1);
+				[this](ffmpeg_cache_man_t::cache_item_t decoder) { close_ffmpeg_details(decoder.get()); }, std::placeholders::_1);
 
 		std::vector<unsigned char>(static_cast<std::size_t>(_ffmpeg_buffer_size), 0).swap(_ffmpeg_buffer);
 
@@ -128,8 +157,29 @@ namespace mprt {
 		auto ffmpeg_decoder = _decoders.get_from_cache(std::bind(&decoder_plugin_ffmpeg::create_new_ffmpeg_decoder, this), decoder_dets->_sound_details._url_id);
 		decoder_dets->_current_cache_buf = get_cache_put_buf(decoder_dets->_sound_details._url_id);
 		decltype(decoder_dets->_current_cache_buf->get_data_ptr()) data_ptr = nullptr;
+
+		// a recycled decoder may still demux its previous file from the contexts replaced below
+		close_ffmpeg_details(ffmpeg_decoder.get());
+
+		// local files are read by ffmpeg itself, streams go through the input plugin chunks
+		bool direct_io = reads_url_itself(decoder_dets->_url);
+		// an input read in place has no chunk to probe, ffmpeg probes through the io context
+		bool in_place = !direct_io && decoder_dets->_input_view;
+
+		// raw mpeg audio and adts streams have no index of their own to seek with
+		bool frame_indexed = false;
+
+		// only files read directly have a stable identity to key the probe cache on
+		file_identity ident;
+		ffmpeg_probe_cache::probe_info probe_info;
+		bool probe_cached = false;
+		if (direct_io && _use_probe_cache)
+		{
+			ident = file_identity::from_path(decoder_dets->_url);
+			probe_cached = _probe_cache.load(ident, probe_info);
+		}
 		
-		while ((data_ptr = decoder_dets->_current_cache_buf->get_data_ptr()) == nullptr)
+		while (!direct_io && !in_place && (data_ptr = decoder_dets->_current_cache_buf->get_data_ptr()) == nullptr)
 		{
 			std::this_thread::sleep_for(std::chrono::milliseconds(100));
 			BOOST_LOG_TRIVIAL(debug) << "waiting for the data to arrive";
@@ -141,20 +191,27 @@ namespace mprt {
 			{
 				decoder_dets->_sound_details._total_samples = std::numeric_limits<size_type>::max();
 				decoder_dets->_sound_details._current_samples_written_to_sound_buffer = 0;
-				decoder_dets->_sound_details._channels = ffmpeg_decoder->formatContext->streams[ffmpeg_decoder->streamId]->codecpar->channels;
-				decoder_dets->_sound_details._is_float =
-					ffmpeg_decoder->codecContext->sample_fmt == AV_SAMPLE_FMT_FLTP ||
-					ffmpeg_decoder->codecContext->sample_fmt == AV_SAMPLE_FMT_FLT;
-				decoder_dets->_sound_details._bps = decoder_dets->_sound_details._is_float ? 8 * sizeof(float) :
-					ffmpeg_decoder->codecContext->sample_fmt == AV_SAMPLE_FMT_S32 ? 32 : 16;
+				decoder_dets->_sound_details._channels = ffmpeg_decoder->outFormat._channels;
+				decoder_dets->_sound_details._is_float = ffmpeg_decoder->outFormat._sample_fmt == AV_SAMPLE_FMT_FLT;
+				decoder_dets->_sound_details._bps = 8 * av_get_bytes_per_sample(ffmpeg_decoder->outFormat._sample_fmt);
 				decoder_dets->_sound_details._orig_bps = decoder_dets->_sound_details._bps;
-				decoder_dets->_sound_details._sample_rate = ffmpeg_decoder->formatContext->streams[ffmpeg_decoder->streamId]->codecpar->sample_rate;
+				decoder_dets->_sound_details._sample_rate = ffmpeg_decoder->outFormat._sample_rate;
 				decoder_dets->_sound_details._decoder_set_output_buffer_callback = _decoder_plugins_manager->set_output_buf_callback();
 				decoder_dets->_sound_details._decoder_play_finished_callback = _play_finished_callback;
 
 				decoder_dets->_current_samples_written = 0;
 
 				_decoder_plugins_manager->decoder_opened(decoder_dets->_sound_details);
+
+				// the frame scan finds the exact length as well, one pass over the file is enough
+				if (frame_indexed)
+				{
+					build_frame_index(decoder_dets->_url, decoder_dets->_sound_details._url_id, ffmpeg_decoder->codecContext->sample_rate);
+				}
+				else if (direct_io && _use_duration_resolver)
+				{
+					resolve_duration(decoder_dets->_url, decoder_dets->_sound_details._url_id);
+				}
 			}
 			else
 			{
@@ -162,16 +219,26 @@ namespace mprt {
 			}
 		);
 
-		ffmpeg_decoder->ioContext = std::shared_ptr<AVIOContext>(
-			avio_alloc_context(
-				&_ffmpeg_buffer[0],
-				static_cast<int>(_ffmpeg_buffer_size - AV_INPUT_BUFFER_PADDING_SIZE),
-				0,
-				this,
-				read_callback_C,
-				nullptr,
-				seek_callback_C), &av_free);
-
+		if (direct_io)
+		{
+			if (!open_direct_io(ffmpeg_decoder.get(), decoder_dets->_url))
+			{
+				return false;
+			}
+		}
+		else
+		{
+			ffmpeg_decoder->ioContext = std::shared_ptr<AVIOContext>(
+				avio_alloc_context(
+					&_ffmpeg_buffer[0],
+					static_cast<int>(_ffmpeg_buffer_size - AV_INPUT_BUFFER_PADDING_SIZE),
+					0,
+					this,
+					read_callback_C,
+					nullptr,
+					seek_callback_C), &av_free);
+			ffmpeg_decoder->fileIo.reset();
+		}
 
 		if (!ffmpeg_decoder->ioContext)
 		{
@@ -191,20 +258,29 @@ namespace mprt {
 		ffmpeg_decoder->formatContext->pb = ffmpeg_decoder->ioContext.get();
 		ffmpeg_decoder->formatContext->flags |= AVFMT_FLAG_CUSTOM_IO | AVFMT_FLAG_GENPTS | AVFMT_FLAG_DISCARD_CORRUPT;
 
-		AVProbeData probeData = { 0 };
-		probeData.buf = (unsigned char*)(*data_ptr)->second.linearize();
-		probeData.buf_size = std::min(static_cast<int>(_ffmpeg_probe_size), static_cast<int>((*data_ptr)->second.size()));
-		probeData.filename = "";
-
-		ffmpeg_decoder->formatContext->iformat = av_probe_input_format(&probeData, 1);
-		if (!ffmpeg_decoder->formatContext->iformat)
+		// with direct io ffmpeg probes through the io context itself, unless the format is cached
+		if (probe_cached)
 		{
-			BOOST_LOG_TRIVIAL(error) << "ffmpeg plugin cannot init formatContext->iformat";
-			return false;
+			ffmpeg_decoder->formatContext->iformat = av_find_input_format(probe_info._format_name.c_str());
+			probe_cached = ffmpeg_decoder->formatContext->iformat != nullptr;
+		}
+		else if (!direct_io && !in_place)
+		{
+			AVProbeData probeData = { 0 };
+			probeData.buf = (unsigned char*)(*data_ptr)->second.linearize();
+			probeData.buf_size = std::min(static_cast<int>(_ffmpeg_probe_size), static_cast<int>((*data_ptr)->second.size()));
+			probeData.filename = "";
+
+			ffmpeg_decoder->formatContext->iformat = av_probe_input_format(&probeData, 1);
+			if (!ffmpeg_decoder->formatContext->iformat)
+			{
+				BOOST_LOG_TRIVIAL(error) << "ffmpeg plugin cannot init formatContext->iformat";
+				return false;
+			}
 		}
 
 		auto format_ctx_ptr = ffmpeg_decoder->formatContext.get();
-		if ((err = avformat_open_input(std::addressof(format_ctx_ptr), ""/*decoder_dets->_url.c_str()*/, ffmpeg_decoder->formatContext->iformat, nullptr)) < 0)
+		if ((err = avformat_open_input(std::addressof(format_ctx_ptr), direct_io ? decoder_dets->_url.c_str() : "", ffmpeg_decoder->formatContext->iformat, nullptr)) < 0)
 		{
 			BOOST_LOG_TRIVIAL(error) << "ffmpeg plugin avformat_open_input error: " << ffmpeg_strerror(err);
 			return false;
@@ -212,15 +288,26 @@ namespace mprt {
 
 		av_format_inject_global_side_data(ffmpeg_decoder->formatContext.get());
 
-		if (avformat_find_stream_info(ffmpeg_decoder->formatContext.get(), nullptr) < 0)
+		// the cached stream info saves reading and decoding the first packets of the file
+		bool stream_info_cached = probe_cached && ffmpeg_probe_cache::apply(probe_info, ffmpeg_decoder->formatContext.get());
+		if (stream_info_cached)
 		{
-			BOOST_LOG_TRIVIAL(error) << "ffmpeg plugin avformat_find_stream_info error";
-			return false;
+			BOOST_LOG_TRIVIAL(debug) << "ffmpeg probe cache hit: " << decoder_dets->_url;
+
+			ffmpeg_decoder->streamId = probe_info._stream_id;
 		}
+		else
+		{
+			if (avformat_find_stream_info(ffmpeg_decoder->formatContext.get(), nullptr) < 0)
+			{
+				BOOST_LOG_TRIVIAL(error) << "ffmpeg plugin avformat_find_stream_info error";
+				return false;
+			}
 
-		av_dump_format(ffmpeg_decoder->formatContext.get(), 0, "", 0);
-			
-		ffmpeg_decoder->streamId = av_find_best_stream(ffmpeg_decoder->formatContext.get(), AVMEDIA_TYPE_AUDIO, -1, -1, 0, 0);
+			av_dump_format(ffmpeg_decoder->formatContext.get(), 0, "", 0);
+
+			ffmpeg_decoder->streamId = av_find_best_stream(ffmpeg_decoder->formatContext.get(), AVMEDIA_TYPE_AUDIO, -1, -1, 0, 0);
+		}
 
 		//for (unsigned i = 0; i < ffmpeg_decoder->formatContext->nb_streams; i++) {
 		//	if (ffmpeg_decoder->formatContext->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
@@ -261,28 +348,209 @@ namespace mprt {
 			return false;
 		}
 
+		// codecs without frame or slice threading ignore these
+		ffmpeg_decoder->codecContext->thread_count = static_cast<int>(_decode_threads);
+		ffmpeg_decoder->codecContext->thread_type = _decode_thread_type;
+
 		if (avcodec_open2(ffmpeg_decoder->codecContext.get(), pcodec, nullptr) < 0) {
 			BOOST_LOG_TRIVIAL(error) << "ffmpeg plugin cannot avcodec_open2";
 			return false;
 		}
 
-		/*
-		AVDictionaryEntry *tag = NULL;
-		while ((tag = av_dict_get(pffmpeg_decoder->formatContext->metadata, "", tag, AV_DICT_IGNORE_SUFFIX)))
-			printf("%s=%s\n", tag->key, tag->value);
-			*/
+		BOOST_LOG_TRIVIAL(debug) << "ffmpeg codec: " << pcodec->name
+			<< " threads: " << ffmpeg_decoder->codecContext->thread_count
+			<< " active thread type: " << ffmpeg_decoder->codecContext->active_thread_type;
+
+		if (!negotiate_output_format(ffmpeg_decoder.get()))
+		{
+			BOOST_LOG_TRIVIAL(error) << "ffmpeg plugin unsupported sample format: " << ffmpeg_decoder->codecContext->sample_fmt;
+			return false;
+		}
+
+		// id3 txxx, vorbis and opus comments end up in the container or in the stream metadata
+		for (auto metadata : { ffmpeg_decoder->formatContext->metadata, ffmpeg_decoder->formatContext->streams[ffmpeg_decoder->streamId]->metadata })
+		{
+			AVDictionaryEntry *tag = nullptr;
+			while ((tag = av_dict_get(metadata, "", tag, AV_DICT_IGNORE_SUFFIX)))
+			{
+				replay_gain::parse_tag(tag->key, tag->value, decoder_dets->_sound_details._replay_gain);
+			}
+		}
 		auto dur =
 			double(ffmpeg_decoder->formatContext->streams[ffmpeg_decoder->streamId]->duration)
 			* av_q2d(ffmpeg_decoder->formatContext->streams[ffmpeg_decoder->streamId]->time_base);
 		BOOST_LOG_TRIVIAL(debug) << "file duration: " << dur << "(s)";
 
+		// nothing is read from the stream yet, the context still holds what the probing found
+		if (ident._ok && !stream_info_cached &&
+			ffmpeg_probe_cache::capture(ffmpeg_decoder->formatContext.get(), ffmpeg_decoder->streamId, probe_info))
+		{
+			_probe_cache.save(ident, probe_info);
+		}
+
+		ffmpeg_decoder->frameIndex.reset();
+		ffmpeg_decoder->skipSamples = 0;
+
+		auto format_name = std::string(ffmpeg_decoder->formatContext->iformat->name);
+		frame_indexed = direct_io && _use_frame_index && (format_name == "mp3" || format_name == "aac");
+
+		// the demux thread owns the format context from now on, only with direct io
+		// since the chunked input path is driven by the decoder thread
+		if (direct_io && _use_demux_thread)
+		{
+			ffmpeg_decoder->demuxer = std::make_shared<ffmpeg_demuxer>(
+				ffmpeg_decoder->formatContext.get(), ffmpeg_decoder->streamId, static_cast<std::size_t>(_demux_queue_packets));
+			ffmpeg_decoder->demuxer->start();
+		}
+
 		is_ok_cont = true;
 
 		return true;
 	}
 
+	bool decoder_plugin_ffmpeg::open_direct_io(ffmpeg_details * pdecoder, std::string const& filename)
+	{
+		if (_direct_io_use_mmap)
+		{
+			auto file_io = std::make_shared<ffmpeg_file_io>();
+			if (!file_io->open(filename))
+			{
+				return false;
+			}
+
+			pdecoder->fileIo = file_io;
+			pdecoder->ioContext = std::shared_ptr<AVIOContext>(
+				file_io->create_avio_context(static_cast<int>(_direct_io_buffer_size)), &ffmpeg_file_io::free_avio_context);
+		}
+		else
+		{
+			AVIOContext *pio_ctx = nullptr;
+			auto err = avio_open2(&pio_ctx, ("file:" + filename).c_str(), AVIO_FLAG_READ, nullptr, nullptr);
+			if (err < 0)
+			{
+				BOOST_LOG_TRIVIAL(error) << "ffmpeg plugin avio_open2 error: " << ffmpeg_strerror(err) << " file: " << filename;
+				return false;
+			}
+
+			pdecoder->fileIo.reset();
+			pdecoder->ioContext = std::shared_ptr<AVIOContext>(pio_ctx, [](AVIOContext *pio)
+			{
+				avio_closep(&pio);
+			});
+		}
+
+		return static_cast<bool>(pdecoder->ioContext);
+	}
+
+	ffmpeg_duration_resolver & decoder_plugin_ffmpeg::duration_resolver()
+	{
+		if (!_duration_resolver)
+		{
+			_duration_resolver = std::make_unique<ffmpeg_duration_resolver>(
+				static_cast<std::size_t>(_duration_resolver_threads), _duration_cache_dir);
+		}
+
+		return *_duration_resolver;
+	}
+
+	void decoder_plugin_ffmpeg::resolve_duration(std::string const& url, url_id_t url_id)
+	{
+		// until this arrives the length is only known at the end of decoding
+		auto manager = _decoder_plugins_manager;
+		duration_resolver().resolve(url, [manager, url_id](size_type total_samples, size_type sample_rate)
+		{
+			manager->duration_resolved(url_id, total_samples, sample_rate);
+		});
+	}
+
+	void decoder_plugin_ffmpeg::build_frame_index(std::string const& url, url_id_t url_id, size_type sample_rate)
+	{
+		auto manager = _decoder_plugins_manager;
+		auto index_dir = _frame_index_dir;
+
+		duration_resolver().post([this, manager, url, url_id, sample_rate, index_dir]
+		{
+			auto ident = file_identity::from_path(url);
+			if (!ident._ok)
+				return;
+
+			auto index_path = ident.cache_file_path(index_dir, ".mpgidx");
+			auto index = std::make_shared<seek_index>();
+
+			if (!index->load(index_path, ident) || !index->is_complete())
+			{
+				mpeg_frame_scanner::scan_result result;
+				if (!mpeg_frame_scanner::scan(url, *index, result))
+				{
+					BOOST_LOG_TRIVIAL(debug) << "mpeg frame scan found no frames: " << url;
+					return;
+				}
+
+				if (result._sample_rate != sample_rate)
+				{
+					BOOST_LOG_TRIVIAL(debug) << "mpeg frame scan sample rate mismatch: " << url;
+					return;
+				}
+
+				index->save(index_path, ident);
+
+				BOOST_LOG_TRIVIAL(debug) << "mpeg frame index built: " << url << " frames: " << result._frames;
+			}
+
+			manager->duration_resolved(url_id, index->total_samples(), sample_rate);
+
+			manager->add_job([this, url_id, index]
+			{
+				auto pdecoder = _decoders.get_from_cache(url_id);
+				if (pdecoder)
+				{
+					pdecoder->frameIndex = index;
+				}
+			});
+		});
+	}
+
+	bool decoder_plugin_ffmpeg::seek_with_frame_index(ffmpeg_details * pdecoder, size_type duration_ms)
+	{
+		auto index = pdecoder->frameIndex;
+		auto sample_rate = pdecoder->codecContext->sample_rate;
+		if (!index || sample_rate <= 0)
+			return false;
+
+		auto target_sample = av_rescale(duration_ms, sample_rate, 1000);
+		auto const& points = index->points();
+		auto iter = std::upper_bound(points.begin(), points.end(), target_sample,
+			[](size_type sample, seek_index::seek_point const& point) { return sample < point._sample; });
+
+		if (iter == points.begin())
+			return false;
+
+		// start a few frames earlier, layer 3 frames take part of their data from the ones before
+		// (bit reservoir) and aac frames overlap, the decoded pre-roll is dropped
+		auto frame = std::prev(iter);
+		frame -= std::min<std::ptrdiff_t>(static_cast<std::ptrdiff_t>(_frame_index_preroll_frames), std::distance(points.begin(), frame));
+
+		auto result = av_seek_frame(pdecoder->formatContext.get(), pdecoder->streamId, frame->_byte_pos, AVSEEK_FLAG_BYTE);
+		if (result < 0)
+		{
+			BOOST_LOG_TRIVIAL(debug) << "ffmpeg frame index seek error: " << ffmpeg_strerror(result);
+			return false;
+		}
+
+		pdecoder->skipSamples = target_sample - frame->_sample;
+
+		return true;
+	}
+
 	void decoder_plugin_ffmpeg::close_ffmpeg_details(ffmpeg_details* pffmpeg_details)
 	{
+		// an idle cached decoder keeps no thread or queued packets, and the contexts
+		// are only replaced once nothing reads from them any more
+		if (pffmpeg_details->demuxer)
+		{
+			pffmpeg_details->demuxer->stop();
+			pffmpeg_details->demuxer.reset();
+		}
 	}
 
 	std::string decoder_plugin_ffmpeg::ffmpeg_strerror(int errnum)
@@ -297,6 +565,183 @@ namespace mprt {
 
 
 
+	bool decoder_plugin_ffmpeg::negotiate_output_format(ffmpeg_details * pdecoder)
+	{
+		auto codec_ctx = pdecoder->codecContext.get();
+
+		size_type bps = 32;
+		bool is_float = true;
+		bool native_ok = ffmpeg_sample_converter::output_format(codec_ctx->sample_fmt, bps, is_float);
+		if (!native_ok && _resample_mode == resample_modes::off)
+			return false;
+
+		ffmpeg_audio_format native_format;
+		native_format._sample_fmt = ffmpeg_resampler::packed_sample_fmt(bps, is_float);
+		native_format._channels = codec_ctx->channels;
+		native_format._channel_layout = ffmpeg_resampler::channel_layout_or_default(codec_ctx->channel_layout, codec_ctx->channels);
+		native_format._sample_rate = codec_ctx->sample_rate;
+
+		auto out_format = native_format;
+
+		if (_resample_mode != resample_modes::off)
+		{
+			std::vector<output_format_caps> caps_list;
+			for (auto & output_plugin : _output_plugin_list)
+			{
+				caps_list.push_back(output_plugin->format_caps());
+			}
+
+			auto all_accept = [&caps_list](std::function<bool(output_format_caps const&)> pred)
+			{
+				return std::all_of(caps_list.begin(), caps_list.end(), pred);
+			};
+
+			// keep as much precision as the devices allow
+			std::vector<std::pair<size_type, bool>> candidates =
+				is_float ? std::vector<std::pair<size_type, bool>>{ { 32, true }, { 32, false }, { 16, false } } :
+				bps == 32 ? std::vector<std::pair<size_type, bool>>{ { 32, false }, { 32, true }, { 16, false } } :
+				std::vector<std::pair<size_type, bool>>{ { 16, false }, { 32, false }, { 32, true } };
+
+			for (auto const& candidate : candidates)
+			{
+				if (all_accept([&candidate](output_format_caps const& caps) { return caps.accepts_format(candidate.first, candidate.second); }))
+				{
+					out_format._sample_fmt = ffmpeg_resampler::packed_sample_fmt(candidate.first, candidate.second);
+					break;
+				}
+			}
+
+			auto rate_ok = [&all_accept](size_type rate)
+			{
+				return all_accept([rate](output_format_caps const& caps) { return caps.accepts_rate(rate); });
+			};
+
+			if (!rate_ok(native_format._sample_rate))
+			{
+				size_type best_rate = -1;
+				for (size_type rate : { 44100, 48000, 88200, 96000, 176400, 192000, 32000, 22050 })
+				{
+					if (rate_ok(rate) && (best_rate < 0 || std::abs(rate - native_format._sample_rate) < std::abs(best_rate - native_format._sample_rate)))
+					{
+						best_rate = rate;
+					}
+				}
+
+				if (best_rate > 0)
+				{
+					out_format._sample_rate = static_cast<int>(best_rate);
+				}
+			}
+
+			size_type min_channels = 1, max_channels = std::numeric_limits<size_type>::max();
+			for (auto const& caps : caps_list)
+			{
+				if (caps._valid)
+				{
+					min_channels = std::max(min_channels, caps._min_channels);
+					max_channels = std::min(max_channels, caps._max_channels);
+				}
+			}
+
+			if (min_channels <= max_channels && (native_format._channels < min_channels || native_format._channels > max_channels))
+			{
+				out_format._channels = static_cast<int>(bound_val(min_channels, static_cast<size_type>(native_format._channels), max_channels));
+				out_format._channel_layout = ffmpeg_resampler::channel_layout_or_default(0, out_format._channels);
+			}
+
+			// converting into the format the devices are open with is cheaper than setting them up again
+			auto const& open_caps = caps_list.empty() ? output_format_caps() : caps_list.front();
+			bool keep_open = !caps_list.empty() &&
+				all_accept([&](output_format_caps const& caps)
+				{
+					return
+						caps.prefers_open_format(bps, is_float, native_format._sample_rate, native_format._channels) &&
+						caps._open_bps == open_caps._open_bps && caps._open_is_float == open_caps._open_is_float &&
+						caps._open_rate == open_caps._open_rate && caps._open_channels == open_caps._open_channels;
+				});
+
+			if (keep_open)
+			{
+				BOOST_LOG_TRIVIAL(debug) << "ffmpeg keeps the open output format, bps: " << open_caps._open_bps
+					<< " float: " << open_caps._open_is_float << " rate: " << open_caps._open_rate << " channels: " << open_caps._open_channels;
+
+				out_format._sample_fmt = ffmpeg_resampler::packed_sample_fmt(open_caps._open_bps, open_caps._open_is_float);
+				out_format._sample_rate = static_cast<int>(open_caps._open_rate);
+				if (out_format._channels != open_caps._open_channels)
+				{
+					out_format._channels = static_cast<int>(open_caps._open_channels);
+					out_format._channel_layout = ffmpeg_resampler::channel_layout_or_default(0, out_format._channels);
+				}
+			}
+		}
+
+		pdecoder->outFormat = out_format;
+		pdecoder->useResampler =
+			_resample_mode == resample_modes::always ||
+			(_resample_mode == resample_modes::automatic && (!native_ok || out_format != native_format));
+
+		return true;
+	}
+
+	template <typename Func>
+	void decoder_plugin_ffmpeg::write_to_outputs(size_type max_bytes, Func write_func)
+	{
+		auto & cur_dec_det = _decoder_plugins_manager->get_current_decoder_details_ref();
+		auto one_sample_to_byte = samples_to_bytes(1, cur_dec_det->_sound_details);
+
+		if (max_bytes <= 0 || cur_dec_det->_output_buf_list.empty())
+		{
+			return;
+		}
+
+		_output_chunks.clear();
+		for (auto decoder_output_buffer : cur_dec_det->_output_buf_list) {
+
+			decltype(decoder_output_buffer->get_cache_ptr()) free_chunk_buffer;
+			while (!(free_chunk_buffer = decoder_output_buffer->get_cache_ptr()))
+			{
+				BOOST_LOG_TRIVIAL(debug) << "waiting cache";
+				std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+			}
+			//BOOST_LOG_TRIVIAL(debug) << "cont cache";
+
+			auto & chunk = (*free_chunk_buffer)->second;
+			auto need_free_bytes = max_bytes - static_cast<size_type>(chunk.reserve());
+			if (need_free_bytes > 0) {
+				chunk.set_capacity(chunk.capacity() + static_cast<std::size_t>(need_free_bytes));
+				// BOOST_LOG_TRIVIAL(debug) << "enlarging buffer with: " << need_free_bytes;
+			}
+
+			chunk.resize(chunk.size() + static_cast<std::size_t>(max_bytes));
+			_output_chunks.push_back(*free_chunk_buffer);
+		}
+
+		// convert once straight into the first chunk, the other outputs get a copy
+		auto & first_chunk = _output_chunks.front()->second;
+		auto first_pos = first_chunk.size() - static_cast<std::size_t>(max_bytes);
+		auto written_bytes = std::max<size_type>(write_func(first_chunk.linearize() + first_pos), 0);
+		first_chunk.resize(first_pos + static_cast<std::size_t>(written_bytes));
+
+		for (std::size_t i = 1; i < _output_chunks.size(); ++i)
+		{
+			auto & chunk = _output_chunks[i]->second;
+			auto pos = chunk.size() - static_cast<std::size_t>(max_bytes);
+			std::memcpy(chunk.linearize() + pos, first_chunk.linearize() + first_pos, static_cast<std::size_t>(written_bytes));
+			chunk.resize(pos + static_cast<std::size_t>(written_bytes));
+		}
+
+		cur_dec_det->_current_samples_written += written_bytes / one_sample_to_byte;
+
+		std::size_t chunk_index = 0;
+		for (auto decoder_output_buffer : cur_dec_det->_output_buf_list) {
+			decoder_output_buffer->put_cache_ptr(
+				// is this the very very last data
+				(cur_dec_det->_current_samples_written == cur_dec_det->_sound_details._total_samples) ||
+				_output_chunks[chunk_index++]->second.reserve() < one_sample_to_byte
+			);
+		}
+	}
+
 	void decoder_plugin_ffmpeg::decode_new()
 	{
 		auto & cur_dec_det = _decoder_plugins_manager->get_current_decoder_details_ref();
@@ -308,6 +753,8 @@ namespace mprt {
 			BOOST_LOG_TRIVIAL(error) << "Error submitting the packet to the decoder: " << ffmpeg_strerror(ret);
 		}
 
+		auto one_sample_to_byte = samples_to_bytes(1, cur_dec_det->_sound_details);
+
 		while ((ret = avcodec_receive_frame(pdecoder->codecContext.get(), _decoded_frame.get())) != AVERROR_EOF) {
 			//BOOST_LOG_TRIVIAL(debug) << "received frame";
 			if (ret == AVERROR(EAGAIN))
@@ -322,72 +769,63 @@ namespace mprt {
 				return;
 			}
 
-			int samples = _decoded_frame->nb_samples;
-			int channels = pdecoder->codecContext->channels;
-
-			auto one_sample_to_byte = samples_to_bytes(1, cur_dec_det->_sound_details);
-			auto total_bytes_to_write = one_sample_to_byte * samples;
-			auto sample_width = av_get_bytes_per_sample(pdecoder->codecContext->sample_fmt);
-			cur_dec_det->_current_samples_written += samples;
-			for (auto decoder_output_buffer : cur_dec_det->_output_buf_list) {
+			// pre-roll of an exact seek
+			if (pdecoder->skipSamples > 0)
+			{
+				auto drop = std::min<size_type>(pdecoder->skipSamples, _decoded_frame->nb_samples);
+				pdecoder->skipSamples -= drop;
 
-				decltype(decoder_output_buffer->get_cache_ptr()) free_chunk_buffer;
-				while (!(free_chunk_buffer = decoder_output_buffer->get_cache_ptr()))
+				if (drop == _decoded_frame->nb_samples)
 				{
-					BOOST_LOG_TRIVIAL(debug) << "waiting cache";
-					std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+					continue;
 				}
-				//BOOST_LOG_TRIVIAL(debug) << "cont cache";
 
+				ffmpeg_sample_converter::drop_leading_samples(_decoded_frame.get(), static_cast<int>(drop));
+			}
 
-				auto need_free_bytes = total_bytes_to_write - static_cast<size_type>((*free_chunk_buffer)->second.reserve());
-				if (need_free_bytes > 0) {
-					(*free_chunk_buffer)->second.set_capacity((*free_chunk_buffer)->second.capacity() + static_cast<std::size_t>(need_free_bytes));
-					// BOOST_LOG_TRIVIAL(debug) << "enlarging buffer with: " << need_free_bytes;
-				}
-				bool is_planar = av_sample_fmt_is_planar(pdecoder->codecContext->sample_fmt);
-				if (is_planar) {
-					for (int i = 0; i < samples; i += 1) {
-						for (int channel = 0; channel < cur_dec_det->_sound_details._channels; channel += 1)
-						{
-							float_int32_bytes samplex;
-							for (int j = 0; j != sample_width; ++j)
-							{
-								samplex.bytes[j] = *(_decoded_frame->extended_data[channel] + i * sample_width + j);
-							}
-							//_sound_details._is_float ? 
-							//	samplex.fval = *(float*)(_decodedFrame->extended_data[ch] + i * sample_width) : 
-							//	samplex.ival = *(int32_t*)(_decodedFrame->extended_data[ch] + i * sample_width);
-							//(this->*push_call)((*free_chunk_buffer), samplex);
-							push_func_call(*free_chunk_buffer, samplex, sample_width);
-						}
-					}
-				}
-				else
+			if (pdecoder->useResampler)
+			{
+				if (!_resampler.configure(ffmpeg_resampler::frame_format(_decoded_frame.get()), pdecoder->outFormat))
 				{
-					//(*free_chunk_buffer)->second.resize((*free_chunk_buffer)->second.size() + static_cast<std::size_t>(total_bytes_to_write));
-					//std::memcpy((*free_chunk_buffer)->second.linearize(), _decodedFrame->extended_data[0], static_cast<std::size_t>(total_bytes_to_write));
-
-					for (int i = 0; i != samples; ++i) {
-						for (int channel = 0; channel != cur_dec_det->_sound_details._channels; ++channel) {
-							float_int32_bytes samplex;
-							for (int j = 0; j != sample_width; ++j)
-							{
-								samplex.bytes[j] = *(_decoded_frame->extended_data[0] + (2 * i + channel) * sample_width + j);
-							}
-							//samplex.ival = *(uint32_t*)(_decodedFrame->extended_data[0] + (2 * i + channel) * sample_width);
-							//samplex.fval = *(float*)(_decodedFrame->extended_data[0] + (2 * i + channel) * sample_width);
-							push_func_call(*free_chunk_buffer, samplex, sample_width);
-						}
-					}
+					continue;
 				}
 
-				decoder_output_buffer->put_cache_ptr(
-					// is this the very very last data
-					(cur_dec_det->_current_samples_written == cur_dec_det->_sound_details._total_samples) ||
-					(*free_chunk_buffer)->second.reserve() < one_sample_to_byte
-				);
+				auto max_samples = _resampler.max_out_samples(_decoded_frame->nb_samples);
+				write_to_outputs(max_samples * one_sample_to_byte, [this, max_samples, one_sample_to_byte](buffer_elem_t *out)
+				{
+					return _resampler.convert(_decoded_frame.get(), out, max_samples) * one_sample_to_byte;
+				});
+
+				continue;
 			}
+
+			// the codec context only gives the format it started with
+			auto sample_fmt = static_cast<AVSampleFormat>(_decoded_frame->format);
+			auto channels = cur_dec_det->_sound_details._channels;
+			if (_decoded_frame->channels != channels)
+			{
+				BOOST_LOG_TRIVIAL(error) << "ffmpeg frame channel count changed: " << _decoded_frame->channels << " expected: " << channels;
+				continue;
+			}
+
+			write_to_outputs(one_sample_to_byte * _decoded_frame->nb_samples, [this, sample_fmt, channels](buffer_elem_t *out)
+			{
+				// convert straight into the chunk memory
+				return _sample_converter.convert(_decoded_frame.get(), sample_fmt, channels, out);
+			});
+		}
+
+		// the codec is drained, push the samples the resampler still keeps
+		if (pdecoder->useResampler && _resampler.is_configured())
+		{
+			auto max_samples = _resampler.max_out_samples(0);
+			write_to_outputs(max_samples * one_sample_to_byte, [this, max_samples, one_sample_to_byte](buffer_elem_t *out)
+			{
+				return _resampler.convert(nullptr, out, max_samples) * one_sample_to_byte;
+			});
+
+			// the next track must not start with the delay and filter state of this one
+			_resampler.reset();
 		}
 	}
 
@@ -401,7 +839,9 @@ namespace mprt {
 			return;
 		}
 
-		int retx = av_read_frame(pdecoder->formatContext.get(), &_packet);
+		int retx = pdecoder->demuxer ?
+			pdecoder->demuxer->read_packet(&_packet) :
+			av_read_frame(pdecoder->formatContext.get(), &_packet);
 		if (AVERROR_EOF == retx) {
 			BOOST_LOG_TRIVIAL(debug) << "finish read ...";
 			_packet.buf = nullptr;
@@ -486,6 +926,11 @@ namespace mprt {
 		return _decoder_plugins_manager->seek_byte_internal(cur_det->_sound_details._url_id, absolute_pos) ? absolute_pos : -1;
 	}
 
+	bool decoder_plugin_ffmpeg::reads_url_itself(std::string const& url)
+	{
+		return _use_direct_io && ffmpeg_file_io::is_local_file(url);
+	}
+
 	void decoder_plugin_ffmpeg::seek_duration(size_type duration_ms)
 	{
 		auto & cur_dec_det = _decoder_plugins_manager->get_current_decoder_details_ref();
@@ -509,6 +954,13 @@ namespace mprt {
 			double(pdecoder->formatContext->streams[pdecoder->streamId]->duration)
 			* av_q2d(pdecoder->formatContext->streams[pdecoder->streamId]->time_base) * 1000;
 
+		// raw mpeg audio often has no stream duration, the complete frame index knows it
+		auto const& frame_index = pdecoder->frameIndex;
+		if (frame_index && frame_index->is_complete() && pdecoder->codecContext->sample_rate > 0)
+		{
+			file_duration_ms = double(frame_index->total_samples()) * 1000 / pdecoder->codecContext->sample_rate;
+		}
+
 		if (duration_ms > 0 && double(duration_ms) < file_duration_ms)
 		{
 			/*
@@ -524,13 +976,20 @@ namespace mprt {
 		int ret = av_seek_frame(m_pFormatContext, seekStreamIndex, seekTime, flags);
 		if (ret < 0)
 			ret = av_seek_frame(m_pFormatContext, seekStreamIndex, seekTime, AVSEEK_FLAG_ANY);*/
+			if (pdecoder->demuxer)
+			{
+				pdecoder->demuxer->stop();
+			}
+
 			AVRational scale_ms;
 			scale_ms.den = 1000;
 			scale_ms.num = 1;
 			auto seek_time = av_rescale_q(duration_ms, scale_ms, pdecoder->formatContext->streams[pdecoder->streamId]->time_base);
 			auto file_duration_ffmpeg_time_base = std::llround(file_duration_ms);
 			//auto request_timestamp = std::llround(double(duration_ms) / 1000);
-			auto result =
+			pdecoder->skipSamples = 0;
+
+			auto result = seek_with_frame_index(pdecoder, duration_ms) ? 0 :
 				_use_seek_file ?
 				avformat_seek_file(pdecoder->formatContext.get(),
 					pdecoder->streamId,	0, seek_time, pdecoder->formatContext->streams[pdecoder->streamId]->duration, AVSEEK_FLAG_ANY)
@@ -541,6 +1000,16 @@ namespace mprt {
 				BOOST_LOG_TRIVIAL(debug) << "ffmpeg seek error: " << ffmpeg_strerror(result);
 			}
 			avcodec_flush_buffers(pdecoder->codecContext.get());
+
+			if (pdecoder->useResampler)
+			{
+				_resampler.reset();
+			}
+
+			if (pdecoder->demuxer)
+			{
+				pdecoder->demuxer->start();
+			}
 		}
 
 	}
@@ -12,6 +12,14 @@
 #include "common/type_defs.h"
 #include "common/cache_manage.h"
 
+#include "ffmpeg_sample_convert.h"
+#include "ffmpeg_resampler.h"
+#include "ffmpeg_file_io.h"
+#include "ffmpeg_demuxer.h"
+#include "ffmpeg_probe_cache.h"
+#include "ffmpeg_duration_resolver.h"
+#include "mpeg_frame_scanner.h"
+
 extern "C" {
 #include <libavformat/avio.h>
 #include <libavformat/avformat.h>
@@ -23,16 +31,28 @@ namespace mprt {
 
 	struct ffmpeg_details
 	{
+		// direct io only, declared first so that it outlives the io context
+		std::shared_ptr<ffmpeg_file_io> fileIo;
 		std::shared_ptr<AVIOContext> ioContext;
 		std::shared_ptr<AVFormatContext> formatContext;
 		std::shared_ptr<AVCodecContext> codecContext;
 		int streamId;
+		bool useResampler;
+		ffmpeg_audio_format outFormat;
+		// frame starts of mpeg audio and adts files, set when the background scan is done
+		std::shared_ptr<seek_index const> frameIndex;
+		// decoded samples still to drop after an exact seek
+		size_type skipSamples;
+		// declared last so that it stops before the contexts go away
+		std::shared_ptr<ffmpeg_demuxer> demuxer;
 		
 		ffmpeg_details()
 			: ioContext(nullptr)
 			, formatContext(nullptr)
 			, codecContext(nullptr)
 			, streamId(-1)
+			, useResampler(false)
+			, skipSamples(0)
 		{}
 	};
 
@@ -48,6 +68,29 @@ namespace mprt {
 		size_type _ffmpeg_probe_size;
 		std::vector<unsigned char> _ffmpeg_buffer;
 		bool _use_seek_file;
+		bool _use_direct_io;
+		bool _direct_io_use_mmap;
+		size_type _direct_io_buffer_size;
+		bool _use_demux_thread;
+		size_type _demux_queue_packets;
+		size_type _decode_threads; // 0: as many as the cores
+		int _decode_thread_type;
+		bool _use_probe_cache;
+		ffmpeg_probe_cache _probe_cache;
+		bool _use_duration_resolver;
+		size_type _duration_resolver_threads;
+		std::string _duration_cache_dir;
+		std::unique_ptr<ffmpeg_duration_resolver> _duration_resolver;
+		bool _use_frame_index;
+		std::string _frame_index_dir;
+		size_type _frame_index_preroll_frames;
+		ffmpeg_sample_converter _sample_converter;
+
+		// off: never, automatic: when the outputs cannot take the decoded format, always: every stream
+		enum class resample_modes { off, automatic, always };
+		resample_modes _resample_mode;
+		ffmpeg_resampler _resampler;
+		std::vector<shared_chunk_buffer_t> _output_chunks;
 
 		ffmpeg_cache_man_t _decoders;
 
@@ -59,9 +102,17 @@ namespace mprt {
 
 		void init_decode_internal_single(url_id_t url_id) override;
 
+		bool open_direct_io(ffmpeg_details * pdecoder, std::string const& filename);
+		ffmpeg_duration_resolver & duration_resolver();
+		void resolve_duration(std::string const& url, url_id_t url_id);
+		void build_frame_index(std::string const& url, url_id_t url_id, size_type sample_rate);
+		bool seek_with_frame_index(ffmpeg_details * pdecoder, size_type duration_ms);
 		void close_ffmpeg_details(ffmpeg_details *pffmpeg_details);
 
 		std::string ffmpeg_strerror(int errnum);
+		bool negotiate_output_format(ffmpeg_details * pdecoder);
+		template <typename Func>
+		void write_to_outputs(size_type max_bytes, Func write_func);
 		void decode_new();
 
 
@@ -84,6 +135,7 @@ namespace mprt {
 		size_type seek_callback(void* opaque, size_type offset, int whence);
 
 		virtual void seek_duration(size_type duration_ms) override;
+		virtual bool reads_url_itself(std::string const& url) override;
 
 	};
 
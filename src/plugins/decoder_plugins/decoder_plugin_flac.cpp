@@ -11,6 +11,7 @@
 #include "common/input_plugin_api.h"
 #include "common/output_plugin_api.h"
 #include "common/enum_cast.h"
+#include "common/replay_gain.h"
 
 #include "decoder_plugin_flac.h"
 
@@ -94,7 +95,11 @@ namespace mprt {
 	decoder_plugin_flac::decoder_plugin_flac()
 		//: _decoder(nullptr)
 		//: _init_flac(false)
-		: _decoders(3)
+		: _check_md5(false)
+		, _use_seek_index(false)
+		, _seek_index_interval_ms(500)
+		, _seek_index_max_gap_ms(5000)
+		, _decoders(3)
 		, _finish_flac_dec_func(std::bind(&decoder_plugin_flac::finish_flac_decoder, this, std::placeholders::_1))
 	{
 	
@@ -127,6 +132,16 @@ namespace mprt {
 		_max_memory_size_per_file = pt.get<size_type>("max_memory_size_per_file", 16384) * 1024;
 		_priority = pt.get<size_type>("priority", 100);
 
+		_use_seek_index = (pt.get<std::string>("use_seek_index", "false") == "true");
+		_seek_index_dir = pt.get<std::string>("seek_index_dir", "../cache/seek_index");
+		_seek_index_interval_ms = pt.get<size_type>("seek_index_interval_msecs", 500);
+		_seek_index_max_gap_ms = pt.get<size_type>("seek_index_max_gap_msecs", 5000);
+
+		_md5_verify_threads = pt.get<std::size_t>("md5_verify_threads", 1);
+		_md5_verify_max_bytes_per_sec = pt.get<size_type>("md5_verify_max_kbytes_per_sec", 8192) * 1024;
+		_md5_verify_results_file = pt.get<std::string>("md5_verify_results_file", "../cache/flac_md5_results.xml");
+		_md5_verify_recheck_days = pt.get<size_type>("md5_verify_recheck_days", 90);
+
 		auto file_extensions = pt.get_child("file_extensions");
 		for (auto & file_extension : file_extensions)
 		{
@@ -134,6 +149,12 @@ namespace mprt {
 				std::regex_constants::ECMAScript | std::regex_constants::icase));
 		}
 
+		auto library_dir = pt.get<std::string>("md5_verify_library_dir", "");
+		if (!library_dir.empty())
+		{
+			md5_verifier().verify_directory(library_dir, _supported_extensions);
+		}
+
 		_play_finished_callback =
 			std::bind(
 				&decoder_plugin_flac::play_finished_callback<flac_cache_man_t, finish_flac_dec_func_t>,
@@ -157,12 +178,32 @@ namespace mprt {
 			return;
 		}
 
+		auto seek_dets = get_seek_details(pdecoder);
+		if (seek_dets)
+		{
+			seek_dets->_next_frame_sample = -1;
+		}
+
 		FLAC__stream_decoder_process_single(pdecoder);
 
+		// the decode position cannot be asked in the write callback, so the frame boundary is recorded here
+		FLAC__uint64 decode_pos;
+		if (seek_dets && seek_dets->_next_frame_sample >= 0 &&
+			FLAC__stream_decoder_get_decode_position(pdecoder, &decode_pos))
+		{
+			seek_dets->_index.add_point(seek_dets->_next_frame_sample, static_cast<size_type>(decode_pos));
+		}
+
 		auto decoder_state = FLAC__stream_decoder_get_state(pdecoder);
 		if ((decoder_state == FLAC__STREAM_DECODER_END_OF_STREAM ||
 			decoder_state == FLAC__STREAM_DECODER_ABORTED)) {
 
+			if (seek_dets && decoder_state == FLAC__STREAM_DECODER_END_OF_STREAM)
+			{
+				seek_dets->_index.set_complete(cur_det->_sound_details._total_samples);
+				save_seek_index(pdecoder);
+			}
+
 			_decoder_plugins_manager->finish_decode_internal_single(cur_det->_sound_details._url_id);
 		}
 
@@ -177,6 +218,10 @@ namespace mprt {
 
 		auto pdecoder = _decoders.get_from_cache(decoder_dets->_sound_details._url_id).get();
 
+		if (seek_with_index(pdecoder, decoder_dets, static_cast<size_type>(sample_to_seek))) {
+			return;
+		}
+
 		if (FLAC__stream_decoder_seek_absolute(pdecoder, sample_to_seek)) {
 			return;
 		}
@@ -196,6 +241,25 @@ namespace mprt {
 		}
 	}
 
+	void decoder_plugin_flac::verify_integrity(std::shared_ptr<std::vector<std::string>> urls)
+	{
+		md5_verifier().verify(*urls);
+	}
+
+	flac_md5_verifier & decoder_plugin_flac::md5_verifier()
+	{
+		if (!_md5_verifier)
+		{
+			_md5_verifier = std::make_unique<flac_md5_verifier>(
+				_md5_verify_threads,
+				_md5_verify_max_bytes_per_sec,
+				_md5_verify_results_file,
+				_md5_verify_recheck_days);
+		}
+
+		return *_md5_verifier;
+	}
+
 	decoder_plugin_flac::flac_cache_man_t::cache_item_t decoder_plugin_flac::create_new_flac_decoder()
 	{
 		return std::shared_ptr<FLAC__StreamDecoder>(
@@ -209,6 +273,9 @@ namespace mprt {
 
 	void decoder_plugin_flac::finish_flac_decoder(decoder_plugin_flac::flac_cache_man_t::cache_item_t decoder)
 	{
+		save_seek_index(decoder.get());
+		_seek_details.erase(decoder.get());
+
 		if (!FLAC__stream_decoder_finish(decoder.get())) {
 			BOOST_LOG_TRIVIAL(error) << "FLAC finish decoder error";
 		}
@@ -239,16 +306,103 @@ namespace mprt {
 		FLAC__stream_decoder_set_metadata_ignore_all(pflac_decoder);
 		FLAC__stream_decoder_set_metadata_respond(pflac_decoder,
 			FLAC__METADATA_TYPE_STREAMINFO);
+		FLAC__stream_decoder_set_metadata_respond(pflac_decoder,
+			FLAC__METADATA_TYPE_VORBIS_COMMENT);
 
 		auto result = FLAC__stream_decoder_process_until_end_of_metadata(pflac_decoder);
 		if (!result) {
 			BOOST_LOG_TRIVIAL(debug) <<
 				"metadata error: " << FLAC__StreamDecoderStateString[FLAC__stream_decoder_get_state(pflac_decoder)];
 		}
+		else
+		{
+			init_seek_index(pflac_decoder, decoder_dets);
+		}
+
+		// the comments come after the stream info, the output gets both
+		if (decoder_dets->_sound_details._ok && decoder_dets->_sound_details._sample_rate > 0)
+		{
+			_decoder_plugins_manager->decoder_opened(decoder_dets->_sound_details);
+		}
 
 		return result;
 	}
 
+	std::shared_ptr<decoder_plugin_flac::flac_seek_details> decoder_plugin_flac::get_seek_details(FLAC__StreamDecoder *pdecoder)
+	{
+		auto iter = _seek_details.find(pdecoder);
+
+		return iter == _seek_details.end() ? std::shared_ptr<flac_seek_details>() : iter->second;
+	}
+
+	void decoder_plugin_flac::init_seek_index(FLAC__StreamDecoder *pdecoder, std::shared_ptr<current_decoder_details> const& decoder_dets)
+	{
+		_seek_details.erase(pdecoder);
+
+		if (!_use_seek_index || decoder_dets->_sound_details._sample_rate <= 0)
+			return;
+
+		// only local files have a stable identity to key the index on
+		auto ident = file_identity::from_path(decoder_dets->_url);
+		if (!ident._ok)
+			return;
+
+		auto seek_dets = std::make_shared<flac_seek_details>();
+		seek_dets->_ident = ident;
+		seek_dets->_index.set_min_sample_distance(decoder_dets->_sound_details._sample_rate * _seek_index_interval_ms / 1000);
+
+		if (seek_dets->_index.load(ident.cache_file_path(_seek_index_dir, ".flacidx"), ident))
+		{
+			BOOST_LOG_TRIVIAL(debug) << "flac seek index loaded, points: " << seek_dets->_index.size()
+				<< " complete: " << seek_dets->_index.is_complete();
+		}
+
+		_seek_details[pdecoder] = seek_dets;
+	}
+
+	void decoder_plugin_flac::save_seek_index(FLAC__StreamDecoder *pdecoder)
+	{
+		auto seek_dets = get_seek_details(pdecoder);
+
+		if (seek_dets && seek_dets->_index.is_dirty())
+		{
+			seek_dets->_index.save(seek_dets->_ident.cache_file_path(_seek_index_dir, ".flacidx"), seek_dets->_ident);
+		}
+	}
+
+	bool decoder_plugin_flac::seek_with_index(FLAC__StreamDecoder *pdecoder, std::shared_ptr<current_decoder_details> const& decoder_dets, size_type sample_to_seek)
+	{
+		// libflac disables md5 checking on its own seeks only, a flush + jump would fail the md5 at the end
+		if (_check_md5 || !decoder_dets->_seek_supported)
+			return false;
+
+		auto seek_dets = get_seek_details(pdecoder);
+		if (!seek_dets)
+			return false;
+
+		seek_dets->_skip_to_sample = -1;
+
+		auto max_gap = decoder_dets->_sound_details._sample_rate * _seek_index_max_gap_ms / 1000;
+		seek_index::seek_point point;
+		if (!seek_dets->_index.covers(sample_to_seek, max_gap) || !seek_dets->_index.find_point(sample_to_seek, point))
+			return false;
+
+		if (!FLAC__stream_decoder_flush(pdecoder))
+			return false;
+
+		// single jump in the input, the decoder syncs on the indexed frame and
+		// the samples up to the target are dropped in the write callback
+		if (!_decoder_plugins_manager->seek_byte_internal(decoder_dets->_sound_details._url_id, point._byte_pos))
+			return false;
+
+		seek_dets->_skip_to_sample = sample_to_seek;
+
+		BOOST_LOG_TRIVIAL(debug) << "flac index seek, sample: " << sample_to_seek
+			<< " frame sample: " << point._sample << " byte: " << point._byte_pos;
+
+		return true;
+	}
+
 	void decoder_plugin_flac::seek_internal(size_type msecs)
 	{
 		auto & decoder_dets = _decoder_plugins_manager->get_current_decoder_details_ref();
@@ -363,17 +517,37 @@ namespace mprt {
 
 	// producer of the flac to pcm
 	FLAC__StreamDecoderWriteStatus decoder_plugin_flac::write_callback(
-		const FLAC__StreamDecoder * /*decoder*/,
+		const FLAC__StreamDecoder *decoder,
 		const FLAC__Frame *frame,
 		const FLAC__int32 * const buffer[],
 		void * /*client_data*/)
 	{
 		//std::cout << "w" << std::flush;
 		auto & cur_dec_det = _decoder_plugins_manager->get_current_decoder_details_ref();
+
+		size_type first_sample = 0;
+		auto seek_dets = get_seek_details(const_cast<FLAC__StreamDecoder *>(decoder));
+		if (seek_dets && frame->header.number_type == FLAC__FRAME_NUMBER_TYPE_SAMPLE_NUMBER)
+		{
+			auto frame_sample = static_cast<size_type>(frame->header.number.sample_number);
+			seek_dets->_next_frame_sample = frame_sample + frame->header.blocksize;
+
+			if (seek_dets->_skip_to_sample >= 0)
+			{
+				first_sample = std::min<size_type>(std::max<size_type>(seek_dets->_skip_to_sample - frame_sample, 0), frame->header.blocksize);
+				if (seek_dets->_skip_to_sample < seek_dets->_next_frame_sample)
+					seek_dets->_skip_to_sample = -1;
+			}
+
+			if (first_sample == frame->header.blocksize)
+				return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+		}
+
+		auto frame_samples = frame->header.blocksize - first_sample;
 		
 		/* write decoded PCM samples */
 		auto one_sample_to_byte = samples_to_bytes(1, cur_dec_det->_sound_details);
-		auto total_bytes_to_write = one_sample_to_byte * frame->header.blocksize;
+		auto total_bytes_to_write = one_sample_to_byte * frame_samples;
 		using pf = void (decoder_plugin_flac::*)(shared_chunk_buffer_t & /*buf*/, float_int32_bytes /*sample*/, std::size_t /*sample_width*/);
 		pf push_call;
 		std::size_t sample_width;
@@ -403,8 +577,8 @@ namespace mprt {
 				(*free_chunk_buffer)->second.set_capacity((*free_chunk_buffer)->second.capacity() + static_cast<std::size_t>(need_free_bytes));
 				// BOOST_LOG_TRIVIAL(debug) << "enlarging buffer with: " << need_free_bytes;
 			}
-			cur_dec_det->_current_samples_written += frame->header.blocksize;
-			for (int i = 0; i != frame->header.blocksize; ++i) {
+			cur_dec_det->_current_samples_written += frame_samples;
+			for (auto i = first_sample; i != frame->header.blocksize; ++i) {
 				for (int channel = 0; channel != cur_dec_det->_sound_details._channels; ++channel) {
 					float_int32_bytes data;
 					data.ival = buffer[channel][i];
@@ -460,9 +634,18 @@ namespace mprt {
 				" sample rate: " << current_decoder_dets->_sound_details._sample_rate <<
 				" channels: " << current_decoder_dets->_sound_details._channels <<
 				" bps: " << current_decoder_dets->_sound_details._orig_bps;
-
-
-			_decoder_plugins_manager->decoder_opened(current_decoder_dets->_sound_details);
+		}
+		else if (metadata->type == FLAC__METADATA_TYPE_VORBIS_COMMENT) {
+			auto & current_decoder_dets = _decoder_plugins_manager->get_current_decoder_details_ref();
+			auto const& comments = metadata->data.vorbis_comment;
+			for (FLAC__uint32 i = 0; i != comments.num_comments; ++i) {
+				// NAME=value, not null terminated
+				std::string comment(reinterpret_cast<char const*>(comments.comments[i].entry), comments.comments[i].length);
+				auto eq = comment.find('=');
+				if (eq != std::string::npos) {
+					replay_gain::parse_tag(comment.substr(0, eq), comment.substr(eq + 1), current_decoder_dets->_sound_details._replay_gain);
+				}
+			}
 		}
 	}
 
@@ -2,6 +2,7 @@
 #define BOOST_DLL_FORCE_ALIAS_INSTANTIATION
 
 #include <thread>
+#include <unordered_map>
 
 #include <boost/filesystem/path.hpp>
 #include <boost/circular_buffer_fwd.hpp>
@@ -15,6 +16,10 @@ extern "C"
 #include "common/producerconsumerqueue.h"
 #include "common/type_defs.h"
 #include "common/cache_manage.h"
+#include "common/file_identity.h"
+#include "common/seek_index.h"
+
+#include "flac_md5_verifier.h"
 
 namespace mprt {
 
@@ -22,15 +27,48 @@ namespace mprt {
 	private:
 		using flac_cache_man_t = cache_manage<std::shared_ptr<FLAC__StreamDecoder>>;
 		using finish_flac_dec_func_t = std::function<void (flac_cache_man_t::cache_item_t decoder)>;
+
+		struct flac_seek_details
+		{
+			file_identity _ident;
+			seek_index _index;
+			size_type _next_frame_sample; // first sample of the frame after the last decoded one
+			size_type _skip_to_sample; // after an index seek, drop the samples before this
+
+			flac_seek_details()
+				: _next_frame_sample(-1)
+				, _skip_to_sample(-1)
+			{}
+		};
+		using flac_seek_details_list_t = std::unordered_map<FLAC__StreamDecoder*, std::shared_ptr<flac_seek_details>>;
+
 		bool _check_md5;
+		bool _use_seek_index;
+		boost::filesystem::path _seek_index_dir;
+		size_type _seek_index_interval_ms;
+		size_type _seek_index_max_gap_ms;
 		flac_cache_man_t _decoders;
 		finish_flac_dec_func_t _finish_flac_dec_func;
+		flac_seek_details_list_t _seek_details;
+
+		std::size_t _md5_verify_threads;
+		size_type _md5_verify_max_bytes_per_sec;
+		boost::filesystem::path _md5_verify_results_file;
+		size_type _md5_verify_recheck_days;
+		std::unique_ptr<flac_md5_verifier> _md5_verifier;
+
+		flac_md5_verifier & md5_verifier();
 
 		flac_cache_man_t::cache_item_t create_new_flac_decoder();
 		void finish_flac_decoder(flac_cache_man_t::cache_item_t decoder);
 
 		bool init_flac();
 
+		std::shared_ptr<flac_seek_details> get_seek_details(FLAC__StreamDecoder *pdecoder);
+		void init_seek_index(FLAC__StreamDecoder *pdecoder, std::shared_ptr<current_decoder_details> const& decoder_dets);
+		void save_seek_index(FLAC__StreamDecoder *pdecoder);
+		bool seek_with_index(FLAC__StreamDecoder *pdecoder, std::shared_ptr<current_decoder_details> const& decoder_dets, size_type sample_to_seek);
+
 		virtual void reset_buffers() override;
 
 		void init_decode_internal_single(url_id_t url_id) override;
@@ -52,6 +90,7 @@ namespace mprt {
 		virtual void decode() override;
 
 		virtual void seek_duration(size_type duration_ms) override;
+		virtual void verify_integrity(std::shared_ptr<std::vector<std::string>> urls) override;
 
 		// flac specific functions
 		FLAC__StreamDecoderReadStatus read_callback(
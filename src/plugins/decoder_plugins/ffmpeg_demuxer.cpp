@@ -0,0 +1,134 @@
+#include <chrono>
+#include <algorithm>
+
+#include <boost/log/trivial.hpp>
+
+#include "ffmpeg_demuxer.h"
+
+namespace mprt
+{
+	ffmpeg_demuxer::ffmpeg_demuxer(AVFormatContext *format_ctx, int stream_id, std::size_t max_packets)
+		: _format_ctx(format_ctx)
+		, _stream_id(stream_id)
+		, _max_packets(std::max<std::size_t>(max_packets, 1))
+		, _stop(true)
+		, _finished(false)
+		, _finish_status(0)
+	{
+	}
+
+	ffmpeg_demuxer::~ffmpeg_demuxer()
+	{
+		stop();
+	}
+
+	void ffmpeg_demuxer::start()
+	{
+		stop();
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_stop = false;
+			_finished = false;
+			_finish_status = 0;
+		}
+
+		_thread = std::thread([this] { demux_loop(); });
+	}
+
+	void ffmpeg_demuxer::stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_stop = true;
+		}
+		_cond.notify_all();
+
+		if (_thread.joinable())
+		{
+			_thread.join();
+		}
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		clear_packets();
+	}
+
+	// _mutex must be held
+	void ffmpeg_demuxer::clear_packets()
+	{
+		for (auto packet : _packets)
+		{
+			av_packet_free(&packet);
+		}
+		_packets.clear();
+	}
+
+	void ffmpeg_demuxer::demux_loop()
+	{
+		for (;;)
+		{
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				_cond.wait(lock, [this] { return _stop || _packets.size() < _max_packets; });
+				if (_stop)
+					return;
+			}
+
+			auto packet = av_packet_alloc();
+			auto ret = packet ? av_read_frame(_format_ctx, packet) : AVERROR(ENOMEM);
+
+			if (ret == AVERROR(EAGAIN))
+			{
+				av_packet_free(&packet);
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+				continue;
+			}
+
+			std::lock_guard<std::mutex> lock(_mutex);
+
+			if (ret < 0)
+			{
+				if (ret != AVERROR_EOF)
+				{
+					BOOST_LOG_TRIVIAL(debug) << "ffmpeg demux thread stopped with: " << ret;
+				}
+
+				av_packet_free(&packet);
+				_finished = true;
+				_finish_status = ret;
+				_cond.notify_all();
+				return;
+			}
+
+			if (packet->stream_index != _stream_id)
+			{
+				av_packet_free(&packet);
+				continue;
+			}
+
+			_packets.push_back(packet);
+			_cond.notify_all();
+		}
+	}
+
+	int ffmpeg_demuxer::read_packet(AVPacket *packet)
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_cond.wait(lock, [this] { return _stop || _finished || !_packets.empty(); });
+
+		if (_packets.empty())
+		{
+			return _finished ? _finish_status : AVERROR(EAGAIN);
+		}
+
+		auto queued = _packets.front();
+		_packets.pop_front();
+		_cond.notify_all();
+		lock.unlock();
+
+		av_packet_move_ref(packet, queued);
+		av_packet_free(&queued);
+
+		return 0;
+	}
+}
@@ -0,0 +1,56 @@
+#ifndef ffmpeg_demuxer_h__
+#define ffmpeg_demuxer_h__
+
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+#include "common/common_defs.h"
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+}
+
+namespace mprt
+{
+	// reads the packets of one stream on its own thread into a bounded queue, so that
+	// the file io and the demuxing overlap with the decoding.
+	// the format context must not be touched by anyone else while it is running,
+	// seeks have to stop it first and start it again after
+	class ffmpeg_demuxer
+	{
+	private:
+		AVFormatContext *_format_ctx;
+		int _stream_id;
+		std::size_t _max_packets;
+
+		std::mutex _mutex;
+		std::condition_variable _cond;
+		std::deque<AVPacket*> _packets;
+		bool _stop;
+		bool _finished;
+		int _finish_status;
+		std::thread _thread;
+
+		void demux_loop();
+		void clear_packets();
+
+	public:
+		ffmpeg_demuxer(AVFormatContext *format_ctx, int stream_id, std::size_t max_packets);
+		~ffmpeg_demuxer();
+
+		ffmpeg_demuxer(ffmpeg_demuxer const&) = delete;
+		ffmpeg_demuxer & operator=(ffmpeg_demuxer const&) = delete;
+
+		void start();
+		// waits the thread, queued packets are dropped
+		void stop();
+
+		// same results as av_read_frame, waits for the demux thread when the queue is empty
+		int read_packet(AVPacket *packet);
+	};
+}
+
+#endif // ffmpeg_demuxer_h__
@@ -0,0 +1,258 @@
+#include <fstream>
+
+#include <boost/filesystem.hpp>
+#include <boost/log/trivial.hpp>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/mathematics.h>
+}
+
+#include "common/scope_exit.h"
+
+#include "ffmpeg_duration_resolver.h"
+
+namespace mprt
+{
+	namespace
+	{
+		template <typename T>
+		void write_val(std::ofstream & os, T const& val)
+		{
+			os.write(reinterpret_cast<const char *>(&val), sizeof(T));
+		}
+
+		template <typename T>
+		bool read_val(std::ifstream & is, T & val)
+		{
+			is.read(reinterpret_cast<char *>(&val), sizeof(T));
+			return static_cast<bool>(is);
+		}
+	}
+
+	ffmpeg_duration_resolver::ffmpeg_duration_resolver(std::size_t thread_count, boost::filesystem::path const& cache_dir)
+		: _pool(thread_count, true)
+		, _cache_dir(cache_dir)
+	{
+	}
+
+	void ffmpeg_duration_resolver::resolve(std::string const& path, resolved_callback_t callback)
+	{
+		{
+			// the same file is often opened again before the first scan ends (seek, replay),
+			// under a new url id which waits for the same scan
+			std::lock_guard<std::mutex> lock(_pending_mutex);
+			auto & callbacks = _pending[path];
+			callbacks.push_back(std::move(callback));
+			if (callbacks.size() > 1)
+				return;
+		}
+
+		_pool.post([this, path]
+		{
+			size_type total_samples = 0;
+			size_type sample_rate = 0;
+			auto resolved = resolve_internal(path, total_samples, sample_rate);
+
+			std::vector<resolved_callback_t> callbacks;
+			{
+				std::lock_guard<std::mutex> lock(_pending_mutex);
+				auto iter = _pending.find(path);
+				if (iter != _pending.end())
+				{
+					callbacks.swap(iter->second);
+					_pending.erase(iter);
+				}
+			}
+
+			if (!resolved)
+				return;
+
+			for (auto & callback : callbacks)
+			{
+				callback(total_samples, sample_rate);
+			}
+		});
+	}
+
+	bool ffmpeg_duration_resolver::resolve_internal(std::string const& path, size_type & total_samples, size_type & sample_rate)
+	{
+		auto ident = file_identity::from_path(path);
+		if (!ident._ok)
+			return false;
+
+		if (load(ident, total_samples, sample_rate))
+			return true;
+
+		if (!scan_file(path, total_samples, sample_rate))
+		{
+			BOOST_LOG_TRIVIAL(debug) << "ffmpeg duration cannot be resolved: " << path;
+			return false;
+		}
+
+		BOOST_LOG_TRIVIAL(debug) << "ffmpeg duration resolved: " << path << " samples: " << total_samples << " rate: " << sample_rate;
+
+		save(ident, total_samples, sample_rate);
+		return true;
+	}
+
+	bool ffmpeg_duration_resolver::scan_file(std::string const& path, size_type & total_samples, size_type & sample_rate)
+	{
+		AVFormatContext *format_ctx = nullptr;
+		if (avformat_open_input(&format_ctx, ("file:" + path).c_str(), nullptr, nullptr) < 0)
+			return false;
+
+		SCOPE_EXIT_REF(avformat_close_input(&format_ctx););
+
+		auto stream_id = av_find_best_stream(format_ctx, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
+
+		// headerless streams only tell their parameters after a few packets
+		if (stream_id < 0 || format_ctx->streams[stream_id]->codecpar->sample_rate <= 0)
+		{
+			if (avformat_find_stream_info(format_ctx, nullptr) < 0)
+				return false;
+
+			stream_id = av_find_best_stream(format_ctx, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
+			if (stream_id < 0 || format_ctx->streams[stream_id]->codecpar->sample_rate <= 0)
+				return false;
+		}
+
+		auto stream = format_ctx->streams[stream_id];
+		auto samples_time_base = AVRational{ 1, stream->codecpar->sample_rate };
+		sample_rate = stream->codecpar->sample_rate;
+
+		// containers with an index, xing/vbri/info frames or a fixed frame size know the length
+		// after reading the header, only the rest has to walk the packets. for a headerless stream
+		// (adts aac, mp3 without a xing/vbri frame) find_stream_info guesses it from the bitrate
+		if (stream->duration != AV_NOPTS_VALUE && stream->duration > 0 &&
+			format_ctx->duration_estimation_method != AVFMT_DURATION_FROM_BITRATE)
+		{
+			total_samples = av_rescale_q(stream->duration, stream->time_base, samples_time_base);
+			return total_samples > 0;
+		}
+
+		for (unsigned i = 0; i < format_ctx->nb_streams; ++i)
+		{
+			if (static_cast<int>(i) != stream_id)
+			{
+				format_ctx->streams[i]->discard = AVDISCARD_ALL;
+			}
+		}
+
+		auto packet = av_packet_alloc();
+		if (!packet)
+			return false;
+
+		SCOPE_EXIT_REF(av_packet_free(&packet););
+
+		int64_t first_ts = AV_NOPTS_VALUE;
+		int64_t end_ts = AV_NOPTS_VALUE;
+		int64_t summed_duration = 0;
+		int err;
+
+		while ((err = av_read_frame(format_ctx, packet)) >= 0)
+		{
+			if (packet->stream_index == stream_id)
+			{
+				auto ts = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+				if (ts != AV_NOPTS_VALUE)
+				{
+					if (first_ts == AV_NOPTS_VALUE || ts < first_ts)
+						first_ts = ts;
+					if (end_ts == AV_NOPTS_VALUE || ts + packet->duration > end_ts)
+						end_ts = ts + std::max<int64_t>(packet->duration, 0);
+				}
+
+				summed_duration += std::max<int64_t>(packet->duration, 0);
+			}
+
+			av_packet_unref(packet);
+		}
+
+		if (err != AVERROR_EOF)
+			return false;
+
+		auto length = (first_ts != AV_NOPTS_VALUE && end_ts > first_ts) ? end_ts - first_ts : summed_duration;
+		total_samples = av_rescale_q(length, stream->time_base, samples_time_base);
+
+		return total_samples > 0;
+	}
+
+	bool ffmpeg_duration_resolver::load(file_identity const& ident, size_type & total_samples, size_type & sample_rate)
+	{
+		std::ifstream is(ident.cache_file_path(_cache_dir, ".duration").string(), std::ios::binary);
+		if (!is)
+			return false;
+
+		uint32_t magic, version;
+		uint64_t path_len;
+		size_type file_size;
+		int64_t mtime;
+
+		if (!read_val(is, magic) || magic != _MAGIC_ ||
+			!read_val(is, version) || version != _VERSION_ ||
+			!read_val(is, path_len) || path_len > 4096)
+		{
+			return false;
+		}
+
+		std::string path(static_cast<std::size_t>(path_len), '\0');
+		is.read(&path[0], static_cast<std::streamsize>(path_len));
+
+		if (!is ||
+			!read_val(is, file_size) ||
+			!read_val(is, mtime) ||
+			!read_val(is, total_samples) ||
+			!read_val(is, sample_rate))
+		{
+			return false;
+		}
+
+		// hash collision or the file has changed since
+		return path == ident._path && file_size == ident._size && mtime == static_cast<int64_t>(ident._mtime) &&
+			total_samples > 0 && sample_rate > 0;
+	}
+
+	bool ffmpeg_duration_resolver::save(file_identity const& ident, size_type total_samples, size_type sample_rate)
+	{
+		auto file_path = ident.cache_file_path(_cache_dir, ".duration");
+
+		boost::system::error_code ec;
+		boost::filesystem::create_directories(file_path.parent_path(), ec);
+
+		// write aside and rename, a half written entry must never be picked up
+		auto tmp_path = file_path;
+		tmp_path += ".tmp";
+
+		{
+			std::ofstream os(tmp_path.string(), std::ios::binary | std::ios::trunc);
+			if (!os)
+			{
+				BOOST_LOG_TRIVIAL(error) << "cannot create ffmpeg duration cache: " << tmp_path;
+				return false;
+			}
+
+			write_val(os, _MAGIC_);
+			write_val(os, _VERSION_);
+			write_val(os, static_cast<uint64_t>(ident._path.size()));
+			os.write(ident._path.data(), static_cast<std::streamsize>(ident._path.size()));
+			write_val(os, ident._size);
+			write_val(os, static_cast<int64_t>(ident._mtime));
+			write_val(os, total_samples);
+			write_val(os, sample_rate);
+
+			if (!os)
+				return false;
+		}
+
+		boost::filesystem::rename(tmp_path, file_path, ec);
+		if (ec)
+		{
+			BOOST_LOG_TRIVIAL(error) << "cannot save ffmpeg duration cache: " << file_path << " " << ec.message();
+			return false;
+		}
+
+		return true;
+	}
+}
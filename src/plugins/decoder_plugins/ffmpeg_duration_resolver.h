@@ -0,0 +1,63 @@
+#ifndef ffmpeg_duration_resolver_h__
+#define ffmpeg_duration_resolver_h__
+
+#include <string>
+#include <mutex>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+
+#include <boost/filesystem/path.hpp>
+
+#include "common/common_defs.h"
+#include "common/file_identity.h"
+#include "common/worker_pool.h"
+
+namespace mprt
+{
+	// finds the exact length of local files on low priority threads without decoding them:
+	// the container header (index, xing/vbri/info frames) is used when it has the length,
+	// otherwise the packet timestamps of the whole stream are scanned.
+	// results are kept on disk, keyed by the file identity
+	class ffmpeg_duration_resolver
+	{
+	public:
+		// total samples at the stream's own sample rate
+		using resolved_callback_t = std::function<void (size_type total_samples, size_type sample_rate)>;
+
+	private:
+		constexpr static uint32_t _MAGIC_ = 0x5255444d; // "MDUR"
+		constexpr static uint32_t _VERSION_ = 2; // 1 kept lengths guessed from the bitrate
+
+		worker_pool _pool;
+		boost::filesystem::path _cache_dir;
+
+		std::mutex _pending_mutex;
+		// every item waiting for a file, it is scanned once for all of them
+		std::unordered_map<std::string, std::vector<resolved_callback_t>> _pending;
+
+		bool resolve_internal(std::string const& path, size_type & total_samples, size_type & sample_rate);
+		bool scan_file(std::string const& path, size_type & total_samples, size_type & sample_rate);
+
+		bool load(file_identity const& ident, size_type & total_samples, size_type & sample_rate);
+		bool save(file_identity const& ident, size_type total_samples, size_type sample_rate);
+
+	public:
+		ffmpeg_duration_resolver(std::size_t thread_count, boost::filesystem::path const& cache_dir);
+
+		ffmpeg_duration_resolver(ffmpeg_duration_resolver const&) = delete;
+		ffmpeg_duration_resolver & operator=(ffmpeg_duration_resolver const&) = delete;
+
+		// the callback runs on a resolver thread, never when the length cannot be found
+		void resolve(std::string const& path, resolved_callback_t callback);
+
+		// other whole file scans share the same low priority threads
+		template <typename Func>
+		void post(Func f)
+		{
+			_pool.post(f);
+		}
+	};
+}
+
+#endif // ffmpeg_duration_resolver_h__
@@ -0,0 +1,216 @@
+#include <cstdio>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#if defined(__linux__)
+#include <sys/vfs.h>
+#endif
+
+#include <boost/filesystem.hpp>
+#include <boost/log/trivial.hpp>
+
+extern "C" {
+#include <libavutil/avutil.h>
+}
+
+#include "ffmpeg_file_io.h"
+
+namespace mprt
+{
+	ffmpeg_file_io::ffmpeg_file_io()
+		: _data(nullptr)
+		, _size(0)
+		, _pos(0)
+		, _fd(-1)
+		, _truncated(false)
+	{
+	}
+
+	ffmpeg_file_io::~ffmpeg_file_io()
+	{
+#ifndef _WIN32
+		if (_fd >= 0)
+		{
+			::close(_fd);
+		}
+#endif
+	}
+
+	bool ffmpeg_file_io::open(std::string const& filename)
+	{
+		try
+		{
+#ifndef _WIN32
+			_fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+			if (_fd < 0)
+			{
+				throw std::runtime_error(std::strerror(errno));
+			}
+#endif
+			boost::interprocess::file_mapping mapping(filename.c_str(), boost::interprocess::read_only);
+			boost::interprocess::mapped_region region(mapping, boost::interprocess::read_only);
+
+			// the demuxers mostly read forward, jumps are handled by seek
+			region.advise(boost::interprocess::mapped_region::advice_sequential);
+
+			_mapping.swap(mapping);
+			_region.swap(region);
+		}
+		catch (std::exception const& e)
+		{
+			BOOST_LOG_TRIVIAL(error) << "ffmpeg cannot map file: " << filename << " error: " << e.what();
+			return false;
+		}
+
+		_data = static_cast<unsigned char const*>(_region.get_address());
+		_size = static_cast<size_type>(_region.get_size());
+		_pos = 0;
+		_truncated = false;
+		_filename = filename;
+
+		return true;
+	}
+
+	int ffmpeg_file_io::read(uint8_t *buffer, int buffer_size)
+	{
+#ifndef _WIN32
+		// the pages of a file cut short under the mapping give SIGBUS, the size is checked
+		// before every copy and the rest of such a file is read with pread
+		struct stat st;
+		if (!_truncated && (::fstat(_fd, &st) != 0 || static_cast<size_type>(st.st_size) < _size))
+		{
+			BOOST_LOG_TRIVIAL(info) << "ffmpeg file is cut short, reading it without the mapping: " << _filename;
+			_truncated = true;
+		}
+
+		if (_truncated)
+		{
+			auto read_bytes = ::pread(_fd, buffer, static_cast<std::size_t>(buffer_size), static_cast<off_t>(_pos));
+			if (read_bytes < 0)
+				return AVERROR(errno);
+			if (read_bytes == 0)
+				return AVERROR_EOF;
+
+			_pos += read_bytes;
+			return static_cast<int>(read_bytes);
+		}
+#endif
+
+		auto count = std::min<size_type>(buffer_size, _size - _pos);
+		if (count <= 0)
+			return AVERROR_EOF;
+
+		std::memcpy(buffer, _data + _pos, static_cast<std::size_t>(count));
+		_pos += count;
+
+		return static_cast<int>(count);
+	}
+
+	int64_t ffmpeg_file_io::seek(int64_t offset, int whence)
+	{
+		size_type absolute_pos;
+		switch (whence & ~AVSEEK_FORCE) {
+		case AVSEEK_SIZE:
+			return _size;
+		case SEEK_SET:
+			absolute_pos = offset;
+			break;
+		case SEEK_CUR:
+			absolute_pos = _pos + offset;
+			break;
+		case SEEK_END:
+			absolute_pos = _size + offset;
+			break;
+		default:
+			return -1;
+		}
+
+		if (absolute_pos < 0 || absolute_pos > _size)
+			return -1;
+
+		_pos = absolute_pos;
+
+		return _pos;
+	}
+
+	int ffmpeg_file_io::read_callback(void *opaque, uint8_t *buffer, int buffer_size)
+	{
+		return reinterpret_cast<ffmpeg_file_io*>(opaque)->read(buffer, buffer_size);
+	}
+
+	int64_t ffmpeg_file_io::seek_callback(void *opaque, int64_t offset, int whence)
+	{
+		return reinterpret_cast<ffmpeg_file_io*>(opaque)->seek(offset, whence);
+	}
+
+	AVIOContext * ffmpeg_file_io::create_avio_context(int buffer_size)
+	{
+		// ffmpeg may reallocate this buffer, it has to come from av_malloc
+		auto buffer = static_cast<unsigned char*>(av_malloc(static_cast<std::size_t>(buffer_size)));
+		if (!buffer)
+			return nullptr;
+
+		auto pio_ctx = avio_alloc_context(buffer, buffer_size, 0, this, &ffmpeg_file_io::read_callback, nullptr, &ffmpeg_file_io::seek_callback);
+		if (!pio_ctx)
+		{
+			av_free(buffer);
+		}
+
+		return pio_ctx;
+	}
+
+	void ffmpeg_file_io::free_avio_context(AVIOContext *pio_ctx)
+	{
+		if (pio_ctx)
+		{
+			av_freep(&pio_ctx->buffer);
+			avio_context_free(&pio_ctx);
+		}
+	}
+
+	bool ffmpeg_file_io::is_local_file(std::string const& url)
+	{
+		boost::system::error_code ec;
+
+		if (url.find("://") != std::string::npos || !boost::filesystem::is_regular_file(url, ec))
+			return false;
+
+		// files on network or fuse mounts keep going through the input plugins, which cache,
+		// prefetch and pace them
+#if defined(__linux__)
+		struct statfs st;
+		if (::statfs(url.c_str(), &st) != 0)
+			return false;
+
+		switch (static_cast<unsigned long>(st.f_type))
+		{
+		case 0xef53UL: // ext2, ext3, ext4
+		case 0x58465342UL: // xfs
+		case 0x9123683eUL: // btrfs
+		case 0xf2f52010UL: // f2fs
+		case 0x2fc12fc1UL: // zfs
+		case 0x4d44UL: // vfat
+		case 0x2011bab0UL: // exfat
+		case 0x5346544eUL: // ntfs
+		case 0x3153464aUL: // jfs
+		case 0x52654973UL: // reiserfs
+		case 0x9660UL: // iso9660
+			return true;
+		default:
+			return false;
+		}
+#elif defined(_WIN32)
+		auto root = boost::filesystem::path(url).root_path().string();
+		return GetDriveTypeA(root.c_str()) == DRIVE_FIXED;
+#else
+		return true;
+#endif
+	}
+}
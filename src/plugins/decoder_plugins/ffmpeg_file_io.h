@@ -0,0 +1,57 @@
+#ifndef ffmpeg_file_io_h__
+#define ffmpeg_file_io_h__
+
+#include <string>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include "common/common_defs.h"
+
+extern "C" {
+#include <libavformat/avio.h>
+}
+
+namespace mprt
+{
+	// local files for ffmpeg without the input plugin pipeline: the file is mapped
+	// and ffmpeg reads and seeks straight from the mapping
+	class ffmpeg_file_io
+	{
+	private:
+		boost::interprocess::file_mapping _mapping;
+		boost::interprocess::mapped_region _region;
+		unsigned char const* _data;
+		size_type _size;
+		size_type _pos;
+		// a second handle to read a file cut short under the mapping
+		int _fd;
+		bool _truncated;
+		std::string _filename;
+
+		static int read_callback(void *opaque, uint8_t *buffer, int buffer_size);
+		static int64_t seek_callback(void *opaque, int64_t offset, int whence);
+
+	public:
+		ffmpeg_file_io();
+		~ffmpeg_file_io();
+
+		ffmpeg_file_io(ffmpeg_file_io const&) = delete;
+		ffmpeg_file_io & operator=(ffmpeg_file_io const&) = delete;
+
+		bool open(std::string const& filename);
+
+		int read(uint8_t *buffer, int buffer_size);
+		int64_t seek(int64_t offset, int whence);
+		size_type size() const { return _size; }
+
+		// the context reads from this object, it must not outlive it
+		AVIOContext * create_avio_context(int buffer_size);
+		static void free_avio_context(AVIOContext *pio_ctx);
+
+		// regular files on a local disk filesystem
+		static bool is_local_file(std::string const& url);
+	};
+}
+
+#endif // ffmpeg_file_io_h__
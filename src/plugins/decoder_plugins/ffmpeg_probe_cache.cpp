@@ -0,0 +1,350 @@
+#include <cstring>
+#include <fstream>
+
+#include <boost/filesystem.hpp>
+#include <boost/log/trivial.hpp>
+
+extern "C" {
+#include <libavutil/avutil.h>
+#include <libavutil/mathematics.h>
+}
+
+#include "ffmpeg_probe_cache.h"
+
+namespace mprt
+{
+	namespace
+	{
+		template <typename T>
+		void write_val(std::ofstream & os, T const& val)
+		{
+			os.write(reinterpret_cast<const char *>(&val), sizeof(T));
+		}
+
+		template <typename T>
+		bool read_val(std::ifstream & is, T & val)
+		{
+			is.read(reinterpret_cast<char *>(&val), sizeof(T));
+			return static_cast<bool>(is);
+		}
+
+		void write_bytes(std::ofstream & os, void const* data, std::size_t size)
+		{
+			write_val(os, static_cast<uint64_t>(size));
+			os.write(static_cast<const char *>(data), static_cast<std::streamsize>(size));
+		}
+
+		template <typename Container>
+		bool read_bytes(std::ifstream & is, Container & data, uint64_t max_size)
+		{
+			uint64_t size;
+			if (!read_val(is, size) || size > max_size)
+				return false;
+
+			data.resize(static_cast<std::size_t>(size));
+			if (size == 0)
+				return true;
+
+			is.read(reinterpret_cast<char *>(&data[0]), static_cast<std::streamsize>(size));
+			return static_cast<bool>(is);
+		}
+
+		// sanity limits, a corrupt file must not make us allocate gigabytes
+		constexpr uint64_t _MAX_STRING_SIZE_ = 4096;
+		constexpr uint64_t _MAX_EXTRADATA_SIZE_ = 16 * 1024 * 1024;
+	}
+
+	ffmpeg_probe_cache::probe_info::probe_info()
+		: _stream_id(-1)
+		, _format_start_time(AV_NOPTS_VALUE)
+		, _format_duration(AV_NOPTS_VALUE)
+		, _format_bit_rate(0)
+		, _time_base_num(0)
+		, _time_base_den(1)
+		, _stream_start_time(AV_NOPTS_VALUE)
+		, _stream_duration(AV_NOPTS_VALUE)
+		, _codec_type(AVMEDIA_TYPE_UNKNOWN)
+		, _codec_id(AV_CODEC_ID_NONE)
+		, _codec_tag(0)
+		, _format(-1)
+		, _bit_rate(0)
+		, _bits_per_coded_sample(0)
+		, _bits_per_raw_sample(0)
+		, _profile(0)
+		, _level(0)
+		, _channel_layout(0)
+		, _channels(0)
+		, _sample_rate(0)
+		, _block_align(0)
+		, _frame_size(0)
+		, _initial_padding(0)
+		, _trailing_padding(0)
+		, _seek_preroll(0)
+	{
+	}
+
+	ffmpeg_probe_cache::ffmpeg_probe_cache(boost::filesystem::path const& cache_dir)
+		: _cache_dir(cache_dir)
+	{
+	}
+
+	boost::filesystem::path ffmpeg_probe_cache::cache_path(file_identity const& ident) const
+	{
+		return ident.cache_file_path(_cache_dir, ".probe");
+	}
+
+	bool ffmpeg_probe_cache::load(file_identity const& ident, probe_info & info) const
+	{
+		if (!ident._ok)
+			return false;
+
+		std::ifstream is(cache_path(ident).string(), std::ios::binary);
+		if (!is)
+			return false;
+
+		uint32_t magic, version;
+		std::string path;
+		size_type file_size;
+		int64_t mtime;
+
+		if (!read_val(is, magic) || magic != _MAGIC_ ||
+			!read_val(is, version) || version != _VERSION_ ||
+			!read_bytes(is, path, _MAX_STRING_SIZE_) ||
+			!read_val(is, file_size) ||
+			!read_val(is, mtime))
+		{
+			return false;
+		}
+
+		// hash collision or the file has changed since
+		if (path != ident._path || file_size != ident._size || mtime != static_cast<int64_t>(ident._mtime))
+			return false;
+
+		probe_info loaded;
+		if (!read_bytes(is, loaded._format_name, _MAX_STRING_SIZE_) ||
+			!read_val(is, loaded._stream_id) ||
+			!read_val(is, loaded._format_start_time) ||
+			!read_val(is, loaded._format_duration) ||
+			!read_val(is, loaded._format_bit_rate) ||
+			!read_val(is, loaded._time_base_num) ||
+			!read_val(is, loaded._time_base_den) ||
+			!read_val(is, loaded._stream_start_time) ||
+			!read_val(is, loaded._stream_duration) ||
+			!read_val(is, loaded._codec_type) ||
+			!read_val(is, loaded._codec_id) ||
+			!read_val(is, loaded._codec_tag) ||
+			!read_val(is, loaded._format) ||
+			!read_val(is, loaded._bit_rate) ||
+			!read_val(is, loaded._bits_per_coded_sample) ||
+			!read_val(is, loaded._bits_per_raw_sample) ||
+			!read_val(is, loaded._profile) ||
+			!read_val(is, loaded._level) ||
+			!read_val(is, loaded._channel_layout) ||
+			!read_val(is, loaded._channels) ||
+			!read_val(is, loaded._sample_rate) ||
+			!read_val(is, loaded._block_align) ||
+			!read_val(is, loaded._frame_size) ||
+			!read_val(is, loaded._initial_padding) ||
+			!read_val(is, loaded._trailing_padding) ||
+			!read_val(is, loaded._seek_preroll) ||
+			!read_bytes(is, loaded._extradata, _MAX_EXTRADATA_SIZE_))
+		{
+			return false;
+		}
+
+		info = std::move(loaded);
+
+		return true;
+	}
+
+	bool ffmpeg_probe_cache::save(file_identity const& ident, probe_info const& info) const
+	{
+		if (!ident._ok)
+			return false;
+
+		auto file_path = cache_path(ident);
+
+		boost::system::error_code ec;
+		boost::filesystem::create_directories(file_path.parent_path(), ec);
+
+		// write aside and rename, a half written entry must never be picked up
+		auto tmp_path = file_path;
+		tmp_path += ".tmp";
+
+		{
+			std::ofstream os(tmp_path.string(), std::ios::binary | std::ios::trunc);
+			if (!os)
+			{
+				BOOST_LOG_TRIVIAL(error) << "cannot create ffmpeg probe cache: " << tmp_path;
+				return false;
+			}
+
+			write_val(os, _MAGIC_);
+			write_val(os, _VERSION_);
+			write_bytes(os, ident._path.data(), ident._path.size());
+			write_val(os, ident._size);
+			write_val(os, static_cast<int64_t>(ident._mtime));
+
+			write_bytes(os, info._format_name.data(), info._format_name.size());
+			write_val(os, info._stream_id);
+			write_val(os, info._format_start_time);
+			write_val(os, info._format_duration);
+			write_val(os, info._format_bit_rate);
+			write_val(os, info._time_base_num);
+			write_val(os, info._time_base_den);
+			write_val(os, info._stream_start_time);
+			write_val(os, info._stream_duration);
+			write_val(os, info._codec_type);
+			write_val(os, info._codec_id);
+			write_val(os, info._codec_tag);
+			write_val(os, info._format);
+			write_val(os, info._bit_rate);
+			write_val(os, info._bits_per_coded_sample);
+			write_val(os, info._bits_per_raw_sample);
+			write_val(os, info._profile);
+			write_val(os, info._level);
+			write_val(os, info._channel_layout);
+			write_val(os, info._channels);
+			write_val(os, info._sample_rate);
+			write_val(os, info._block_align);
+			write_val(os, info._frame_size);
+			write_val(os, info._initial_padding);
+			write_val(os, info._trailing_padding);
+			write_val(os, info._seek_preroll);
+			write_bytes(os, info._extradata.data(), info._extradata.size());
+
+			if (!os)
+				return false;
+		}
+
+		boost::filesystem::rename(tmp_path, file_path, ec);
+		if (ec)
+		{
+			BOOST_LOG_TRIVIAL(error) << "cannot save ffmpeg probe cache: " << file_path << " " << ec.message();
+			return false;
+		}
+
+		return true;
+	}
+
+	bool ffmpeg_probe_cache::capture(AVFormatContext const* format_ctx, int stream_id, probe_info & info)
+	{
+		if (!format_ctx->iformat || !format_ctx->iformat->name ||
+			stream_id < 0 || static_cast<unsigned>(stream_id) >= format_ctx->nb_streams)
+		{
+			return false;
+		}
+
+		auto stream = format_ctx->streams[stream_id];
+		auto par = stream->codecpar;
+
+		info._format_name = format_ctx->iformat->name;
+		info._stream_id = stream_id;
+		info._format_start_time = format_ctx->start_time;
+		info._format_duration = format_ctx->duration;
+		info._format_bit_rate = format_ctx->bit_rate;
+		info._time_base_num = stream->time_base.num;
+		info._time_base_den = stream->time_base.den;
+		info._stream_start_time = stream->start_time;
+		info._stream_duration = stream->duration;
+
+		info._codec_type = par->codec_type;
+		info._codec_id = par->codec_id;
+		info._codec_tag = par->codec_tag;
+		info._format = par->format;
+		info._bit_rate = par->bit_rate;
+		info._bits_per_coded_sample = par->bits_per_coded_sample;
+		info._bits_per_raw_sample = par->bits_per_raw_sample;
+		info._profile = par->profile;
+		info._level = par->level;
+		info._channel_layout = par->channel_layout;
+		info._channels = par->channels;
+		info._sample_rate = par->sample_rate;
+		info._block_align = par->block_align;
+		info._frame_size = par->frame_size;
+		info._initial_padding = par->initial_padding;
+		info._trailing_padding = par->trailing_padding;
+		info._seek_preroll = par->seek_preroll;
+
+		if (par->extradata && par->extradata_size > 0)
+		{
+			info._extradata.assign(par->extradata, par->extradata + par->extradata_size);
+		}
+		else
+		{
+			info._extradata.clear();
+		}
+
+		return true;
+	}
+
+	bool ffmpeg_probe_cache::apply(probe_info const& info, AVFormatContext * format_ctx)
+	{
+		if (info._stream_id < 0 || static_cast<unsigned>(info._stream_id) >= format_ctx->nb_streams)
+			return false;
+
+		auto stream = format_ctx->streams[info._stream_id];
+		auto par = stream->codecpar;
+
+		// the header knows the codec for most containers, it has to be the cached one
+		if ((par->codec_id != AV_CODEC_ID_NONE && par->codec_id != info._codec_id) ||
+			(par->codec_type != AVMEDIA_TYPE_UNKNOWN && par->codec_type != info._codec_type))
+		{
+			return false;
+		}
+
+		if (!info._extradata.empty())
+		{
+			auto extradata = static_cast<uint8_t*>(av_malloc(info._extradata.size() + AV_INPUT_BUFFER_PADDING_SIZE));
+			if (!extradata)
+				return false;
+
+			std::memcpy(extradata, info._extradata.data(), info._extradata.size());
+			std::memset(extradata + info._extradata.size(), 0, AV_INPUT_BUFFER_PADDING_SIZE);
+
+			av_freep(&par->extradata);
+			par->extradata = extradata;
+			par->extradata_size = static_cast<int>(info._extradata.size());
+		}
+
+		par->codec_type = static_cast<AVMediaType>(info._codec_type);
+		par->codec_id = static_cast<AVCodecID>(info._codec_id);
+		par->codec_tag = info._codec_tag;
+		par->format = info._format;
+		par->bit_rate = info._bit_rate;
+		par->bits_per_coded_sample = info._bits_per_coded_sample;
+		par->bits_per_raw_sample = info._bits_per_raw_sample;
+		par->profile = info._profile;
+		par->level = info._level;
+		par->channel_layout = info._channel_layout;
+		par->channels = info._channels;
+		par->sample_rate = info._sample_rate;
+		par->block_align = info._block_align;
+		par->frame_size = info._frame_size;
+		par->initial_padding = info._initial_padding;
+		par->trailing_padding = info._trailing_padding;
+		par->seek_preroll = info._seek_preroll;
+
+		// durations are often estimated by avformat_find_stream_info, the header may not have them.
+		// the demuxer has already set the time base of the packets, the cached values follow it
+		auto cached_time_base = AVRational{ info._time_base_num, info._time_base_den };
+		auto to_stream_time_base = [&](int64_t ts)
+		{
+			return ts == AV_NOPTS_VALUE || cached_time_base.num <= 0 || cached_time_base.den <= 0 ?
+				AV_NOPTS_VALUE : av_rescale_q(ts, cached_time_base, stream->time_base);
+		};
+
+		if (stream->start_time == AV_NOPTS_VALUE)
+			stream->start_time = to_stream_time_base(info._stream_start_time);
+		if (stream->duration == AV_NOPTS_VALUE)
+			stream->duration = to_stream_time_base(info._stream_duration);
+		if (format_ctx->start_time == AV_NOPTS_VALUE)
+			format_ctx->start_time = info._format_start_time;
+		if (format_ctx->duration == AV_NOPTS_VALUE)
+			format_ctx->duration = info._format_duration;
+		if (format_ctx->bit_rate <= 0)
+			format_ctx->bit_rate = info._format_bit_rate;
+
+		return true;
+	}
+}
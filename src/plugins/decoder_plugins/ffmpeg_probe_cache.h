@@ -0,0 +1,83 @@
+#ifndef ffmpeg_probe_cache_h__
+#define ffmpeg_probe_cache_h__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem/path.hpp>
+
+#include "common/common_defs.h"
+#include "common/file_identity.h"
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+}
+
+namespace mprt
+{
+	// what probing and avformat_find_stream_info found out about a local file, kept on
+	// disk so that opening the same file again only has to read the container header
+	class ffmpeg_probe_cache
+	{
+	public:
+		struct probe_info
+		{
+			std::string _format_name;
+			int32_t _stream_id;
+			int64_t _format_start_time;
+			int64_t _format_duration;
+			int64_t _format_bit_rate;
+			int32_t _time_base_num;
+			int32_t _time_base_den;
+			int64_t _stream_start_time;
+			int64_t _stream_duration;
+
+			int32_t _codec_type;
+			int32_t _codec_id;
+			uint32_t _codec_tag;
+			int32_t _format;
+			int64_t _bit_rate;
+			int32_t _bits_per_coded_sample;
+			int32_t _bits_per_raw_sample;
+			int32_t _profile;
+			int32_t _level;
+			uint64_t _channel_layout;
+			int32_t _channels;
+			int32_t _sample_rate;
+			int32_t _block_align;
+			int32_t _frame_size;
+			int32_t _initial_padding;
+			int32_t _trailing_padding;
+			int32_t _seek_preroll;
+			std::vector<uint8_t> _extradata;
+
+			probe_info();
+		};
+
+	private:
+		constexpr static uint32_t _MAGIC_ = 0x4250464d; // "MFPB"
+		constexpr static uint32_t _VERSION_ = 1;
+
+		boost::filesystem::path _cache_dir;
+
+		boost::filesystem::path cache_path(file_identity const& ident) const;
+
+	public:
+		explicit ffmpeg_probe_cache(boost::filesystem::path const& cache_dir = boost::filesystem::path());
+
+		void set_cache_dir(boost::filesystem::path const& cache_dir) { _cache_dir = cache_dir; }
+
+		bool load(file_identity const& ident, probe_info & info) const;
+		bool save(file_identity const& ident, probe_info const& info) const;
+
+		// fills info from an opened context after avformat_find_stream_info
+		static bool capture(AVFormatContext const* format_ctx, int stream_id, probe_info & info);
+		// puts the cached stream info into a context which has only read the header,
+		// false if the header does not agree with the cache
+		static bool apply(probe_info const& info, AVFormatContext * format_ctx);
+	};
+}
+
+#endif // ffmpeg_probe_cache_h__
@@ -0,0 +1,106 @@
+#include <boost/log/trivial.hpp>
+
+extern "C" {
+#include <libavutil/channel_layout.h>
+}
+
+#include "ffmpeg_resampler.h"
+
+namespace mprt
+{
+	ffmpeg_resampler::ffmpeg_resampler()
+		: _swr(nullptr, [](SwrContext *pswr)
+		{
+			swr_free(&pswr);
+		})
+	{
+	}
+
+	bool ffmpeg_resampler::configure(ffmpeg_audio_format const& in_format, ffmpeg_audio_format const& out_format)
+	{
+		if (_swr && in_format == _in_format && out_format == _out_format)
+			return true;
+
+		_swr.reset();
+
+		auto pswr = swr_alloc_set_opts(nullptr,
+			static_cast<int64_t>(out_format._channel_layout), out_format._sample_fmt, out_format._sample_rate,
+			static_cast<int64_t>(in_format._channel_layout), in_format._sample_fmt, in_format._sample_rate,
+			0, nullptr);
+
+		if (!pswr)
+		{
+			BOOST_LOG_TRIVIAL(error) << "ffmpeg resampler cannot allocate swr context";
+			return false;
+		}
+
+		if (swr_init(pswr) < 0)
+		{
+			BOOST_LOG_TRIVIAL(error) << "ffmpeg resampler cannot init swr context";
+			swr_free(&pswr);
+			return false;
+		}
+
+		_swr.reset(pswr);
+		_in_format = in_format;
+		_out_format = out_format;
+
+		BOOST_LOG_TRIVIAL(debug) << "ffmpeg resampler: "
+			<< av_get_sample_fmt_name(in_format._sample_fmt) << "/" << in_format._channels << "ch/" << in_format._sample_rate << "Hz -> "
+			<< av_get_sample_fmt_name(out_format._sample_fmt) << "/" << out_format._channels << "ch/" << out_format._sample_rate << "Hz";
+
+		return true;
+	}
+
+	void ffmpeg_resampler::reset()
+	{
+		if (_swr && swr_init(_swr.get()) < 0)
+		{
+			_swr.reset();
+		}
+	}
+
+	int ffmpeg_resampler::max_out_samples(int in_samples) const
+	{
+		return _swr ? swr_get_out_samples(_swr.get(), in_samples) : 0;
+	}
+
+	int ffmpeg_resampler::convert(AVFrame const* frame, buffer_elem_t *out, int max_samples)
+	{
+		if (!_swr)
+			return -1;
+
+		uint8_t *out_planes[1] = { out };
+
+		return frame ?
+			swr_convert(_swr.get(), out_planes, max_samples, const_cast<const uint8_t**>(frame->extended_data), frame->nb_samples) :
+			swr_convert(_swr.get(), out_planes, max_samples, nullptr, 0);
+	}
+
+	ffmpeg_audio_format ffmpeg_resampler::frame_format(AVFrame const* frame)
+	{
+		ffmpeg_audio_format format;
+		format._sample_fmt = static_cast<AVSampleFormat>(frame->format);
+		format._channels = frame->channels;
+		format._channel_layout = channel_layout_or_default(frame->channel_layout, frame->channels);
+		format._sample_rate = frame->sample_rate;
+
+		return format;
+	}
+
+	uint64_t ffmpeg_resampler::channel_layout_or_default(uint64_t channel_layout, int channels)
+	{
+		if (channel_layout != 0 && av_get_channel_layout_nb_channels(channel_layout) == channels)
+			return channel_layout;
+
+		return static_cast<uint64_t>(av_get_default_channel_layout(channels));
+	}
+
+	AVSampleFormat ffmpeg_resampler::packed_sample_fmt(size_type bps, bool is_float)
+	{
+		if (is_float)
+			return AV_SAMPLE_FMT_FLT;
+
+		return bps == 32 ? AV_SAMPLE_FMT_S32 : AV_SAMPLE_FMT_S16;
+	}
+}
@@ -0,0 +1,77 @@
+#ifndef ffmpeg_resampler_h__
+#define ffmpeg_resampler_h__
+
+#include <memory>
+
+#include "common/common_defs.h"
+
+extern "C" {
+#include <libavutil/samplefmt.h>
+#include <libavcodec/avcodec.h>
+#include <libswresample/swresample.h>
+}
+
+namespace mprt
+{
+	struct ffmpeg_audio_format
+	{
+		AVSampleFormat _sample_fmt;
+		uint64_t _channel_layout;
+		int _channels;
+		int _sample_rate;
+
+		ffmpeg_audio_format()
+			: _sample_fmt(AV_SAMPLE_FMT_NONE)
+			, _channel_layout(0)
+			, _channels(0)
+			, _sample_rate(0)
+		{}
+
+		bool operator==(ffmpeg_audio_format const& other) const
+		{
+			return
+				_sample_fmt == other._sample_fmt &&
+				_channel_layout == other._channel_layout &&
+				_channels == other._channels &&
+				_sample_rate == other._sample_rate;
+		}
+
+		bool operator!=(ffmpeg_audio_format const& other) const
+		{
+			return !(*this == other);
+		}
+	};
+
+	// sample format, channel layout and rate conversion through libswresample, the context
+	// is kept as long as the input and output configuration stay the same (tracks of an album)
+	class ffmpeg_resampler
+	{
+	private:
+		std::unique_ptr<SwrContext, void(*)(SwrContext*)> _swr;
+		ffmpeg_audio_format _in_format;
+		ffmpeg_audio_format _out_format;
+
+	public:
+		ffmpeg_resampler();
+
+		bool configure(ffmpeg_audio_format const& in_format, ffmpeg_audio_format const& out_format);
+		bool is_configured() const { return static_cast<bool>(_swr); }
+
+		// drops the buffered (delayed) samples, after a seek
+		void reset();
+
+		// upper bound of the samples the next convert may produce
+		int max_out_samples(int in_samples) const;
+
+		// frame == nullptr flushes the delayed samples, returns the samples written or < 0 on error
+		int convert(AVFrame const* frame, buffer_elem_t *out, int max_samples);
+
+		ffmpeg_audio_format const& out_format() const { return _out_format; }
+
+		static ffmpeg_audio_format frame_format(AVFrame const* frame);
+		static uint64_t channel_layout_or_default(uint64_t channel_layout, int channels);
+		static AVSampleFormat packed_sample_fmt(size_type bps, bool is_float);
+	};
+}
+
+#endif // ffmpeg_resampler_h__
@@ -0,0 +1,153 @@
+#include <cstring>
+#include <algorithm>
+
+#include "common/pcm_convert.h"
+
+#include "ffmpeg_sample_convert.h"
+
+namespace mprt
+{
+	namespace
+	{
+		constexpr std::size_t _BLOCK_SAMPLES_ = 1024;
+	}
+
+	bool ffmpeg_sample_converter::output_format(AVSampleFormat fmt, size_type & bps, bool & is_float)
+	{
+		switch (av_get_packed_sample_fmt(fmt))
+		{
+		case AV_SAMPLE_FMT_U8:
+		case AV_SAMPLE_FMT_S16:
+			bps = 16;
+			is_float = false;
+			return true;
+		case AV_SAMPLE_FMT_S32:
+		case AV_SAMPLE_FMT_S64:
+			bps = 32;
+			is_float = false;
+			return true;
+		case AV_SAMPLE_FMT_FLT:
+		case AV_SAMPLE_FMT_DBL:
+			bps = 8 * sizeof(float);
+			is_float = true;
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	size_type ffmpeg_sample_converter::output_frame_bytes(AVSampleFormat fmt, size_type channels)
+	{
+		size_type bps = 0;
+		bool is_float = false;
+
+		return output_format(fmt, bps, is_float) ? channels * bps / 8 : 0;
+	}
+
+	template <typename TIn, typename TOut, typename Conv>
+	void ffmpeg_sample_converter::convert_planar(AVFrame const* frame, std::size_t channels, std::size_t samples, buffer_elem_t *out, Conv conv)
+	{
+		_scratch.resize(channels * _BLOCK_SAMPLES_ * sizeof(TOut));
+
+		_planes.resize(channels);
+		for (std::size_t ch = 0; ch != channels; ++ch)
+		{
+			_planes[ch] = _scratch.data() + ch * _BLOCK_SAMPLES_ * sizeof(TOut);
+		}
+
+		for (std::size_t start = 0; start < samples; start += _BLOCK_SAMPLES_)
+		{
+			auto count = std::min(_BLOCK_SAMPLES_, samples - start);
+
+			for (std::size_t ch = 0; ch != channels; ++ch)
+			{
+				conv(reinterpret_cast<TIn const*>(frame->extended_data[ch]) + start,
+					reinterpret_cast<TOut*>(_scratch.data() + ch * _BLOCK_SAMPLES_ * sizeof(TOut)), count);
+			}
+
+			auto block_out = out + start * channels * sizeof(TOut);
+			if (sizeof(TOut) == 2)
+				pcm_convert::interleave_16(_planes.data(), channels, count, block_out);
+			else
+				pcm_convert::interleave_32(_planes.data(), channels, count, block_out);
+		}
+	}
+
+	void ffmpeg_sample_converter::drop_leading_samples(AVFrame * frame, int count)
+	{
+		auto fmt = static_cast<AVSampleFormat>(frame->format);
+		auto sample_bytes = av_get_bytes_per_sample(fmt);
+		count = std::min(count, frame->nb_samples);
+
+		// the buffers are freed through their refs, only the pointers move
+		if (av_sample_fmt_is_planar(fmt))
+		{
+			for (int ch = 0; ch < frame->channels; ++ch)
+			{
+				frame->extended_data[ch] += count * sample_bytes;
+			}
+		}
+		else
+		{
+			frame->extended_data[0] += count * sample_bytes * frame->channels;
+		}
+
+		if (frame->extended_data != frame->data)
+		{
+			std::copy_n(frame->extended_data, std::min(frame->channels, AV_NUM_DATA_POINTERS), frame->data);
+		}
+
+		frame->nb_samples -= count;
+	}
+
+	size_type ffmpeg_sample_converter::convert(AVFrame const* frame, AVSampleFormat fmt, size_type channels, buffer_elem_t *out)
+	{
+		auto samples = static_cast<std::size_t>(frame->nb_samples);
+		auto nch = static_cast<std::size_t>(channels);
+		auto total = samples * nch;
+
+		// planes of the same width can go to the interleave kernels as they are
+		if (av_sample_fmt_is_planar(fmt))
+		{
+			_planes.assign(frame->extended_data, frame->extended_data + nch);
+		}
+
+		switch (fmt)
+		{
+		case AV_SAMPLE_FMT_S16:
+		case AV_SAMPLE_FMT_S32:
+		case AV_SAMPLE_FMT_FLT:
+			std::memcpy(out, frame->extended_data[0], total * av_get_bytes_per_sample(fmt));
+			break;
+		case AV_SAMPLE_FMT_U8:
+			pcm_convert::u8_to_s16(frame->extended_data[0], reinterpret_cast<int16_t*>(out), total);
+			break;
+		case AV_SAMPLE_FMT_DBL:
+			pcm_convert::dbl_to_flt(reinterpret_cast<double const*>(frame->extended_data[0]), reinterpret_cast<float*>(out), total);
+			break;
+		case AV_SAMPLE_FMT_S64:
+			pcm_convert::s64_to_s32(reinterpret_cast<int64_t const*>(frame->extended_data[0]), reinterpret_cast<int32_t*>(out), total);
+			break;
+		case AV_SAMPLE_FMT_S16P:
+			pcm_convert::interleave_16(_planes.data(), nch, samples, out);
+			break;
+		case AV_SAMPLE_FMT_S32P:
+		case AV_SAMPLE_FMT_FLTP:
+			pcm_convert::interleave_32(_planes.data(), nch, samples, out);
+			break;
+		case AV_SAMPLE_FMT_U8P:
+			convert_planar<uint8_t, int16_t>(frame, nch, samples, out, pcm_convert::u8_to_s16);
+			break;
+		case AV_SAMPLE_FMT_DBLP:
+			convert_planar<double, float>(frame, nch, samples, out, pcm_convert::dbl_to_flt);
+			break;
+		case AV_SAMPLE_FMT_S64P:
+			convert_planar<int64_t, int32_t>(frame, nch, samples, out, pcm_convert::s64_to_s32);
+			break;
+		default:
+			return 0;
+		}
+
+		return static_cast<size_type>(samples) * output_frame_bytes(fmt, channels);
+	}
+}
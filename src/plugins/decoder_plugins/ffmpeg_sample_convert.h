@@ -0,0 +1,43 @@
+#ifndef ffmpeg_sample_convert_h__
+#define ffmpeg_sample_convert_h__
+
+#include <vector>
+
+#include "common/common_defs.h"
+
+extern "C" {
+#include <libavutil/samplefmt.h>
+#include <libavcodec/avcodec.h>
+}
+
+namespace mprt
+{
+	// turns decoded ffmpeg frames (every sample format, planar or packed, any channel count)
+	// into the packed pcm the output plugins take:
+	// u8 -> s16, s16 -> s16, s32 -> s32, flt -> float, dbl -> float, s64 -> s32
+	class ffmpeg_sample_converter
+	{
+	private:
+		// planar formats which need a conversion go through this in blocks
+		std::vector<unsigned char> _scratch;
+		std::vector<void const*> _planes;
+
+		template <typename TIn, typename TOut, typename Conv>
+		void convert_planar(AVFrame const* frame, std::size_t channels, std::size_t samples, buffer_elem_t *out, Conv conv);
+
+	public:
+		// false for the formats we do not know about
+		static bool output_format(AVSampleFormat fmt, size_type & bps, bool & is_float);
+
+		// bytes one converted sample (all channels) takes
+		static size_type output_frame_bytes(AVSampleFormat fmt, size_type channels);
+
+		// moves the start of the frame forward, for the pre-roll after exact seeks
+		static void drop_leading_samples(AVFrame * frame, int count);
+
+		// out must have room for frame->nb_samples * output_frame_bytes(), returns the bytes written
+		size_type convert(AVFrame const* frame, AVSampleFormat fmt, size_type channels, buffer_elem_t *out);
+	};
+}
+
+#endif // ffmpeg_sample_convert_h__
@@ -0,0 +1,385 @@
+#include <cstdio>
+#include <algorithm>
+
+#include <boost/filesystem.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/xml_parser.hpp>
+#include <boost/log/trivial.hpp>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#endif
+
+extern "C"
+{
+#include <FLAC/stream_decoder.h>
+}
+
+#include "common/scope_exit.h"
+#include "common/file_identity.h"
+#include "common/utils.h"
+
+#include "flac_md5_verifier.h"
+
+namespace
+{
+	struct verify_context
+	{
+		std::FILE *_file;
+		mprt::io_throttle *_throttle;
+		// stopped on shutdown or unload, the decode is given up at the next read or frame
+		mprt::worker_pool const *_pool;
+		bool _has_md5;
+		bool _decode_error;
+	};
+
+	FLAC__StreamDecoderReadStatus verify_read_callback(
+		const FLAC__StreamDecoder * /*decoder*/,
+		FLAC__byte buffer[],
+		size_t *bytes,
+		void *client_data)
+	{
+		auto ctx = reinterpret_cast<verify_context*>(client_data);
+
+		if (ctx->_pool->is_stopped())
+		{
+			*bytes = 0;
+			return FLAC__STREAM_DECODER_READ_STATUS_ABORT;
+		}
+
+		ctx->_throttle->consume(static_cast<size_type>(*bytes));
+		*bytes = std::fread(buffer, 1, *bytes, ctx->_file);
+
+		if (*bytes == 0)
+		{
+			return std::ferror(ctx->_file) ?
+				FLAC__STREAM_DECODER_READ_STATUS_ABORT :
+				FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM;
+		}
+
+		return FLAC__STREAM_DECODER_READ_STATUS_CONTINUE;
+	}
+
+	FLAC__StreamDecoderWriteStatus verify_write_callback(
+		const FLAC__StreamDecoder * /*decoder*/,
+		const FLAC__Frame * /*frame*/,
+		const FLAC__int32 * const /*buffer*/[],
+		void *client_data)
+	{
+		if (reinterpret_cast<verify_context*>(client_data)->_pool->is_stopped())
+			return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+
+		// libflac feeds the md5 itself, nothing to do with the pcm
+		return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+	}
+
+	void verify_metadata_callback(
+		const FLAC__StreamDecoder * /*decoder*/,
+		const FLAC__StreamMetadata *metadata,
+		void *client_data)
+	{
+		auto ctx = reinterpret_cast<verify_context*>(client_data);
+
+		if (metadata->type == FLAC__METADATA_TYPE_STREAMINFO)
+		{
+			auto md5 = metadata->data.stream_info.md5sum;
+			ctx->_has_md5 = std::any_of(md5, md5 + 16, [](FLAC__byte b) { return b != 0; });
+		}
+	}
+
+	void verify_error_callback(
+		const FLAC__StreamDecoder * /*decoder*/,
+		FLAC__StreamDecoderErrorStatus /*status*/,
+		void *client_data)
+	{
+		reinterpret_cast<verify_context*>(client_data)->_decode_error = true;
+	}
+}
+
+namespace mprt
+{
+	flac_md5_verifier::flac_md5_verifier(
+		std::size_t thread_count,
+		size_type max_bytes_per_sec,
+		boost::filesystem::path const& results_file,
+		size_type recheck_days)
+		: _pool(thread_count, true)
+		, _throttle(max_bytes_per_sec)
+		, _results_file(results_file)
+		, _recheck_secs(static_cast<std::time_t>(recheck_days) * 24 * 60 * 60)
+		, _save_every(20)
+		, _unsaved_count(0)
+		, _pending(0)
+	{
+		load_results();
+	}
+
+	flac_md5_verifier::~flac_md5_verifier()
+	{
+		// a running decode sees the stopped pool and gives up, the join does not wait for the whole file
+		_pool.stop();
+
+		std::lock_guard<std::mutex> lock(_results_mutex);
+		if (_unsaved_count > 0)
+		{
+			save_results();
+		}
+	}
+
+	void flac_md5_verifier::verify(std::vector<std::string> const& paths, bool force)
+	{
+		for (auto const& path : paths)
+		{
+			++_pending;
+			_pool.post([this, path, force]
+			{
+				verify_file(path, force);
+				--_pending;
+			});
+		}
+	}
+
+	void flac_md5_verifier::verify_directory(std::string const& dirname, std::vector<std::regex> const& extensions, bool force)
+	{
+		// scanning a big library takes a while too, do it on the pool as well
+		_pool.post([this, dirname, extensions, force]
+		{
+			std::vector<std::string> paths;
+			boost::system::error_code ec;
+
+			boost::filesystem::recursive_directory_iterator dir(dirname, ec), end;
+			for (; !ec && !_pool.is_stopped() && dir != end; dir.increment(ec))
+			{
+				auto ext = get_ext(dir->path().filename().string());
+				auto matched = std::any_of(extensions.begin(), extensions.end(),
+					[&ext](std::regex const& ext_pattern) { return std::regex_match(ext, ext_pattern); });
+
+				if (matched && boost::filesystem::is_regular_file(dir->path(), ec))
+				{
+					paths.push_back(dir->path().string());
+				}
+			}
+
+			if (ec)
+			{
+				BOOST_LOG_TRIVIAL(error) << "flac md5 verify, directory scan error: " << dirname << " " << ec.message();
+			}
+
+			BOOST_LOG_TRIVIAL(debug) << "flac md5 verify, files found: " << paths.size() << " in: " << dirname;
+
+			verify(paths, force);
+		});
+	}
+
+	bool flac_md5_verifier::get_record(std::string const& path, verify_record & rec)
+	{
+		std::lock_guard<std::mutex> lock(_results_mutex);
+
+		auto iter = _results.find(path);
+		if (iter == _results.end())
+			return false;
+
+		rec = iter->second;
+		return true;
+	}
+
+	bool flac_md5_verifier::is_up_to_date(std::string const& path, size_type size, std::time_t mtime)
+	{
+		std::lock_guard<std::mutex> lock(_results_mutex);
+
+		auto iter = _results.find(path);
+
+		return
+			iter != _results.end() &&
+			iter->second._size == size &&
+			iter->second._mtime == mtime &&
+			iter->second._result != verify_result::error &&
+			(_recheck_secs <= 0 || std::time(nullptr) - iter->second._last_check < _recheck_secs);
+	}
+
+	void flac_md5_verifier::verify_file(std::string const& path, bool force)
+	{
+		auto ident = file_identity::from_path(path);
+		if (!ident._ok)
+		{
+			BOOST_LOG_TRIVIAL(debug) << "flac md5 verify, cannot stat: " << path;
+			return;
+		}
+
+		if (!force && is_up_to_date(path, ident._size, ident._mtime))
+			return;
+
+		auto start = std::chrono::steady_clock::now();
+		auto result = run_decoder(path);
+
+		// a decode given up half way tells nothing about the file, it is checked next time
+		if (_pool.is_stopped() && result != verify_result::pass && result != verify_result::no_md5)
+			return;
+
+		BOOST_LOG_TRIVIAL(debug) << "flac md5 verify: " << path << " result: " << result_to_string(result)
+			<< " took(ms): " << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+		if (result == verify_result::fail)
+		{
+			BOOST_LOG_TRIVIAL(error) << "flac md5 mismatch: " << path;
+		}
+
+		add_record(verify_record{ path, ident._size, ident._mtime, result, std::time(nullptr) });
+	}
+
+	flac_md5_verifier::verify_result flac_md5_verifier::run_decoder(std::string const& path)
+	{
+		verify_context ctx{ std::fopen(path.c_str(), "rb"), &_throttle, &_pool, false, false };
+		if (!ctx._file)
+			return verify_result::error;
+
+		SCOPE_EXIT_REF(
+			std::fclose(ctx._file);
+		);
+
+#if !defined(_WIN32)
+		// we read every file once, keep the page cache for the playback
+		auto fd = fileno(ctx._file);
+		(void)posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+		SCOPE_EXIT_REF(
+			(void)posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+		);
+#endif
+
+		std::shared_ptr<FLAC__StreamDecoder> decoder(FLAC__stream_decoder_new(), [](FLAC__StreamDecoder *pdecoder)
+		{
+			FLAC__stream_decoder_delete(pdecoder);
+		});
+
+		if (!decoder)
+			return verify_result::error;
+
+		(void)FLAC__stream_decoder_set_md5_checking(decoder.get(), true);
+
+		auto init_status = FLAC__stream_decoder_init_stream(
+			decoder.get(),
+			verify_read_callback, nullptr, nullptr, nullptr, nullptr,
+			verify_write_callback, verify_metadata_callback, verify_error_callback,
+			&ctx);
+
+		if (init_status != FLAC__STREAM_DECODER_INIT_STATUS_OK)
+			return verify_result::error;
+
+		auto decoded = FLAC__stream_decoder_process_until_end_of_stream(decoder.get());
+		auto state = FLAC__stream_decoder_get_state(decoder.get());
+
+		// finish does the md5 comparison
+		auto md5_ok = FLAC__stream_decoder_finish(decoder.get());
+
+		if (!decoded || state != FLAC__STREAM_DECODER_END_OF_STREAM)
+			return ctx._has_md5 || ctx._decode_error ? verify_result::fail : verify_result::error;
+
+		if (ctx._decode_error)
+			return verify_result::fail;
+
+		if (!ctx._has_md5)
+			return verify_result::no_md5;
+
+		return md5_ok ? verify_result::pass : verify_result::fail;
+	}
+
+	void flac_md5_verifier::add_record(verify_record const& rec)
+	{
+		std::lock_guard<std::mutex> lock(_results_mutex);
+
+		_results[rec._path] = rec;
+
+		if (++_unsaved_count >= _save_every || _pending <= 1)
+		{
+			save_results();
+		}
+	}
+
+	void flac_md5_verifier::load_results()
+	{
+		boost::system::error_code ec;
+		if (!boost::filesystem::exists(_results_file, ec))
+			return;
+
+		try
+		{
+			boost::property_tree::ptree pt;
+			boost::property_tree::read_xml(_results_file.string(), pt);
+
+			for (auto & file_node : pt.get_child("mprt.flac_md5_results"))
+			{
+				auto const& file_pt = file_node.second;
+
+				verify_record rec;
+				rec._path = file_pt.get<std::string>("path");
+				rec._size = file_pt.get<size_type>("size");
+				rec._mtime = static_cast<std::time_t>(file_pt.get<int64_t>("mtime"));
+				rec._result = result_from_string(file_pt.get<std::string>("result"));
+				rec._last_check = static_cast<std::time_t>(file_pt.get<int64_t>("last_check"));
+
+				_results[rec._path] = rec;
+			}
+		}
+		catch (std::exception const& e)
+		{
+			BOOST_LOG_TRIVIAL(error) << "cannot load flac md5 results: " << _results_file << " " << e.what();
+		}
+	}
+
+	// _results_mutex must be held
+	void flac_md5_verifier::save_results()
+	{
+		boost::property_tree::ptree pt;
+		auto & results_pt = pt.put_child("mprt.flac_md5_results", boost::property_tree::ptree());
+
+		for (auto const& res : _results)
+		{
+			boost::property_tree::ptree file_pt;
+			file_pt.put("path", res.second._path);
+			file_pt.put("size", res.second._size);
+			file_pt.put("mtime", static_cast<int64_t>(res.second._mtime));
+			file_pt.put("result", result_to_string(res.second._result));
+			file_pt.put("last_check", static_cast<int64_t>(res.second._last_check));
+
+			results_pt.add_child("file", file_pt);
+		}
+
+		try
+		{
+			boost::system::error_code ec;
+			boost::filesystem::create_directories(_results_file.parent_path(), ec);
+
+			auto tmp_file = _results_file;
+			tmp_file += ".tmp";
+			boost::property_tree::write_xml(tmp_file.string(), pt, std::locale(),
+				boost::property_tree::xml_writer_make_settings<std::string>('\t', 1));
+			boost::filesystem::rename(tmp_file, _results_file);
+
+			_unsaved_count = 0;
+		}
+		catch (std::exception const& e)
+		{
+			BOOST_LOG_TRIVIAL(error) << "cannot save flac md5 results: " << _results_file << " " << e.what();
+		}
+	}
+
+	const char * flac_md5_verifier::result_to_string(verify_result result)
+	{
+		switch (result)
+		{
+		case verify_result::pass: return "pass";
+		case verify_result::fail: return "fail";
+		case verify_result::no_md5: return "no_md5";
+		default: return "error";
+		}
+	}
+
+	flac_md5_verifier::verify_result flac_md5_verifier::result_from_string(std::string const& result)
+	{
+		if (result == "pass") return verify_result::pass;
+		if (result == "fail") return verify_result::fail;
+		if (result == "no_md5") return verify_result::no_md5;
+
+		return verify_result::error;
+	}
+}
@@ -0,0 +1,84 @@
+#ifndef flac_md5_verifier_h__
+#define flac_md5_verifier_h__
+
+#include <ctime>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <regex>
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+
+#include <boost/filesystem/path.hpp>
+
+#include "common/common_defs.h"
+#include "common/worker_pool.h"
+#include "common/io_throttle.h"
+
+namespace mprt
+{
+	// decodes whole flac files with md5 checking on its own low priority threads,
+	// completely outside of the playback pipeline
+	class flac_md5_verifier
+	{
+	public:
+		enum class verify_result
+		{
+			pass,
+			fail,
+			no_md5, // encoder did not store an md5, nothing to compare
+			error // cannot open / not a flac stream
+		};
+
+		struct verify_record
+		{
+			std::string _path;
+			size_type _size;
+			std::time_t _mtime;
+			verify_result _result;
+			std::time_t _last_check;
+		};
+
+	private:
+		worker_pool _pool;
+		io_throttle _throttle;
+		boost::filesystem::path _results_file;
+		std::time_t _recheck_secs;
+		size_type _save_every;
+
+		std::mutex _results_mutex;
+		std::unordered_map<std::string, verify_record> _results;
+		size_type _unsaved_count;
+		std::atomic<size_type> _pending;
+
+		void verify_file(std::string const& path, bool force);
+		verify_result run_decoder(std::string const& path);
+		bool is_up_to_date(std::string const& path, size_type size, std::time_t mtime);
+		void add_record(verify_record const& rec);
+
+		void load_results();
+		void save_results();
+
+	public:
+		flac_md5_verifier(
+			std::size_t thread_count,
+			size_type max_bytes_per_sec,
+			boost::filesystem::path const& results_file,
+			size_type recheck_days);
+		~flac_md5_verifier();
+
+		// files already checked (same size and mtime) within the recheck period are skipped unless forced
+		void verify(std::vector<std::string> const& paths, bool force = false);
+		// the files whose extension matches one of the patterns, as the decoder plugins match them
+		void verify_directory(std::string const& dirname, std::vector<std::regex> const& extensions, bool force = false);
+
+		bool get_record(std::string const& path, verify_record & rec);
+		size_type pending() const { return _pending; }
+
+		static const char * result_to_string(verify_result result);
+		static verify_result result_from_string(std::string const& result);
+	};
+}
+
+#endif // flac_md5_verifier_h__
@@ -0,0 +1,261 @@
+#include <cstring>
+#include <algorithm>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/log/trivial.hpp>
+
+#include "mpeg_frame_scanner.h"
+
+namespace mprt
+{
+	namespace
+	{
+		bool starts_with(unsigned char const* data, size_type size, char const* text)
+		{
+			auto len = static_cast<size_type>(std::strlen(text));
+			return size >= len && std::memcmp(data, text, static_cast<std::size_t>(len)) == 0;
+		}
+
+		// id3v1, ape and lyrics tags after the last frame
+		bool is_trailing_tag(unsigned char const* data, size_type size)
+		{
+			return starts_with(data, size, "TAG") || starts_with(data, size, "APETAGEX") || starts_with(data, size, "LYRICS");
+		}
+
+		bool parse_frame(unsigned char const* data, size_type size, mpeg_frame_scanner::frame_header & header)
+		{
+			return
+				mpeg_frame_scanner::parse_mpeg_header(data, size, header) ||
+				mpeg_frame_scanner::parse_adts_header(data, size, header);
+		}
+	}
+
+	bool mpeg_frame_scanner::parse_mpeg_header(unsigned char const* data, size_type size, frame_header & header)
+	{
+		if (size < 4 || data[0] != 0xFF || (data[1] & 0xE0) != 0xE0)
+			return false;
+
+		int version = (data[1] >> 3) & 3; // 0: mpeg 2.5, 1: reserved, 2: mpeg 2, 3: mpeg 1
+		int layer = (data[1] >> 1) & 3; // 0: reserved, 1: layer 3, 2: layer 2, 3: layer 1
+		int bitrate_index = data[2] >> 4;
+		int rate_index = (data[2] >> 2) & 3;
+		int padding = (data[2] >> 1) & 1;
+		int mode = data[3] >> 6;
+
+		// free format frames have no size in the header, they cannot be indexed
+		if (version == 1 || layer == 0 || bitrate_index == 0 || bitrate_index == 15 || rate_index == 3)
+			return false;
+
+		static const int bitrates_kbps[2][3][15] = {
+			{
+				{ 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448 },
+				{ 0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384 },
+				{ 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 }
+			},
+			{
+				{ 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256 },
+				{ 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 },
+				{ 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 }
+			}
+		};
+		static const int sample_rates[3] = { 44100, 48000, 32000 };
+
+		bool mpeg1 = (version == 3);
+		int layer_index = 3 - layer; // 0: layer 1, 1: layer 2, 2: layer 3
+
+		size_type bitrate = bitrates_kbps[mpeg1 ? 0 : 1][layer_index][bitrate_index] * 1000;
+		size_type sample_rate = sample_rates[rate_index] >> (mpeg1 ? 0 : (version == 2 ? 1 : 2));
+
+		header._samples = layer_index == 0 ? 384 : ((layer_index == 2 && !mpeg1) ? 576 : 1152);
+		header._frame_bytes = layer_index == 0 ?
+			(12 * bitrate / sample_rate + padding) * 4 :
+			header._samples / 8 * bitrate / sample_rate + padding;
+		header._sample_rate = sample_rate;
+		header._channels = mode == 3 ? 1 : 2;
+		header._header_bytes = 4;
+		header._stream_key = (static_cast<uint32_t>(data[1] & 0xFE) << 8) | (data[2] & 0x0C);
+
+		return true;
+	}
+
+	bool mpeg_frame_scanner::parse_adts_header(unsigned char const* data, size_type size, frame_header & header)
+	{
+		// the layer bits are always 0 in adts, that keeps it apart from mpeg audio
+		if (size < 7 || data[0] != 0xFF || (data[1] & 0xF6) != 0xF0)
+			return false;
+
+		static const int sample_rates[13] = { 96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050, 16000, 12000, 11025, 8000, 7350 };
+
+		bool protection_absent = (data[1] & 1) != 0;
+		int rate_index = (data[2] >> 2) & 0xF;
+		int channel_config = ((data[2] & 1) << 2) | (data[3] >> 6);
+		size_type frame_length = ((data[3] & 3) << 11) | (data[4] << 3) | (data[5] >> 5);
+		size_type header_bytes = protection_absent ? 7 : 9;
+
+		if (rate_index >= 13 || frame_length <= header_bytes)
+			return false;
+
+		header._samples = 1024 * ((data[6] & 3) + 1);
+		header._frame_bytes = frame_length;
+		header._sample_rate = sample_rates[rate_index];
+		header._channels = channel_config;
+		header._header_bytes = header_bytes;
+		header._stream_key = 0x80000000u | (static_cast<uint32_t>(data[1] & 0x08) << 16) | (static_cast<uint32_t>(data[2] & 0xFD) << 8) | (data[3] & 0xC0);
+
+		return true;
+	}
+
+	size_type mpeg_frame_scanner::id3v2_size(unsigned char const* data, size_type size)
+	{
+		size_type total = 0;
+
+		// some taggers write more than one tag
+		while (size - total >= 10 && starts_with(data + total, size - total, "ID3"))
+		{
+			auto tag = data + total;
+			size_type tag_size =
+				((tag[6] & 0x7F) << 21) | ((tag[7] & 0x7F) << 14) | ((tag[8] & 0x7F) << 7) | (tag[9] & 0x7F);
+
+			tag_size += 10;
+			if (tag[5] & 0x10) // footer
+			{
+				tag_size += 10;
+			}
+
+			total = std::min(total + tag_size, size);
+		}
+
+		return total;
+	}
+
+	bool mpeg_frame_scanner::parse_info_frame(unsigned char const* data, frame_header const& header,
+		size_type & start_padding, size_type & end_padding)
+	{
+		// xing, info and vbri headers are written into layer 3 frames only
+		if (((data[1] >> 1) & 3) != 1)
+			return false;
+
+		bool mpeg1 = ((data[1] >> 3) & 3) == 3;
+		size_type side_info = mpeg1 ? (header._channels == 1 ? 17 : 32) : (header._channels == 1 ? 9 : 17);
+		auto frame_end = data + header._frame_bytes;
+		auto tag = data + 4 + side_info;
+
+		if (tag + 8 <= frame_end && (starts_with(tag, 4, "Xing") || starts_with(tag, 4, "Info")))
+		{
+			auto flags = tag[7];
+			auto ext = tag + 8;
+			ext += (flags & 1) ? 4 : 0; // frames
+			ext += (flags & 2) ? 4 : 0; // bytes
+			ext += (flags & 4) ? 100 : 0; // toc
+			ext += (flags & 8) ? 4 : 0; // quality
+
+			// the lame extension holds the encoder delay and padding, the decoder drops
+			// the delay plus its own 529 samples at the start and the rest of the padding at the end
+			if (ext + 24 <= frame_end &&
+				(starts_with(ext, 4, "LAME") || starts_with(ext, 4, "Lavf") || starts_with(ext, 4, "Lavc")))
+			{
+				size_type delay = (ext[21] << 4) | (ext[22] >> 4);
+				size_type padding = ((ext[22] & 0x0F) << 8) | ext[23];
+
+				start_padding = delay + 529;
+				end_padding = padding - 529;
+			}
+
+			return true;
+		}
+
+		return data + 40 <= frame_end && starts_with(data + 36, 4, "VBRI");
+	}
+
+	bool mpeg_frame_scanner::scan(std::string const& path, seek_index & index, scan_result & result)
+	{
+		boost::interprocess::file_mapping mapping;
+		boost::interprocess::mapped_region region;
+
+		try
+		{
+			boost::interprocess::file_mapping(path.c_str(), boost::interprocess::read_only).swap(mapping);
+			boost::interprocess::mapped_region(mapping, boost::interprocess::read_only).swap(region);
+			region.advise(boost::interprocess::mapped_region::advice_sequential);
+		}
+		catch (std::exception const& e)
+		{
+			BOOST_LOG_TRIVIAL(error) << "mpeg frame scanner cannot map file: " << path << " error: " << e.what();
+			return false;
+		}
+
+		auto data = static_cast<unsigned char const*>(region.get_address());
+		auto size = static_cast<size_type>(region.get_size());
+
+		index.clear();
+
+		size_type pos = id3v2_size(data, size);
+		size_type sample = 0;
+		size_type start_padding = 0;
+		size_type end_padding = 0;
+		size_type frames = 0;
+		uint32_t stream_key = 0;
+		bool have_key = false;
+		bool synced = false;
+
+		result._sample_rate = 0;
+
+		while (pos + 4 <= size)
+		{
+			frame_header header;
+			bool ok =
+				parse_frame(data + pos, size - pos, header) &&
+				(!have_key || header._stream_key == stream_key) &&
+				pos + header._frame_bytes <= size;
+
+			// a sync word is easily found in other data, a real frame is followed by another one
+			if (ok && !synced)
+			{
+				frame_header next;
+				auto next_pos = pos + header._frame_bytes;
+				ok =
+					next_pos == size ||
+					is_trailing_tag(data + next_pos, size - next_pos) ||
+					(parse_frame(data + next_pos, size - next_pos, next) && next._stream_key == header._stream_key);
+			}
+
+			if (!ok)
+			{
+				synced = false;
+				++pos;
+				continue;
+			}
+
+			synced = true;
+
+			if (!have_key)
+			{
+				have_key = true;
+				stream_key = header._stream_key;
+				result._sample_rate = header._sample_rate;
+
+				// the demuxer does not pass this frame to the decoder
+				if (parse_info_frame(data + pos, header, start_padding, end_padding))
+				{
+					pos += header._frame_bytes;
+					continue;
+				}
+			}
+
+			index.add_point(sample - start_padding, pos);
+			sample += header._samples;
+			++frames;
+			pos += header._frame_bytes;
+		}
+
+		if (frames == 0)
+			return false;
+
+		result._frames = frames;
+		result._total_samples = std::max<size_type>(sample - start_padding - end_padding, 0);
+		index.set_complete(result._total_samples);
+
+		return true;
+	}
+}
@@ -0,0 +1,51 @@
+#ifndef mpeg_frame_scanner_h__
+#define mpeg_frame_scanner_h__
+
+#include <string>
+
+#include "common/common_defs.h"
+#include "common/seek_index.h"
+
+namespace mprt
+{
+	// walks the frame headers of mpeg audio (layer 1/2/3) and adts aac files and puts every
+	// frame start into a seek index. nothing is decoded, the frame sizes come from the headers.
+	// the samples are counted on the decoder output timeline, ie. the lame encoder delay
+	// which the decoder drops is taken off
+	class mpeg_frame_scanner
+	{
+	public:
+		struct frame_header
+		{
+			size_type _frame_bytes;
+			size_type _samples;
+			size_type _sample_rate;
+			size_type _channels;
+			size_type _header_bytes;
+			uint32_t _stream_key; // frames of the same stream share this
+		};
+
+		struct scan_result
+		{
+			size_type _sample_rate;
+			size_type _total_samples;
+			size_type _frames;
+		};
+
+		// false for anything which is not a plausible frame header
+		static bool parse_mpeg_header(unsigned char const* data, size_type size, frame_header & header);
+		static bool parse_adts_header(unsigned char const* data, size_type size, frame_header & header);
+
+		static bool scan(std::string const& path, seek_index & index, scan_result & result);
+
+	private:
+		// bytes of the id3v2 tag at the start, 0 if there is none
+		static size_type id3v2_size(unsigned char const* data, size_type size);
+		// true if the frame only carries a xing/info/vbri header, start and end padding are
+		// set from its lame extension when there is one
+		static bool parse_info_frame(unsigned char const* data, frame_header const& header,
+			size_type & start_padding, size_type & end_padding);
+	};
+}
+
+#endif // mpeg_frame_scanner_h__
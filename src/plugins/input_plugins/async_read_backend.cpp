@@ -0,0 +1,225 @@
+#include <cerrno>
+#include <cstring>
+#include <thread>
+
+#include <unistd.h>
+
+#include <boost/log/trivial.hpp>
+
+#ifdef _URING_FOUND
+#include <liburing.h>
+#endif
+
+#include "common/worker_pool.h"
+
+#include "async_read_backend.h"
+
+namespace mprt
+{
+	namespace
+	{
+		// every read is a blocking pread on one of the pool threads
+		class pread_read_backend : public async_read_backend
+		{
+		private:
+			worker_pool _pool;
+
+		public:
+			pread_read_backend(std::size_t thread_count, notify_callback_t notify)
+				: async_read_backend(notify)
+				, _pool(thread_count)
+			{
+			}
+
+			std::string name() const override
+			{
+				return "pread";
+			}
+
+			bool submit(int fd, unsigned char * buffer, size_type length, size_type offset, uint64_t tag) override
+			{
+				_pool.post([this, fd, buffer, length, offset, tag]
+				{
+					size_type done = 0;
+
+					// short reads are only expected at the end of the file, but network filesystems
+					// may return less on a signal as well
+					while (done < length)
+					{
+						auto res = ::pread(fd, buffer + done, static_cast<std::size_t>(length - done), static_cast<off_t>(offset + done));
+						if (res < 0 && errno == EINTR)
+							continue;
+						if (res < 0)
+						{
+							complete(tag, done > 0 ? done : -errno);
+							return;
+						}
+						if (res == 0)
+							break;
+
+						done += res;
+					}
+
+					complete(tag, done);
+				});
+
+				return true;
+			}
+		};
+
+#ifdef _URING_FOUND
+		// reads are queued on the submission ring from the caller's thread and a single
+		// thread waits on the completion ring
+		class uring_read_backend : public async_read_backend
+		{
+		private:
+			constexpr static uint64_t _WAKE_TAG_ = ~static_cast<uint64_t>(0);
+
+			io_uring _ring;
+			std::thread _reaper;
+
+			void reap_loop()
+			{
+				for (;;)
+				{
+					io_uring_cqe *cqe = nullptr;
+					auto err = io_uring_wait_cqe(&_ring, &cqe);
+					if (err == -EINTR)
+						continue;
+					if (err < 0)
+					{
+						BOOST_LOG_TRIVIAL(error) << "io_uring wait error: " << std::strerror(-err);
+						return;
+					}
+
+					auto tag = static_cast<uint64_t>(cqe->user_data);
+					auto res = static_cast<int64_t>(cqe->res);
+					io_uring_cqe_seen(&_ring, cqe);
+
+					if (tag == _WAKE_TAG_)
+						return;
+
+					complete(tag, res);
+				}
+			}
+
+		public:
+			explicit uring_read_backend(notify_callback_t notify)
+				: async_read_backend(notify)
+			{
+			}
+
+			~uring_read_backend()
+			{
+				if (_reaper.joinable())
+				{
+					// the reaper waits on the ring, it has to be woken up and gone before the ring is freed
+					io_uring_sqe * sqe = nullptr;
+					while (!(sqe = io_uring_get_sqe(&_ring)))
+					{
+						// the submission ring is full, the kernel takes what is on it first
+						io_uring_submit(&_ring);
+						std::this_thread::yield();
+					}
+
+					io_uring_prep_nop(sqe);
+					sqe->user_data = _WAKE_TAG_;
+					io_uring_submit(&_ring);
+					_reaper.join();
+
+					// waits for the reads still running in the kernel
+					io_uring_queue_exit(&_ring);
+				}
+			}
+
+			bool init(std::size_t queue_depth)
+			{
+				auto err = io_uring_queue_init(static_cast<unsigned>(queue_depth), &_ring, 0);
+				if (err < 0)
+				{
+					BOOST_LOG_TRIVIAL(info) << "io_uring is not available: " << std::strerror(-err);
+					return false;
+				}
+
+				_reaper = std::thread([this] { reap_loop(); });
+				return true;
+			}
+
+			std::string name() const override
+			{
+				return "io_uring";
+			}
+
+			bool submit(int fd, unsigned char * buffer, size_type length, size_type offset, uint64_t tag) override
+			{
+				auto sqe = io_uring_get_sqe(&_ring);
+				if (!sqe)
+				{
+					// the submission ring is full, hand it over and try once more
+					io_uring_submit(&_ring);
+					sqe = io_uring_get_sqe(&_ring);
+					if (!sqe)
+						return false;
+				}
+
+				io_uring_prep_read(sqe, fd, buffer, static_cast<unsigned>(length), static_cast<uint64_t>(offset));
+				sqe->user_data = tag;
+
+				return true;
+			}
+
+			void flush() override
+			{
+				auto err = io_uring_submit(&_ring);
+				if (err < 0)
+				{
+					BOOST_LOG_TRIVIAL(error) << "io_uring submit error: " << std::strerror(-err);
+				}
+			}
+		};
+#endif
+	}
+
+	async_read_backend::async_read_backend(notify_callback_t notify)
+		: _notify(notify)
+	{
+	}
+
+	void async_read_backend::complete(uint64_t tag, int64_t result)
+	{
+		{
+			std::lock_guard<std::mutex> lock(_completions_mutex);
+			_completions.push_back({ tag, result });
+		}
+
+		_notify();
+	}
+
+	void async_read_backend::reap(std::vector<completion> & completions)
+	{
+		std::lock_guard<std::mutex> lock(_completions_mutex);
+		completions.insert(completions.end(), _completions.begin(), _completions.end());
+		_completions.clear();
+	}
+
+	std::unique_ptr<async_read_backend> async_read_backend::create(std::string const& kind,
+		std::size_t queue_depth, std::size_t pread_threads, notify_callback_t notify)
+	{
+#ifdef _URING_FOUND
+		if (kind != "pread")
+		{
+			// the kernel may be too old or io_uring may be disabled by the administrator
+			auto backend = std::make_unique<uring_read_backend>(notify);
+			if (backend->init(queue_depth))
+				return std::move(backend);
+		}
+#else
+		if (kind == "io_uring")
+		{
+			BOOST_LOG_TRIVIAL(info) << "built without io_uring support, using pread threads";
+		}
+#endif
+
+		return std::make_unique<pread_read_backend>(pread_threads, notify);
+	}
+}
@@ -0,0 +1,59 @@
+#ifndef async_read_backend_h__
+#define async_read_backend_h__
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <memory>
+#include <functional>
+
+#include "common/common_defs.h"
+
+namespace mprt
+{
+	// positional reads which finish in the background. submit() is called from a single
+	// thread, the finished reads are collected with reap() on the same thread after the
+	// notify callback has been called from a backend thread
+	class async_read_backend
+	{
+	public:
+		struct completion
+		{
+			uint64_t _tag;
+			int64_t _result; // bytes read, -errno on error
+		};
+
+		using notify_callback_t = std::function<void()>;
+
+	protected:
+		notify_callback_t _notify;
+
+		std::mutex _completions_mutex;
+		std::vector<completion> _completions;
+
+		void complete(uint64_t tag, int64_t result);
+
+	public:
+		explicit async_read_backend(notify_callback_t notify);
+		virtual ~async_read_backend() = default;
+
+		async_read_backend(async_read_backend const&) = delete;
+		async_read_backend & operator=(async_read_backend const&) = delete;
+
+		virtual std::string name() const = 0;
+
+		// false when the read cannot be queued, the buffer must stay valid until it is reaped
+		virtual bool submit(int fd, unsigned char * buffer, size_type length, size_type offset, uint64_t tag) = 0;
+		// reads queued by submit() calls since the last flush are handed to the kernel
+		virtual void flush() {}
+
+		// never blocks
+		void reap(std::vector<completion> & completions);
+
+		// kind: "io_uring", "pread" or "auto" (io_uring when the kernel allows it)
+		static std::unique_ptr<async_read_backend> create(std::string const& kind,
+			std::size_t queue_depth, std::size_t pread_threads, notify_callback_t notify);
+	};
+}
+
+#endif // async_read_backend_h__
@@ -0,0 +1,456 @@
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+#if defined(__linux__)
+#include <sys/vfs.h>
+#endif
+
+#include <boost/filesystem.hpp>
+#include <boost/log/trivial.hpp>
+
+#include "block_cache.h"
+
+namespace mprt
+{
+	namespace
+	{
+		constexpr uint32_t _MAGIC_ = 0x4d504243; // MPBC
+		constexpr uint32_t _VERSION_ = 1;
+		const std::string _BLOCK_EXT_ = ".blk";
+
+		template <typename T>
+		void write_val(std::ofstream & os, T const& val)
+		{
+			os.write(reinterpret_cast<const char *>(&val), sizeof(T));
+		}
+
+		template <typename T>
+		bool read_val(std::ifstream & is, T & val)
+		{
+			is.read(reinterpret_cast<char *>(&val), sizeof(T));
+			return static_cast<bool>(is);
+		}
+	}
+
+	block_cache::block_cache(boost::filesystem::path const& cache_dir, size_type block_size, size_type max_disk_size,
+		size_type max_pending_size, bool remote_only)
+		: _pool(1, true)
+		, _cache_dir(cache_dir)
+		, _block_size(std::max<size_type>(block_size, 4096))
+		, _max_disk_size(max_disk_size)
+		, _max_pending_size(max_pending_size)
+		, _remote_only(remote_only)
+		, _disk_size(0)
+		, _pending_size(0)
+	{
+		_pool.post([this]
+		{
+			load_index();
+		});
+	}
+
+	block_cache::~block_cache()
+	{
+		// the queued writes are dropped, the one running uses the index
+		_pool.stop();
+	}
+
+	bool block_cache::is_remote(std::string const& path)
+	{
+#if defined(__linux__)
+		struct statfs st;
+		if (::statfs(path.c_str(), &st) != 0)
+			return false;
+
+		switch (static_cast<unsigned long>(st.f_type))
+		{
+		case 0x6969UL: // nfs
+		case 0x517bUL: // smb
+		case 0xff534d42UL: // cifs
+		case 0xfe534d42UL: // smb2
+		case 0x65735546UL: // fuse (sshfs, rclone ...)
+		case 0x01021997UL: // 9p
+		case 0x00c36400UL: // ceph
+		case 0x5346414fUL: // afs
+			return true;
+		default:
+			return false;
+		}
+#elif defined(_WIN32)
+		auto root = boost::filesystem::path(path).root_path().string();
+		// unc paths are always on a share
+		if (root.size() >= 2 && (root[0] == '\\' || root[0] == '/') && root[0] == root[1])
+			return true;
+
+		return GetDriveTypeA(root.c_str()) == DRIVE_REMOTE;
+#else
+		return false;
+#endif
+	}
+
+	std::string block_cache::block_name(file_identity const& ident, size_type index) const
+	{
+		std::ostringstream o;
+		o << "_" << std::hex << std::setw(8) << std::setfill('0') << index << _BLOCK_EXT_;
+		return ident.cache_file_name(o.str());
+	}
+
+	size_type block_cache::block_length(file_identity const& ident, size_type index) const
+	{
+		return std::min(_block_size, ident._size - index * _block_size);
+	}
+
+	void block_cache::load_index()
+	{
+		struct found_block
+		{
+			std::time_t _mtime;
+			entry _entry;
+		};
+
+		std::vector<found_block> found;
+		std::vector<std::string> leftovers;
+		boost::system::error_code ec;
+
+		boost::filesystem::create_directories(_cache_dir, ec);
+
+		for (boost::filesystem::directory_iterator iter(_cache_dir, ec), iter_end; !ec && iter != iter_end; iter.increment(ec))
+		{
+			auto const& path = iter->path();
+			auto ext = path.extension().string();
+
+			if (ext == ".tmp")
+			{
+				// written when the player was stopped
+				leftovers.push_back(path.filename().string());
+				continue;
+			}
+
+			if (ext != _BLOCK_EXT_)
+				continue;
+
+			boost::system::error_code file_ec;
+			auto size = boost::filesystem::file_size(path, file_ec);
+			auto mtime = boost::filesystem::last_write_time(path, file_ec);
+			if (!file_ec)
+			{
+				found.push_back({ mtime, { path.filename().string(), static_cast<size_type>(size) } });
+			}
+		}
+
+		// the modification time of a block is bumped when it is read, that is the lru order of the last run
+		std::sort(found.begin(), found.end(), [](found_block const& lhs, found_block const& rhs) { return lhs._mtime > rhs._mtime; });
+
+		std::vector<std::string> evicted;
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+
+			// blocks of this run are already in, the ones found here are older
+			for (auto const& block : found)
+			{
+				if (_index.count(block._entry._name))
+					continue;
+
+				_lru.push_front(block._entry);
+				_index[block._entry._name] = _lru.begin();
+				_disk_size += block._entry._size;
+			}
+
+			evicted = evict();
+		}
+
+		remove_files(leftovers);
+		remove_files(evicted);
+
+		BOOST_LOG_TRIVIAL(debug) << "block cache: " << _cache_dir << " blocks: " << found.size() << " bytes: " << _disk_size;
+	}
+
+	std::vector<std::string> block_cache::evict()
+	{
+		std::vector<std::string> names;
+
+		while (_disk_size > _max_disk_size && !_lru.empty())
+		{
+			auto & oldest = _lru.front();
+			_disk_size -= oldest._size;
+			_index.erase(oldest._name);
+			names.push_back(oldest._name);
+			_lru.pop_front();
+		}
+
+		return names;
+	}
+
+	void block_cache::remove_files(std::vector<std::string> const& names)
+	{
+		for (auto const& name : names)
+		{
+			boost::system::error_code ec;
+			boost::filesystem::remove(_cache_dir / name, ec);
+		}
+	}
+
+	bool block_cache::open_track(track & trk, std::string const& path)
+	{
+		trk = track();
+
+		if (_remote_only && !is_remote(path))
+			return false;
+
+		trk._ident = file_identity::from_path(path);
+
+		return trk._ident._ok;
+	}
+
+	block_cache::data_t block_cache::load_block(file_identity const& ident, size_type index)
+	{
+		auto name = block_name(ident, index);
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+
+			auto iter = _index.find(name);
+			if (iter == _index.end())
+				return data_t();
+
+			// the most recently used one
+			_lru.splice(_lru.end(), _lru, iter->second);
+		}
+
+		auto file_path = _cache_dir / name;
+		std::ifstream is(file_path.string(), std::ios::binary);
+
+		uint32_t magic = 0, version = 0;
+		uint64_t path_len = 0, data_len = 0;
+		size_type file_size = 0, block_index = 0;
+		int64_t mtime = 0;
+		std::string path;
+		bool ok =
+			is &&
+			read_val(is, magic) && magic == _MAGIC_ &&
+			read_val(is, version) && version == _VERSION_ &&
+			read_val(is, path_len) && path_len <= 4096;
+
+		if (ok)
+		{
+			path.resize(static_cast<std::size_t>(path_len));
+			is.read(&path[0], static_cast<std::streamsize>(path_len));
+
+			// hash collision or a damaged block
+			ok =
+				is &&
+				read_val(is, file_size) &&
+				read_val(is, mtime) &&
+				read_val(is, block_index) &&
+				read_val(is, data_len) &&
+				path == ident._path && file_size == ident._size && mtime == static_cast<int64_t>(ident._mtime) &&
+				block_index == index && data_len == static_cast<uint64_t>(block_length(ident, index));
+		}
+
+		auto data = std::make_shared<std::vector<unsigned char>>();
+
+		if (ok)
+		{
+			data->resize(static_cast<std::size_t>(data_len));
+			is.read(reinterpret_cast<char *>(data->data()), static_cast<std::streamsize>(data_len));
+			ok = static_cast<bool>(is);
+		}
+
+		if (!ok)
+		{
+			BOOST_LOG_TRIVIAL(debug) << "block cache entry dropped: " << file_path;
+
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+
+				auto iter = _index.find(name);
+				if (iter != _index.end())
+				{
+					_disk_size -= iter->second->_size;
+					_lru.erase(iter->second);
+					_index.erase(iter);
+				}
+			}
+
+			_pool.post([this, name]
+			{
+				remove_files({ name });
+			});
+
+			return data_t();
+		}
+
+		// keeps the lru order for the next run
+		_pool.post([file_path]
+		{
+			boost::system::error_code ec;
+			boost::filesystem::last_write_time(file_path, std::time(nullptr), ec);
+		});
+
+		return data;
+	}
+
+	size_type block_cache::read(track & trk, size_type pos, unsigned char * dest, size_type len)
+	{
+		if (!trk._ident._ok || pos >= trk._ident._size)
+			return 0;
+
+		auto index = pos / _block_size;
+
+		// a miss is remembered as well, the index is not looked up for every read of the block
+		if (trk._loaded_index != index)
+		{
+			trk._loaded_index = index;
+			trk._loaded = load_block(trk._ident, index);
+		}
+
+		if (!trk._loaded)
+			return 0;
+
+		auto offset = pos - index * _block_size;
+		auto count = std::min(len, static_cast<size_type>(trk._loaded->size()) - offset);
+		std::copy_n(trk._loaded->data() + offset, count, dest);
+
+		return count;
+	}
+
+	void block_cache::write(track & trk, size_type pos, unsigned char const * data, size_type len)
+	{
+		if (!trk._ident._ok)
+			return;
+
+		while (len > 0 && pos < trk._ident._size)
+		{
+			auto index = pos / _block_size;
+			auto block_start = index * _block_size;
+			auto block_end = block_start + block_length(trk._ident, index);
+			auto count = std::min(len, block_end - pos);
+
+			if (trk._fill_index != index)
+			{
+				trk._fill_index = index;
+				trk._fill.reset();
+
+				// a block is cached from its first byte on only, after a seek into the middle the next one is taken
+				if (pos == block_start && !(trk._loaded_index == index && trk._loaded))
+				{
+					trk._fill = std::make_shared<std::vector<unsigned char>>();
+					trk._fill->reserve(static_cast<std::size_t>(block_end - block_start));
+				}
+			}
+
+			if (trk._fill && pos == block_start + static_cast<size_type>(trk._fill->size()))
+			{
+				trk._fill->insert(trk._fill->end(), data, data + count);
+
+				if (pos + count == block_end)
+				{
+					store_block(trk._ident, index, std::move(trk._fill));
+					trk._fill.reset();
+				}
+			}
+			else
+			{
+				// not contiguous, a seek inside the block
+				trk._fill.reset();
+			}
+
+			pos += count;
+			data += count;
+			len -= count;
+		}
+	}
+
+	void block_cache::store_block(file_identity ident, size_type index, data_t data)
+	{
+		auto size = static_cast<size_type>(data->size());
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+
+			// the disk is slower than the source for now, the block is not cached
+			if (_index.count(block_name(ident, index)) || _pending_size + size > _max_pending_size)
+				return;
+
+			_pending_size += size;
+		}
+
+		_pool.post([this, ident, index, data, size]
+		{
+			auto saved = save_block(ident, index, *data);
+			auto name = block_name(ident, index);
+			std::vector<std::string> evicted;
+
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_pending_size -= size;
+
+				if (!saved || _index.count(name))
+					return;
+
+				boost::system::error_code ec;
+				auto file_size = boost::filesystem::file_size(_cache_dir / name, ec);
+
+				_lru.push_back({ name, ec ? size : static_cast<size_type>(file_size) });
+				_index[name] = std::prev(_lru.end());
+				_disk_size += _lru.back()._size;
+
+				evicted = evict();
+			}
+
+			remove_files(evicted);
+		});
+	}
+
+	bool block_cache::save_block(file_identity const& ident, size_type index, std::vector<unsigned char> const& data)
+	{
+		auto file_path = _cache_dir / block_name(ident, index);
+
+		boost::system::error_code ec;
+		boost::filesystem::create_directories(_cache_dir, ec);
+
+		// write aside and rename, a half written block must never be picked up
+		auto tmp_path = file_path;
+		tmp_path += ".tmp";
+
+		{
+			std::ofstream os(tmp_path.string(), std::ios::binary | std::ios::trunc);
+			if (!os)
+			{
+				BOOST_LOG_TRIVIAL(error) << "cannot create block cache entry: " << tmp_path;
+				return false;
+			}
+
+			write_val(os, _MAGIC_);
+			write_val(os, _VERSION_);
+			write_val(os, static_cast<uint64_t>(ident._path.size()));
+			os.write(ident._path.data(), static_cast<std::streamsize>(ident._path.size()));
+			write_val(os, ident._size);
+			write_val(os, static_cast<int64_t>(ident._mtime));
+			write_val(os, index);
+			write_val(os, static_cast<uint64_t>(data.size()));
+			os.write(reinterpret_cast<const char *>(data.data()), static_cast<std::streamsize>(data.size()));
+
+			if (!os)
+			{
+				os.close();
+				boost::filesystem::remove(tmp_path, ec);
+				return false;
+			}
+		}
+
+		boost::filesystem::rename(tmp_path, file_path, ec);
+		if (ec)
+		{
+			BOOST_LOG_TRIVIAL(error) << "cannot save block cache entry: " << file_path << " " << ec.message();
+			boost::filesystem::remove(tmp_path, ec);
+			return false;
+		}
+
+		return true;
+	}
+}
@@ -0,0 +1,99 @@
+#ifndef block_cache_h__
+#define block_cache_h__
+
+#include <list>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include <boost/filesystem/path.hpp>
+
+#include "common/common_defs.h"
+#include "common/file_identity.h"
+#include "common/worker_pool.h"
+
+namespace mprt
+{
+	// keeps fixed size blocks of files from slow (network) filesystems on the local disk.
+	// a block is keyed by the file identity (path, size, mtime) and its index, the blocks
+	// read from the source are written through on a low priority thread and the least
+	// recently read ones are removed when the disk budget is exceeded
+	class block_cache
+	{
+	public:
+		using data_t = std::shared_ptr<std::vector<unsigned char>>;
+
+		// the blocks of one open file, used from the input plugin thread only
+		struct track
+		{
+			file_identity _ident;
+			// the block which is being read from the cache
+			size_type _loaded_index;
+			data_t _loaded;
+			// the block which is being filled from the source reads
+			size_type _fill_index;
+			data_t _fill;
+
+			track()
+				: _loaded_index(-1)
+				, _fill_index(-1)
+			{}
+		};
+
+	private:
+		struct entry
+		{
+			std::string _name;
+			size_type _size;
+		};
+
+		using lru_list_t = std::list<entry>;
+
+		worker_pool _pool;
+		boost::filesystem::path _cache_dir;
+		size_type _block_size;
+		size_type _max_disk_size;
+		size_type _max_pending_size;
+		bool _remote_only;
+
+		std::mutex _mutex;
+		lru_list_t _lru; // the least recently used first
+		std::unordered_map<std::string, lru_list_t::iterator> _index;
+		size_type _disk_size;
+		size_type _pending_size; // blocks posted to be written
+
+		std::string block_name(file_identity const& ident, size_type index) const;
+		size_type block_length(file_identity const& ident, size_type index) const;
+
+		void load_index();
+		data_t load_block(file_identity const& ident, size_type index);
+		void store_block(file_identity ident, size_type index, data_t data);
+		bool save_block(file_identity const& ident, size_type index, std::vector<unsigned char> const& data);
+		// file names to remove, called with the mutex held
+		std::vector<std::string> evict();
+		void remove_files(std::vector<std::string> const& names);
+
+	public:
+		block_cache(boost::filesystem::path const& cache_dir, size_type block_size, size_type max_disk_size,
+			size_type max_pending_size, bool remote_only);
+		~block_cache();
+
+		block_cache(block_cache const&) = delete;
+		block_cache & operator=(block_cache const&) = delete;
+
+		// nfs, smb, fuse and the like
+		static bool is_remote(std::string const& path);
+
+		// false if the file is not cached at all (local with remote_only)
+		bool open_track(track & trk, std::string const& path);
+
+		// copies the cached bytes at pos, 0 if the block is not in the cache
+		size_type read(track & trk, size_type pos, unsigned char * dest, size_type len);
+		// the bytes read from the source at pos, a block is written when it is complete
+		void write(track & trk, size_type pos, unsigned char const * data, size_type len);
+	};
+}
+
+#endif // block_cache_h__
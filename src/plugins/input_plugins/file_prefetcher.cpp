@@ -0,0 +1,170 @@
+#include <algorithm>
+
+#ifdef _WIN32
+#include <boost/filesystem/fstream.hpp>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <boost/log/trivial.hpp>
+
+#include "common/scope_exit.h"
+
+#include "file_prefetcher.h"
+
+namespace mprt
+{
+	file_prefetcher::file_prefetcher(size_type head_size, size_type readahead_size, size_type max_cache_size)
+		: _pool(1, true)
+		, _head_size(head_size)
+		, _readahead_size(readahead_size)
+		, _max_cache_size(max_cache_size)
+		, _cached_bytes(0)
+		, _generation(0)
+	{
+	}
+
+	void file_prefetcher::prefetch(std::vector<std::string> const& paths)
+	{
+		auto generation = ++_generation;
+
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		for (auto const& path : paths)
+		{
+			auto cached = std::find_if(_entries.begin(), _entries.end(), [&path](entry const& ent) { return ent._ident._path == path; });
+			if (cached != _entries.end())
+			{
+				// still wanted, it is not one of the old list any more
+				cached->_generation = generation;
+				continue;
+			}
+
+			// the queued job reads it for this list too
+			auto inserted = _pending.emplace(path, generation);
+			if (!inserted.second)
+			{
+				inserted.first->second = generation;
+				continue;
+			}
+
+			_pool.post([this, path]
+			{
+				prefetch_file(path);
+			});
+		}
+	}
+
+	void file_prefetcher::prefetch_file(std::string const& path)
+	{
+		SCOPE_EXIT_REF(
+			std::lock_guard<std::mutex> lock(_mutex);
+			_pending.erase(path);
+		);
+
+		{
+			// the playlist has moved on since this one was last wanted
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (_pending[path] != _generation)
+				return;
+		}
+
+		auto ident = file_identity::from_path(path);
+		if (!ident._ok)
+			return;
+
+		auto data = std::make_shared<std::vector<unsigned char>>(static_cast<std::size_t>(std::min(_head_size, ident._size)));
+		size_type done = 0;
+
+#ifdef _WIN32
+		boost::filesystem::ifstream is(path, std::ios_base::binary);
+		if (!is)
+			return;
+
+		is.read(reinterpret_cast<char *>(data->data()), static_cast<std::streamsize>(data->size()));
+		done = static_cast<size_type>(is.gcount());
+#else
+		int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+			return;
+
+		SCOPE_EXIT_REF(::close(fd););
+
+		// the first read is the one which waits for a sleeping disk
+		while (done < static_cast<size_type>(data->size()))
+		{
+			auto res = ::read(fd, data->data() + done, static_cast<std::size_t>(static_cast<size_type>(data->size()) - done));
+			if (res < 0 && errno == EINTR)
+				continue;
+			if (res <= 0)
+				break;
+
+			done += res;
+		}
+
+		// the rest comes into the page cache in the background
+		(void)::posix_fadvise(fd, static_cast<off_t>(done), static_cast<off_t>(_readahead_size), POSIX_FADV_WILLNEED);
+#endif
+
+		data->resize(static_cast<std::size_t>(done));
+
+		BOOST_LOG_TRIVIAL(debug) << "prefetched: " << path << " bytes: " << done;
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		// a newer list may have asked for it again while it was read
+		auto generation = _pending[path];
+		_cached_bytes += done;
+		_entries.push_back({ ident, data, generation });
+		evict(generation);
+	}
+
+	void file_prefetcher::evict(uint64_t generation)
+	{
+		// the heads of older lists go first
+		auto iter = _entries.begin();
+		while (_cached_bytes > _max_cache_size && iter != _entries.end())
+		{
+			if (iter->_generation != generation)
+			{
+				_cached_bytes -= static_cast<size_type>(iter->_data->size());
+				iter = _entries.erase(iter);
+			}
+			else
+			{
+				++iter;
+			}
+		}
+
+		// then the last one of the current list, it is played the latest
+		while (_cached_bytes > _max_cache_size && !_entries.empty())
+		{
+			_cached_bytes -= static_cast<size_type>(_entries.back()._data->size());
+			_entries.pop_back();
+		}
+	}
+
+	file_prefetcher::data_t file_prefetcher::take(std::string const& path)
+	{
+		entry found;
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+
+			auto iter = std::find_if(_entries.begin(), _entries.end(), [&path](entry const& ent) { return ent._ident._path == path; });
+			if (iter == _entries.end())
+				return data_t();
+
+			found = *iter;
+			_cached_bytes -= static_cast<size_type>(found._data->size());
+			_entries.erase(iter);
+		}
+
+		// written since it was prefetched
+		if (!(file_identity::from_path(path) == found._ident))
+			return data_t();
+
+		return found._data;
+	}
+}
@@ -0,0 +1,64 @@
+#ifndef file_prefetcher_h__
+#define file_prefetcher_h__
+
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "common/common_defs.h"
+#include "common/file_identity.h"
+#include "common/worker_pool.h"
+
+namespace mprt
+{
+	// warms the files which are played next on a low priority thread: the head of each
+	// is read into memory and the kernel is asked to read ahead the part after it.
+	// the heads are kept in a bounded cache until the input plugin opens the file
+	class file_prefetcher
+	{
+	public:
+		using data_t = std::shared_ptr<std::vector<unsigned char> const>;
+
+	private:
+		struct entry
+		{
+			file_identity _ident;
+			data_t _data;
+			uint64_t _generation;
+		};
+
+		worker_pool _pool;
+		size_type _head_size;
+		size_type _readahead_size;
+		size_type _max_cache_size;
+
+		std::mutex _mutex;
+		std::list<entry> _entries; // in prefetch order
+		size_type _cached_bytes;
+		// the queued files with the newest list that wants them
+		std::unordered_map<std::string, uint64_t> _pending;
+		// a newer list makes the queued files of the older one pointless
+		std::atomic<uint64_t> _generation;
+
+		void prefetch_file(std::string const& path);
+		void evict(uint64_t generation);
+
+	public:
+		file_prefetcher(size_type head_size, size_type readahead_size, size_type max_cache_size);
+
+		file_prefetcher(file_prefetcher const&) = delete;
+		file_prefetcher & operator=(file_prefetcher const&) = delete;
+
+		// in playing order, replaces the previous list
+		void prefetch(std::vector<std::string> const& paths);
+
+		// the head of the file if it is prefetched and unchanged since, the entry is removed
+		data_t take(std::string const& path);
+	};
+}
+
+#endif // file_prefetcher_h__
@@ -0,0 +1,174 @@
+#include <boost/log/trivial.hpp>
+
+#include "http_connection.h"
+
+namespace mprt
+{
+	http_connection::http_connection(boost::asio::io_context & io, http_url const& url, tls_context * tls_ctx)
+		: _key(url.key())
+		, _resolver(io)
+		, _socket(io)
+		, _tls_context(tls_ctx)
+		, _responses(0)
+	{
+	}
+
+	void http_connection::connect(http_url const& url, connect_handler_t handler)
+	{
+		auto self = shared_from_this();
+
+		_resolver.async_resolve(url._host, url._port,
+			[this, self, url, handler](boost::system::error_code const& ec, tcp::resolver::results_type results)
+		{
+			if (ec)
+			{
+				handler(ec);
+				return;
+			}
+
+			boost::asio::async_connect(_socket, results,
+				[this, self, url, handler](boost::system::error_code const& ec, tcp::endpoint const&)
+			{
+				if (ec)
+				{
+					handler(ec);
+					return;
+				}
+
+				boost::system::error_code opt_ec;
+				_socket.set_option(tcp::no_delay(true), opt_ec);
+
+				if (url.is_tls())
+				{
+					handshake(url._host, handler);
+					return;
+				}
+
+				handler(ec);
+			});
+		});
+	}
+
+	void http_connection::handshake(std::string const& host, connect_handler_t handler)
+	{
+#ifdef _OPENSSL_FOUND
+		if (_tls_context)
+		{
+			_tls = std::make_unique<boost::asio::ssl::stream<tcp::socket &>>(_socket, *_tls_context);
+
+			// sni, most servers behind a cdn need it
+			(void)::SSL_set_tlsext_host_name(_tls->native_handle(), host.c_str());
+			_tls->set_verify_callback(boost::asio::ssl::host_name_verification(host));
+
+			auto self = shared_from_this();
+			_tls->async_handshake(boost::asio::ssl::stream_base::client,
+				[self, handler](boost::system::error_code const& ec)
+			{
+				handler(ec);
+			});
+			return;
+		}
+#endif
+
+		BOOST_LOG_TRIVIAL(error) << "https is not supported by this build, host: " << host;
+		handler(boost::asio::error::operation_not_supported);
+	}
+
+	void http_connection::write(std::string request, io_handler_t handler)
+	{
+		// the request has to live until it is written
+		_request = std::move(request);
+
+		auto self = shared_from_this();
+		with_stream([this, self, handler](auto & stream)
+		{
+			boost::asio::async_write(stream, boost::asio::buffer(_request),
+				[self, handler](boost::system::error_code const& ec, std::size_t bytes)
+			{
+				handler(ec, bytes);
+			});
+		});
+	}
+
+	void http_connection::read_some(unsigned char * buf, std::size_t len, io_handler_t handler)
+	{
+		auto self = shared_from_this();
+		with_stream([self, buf, len, handler](auto & stream)
+		{
+			stream.async_read_some(boost::asio::buffer(buf, len),
+				[self, handler](boost::system::error_code const& ec, std::size_t bytes)
+			{
+				handler(ec, bytes);
+			});
+		});
+	}
+
+	void http_connection::close()
+	{
+		boost::system::error_code ec;
+		_resolver.cancel();
+		_socket.close(ec);
+	}
+
+	http_connection_pool::http_connection_pool(size_type max_per_host, std::chrono::milliseconds idle_timeout)
+		: _max_per_host(max_per_host)
+		, _idle_timeout(idle_timeout)
+	{
+	}
+
+	http_connection_shared http_connection_pool::take(std::string const& key)
+	{
+		auto iter = _idle.find(key);
+		if (iter == _idle.end())
+			return http_connection_shared();
+
+		auto & idle_list = iter->second;
+		auto now = clock_type::now();
+		http_connection_shared conn;
+
+		while (!idle_list.empty() && !conn)
+		{
+			auto idle = idle_list.back();
+			idle_list.pop_back();
+
+			// the server has most likely dropped it already
+			if (now - idle._since < _idle_timeout && idle._conn->is_open())
+				conn = idle._conn;
+			else
+				idle._conn->close();
+		}
+
+		if (idle_list.empty())
+			_idle.erase(iter);
+
+		return conn;
+	}
+
+	void http_connection_pool::give_back(http_connection_shared conn)
+	{
+		if (!conn || !conn->is_open())
+			return;
+
+		auto & idle_list = _idle[conn->key()];
+		idle_list.push_back({ conn, clock_type::now() });
+
+		while (static_cast<size_type>(idle_list.size()) > _max_per_host)
+		{
+			idle_list.front()._conn->close();
+			idle_list.pop_front();
+		}
+	}
+
+	void http_connection_pool::clear()
+	{
+		for (auto & host : _idle)
+		{
+			for (auto & idle : host.second)
+			{
+				idle._conn->close();
+			}
+		}
+
+		_idle.clear();
+	}
+}
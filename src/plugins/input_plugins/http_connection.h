@@ -0,0 +1,112 @@
+#ifndef http_connection_h__
+#define http_connection_h__
+
+#include <list>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <functional>
+#include <unordered_map>
+
+#include <boost/asio.hpp>
+#ifdef _OPENSSL_FOUND
+#include <boost/asio/ssl.hpp>
+#endif
+
+#include "common/common_defs.h"
+
+#include "http_protocol.h"
+
+namespace mprt
+{
+#ifdef _OPENSSL_FOUND
+	using tls_context = boost::asio::ssl::context;
+#else
+	struct tls_context {};
+#endif
+
+	// a plain or tls connection to one scheme://host:port. it is used from the io thread
+	// of the plugin only, the handlers keep the connection alive until they are called
+	class http_connection : public std::enable_shared_from_this<http_connection>
+	{
+	public:
+		using tcp = boost::asio::ip::tcp;
+		using connect_handler_t = std::function<void(boost::system::error_code const&)>;
+		using io_handler_t = std::function<void(boost::system::error_code const&, std::size_t)>;
+
+	private:
+		std::string _key;
+		tcp::resolver _resolver;
+		tcp::socket _socket;
+#ifdef _OPENSSL_FOUND
+		std::unique_ptr<boost::asio::ssl::stream<tcp::socket &>> _tls;
+#endif
+		tls_context * _tls_context;
+		std::string _request;
+		size_type _responses; // read to the end on this connection
+
+		template <typename Func>
+		void with_stream(Func f)
+		{
+#ifdef _OPENSSL_FOUND
+			if (_tls)
+			{
+				f(*_tls);
+				return;
+			}
+#endif
+			f(_socket);
+		}
+
+		void handshake(std::string const& host, connect_handler_t handler);
+
+	public:
+		http_connection(boost::asio::io_context & io, http_url const& url, tls_context * tls_ctx);
+
+		http_connection(http_connection const&) = delete;
+		http_connection & operator=(http_connection const&) = delete;
+
+		std::string const& key() const { return _key; }
+		bool is_open() const { return _socket.is_open(); }
+		// a reused connection may have been closed by the server while it was idle
+		bool is_reused() const { return _responses > 0; }
+		void response_done() { ++_responses; }
+
+		// resolves, connects and does the tls handshake for https
+		void connect(http_url const& url, connect_handler_t handler);
+		void write(std::string request, io_handler_t handler);
+		void read_some(unsigned char * buf, std::size_t len, io_handler_t handler);
+		// the running operations finish with operation_aborted
+		void close();
+	};
+
+	using http_connection_shared = std::shared_ptr<http_connection>;
+
+	// idle keep-alive connections by scheme://host:port, the next track from the same
+	// server goes out on one of them without a new tcp and tls handshake
+	class http_connection_pool
+	{
+	private:
+		using clock_type = std::chrono::steady_clock;
+
+		struct idle_connection
+		{
+			http_connection_shared _conn;
+			clock_type::time_point _since;
+		};
+
+		std::unordered_map<std::string, std::list<idle_connection>> _idle;
+		size_type _max_per_host;
+		std::chrono::milliseconds _idle_timeout;
+
+	public:
+		http_connection_pool(size_type max_per_host, std::chrono::milliseconds idle_timeout);
+
+		// the most recently used one, nullptr if there is none left
+		http_connection_shared take(std::string const& key);
+		void give_back(http_connection_shared conn);
+		void clear();
+	};
+}
+
+#endif // http_connection_h__
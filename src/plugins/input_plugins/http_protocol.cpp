@@ -0,0 +1,443 @@
+#include <cctype>
+#include <cstring>
+#include <limits>
+#include <vector>
+#include <algorithm>
+
+#include <boost/algorithm/string.hpp>
+
+#include "http_protocol.h"
+
+namespace mprt
+{
+	namespace
+	{
+		constexpr std::size_t _MAX_CHUNK_LINE_ = 256;
+
+		// digits only: stoull takes a sign and wraps a negative value around, a size out of
+		// the range of size_type would turn negative too
+		bool parse_number(std::string const& str, size_type & val, int base = 10)
+		{
+			if (str.empty() || !std::isxdigit(static_cast<unsigned char>(str.front())))
+				return false;
+
+			try
+			{
+				std::size_t pos = 0;
+				auto number = std::stoull(str, &pos, base);
+				if (pos != str.size() || number > static_cast<unsigned long long>(std::numeric_limits<size_type>::max()))
+					return false;
+
+				val = static_cast<size_type>(number);
+				return true;
+			}
+			catch (std::exception const&)
+			{
+				return false;
+			}
+		}
+	}
+
+	http_url http_url::parse(std::string const& url)
+	{
+		http_url res;
+
+		auto scheme_end = url.find("://");
+		if (scheme_end == std::string::npos)
+			return res;
+
+		res._scheme = boost::to_lower_copy(url.substr(0, scheme_end));
+		if (res._scheme != "http" && res._scheme != "https")
+			return res;
+
+		auto auth_start = scheme_end + 3;
+		auto auth_end = url.find_first_of("/?#", auth_start);
+		auto authority = url.substr(auth_start, auth_end == std::string::npos ? std::string::npos : auth_end - auth_start);
+
+		// user:password@ is not sent
+		auto at_pos = authority.rfind('@');
+		if (at_pos != std::string::npos)
+			authority.erase(0, at_pos + 1);
+
+		std::string::size_type port_pos;
+		if (!authority.empty() && authority.front() == '[')
+		{
+			auto close_pos = authority.find(']');
+			if (close_pos == std::string::npos)
+				return res;
+
+			res._host = authority.substr(1, close_pos - 1);
+			port_pos = authority.find(':', close_pos);
+		}
+		else
+		{
+			port_pos = authority.rfind(':');
+			res._host = authority.substr(0, port_pos);
+		}
+
+		res._port = port_pos != std::string::npos ? authority.substr(port_pos + 1) : "";
+		if (res._port.empty())
+			res._port = res.is_tls() ? "443" : "80";
+
+		res._target = auth_end != std::string::npos ? url.substr(auth_end) : "/";
+		auto fragment_pos = res._target.find('#');
+		if (fragment_pos != std::string::npos)
+			res._target.erase(fragment_pos);
+		if (res._target.empty() || res._target.front() != '/')
+			res._target.insert(0, "/");
+
+		res._ok = !res._host.empty();
+		return res;
+	}
+
+	http_url http_url::resolve(std::string const& location) const
+	{
+		if (location.find("://") != std::string::npos)
+			return parse(location);
+
+		if (location.compare(0, 2, "//") == 0)
+			return parse(_scheme + ":" + location);
+
+		http_url res = *this;
+		if (!location.empty() && location.front() == '/')
+		{
+			res._target = location;
+		}
+		else
+		{
+			auto path = _target.substr(0, _target.find('?'));
+			res._target = path.substr(0, path.rfind('/') + 1) + location;
+		}
+
+		return res;
+	}
+
+	std::string http_url::host_header() const
+	{
+		auto host = _host.find(':') != std::string::npos ? "[" + _host + "]" : _host;
+		auto default_port = is_tls() ? "443" : "80";
+
+		return _port == default_port ? host : host + ":" + _port;
+	}
+
+	bool http_response::parse(std::string const& head)
+	{
+		std::vector<std::string> lines;
+		boost::split(lines, head, boost::is_any_of("\n"));
+		if (lines.empty())
+			return false;
+
+		for (auto & line : lines)
+		{
+			boost::trim_right_if(line, boost::is_any_of("\r"));
+		}
+
+		std::vector<std::string> status_line;
+		boost::split(status_line, lines.front(), boost::is_space(), boost::token_compress_on);
+		if (status_line.size() < 2)
+			return false;
+
+		auto const& version = status_line[0];
+		if (version == "HTTP/1.1")
+			_http11 = true;
+		else if (version != "HTTP/1.0" && version != "ICY")
+			return false;
+
+		size_type status = 0;
+		if (!parse_number(status_line[1], status))
+			return false;
+		_status = static_cast<int>(status);
+
+		for (std::size_t i = 1; i < lines.size(); ++i)
+		{
+			auto colon_pos = lines[i].find(':');
+			if (colon_pos == std::string::npos)
+				continue;
+
+			auto name = boost::to_lower_copy(boost::trim_copy(lines[i].substr(0, colon_pos)));
+			auto value = boost::trim_copy(lines[i].substr(colon_pos + 1));
+
+			auto & header_val = _headers[name];
+			header_val = header_val.empty() ? value : header_val + ", " + value;
+		}
+
+		return true;
+	}
+
+	std::string http_response::header(std::string const& name) const
+	{
+		auto iter = _headers.find(name);
+		return iter != _headers.end() ? iter->second : std::string();
+	}
+
+	bool http_response::keep_alive() const
+	{
+		auto connection = boost::to_lower_copy(header("connection"));
+
+		return _http11 ?
+			connection.find("close") == std::string::npos :
+			connection.find("keep-alive") != std::string::npos;
+	}
+
+	bool http_response::is_redirect() const
+	{
+		return (_status == 301 || _status == 302 || _status == 303 || _status == 307 || _status == 308) &&
+			!header("location").empty();
+	}
+
+	bool http_response::is_chunked() const
+	{
+		return boost::to_lower_copy(header("transfer-encoding")).find("chunked") != std::string::npos;
+	}
+
+	size_type http_response::content_length() const
+	{
+		size_type length = 0;
+		return parse_number(header("content-length"), length) ? length : -1;
+	}
+
+	bool http_response::content_range(size_type & start, size_type & total) const
+	{
+		auto range = boost::to_lower_copy(header("content-range"));
+		if (range.compare(0, 6, "bytes ") != 0)
+			return false;
+
+		auto dash_pos = range.find('-', 6);
+		auto slash_pos = range.find('/', 6);
+		if (dash_pos == std::string::npos || slash_pos == std::string::npos)
+			return false;
+
+		if (!parse_number(boost::trim_copy(range.substr(6, dash_pos - 6)), start))
+			return false;
+
+		auto total_str = boost::trim_copy(range.substr(slash_pos + 1));
+		if (total_str == "*")
+		{
+			total = -1;
+			return true;
+		}
+
+		return parse_number(total_str, total);
+	}
+
+	void http_body_decoder::reset(framing body_framing, size_type length)
+	{
+		_framing = body_framing;
+		_remaining = body_framing == framing::length ? length : 0;
+		_chunk_state = chunk_state::size;
+		_line.clear();
+		_error = false;
+	}
+
+	size_type http_body_decoder::decode(unsigned char * data, size_type len)
+	{
+		switch (_framing)
+		{
+		case framing::close:
+			return len;
+
+		case framing::length:
+		{
+			auto body_len = std::min(len, _remaining);
+			_remaining -= body_len;
+			return body_len;
+		}
+
+		case framing::chunked:
+			break;
+		}
+
+		size_type in = 0, out = 0;
+
+		while (in < len && _chunk_state != chunk_state::done && !_error)
+		{
+			switch (_chunk_state)
+			{
+			case chunk_state::size:
+			{
+				auto ch = static_cast<char>(data[in++]);
+				if (ch != '\n')
+				{
+					_line.push_back(ch);
+					_error = _line.size() > _MAX_CHUNK_LINE_;
+					break;
+				}
+
+				// chunk extensions are not used
+				auto size_str = boost::trim_copy(_line.substr(0, _line.find(';')));
+				_line.clear();
+
+				size_type chunk_size = 0;
+				if (!parse_number(size_str, chunk_size, 16))
+				{
+					_error = true;
+					break;
+				}
+
+				_remaining = chunk_size;
+				_chunk_state = chunk_size == 0 ? chunk_state::trailer : chunk_state::data;
+				break;
+			}
+
+			case chunk_state::data:
+			{
+				auto data_len = std::min(_remaining, len - in);
+				std::memmove(data + out, data + in, static_cast<std::size_t>(data_len));
+				in += data_len;
+				out += data_len;
+				_remaining -= data_len;
+
+				if (_remaining == 0)
+					_chunk_state = chunk_state::data_end;
+				break;
+			}
+
+			case chunk_state::data_end:
+				if (data[in++] == '\n')
+					_chunk_state = chunk_state::size;
+				break;
+
+			case chunk_state::trailer:
+			{
+				auto ch = static_cast<char>(data[in++]);
+				if (ch != '\n')
+				{
+					_line.push_back(ch);
+					_error = _line.size() > _MAX_CHUNK_LINE_;
+					break;
+				}
+
+				boost::trim_right_if(_line, boost::is_any_of("\r"));
+				if (_line.empty())
+					_chunk_state = chunk_state::done;
+				_line.clear();
+				break;
+			}
+
+			case chunk_state::done:
+				break;
+			}
+		}
+
+		return out;
+	}
+
+	bool http_body_decoder::finished() const
+	{
+		switch (_framing)
+		{
+		case framing::length:
+			return _remaining == 0;
+		case framing::chunked:
+			return _chunk_state == chunk_state::done;
+		case framing::close:
+			break;
+		}
+
+		return false;
+	}
+
+	void icy_demuxer::reset(size_type metaint)
+	{
+		_metaint = std::max<size_type>(metaint, 0);
+		_audio_left = _metaint;
+		_meta_left = 0;
+		_in_meta = false;
+		_meta.clear();
+	}
+
+	size_type icy_demuxer::demux(unsigned char * data, size_type len, metadata_func_t const& on_metadata)
+	{
+		if (!enabled())
+			return len;
+
+		size_type in = 0, out = 0;
+
+		while (in < len)
+		{
+			if (!_in_meta && _audio_left > 0)
+			{
+				auto audio_len = std::min(_audio_left, len - in);
+				std::memmove(data + out, data + in, static_cast<std::size_t>(audio_len));
+				in += audio_len;
+				out += audio_len;
+				_audio_left -= audio_len;
+			}
+			else if (!_in_meta)
+			{
+				_meta_left = data[in++] * 16;
+				_in_meta = _meta_left > 0;
+				_meta.clear();
+
+				if (!_in_meta)
+					_audio_left = _metaint;
+			}
+			else
+			{
+				auto meta_len = std::min(_meta_left, len - in);
+				_meta.append(reinterpret_cast<char const*>(data + in), static_cast<std::size_t>(meta_len));
+				in += meta_len;
+				_meta_left -= meta_len;
+
+				if (_meta_left == 0)
+				{
+					_in_meta = false;
+					_audio_left = _metaint;
+
+					// padded with zeros to the 16 byte blocks
+					_meta.erase(std::find(_meta.begin(), _meta.end(), '\0'), _meta.end());
+					if (!_meta.empty() && on_metadata)
+						on_metadata(_meta);
+				}
+			}
+		}
+
+		return out;
+	}
+
+	std::string icy_demuxer::stream_title(std::string const& metadata)
+	{
+		std::string const title_key = "StreamTitle='";
+
+		auto start = metadata.find(title_key);
+		if (start == std::string::npos)
+			return std::string();
+
+		start += title_key.size();
+
+		// the title itself may have quotes in it
+		auto end = metadata.find("';", start);
+		if (end == std::string::npos)
+			end = metadata.rfind('\'');
+		if (end == std::string::npos || end < start)
+			return std::string();
+
+		return metadata.substr(start, end - start);
+	}
+
+	std::string ext_from_content_type(std::string const& content_type)
+	{
+		static std::unordered_map<std::string, std::string> const ext_map = {
+			{ "audio/mpeg", "mp3" },
+			{ "audio/mp3", "mp3" },
+			{ "audio/aac", "aac" },
+			{ "audio/aacp", "aac" },
+			{ "audio/x-aac", "aac" },
+			{ "audio/mp4", "m4a" },
+			{ "audio/x-m4a", "m4a" },
+			{ "audio/ogg", "ogg" },
+			{ "application/ogg", "ogg" },
+			{ "audio/opus", "opus" },
+			{ "audio/flac", "flac" },
+			{ "audio/x-flac", "flac" },
+			{ "audio/wav", "wav" },
+			{ "audio/x-wav", "wav" },
+			{ "audio/wave", "wav" },
+		};
+
+		auto mime = boost::to_lower_copy(boost::trim_copy(content_type.substr(0, content_type.find(';'))));
+		auto iter = ext_map.find(mime);
+
+		return iter != ext_map.end() ? iter->second : std::string();
+	}
+}
@@ -0,0 +1,132 @@
+#ifndef http_protocol_h__
+#define http_protocol_h__
+
+#include <string>
+#include <functional>
+#include <unordered_map>
+
+#include "common/common_defs.h"
+
+namespace mprt
+{
+	struct http_url
+	{
+		std::string _scheme; // lower case
+		std::string _host;
+		std::string _port;
+		std::string _target; // path and query
+		bool _ok;
+
+		http_url()
+			: _ok(false)
+		{}
+
+		static http_url parse(std::string const& url);
+
+		// a Location header may be relative to this one
+		http_url resolve(std::string const& location) const;
+
+		bool is_tls() const { return _scheme == "https"; }
+		// connections are shared by the urls with the same key
+		std::string key() const { return _scheme + "://" + _host + ":" + _port; }
+		std::string host_header() const;
+		std::string str() const { return key() + _target; }
+	};
+
+	struct http_response
+	{
+		int _status;
+		bool _http11;
+		std::unordered_map<std::string, std::string> _headers; // lower case names
+
+		http_response()
+			: _status(0)
+			, _http11(false)
+		{}
+
+		// the header block without the empty line, shoutcast "ICY 200 OK" is taken as HTTP/1.0
+		bool parse(std::string const& head);
+
+		std::string header(std::string const& name) const;
+		bool keep_alive() const;
+		bool is_redirect() const;
+		bool is_chunked() const;
+		size_type content_length() const; // -1 if there is none
+
+		// Content-Range: bytes start-end/total, total is -1 for '*'
+		bool content_range(size_type & start, size_type & total) const;
+	};
+
+	// takes the framing off a response body: the body bytes of each buffer are moved to
+	// its start, so they can be left in the cache chunk they were read into
+	class http_body_decoder
+	{
+	public:
+		enum class framing { length, chunked, close };
+
+	private:
+		enum class chunk_state { size, data, data_end, trailer, done };
+
+		framing _framing;
+		size_type _remaining; // of the body or of the current chunk
+		chunk_state _chunk_state;
+		std::string _line;
+		bool _error;
+
+	public:
+		http_body_decoder()
+			: _framing(framing::close)
+			, _remaining(0)
+			, _chunk_state(chunk_state::size)
+			, _error(false)
+		{}
+
+		void reset(framing body_framing, size_type length = -1);
+
+		// returns the body bytes now at the start of data
+		size_type decode(unsigned char * data, size_type len);
+
+		bool finished() const;
+		bool error() const { return _error; }
+		framing body_framing() const { return _framing; }
+		// bytes left by Content-Length, -1 if it is not known
+		size_type remaining() const { return _framing == framing::length ? _remaining : -1; }
+	};
+
+	// shoutcast/icecast in stream metadata: a length byte and length * 16 bytes of
+	// metadata after every metaint bytes of audio
+	class icy_demuxer
+	{
+	public:
+		using metadata_func_t = std::function<void(std::string const&)>;
+
+	private:
+		size_type _metaint;
+		size_type _audio_left;
+		size_type _meta_left;
+		bool _in_meta;
+		std::string _meta;
+
+	public:
+		icy_demuxer()
+			: _metaint(0)
+			, _audio_left(0)
+			, _meta_left(0)
+			, _in_meta(false)
+		{}
+
+		// 0 turns it off
+		void reset(size_type metaint);
+		bool enabled() const { return _metaint > 0; }
+
+		// the audio bytes are moved to the start of data, returns their count
+		size_type demux(unsigned char * data, size_type len, metadata_func_t const& on_metadata);
+
+		static std::string stream_title(std::string const& metadata);
+	};
+
+	// file extension for the decoder from a mime type, empty if it is not known
+	std::string ext_from_content_type(std::string const& content_type);
+}
+
+#endif // http_protocol_h__
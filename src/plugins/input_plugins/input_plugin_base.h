@@ -0,0 +1,315 @@
+#ifndef input_plugin_base_h__
+#define input_plugin_base_h__
+
+#include <algorithm>
+#include <functional>
+#include <list>
+#include <memory>
+#include <string>
+#include <chrono>
+
+#include <boost/log/trivial.hpp>
+
+#include "common/input_plugin_api.h"
+#include "common/utils.h"
+
+namespace mprt {
+
+	// the queue, seek and job plumbing the input plugins share. an item needs _url_id and
+	// _cache_buf, the plugin opens it, moves its reads on in read_step and seeks it in seek_item
+	template <typename Item>
+	class input_plugin_base : public input_plugin_api
+	{
+	protected:
+		using item_shared = std::shared_ptr<Item>;
+		using file_list_t = std::list<item_shared>;
+
+		file_list_t _files;
+		file_list_t _finished_files;
+		size_type _max_finish_files;
+		decoder_finish_callback_register_func_t _decoder_finish_callback;
+		set_input_cache_buf_callback_register_func_t _set_input_cache_buf_callback;
+		seek_callback_register_func_t _seek_callback;
+
+		// nullptr if the url cannot be read by this plugin
+		virtual item_shared make_item(std::string const& url, url_id_t url_id) = 0;
+		// the time until the next step
+		virtual std::chrono::microseconds read_step() = 0;
+		// false if the item cannot be moved to seek_point
+		virtual bool seek_item(Item & item, size_type seek_point) = 0;
+		// the item leaves the plugin, its running reads are dropped here
+		virtual void release_item(Item & /*item*/) {}
+
+		bool add_file(std::string url, url_id_t url_id)
+		{
+			auto item = make_item(url, url_id);
+			if (!item)
+				return false;
+
+			_files.push_back(item);
+
+			BOOST_LOG_TRIVIAL(trace) << "item added: " << url << " id: " << url_id;
+
+			if (plugin_states::play == _current_state)
+			{
+				cont();
+			}
+
+			return true;
+		}
+
+		void drop_file(item_shared const& item)
+		{
+			release_item(*item);
+			_files.remove(item);
+		}
+
+		void close_file(item_shared const& item)
+		{
+			auto iter = std::find(_files.begin(), _files.end(), item);
+			if (iter != _files.end())
+			{
+				_finished_files.push_back(item);
+				_files.erase(iter);
+			}
+		}
+
+		void remove_file(url_id_t url_id)
+		{
+			if (!remove_file_helper(_files, url_id))
+			{
+				remove_file_helper(_finished_files, url_id);
+			}
+		}
+
+		bool remove_file_helper(file_list_t & cnt, url_id_t url_id)
+		{
+			for (auto iter = cnt.begin(); iter != cnt.end(); ++iter)
+			{
+				if ((*iter)->_url_id == url_id)
+				{
+					release_item(**iter);
+					cnt.erase(iter);
+					return true;
+				}
+			}
+
+			return false;
+		}
+
+		// the details every opened item is reported with, the plugin changes what differs
+		std::shared_ptr<current_decoder_details> make_decoder_details(Item const& item, std::string const& url, bool is_opened, size_type stream_length)
+		{
+			auto cur_decoder_detail = std::make_shared<current_decoder_details>();
+			cur_decoder_detail->_sound_details._ok = is_opened;
+			cur_decoder_detail->_url = url;
+			cur_decoder_detail->_url_ext = get_ext(url);
+			cur_decoder_detail->_stream_length = stream_length;
+			cur_decoder_detail->_sound_details._total_samples = 0;
+			cur_decoder_detail->_current_samples_written = 0;
+			cur_decoder_detail->_current_stream_pos = 0;
+			cur_decoder_detail->_last_read_empty = true;
+			cur_decoder_detail->_length_supported = true;
+			cur_decoder_detail->_seek_supported = true;
+			cur_decoder_detail->_tell_supported = true;
+			cur_decoder_detail->_sound_details._url_id = item._url_id;
+			cur_decoder_detail->_set_input_cache_buf_callback = _set_input_cache_buf_callback;
+			cur_decoder_detail->_decoder_finish_callback = _decoder_finish_callback;
+			cur_decoder_detail->_seek_callback = _seek_callback;
+
+			return cur_decoder_detail;
+		}
+
+		void try_read()
+		{
+			_STATE_CHECK_(plugin_states::play);
+
+			if (_file_read_timer && is_active_timer(_file_read_timer))
+			{
+				return;
+			}
+
+			schedule_read(read_step());
+		}
+
+		void schedule_read(std::chrono::microseconds next_dur)
+		{
+			if (is_no_job())
+			{
+				BOOST_LOG_TRIVIAL(trace) << "stopping read: " << plugin_name();
+				return;
+			}
+
+			if (!_file_read_timer || is_timer_expired(_file_read_timer))
+			{
+				_file_read_timer = add_job_thread_internal([this]() {
+					try_read();
+				}, next_dur);
+			}
+		}
+
+		void wake_reader()
+		{
+			// a cancelled timer runs its job at once
+			if (_file_read_timer && is_active_timer(_file_read_timer))
+			{
+				_file_read_timer->cancel();
+			}
+			else
+			{
+				try_read();
+			}
+		}
+
+		typename file_list_t::iterator seek_helper(file_list_t & file_cont, url_id_t url_id, size_type seek_point)
+		{
+			auto iter = file_cont.begin(), iter_end = file_cont.end();
+			for (; iter != iter_end; ++iter)
+			{
+				if ((*iter)->_url_id == url_id)
+				{
+					return seek_item(**iter, seek_point) ? iter : iter_end;
+				}
+			}
+
+			return iter_end;
+		}
+
+		void seek_callback_internal(url_id_t url_id, size_type seek_point)
+		{
+			BOOST_LOG_TRIVIAL(debug) << plugin_name() << " seek callback point: " << seek_point;
+			auto was_no_job = is_no_job();
+
+			auto file_detail_iter = seek_helper(_files, url_id, seek_point);
+
+			if (file_detail_iter == _files.end())
+			{
+				file_detail_iter = seek_helper(_finished_files, url_id, seek_point);
+
+				if (file_detail_iter != _finished_files.end())
+				{
+					_files.push_front(*file_detail_iter);
+					_finished_files.erase(file_detail_iter);
+				}
+			}
+
+			if (was_no_job)
+			{
+				_current_state = plugin_states::play;
+				cont_internal();
+			}
+			else if (plugin_states::play == _current_state)
+			{
+				// the reader may be sleeping on a full buffer which is empty now
+				wake_reader();
+			}
+		}
+
+		void seek_callback_job(url_id_t url_id, size_type seek_point)
+		{
+			add_job([this, url_id, seek_point]
+			{
+				seek_callback_internal(url_id, seek_point);
+			});
+		}
+
+		void input_close(url_id_t url_id)
+		{
+			BOOST_LOG_TRIVIAL(trace) << plugin_name() << " input_close() called for id: " << url_id;
+
+			if (!remove_file_helper(_finished_files, url_id) && !remove_file_helper(_files, url_id))
+			{
+				BOOST_LOG_TRIVIAL(debug) << "cannot remove: " << url_id;
+			}
+		}
+
+		bool is_no_job() override
+		{
+			return _files.empty();
+		}
+
+		virtual void stop_internal() override
+		{
+			BOOST_LOG_TRIVIAL(debug) << plugin_name() << " stop_internal() called";
+		}
+
+		virtual void pause_internal() override
+		{
+			BOOST_LOG_TRIVIAL(debug) << plugin_name() << " pause_internal() called";
+		}
+
+		virtual void cont_internal() override
+		{
+			BOOST_LOG_TRIVIAL(debug) << plugin_name() << " cont_internal() called";
+
+			try_read();
+		}
+
+		virtual void quit_internal() override
+		{
+
+		}
+
+	public:
+		input_plugin_base()
+			: _max_finish_files(3)
+			, _decoder_finish_callback(std::bind(&input_plugin_base::decoder_finish, this, std::placeholders::_1, std::placeholders::_2))
+			, _set_input_cache_buf_callback(std::bind(&input_plugin_base::set_cache_buffer, this, std::placeholders::_1, std::placeholders::_2))
+			, _seek_callback(std::bind(&input_plugin_base::seek_callback_job, this, std::placeholders::_1, std::placeholders::_2))
+		{
+		}
+
+		// job functions
+		virtual url_id_t add_input_item(std::string filename) override
+		{
+			BOOST_LOG_TRIVIAL(trace) << plugin_name() << " add_input_item called with " << filename;
+
+			auto url_id = ++_url_id;
+			add_job([=]() {
+				add_file(filename, url_id);
+			});
+
+			return url_id;
+		}
+
+		virtual url_id_t add_input_item(std::string filename, url_id_t url_id) override
+		{
+			add_job([=]() {
+				add_file(filename, url_id);
+			});
+
+			return url_id;
+		}
+
+		virtual void remove_input_item(url_id_t url_id) override
+		{
+			BOOST_LOG_TRIVIAL(trace) << plugin_name() << " remove() item called with " << url_id;
+
+			add_job([=]() { remove_file(url_id); });
+		}
+
+		virtual void set_cache_buffer(url_id_t url_id, cache_buffer_shared cache_buf) override
+		{
+			add_job([=]
+			{
+				for (auto & file : _files)
+				{
+					if (url_id == file->_url_id) {
+						file->_cache_buf = cache_buf;
+						break;
+					}
+				}
+			});
+		}
+
+		// decoder thread functions
+		virtual void decoder_finish(std::string /*plugin_name*/, url_id_t url_id) override
+		{
+			add_job([this, url_id]() {
+				input_close(url_id);
+			});
+		}
+	};
+}
+
+#endif // input_plugin_base_h__
@@ -70,6 +70,35 @@ namespace mprt {
 		_max_file_chunk_size = pt.get<size_type>("max_file_chunk_size", 128) * 1024;
 		_max_finish_files = pt.get<size_type>("max_finish_files", 3);
 
+		if (pt.get<std::string>("use_paced_reads", "true") == "true")
+		{
+			_rate_controller = std::make_unique<io_rate_controller>(
+				pt.get<double>("target_buffer_secs", 8.0),
+				pt.get<double>("low_buffer_secs", 3.0),
+				pt.get<double>("read_time_msecs", 20.0) / 1000,
+				pt.get<size_type>("min_read_size", 16) * 1024,
+				std::chrono::milliseconds(pt.get<std::size_t>("max_sleep_msecs", 4000)));
+		}
+		_max_tick_time = std::chrono::milliseconds(pt.get<std::size_t>("max_tick_msecs", 50));
+
+		if (pt.get<std::string>("use_prefetch", "true") == "true")
+		{
+			_prefetcher = std::make_unique<file_prefetcher>(
+				pt.get<size_type>("prefetch_head_size", 512) * 1024,
+				pt.get<size_type>("prefetch_readahead_size", 4096) * 1024,
+				pt.get<size_type>("prefetch_cache_size", 8192) * 1024);
+		}
+
+		if (pt.get<std::string>("use_block_cache", "false") == "true")
+		{
+			_block_cache = std::make_unique<block_cache>(
+				pt.get<std::string>("block_cache_dir", "../cache/input_blocks"),
+				pt.get<size_type>("block_cache_block_size", 1024) * 1024,
+				pt.get<size_type>("block_cache_disk_size", 2048) * 1024 * 1024,
+				pt.get<size_type>("block_cache_max_pending", 8192) * 1024,
+				pt.get<std::string>("block_cache_remote_only", "true") == "true");
+		}
+
 		_async_task = std::make_shared<async_tasker>(pt.get<std::size_t>("max_free_timer_count", 10));
 	}
 
@@ -132,6 +161,21 @@ namespace mprt {
 				// Stop eating new lines in binary mode!!!
 				file_iter_ref->_file->unsetf(std::ios::skipws);
 				is_opened = true;
+
+				if (_prefetcher)
+				{
+					file_iter_ref->_prefetched = _prefetcher->take(filename);
+				}
+
+				if (_rate_controller)
+				{
+					_rate_controller->start_track(file_iter_ref->_rate, filename, 0);
+				}
+
+				if (_block_cache)
+				{
+					file_iter_ref->_use_block_cache = _block_cache->open_track(file_iter_ref->_blocks, filename);
+				}
 			}
 			
 		}
@@ -227,76 +271,164 @@ namespace mprt {
 			file_iter_ref->_cache_buf
 			&&_current_state == plugin_states::play)
 		{
-
-			// file read part
-			// here is complicated may be a better algorithm can be found ...
-			// get the cache buffer
-			auto file_chunk_contents = file_iter_ref->_cache_buf->get_cache_ptr();
 			bool is_file_finished = false;
-			// check the buffer and file id
-// 			if (file_chunk_contents_tagged->second != (*file_iter)->_url_id) {
-// 				BOOST_LOG_TRIVIAL(debug)
-// 					<< "file : " << file_chunk_contents_tagged->second
-// 					<< " file : " << (*file_iter)->_url_id;
-// 			}
-			if (file_chunk_contents)
+
+			next_dur = _rate_controller ?
+				read_paced(*file_iter_ref, is_file_finished) :
+				read_fixed(*file_iter_ref, is_file_finished);
+
+			if (is_file_finished) {
+				close_file(file_iter);
+			}
+		}
+	}
+
+	bool input_plugin_file::read_chunk(file_details & file, size_type max_size, size_type & read_count, bool & is_file_finished)
+	{
+		// file read part
+		// get the cache buffer
+		auto file_chunk_contents = file._cache_buf->get_cache_ptr();
+		if (!file_chunk_contents)
+		{
+			//BOOST_LOG_TRIVIAL(debug)<< "no cache means full data";
+			return false;
+		}
+
+		read_count = 0;
+
+		// read the file now
+		try
+		{
+			auto & file_chunk_contents_ref = *file_chunk_contents;
+			auto free_size = std::min<size_type>(max_size, file_chunk_contents_ref->second.reserve());
+			auto chunk_size = file_chunk_contents_ref->second.size();
+			if (0 == chunk_size) file_chunk_contents_ref->first = file._file->tellg();
+			file_chunk_contents_ref->second.resize(chunk_size + static_cast<std::size_t>(free_size));
+			auto begin_point = file_chunk_contents_ref->second.linearize();
+
+			auto const& prefetched = file._prefetched;
+			auto dest = begin_point + chunk_size;
+			file._last_read_cached = false;
+
+			if (prefetched && file._current_read_so_far < static_cast<size_type>(prefetched->size()))
 			{
-				// read the file now
-				try
-				{
-					auto & file_chunk_contents_ref = *file_chunk_contents;
-					auto free_size = std::min<size_type>(_max_file_chunk_size, file_chunk_contents_ref->second.reserve());
-					auto chunk_size = file_chunk_contents_ref->second.size();
-					if (0 == chunk_size) file_chunk_contents_ref->first = file_iter_ref->_file->tellg();
-					file_chunk_contents_ref->second.resize(chunk_size + static_cast<std::size_t>(free_size));
-					auto begin_point = file_chunk_contents_ref->second.linearize();
-					file_iter_ref->_file->read(reinterpret_cast<char*>(begin_point + chunk_size), free_size);
-					auto read_count = static_cast<size_type>(file_iter_ref->_file->gcount());
-
-					if (free_size > read_count) {
-						file_chunk_contents_ref->second.erase_end(static_cast<size_t>(free_size - read_count));
-					}
-					file_iter_ref->_current_read_so_far += read_count;
-					is_file_finished =
-						file_iter_ref->_current_read_so_far == file_iter_ref->_file_size ||
-						file_iter_ref->_file->eof();
-
-					file_iter_ref->_cache_buf->put_cache_ptr(is_file_finished);
-
-					/*BOOST_LOG_TRIVIAL(debug)
-					<< "data size:"
-					<< (*file_iter)->_cache_buf->data_size_guess();*/
-
-					if (file_iter_ref->_cache_buf->buffer_size_count() - file_iter_ref->_cache_buf->data_size_guess() <= 2)
-					{
-						//BOOST_LOG_TRIVIAL(debug) << "data near full";
-						next_dur = std::chrono::seconds(1);
-					}
-					else if (file_iter_ref->_cache_buf->data_size_guess() > 2)
-					{
-						//BOOST_LOG_TRIVIAL(debug) << "data ok";
-						next_dur = std::chrono::milliseconds(100);
-					}
-					else
-					{
-						//BOOST_LOG_TRIVIAL(debug) << "data near empty";
-						next_dur = std::chrono::microseconds(0);
-					}
-
-					if (is_file_finished) {
-						close_file(file_iter);
-					}
+				// the prefetched head goes in without touching the disk, the stream is kept at the same position
+				read_count = std::min<size_type>(free_size, static_cast<size_type>(prefetched->size()) - file._current_read_so_far);
+				std::copy_n(prefetched->data() + file._current_read_so_far, read_count, dest);
+				file._file->seekg(file._current_read_so_far + read_count);
+				file._last_read_cached = true;
+			}
+			else if (file._use_block_cache &&
+				(read_count = _block_cache->read(file._blocks, file._current_read_so_far, dest, free_size)) > 0)
+			{
+				// replays and seeks into recently played parts come from the local disk
+				file._file->seekg(file._current_read_so_far + read_count);
+				file._last_read_cached = true;
+			}
+			else
+			{
+				file._file->read(reinterpret_cast<char*>(dest), free_size);
+				read_count = static_cast<size_type>(file._file->gcount());
+			}
 
-				}
-				catch (std::exception const& e)
-				{
-					BOOST_LOG_TRIVIAL(debug) << "exception occurred: " << e.what();
-				}
+			if (file._use_block_cache && read_count > 0)
+			{
+				// the prefetched head is written through as well, it came from the same slow disk
+				_block_cache->write(file._blocks, file._current_read_so_far, dest, read_count);
 			}
-			else {
-				//BOOST_LOG_TRIVIAL(debug)<< "no cache means full data";
-				next_dur = std::chrono::seconds(1);
+
+			if (free_size > read_count) {
+				file_chunk_contents_ref->second.erase_end(static_cast<size_t>(free_size - read_count));
 			}
+			file._current_read_so_far += read_count;
+			is_file_finished =
+				file._current_read_so_far == file._file_size ||
+				file._file->eof();
+
+			file._cache_buf->put_cache_ptr(is_file_finished);
+		}
+		catch (std::exception const& e)
+		{
+			BOOST_LOG_TRIVIAL(debug) << "exception occurred: " << e.what();
+		}
+
+		return true;
+	}
+
+	std::chrono::microseconds input_plugin_file::read_fixed(file_details & file, bool & is_file_finished)
+	{
+		size_type read_count = 0;
+		if (!read_chunk(file, _max_file_chunk_size, read_count, is_file_finished))
+		{
+			return std::chrono::seconds(1);
+		}
+
+		/*BOOST_LOG_TRIVIAL(debug)
+		<< "data size:"
+		<< (*file_iter)->_cache_buf->data_size_guess();*/
+
+		if (file._cache_buf->buffer_size_count() - file._cache_buf->data_size_guess() <= 2)
+		{
+			//BOOST_LOG_TRIVIAL(debug) << "data near full";
+			return std::chrono::seconds(1);
+		}
+		else if (file._cache_buf->data_size_guess() > 2)
+		{
+			//BOOST_LOG_TRIVIAL(debug) << "data ok";
+			return std::chrono::milliseconds(100);
+		}
+
+		//BOOST_LOG_TRIVIAL(debug) << "data near empty";
+		return std::chrono::microseconds(0);
+	}
+
+	std::chrono::microseconds input_plugin_file::read_paced(file_details & file, bool & is_file_finished)
+	{
+		auto & cache_buf = file._cache_buf;
+		auto capacity = cache_buf->total_bytes_in_buffer_guess() + cache_buf->available_bytes();
+		auto wanted = _rate_controller->bytes_wanted(file._rate, cache_buf->total_bytes_in_buffer_guess(), capacity);
+		auto tick_start = io_rate_controller::clock_type::now();
+
+		while (wanted > 0)
+		{
+			auto read_start = io_rate_controller::clock_type::now();
+			size_type read_count = 0;
+
+			if (!read_chunk(file, _rate_controller->read_size(file._rate, std::min(wanted, _max_file_chunk_size)), read_count, is_file_finished))
+			{
+				// no cache means full data
+				break;
+			}
+
+			auto now = io_rate_controller::clock_type::now();
+			_rate_controller->read_done(file._rate, read_count, now - read_start, !file._last_read_cached);
+			wanted -= read_count;
+
+			if (is_file_finished || read_count == 0)
+			{
+				return std::chrono::microseconds(0);
+			}
+
+			// other jobs (seeks, new files) get their turn, the refill goes on right after
+			if (wanted > 0 && now - tick_start >= _max_tick_time)
+			{
+				return std::chrono::microseconds(0);
+			}
+		}
+
+		return _rate_controller->sleep_time(file._rate, cache_buf->total_bytes_in_buffer_guess());
+	}
+
+	void input_plugin_file::wake_reader()
+	{
+		// a cancelled timer runs its job at once
+		if (_file_read_timer && is_active_timer(_file_read_timer))
+		{
+			_file_read_timer->cancel();
+		}
+		else
+		{
+			try_read();
 		}
 	}
 
@@ -329,6 +461,14 @@ namespace mprt {
 
 		add_job([=]() { remove_file(url_id); });
 	}
+
+	void input_plugin_file::prefetch_input_items(std::vector<std::string> urls)
+	{
+		if (_prefetcher)
+		{
+			_prefetcher->prefetch(urls);
+		}
+	}
 	
 	void input_plugin_file::set_cache_buffer(url_id_t url_id, cache_buffer_shared cache_buf)
 	{
@@ -399,6 +539,8 @@ namespace mprt {
 				cnt.erase(_file_iter);
 				return true;
 			}
+
+			++_file_iter;
 		}
 
 		return false;
@@ -422,6 +564,11 @@ namespace mprt {
 				(*iter)->_file->clear();
 				(*iter)->_file->seekg(seek_point);
 				(*iter)->_current_read_so_far = seek_point;
+
+				if (_rate_controller)
+				{
+					_rate_controller->restart_track((*iter)->_rate, (*iter)->_cache_buf->total_bytes_in_buffer_guess());
+				}
 				return iter;
 			}
 		}
@@ -456,6 +603,11 @@ namespace mprt {
 			_current_state = plugin_states::play;
 			cont_internal();
 		}
+		else if (plugin_states::play == _current_state)
+		{
+			// the reader may be sleeping on a full buffer which is empty now
+			wake_reader();
+		}
 	}
 
 	void input_plugin_file::seek_callback_job(url_id_t url_id, size_type seek_point)
@@ -15,6 +15,10 @@
 
 #include "common/input_plugin_api.h"
 
+#include "file_prefetcher.h"
+#include "io_rate_controller.h"
+#include "block_cache.h"
+
 namespace mprt {
 	class output_plugin_api;
 
@@ -25,6 +29,11 @@ namespace mprt {
 		size_type _file_size;
 		size_type _current_read_so_far;
 		cache_buffer_shared _cache_buf;
+		file_prefetcher::data_t _prefetched; // the head of the file, read before it was queued
+		io_rate_controller::track_state _rate;
+		block_cache::track _blocks;
+		bool _use_block_cache;
+		bool _last_read_cached; // not a device read, kept out of the throughput figures
 
 		file_details(
 			std::string &filename,
@@ -38,6 +47,8 @@ namespace mprt {
 			, _file_size(file_size)
 			, _current_read_so_far(0)
 			, _cache_buf(cache_buf)
+			, _use_block_cache(false)
+			, _last_read_cached(false)
 		{}
 	};
 
@@ -53,12 +64,20 @@ namespace mprt {
 		set_input_cache_buf_callback_register_func_t _set_input_cache_buf_callback;
 		seek_callback_register_func_t _seek_callback;
 		size_type _max_finish_files;
+		std::unique_ptr<file_prefetcher> _prefetcher;
+		std::unique_ptr<io_rate_controller> _rate_controller;
+		std::unique_ptr<block_cache> _block_cache;
+		std::chrono::microseconds _max_tick_time;
 
 		bool add_file(std::string filename, url_id_t url_id);
 		void remove_file(url_id_t url_id);
 		bool open_file(file_list_t::iterator& file_iter);
 		void close_file(file_list_t::iterator& file_iter);
 		void try_read();
+		void wake_reader();
+		bool read_chunk(file_details & file, size_type max_size, size_type & read_count, bool & is_file_finished);
+		std::chrono::microseconds read_fixed(file_details & file, bool & is_file_finished);
+		std::chrono::microseconds read_paced(file_details & file, bool & is_file_finished);
 		void input_close(url_id_t url_id);
 		
 		bool is_no_job() override;
@@ -87,6 +106,7 @@ namespace mprt {
 		virtual url_id_t add_input_item(std::string filename) override;
 		virtual url_id_t add_input_item(std::string filename, url_id_t url_id) override;
 		virtual void remove_input_item(url_id_t url_id) override;
+		virtual void prefetch_input_items(std::vector<std::string> urls) override;
 		void set_cache_buffer(url_id_t url_id, cache_buffer_shared cache_buf) override;
 		
 		// decoder thread functions
@@ -0,0 +1,679 @@
+#include <cstring>
+#include <limits>
+#include <algorithm>
+
+#include <boost/dll/runtime_symbol_info.hpp>
+#include <boost/log/trivial.hpp>
+#include <boost/circular_buffer.hpp>
+#include <boost/algorithm/string.hpp>
+
+#include "core/config.h"
+#include "common/refcounting_plugin_api.h"
+#include "common/job_type_enums.h"
+#include "common/utils.h"
+
+#include "input_plugin_http.h"
+
+namespace mprt {
+
+	namespace
+	{
+		constexpr std::size_t _HEAD_READ_SIZE_ = 4096;
+		constexpr std::size_t _MAX_HEAD_SIZE_ = 64 * 1024;
+
+		double msecs_since(http_stream_details::clock_type::time_point start)
+		{
+			return std::chrono::duration<double, std::milli>(http_stream_details::clock_type::now() - start).count();
+		}
+	}
+
+	input_plugin_http::input_plugin_http()
+	{
+
+	}
+
+	input_plugin_http::~input_plugin_http()
+	{
+		BOOST_LOG_TRIVIAL(trace) << "input_plugin_http::~input_plugin_http() called";
+	}
+
+	boost::filesystem::path input_plugin_http::location() const
+	{
+		return boost::dll::this_line_location(); // location of this plugin
+	}
+
+	std::string input_plugin_http::plugin_name() const
+	{
+		return "input_http_plugin";
+	}
+
+	plugin_types input_plugin_http::plugin_type() const
+	{
+		return plugin_types::input_plugin;
+	}
+
+	void input_plugin_http::init(void *)
+	{
+		config::instance().init("../config/config_input_plugin_http.xml");
+		auto pt = config::instance().get_ptree_node("mprt.input_plugin_http");
+		_max_finish_files = pt.get<size_type>("max_finish_files", 3);
+		_read_size = pt.get<size_type>("read_size", 64) * 1024;
+		_max_redirects = pt.get<size_type>("max_redirects", 5);
+		_max_resumes = pt.get<size_type>("max_resumes", 3);
+		_use_icy_metadata = pt.get<std::string>("icy_metadata", "true") == "true";
+		_user_agent = pt.get<std::string>("user_agent", "mprt");
+		_timeout = std::chrono::milliseconds(pt.get<std::size_t>("timeout_msecs", 10000));
+		_full_wait = std::chrono::milliseconds(pt.get<std::size_t>("cache_full_wait_msecs", 100));
+
+		_pool = std::make_unique<http_connection_pool>(
+			pt.get<size_type>("max_idle_connections_per_host", 2),
+			std::chrono::milliseconds(pt.get<std::size_t>("keep_alive_msecs", 15000)));
+
+#ifdef _OPENSSL_FOUND
+		_tls_context = std::make_unique<tls_context>(boost::asio::ssl::context::tls_client);
+		_tls_context->set_default_verify_paths();
+		_tls_context->set_verify_mode(pt.get<std::string>("verify_tls_peer", "true") == "true" ?
+			boost::asio::ssl::verify_peer :
+			boost::asio::ssl::verify_none);
+#endif
+
+		_async_task = std::make_shared<async_tasker>(pt.get<std::size_t>("max_free_timer_count", 10));
+	}
+
+	input_plugin_http::item_shared input_plugin_http::make_item(std::string const& url, url_id_t url_id)
+	{
+		auto stream = std::make_shared<http_stream_details>(url, url_id);
+		if (!stream->_location._ok) {
+			BOOST_LOG_TRIVIAL(error) << plugin_name() << " not an http url: " << url;
+			return nullptr;
+		}
+
+		return stream;
+	}
+
+	std::string input_plugin_http::build_request(item_shared const& stream) const
+	{
+		auto const& location = stream->_location;
+
+		std::string request;
+		request.reserve(256);
+		request += "GET " + location._target + " HTTP/1.1\r\n";
+		request += "Host: " + location.host_header() + "\r\n";
+		request += "User-Agent: " + _user_agent + "\r\n";
+		request += "Accept: */*\r\n";
+		request += "Connection: keep-alive\r\n";
+
+		if (stream->_request_pos > 0)
+		{
+			request += "Range: bytes=" + std::to_string(stream->_request_pos) + "-\r\n";
+		}
+
+		if (_use_icy_metadata)
+		{
+			request += "Icy-MetaData: 1\r\n";
+		}
+
+		request += "\r\n";
+		return request;
+	}
+
+	void input_plugin_http::start_request(item_shared const& stream)
+	{
+		auto generation = ++stream->_generation;
+
+		stream->_state = http_stream_details::stream_state::requesting;
+		stream->_position = stream->_request_pos;
+		stream->_skip = 0;
+		stream->_head.clear();
+		stream->_pending.clear();
+		stream->_request_time = http_stream_details::clock_type::now();
+		stream->_busy_since = stream->_request_time;
+
+		if (!stream->_fresh_conn)
+		{
+			stream->_conn = _pool->take(stream->_location.key());
+		}
+
+		if (stream->_conn)
+		{
+			send_request(stream, generation);
+			return;
+		}
+
+		stream->_conn = std::make_shared<http_connection>(_async_task->get_io_context(), stream->_location, _tls_context.get());
+		stream->_conn->connect(stream->_location, [this, stream, generation](boost::system::error_code const& ec)
+		{
+			if (generation != stream->_generation)
+				return;
+
+			if (ec)
+			{
+				request_failed(stream, ec);
+				return;
+			}
+
+			BOOST_LOG_TRIVIAL(debug) << "connected to: " << stream->_location.key() << " in ms: " << msecs_since(stream->_request_time);
+			send_request(stream, generation);
+		});
+	}
+
+	void input_plugin_http::send_request(item_shared const& stream, uint64_t generation)
+	{
+		stream->_conn->write(build_request(stream), [this, stream, generation](boost::system::error_code const& ec, std::size_t)
+		{
+			if (generation != stream->_generation)
+				return;
+
+			if (ec)
+			{
+				request_failed(stream, ec);
+				return;
+			}
+
+			read_head(stream, generation);
+		});
+	}
+
+	void input_plugin_http::read_head(item_shared const& stream, uint64_t generation)
+	{
+		stream->_head_buf.resize(_HEAD_READ_SIZE_);
+
+		stream->_conn->read_some(stream->_head_buf.data(), stream->_head_buf.size(),
+			[this, stream, generation](boost::system::error_code const& ec, std::size_t bytes)
+		{
+			if (generation != stream->_generation)
+				return;
+
+			if (ec)
+			{
+				request_failed(stream, ec);
+				return;
+			}
+
+			stream->_busy_since = http_stream_details::clock_type::now();
+			stream->_head.append(reinterpret_cast<char const*>(stream->_head_buf.data()), bytes);
+
+			auto head_end = stream->_head.find("\r\n\r\n");
+			if (head_end != std::string::npos)
+			{
+				stream->_head_buf = std::vector<unsigned char>();
+				handle_response(stream, head_end);
+			}
+			else if (stream->_head.size() > _MAX_HEAD_SIZE_)
+			{
+				BOOST_LOG_TRIVIAL(error) << "response head is too long: " << stream->_url;
+				fail_stream(stream);
+			}
+			else
+			{
+				read_head(stream, generation);
+			}
+		});
+	}
+
+	void input_plugin_http::request_failed(item_shared const& stream, boost::system::error_code const& ec)
+	{
+		auto was_reused = stream->_conn && stream->_conn->is_reused();
+		release_connection(*stream);
+
+		// the server closed the idle keep-alive connection, the request is tried once more on a new one
+		if (was_reused && stream->_head.empty() && !stream->_fresh_conn)
+		{
+			BOOST_LOG_TRIVIAL(debug) << "kept alive connection is gone, reconnecting: " << stream->_location.key();
+			stream->_fresh_conn = true;
+			start_request(stream);
+			return;
+		}
+
+		BOOST_LOG_TRIVIAL(error) << "http request error: " << stream->_location.str() << " " << ec.message();
+		fail_stream(stream);
+	}
+
+	void input_plugin_http::handle_response(item_shared const& stream, std::string::size_type head_end)
+	{
+		auto & response = stream->_response;
+		response = http_response();
+
+		if (!response.parse(stream->_head.substr(0, head_end)))
+		{
+			BOOST_LOG_TRIVIAL(error) << "bad http response from: " << stream->_location.str();
+			fail_stream(stream);
+			return;
+		}
+
+		stream->_fresh_conn = false;
+		stream->_pending = stream->_head.substr(head_end + 4);
+		stream->_head.clear();
+
+		if (response.is_redirect())
+		{
+			// the body of a redirect is not read, only an empty one leaves the connection reusable
+			if (0 == response.content_length() && stream->_pending.empty() && response.keep_alive())
+			{
+				stream->_conn->response_done();
+				_pool->give_back(std::move(stream->_conn));
+			}
+			release_connection(*stream);
+
+			auto location = stream->_location.resolve(response.header("location"));
+			if (++stream->_redirects > _max_redirects || !location._ok)
+			{
+				BOOST_LOG_TRIVIAL(error) << "bad or too many redirects: " << stream->_url;
+				fail_stream(stream);
+				return;
+			}
+
+			BOOST_LOG_TRIVIAL(debug) << "redirected to: " << location.str();
+			stream->_location = location;
+			start_request(stream);
+			return;
+		}
+
+		if (response._status != 200 && response._status != 206)
+		{
+			BOOST_LOG_TRIVIAL(error) << "http status: " << response._status << " for: " << stream->_location.str();
+			fail_stream(stream);
+			return;
+		}
+
+		stream->_body.reset(
+			response.is_chunked() ? http_body_decoder::framing::chunked :
+			response.content_length() >= 0 ? http_body_decoder::framing::length :
+			http_body_decoder::framing::close,
+			response.content_length());
+
+		size_type metaint = 0;
+		if (_use_icy_metadata)
+		{
+			try { metaint = std::stoll(response.header("icy-metaint")); }
+			catch (std::exception const&) { metaint = 0; }
+		}
+		stream->_icy.reset(metaint);
+
+		size_type start = 0, total = -1;
+		if (206 == response._status && response.content_range(start, total))
+		{
+			if (start > stream->_request_pos)
+			{
+				BOOST_LOG_TRIVIAL(error) << "range starts after the requested position: " << stream->_location.str();
+				fail_stream(stream);
+				return;
+			}
+		}
+		else
+		{
+			start = 0;
+			total = response.content_length();
+		}
+
+		// the server may send the whole file for a range request
+		stream->_skip = stream->_request_pos - start;
+
+		if (!stream->_opened)
+		{
+			stream->_stream_length = total;
+			stream->_seekable = total >= 0 && !stream->_icy.enabled() &&
+				(206 == response._status || boost::to_lower_copy(response.header("accept-ranges")).find("bytes") != std::string::npos);
+
+			auto station = response.header("icy-name");
+			if (!station.empty())
+			{
+				report_metadata(stream, "TITLE", station);
+			}
+
+			report_opened(stream, true);
+		}
+
+		stream->_state = http_stream_details::stream_state::reading;
+		stream->_response_bytes = 0;
+
+		BOOST_LOG_TRIVIAL(debug) << "http response: " << response._status
+			<< " from: " << stream->_location.str()
+			<< " position: " << stream->_request_pos
+			<< " in ms: " << msecs_since(stream->_request_time);
+
+		if (plugin_states::play == _current_state)
+		{
+			// the step waiting since the request is not waited for
+			wake_reader();
+		}
+	}
+
+	void input_plugin_http::report_opened(item_shared const& stream, bool is_opened)
+	{
+		stream->_opened = true;
+
+		auto url_ext = ext_from_content_type(stream->_response.header("content-type"));
+		if (url_ext.empty())
+		{
+			url_ext = get_ext(stream->_location._target.substr(0, stream->_location._target.find('?')));
+		}
+		if (url_ext.empty() || url_ext.find('/') != std::string::npos)
+		{
+			// radio streams without a type are mostly mp3
+			url_ext = "mp3";
+		}
+
+		auto live = stream->_stream_length < 0;
+
+		// the decoders read up to the stream length, a live stream has none
+		auto cur_decoder_detail = make_decoder_details(*stream, stream->_url, is_opened,
+			live ? std::numeric_limits<size_type>::max() : stream->_stream_length);
+		cur_decoder_detail->_url_ext = url_ext;
+		cur_decoder_detail->_length_supported = !live;
+		cur_decoder_detail->_seek_supported = stream->_seekable;
+
+		_input_opened_register_func(cur_decoder_detail);
+
+		BOOST_LOG_TRIVIAL(trace) << "stream opened: " << stream->_url
+			<< " ext: " << url_ext
+			<< " length: " << stream->_stream_length
+			<< " seekable: " << stream->_seekable;
+	}
+
+	void input_plugin_http::report_metadata(item_shared const& stream, std::string tag_name, std::string tag_value)
+	{
+		BOOST_LOG_TRIVIAL(debug) << "stream metadata: " << tag_name << " = " << tag_value;
+
+		if (_input_metadata_register_func)
+		{
+			_input_metadata_register_func(stream->_url_id, tag_name, tag_value);
+		}
+	}
+
+	size_type input_plugin_http::take_body(item_shared const& stream, buffer_elem_t * data, size_type len)
+	{
+		len = stream->_body.decode(data, len);
+
+		len = stream->_icy.demux(data, len, [this, &stream](std::string const& metadata)
+		{
+			auto title = icy_demuxer::stream_title(metadata);
+			if (!title.empty() && title != stream->_title)
+			{
+				stream->_title = title;
+				report_metadata(stream, "TITLE", title);
+			}
+		});
+
+		if (stream->_skip > 0)
+		{
+			auto skip_len = std::min(stream->_skip, len);
+			std::memmove(data, data + skip_len, static_cast<std::size_t>(len - skip_len));
+			stream->_skip -= skip_len;
+			len -= skip_len;
+		}
+
+		stream->_position += len;
+		return len;
+	}
+
+	bool input_plugin_http::flush_pending(item_shared const& stream)
+	{
+		while (!stream->_pending.empty())
+		{
+			auto size = static_cast<size_type>(stream->_pending.size());
+			auto dest = stream->_cache_buf->reserve_cache_ptr(size, stream->_position);
+			if (!dest)
+			{
+				return false;
+			}
+
+			std::memcpy(dest, stream->_pending.data(), static_cast<std::size_t>(size));
+			stream->_pending.erase(0, static_cast<std::size_t>(size));
+			stream->_cache_buf->commit_cache_ptr(take_body(stream, dest, size), false);
+		}
+
+		if (stream->_body.finished())
+		{
+			finish_stream(stream);
+		}
+
+		return true;
+	}
+
+	bool input_plugin_http::start_body_read(item_shared const& stream)
+	{
+		auto size = _read_size;
+		auto dest = stream->_cache_buf->reserve_cache_ptr(size, stream->_position);
+		if (!dest)
+		{
+			// no cache means full data
+			return false;
+		}
+
+		auto generation = stream->_generation;
+		stream->_reading = true;
+		stream->_busy_since = http_stream_details::clock_type::now();
+
+		// the chunk is kept for the read even if a seek detaches it
+		std::shared_ptr<void> chunk = *stream->_cache_buf->get_cache_ptr();
+
+		stream->_conn->read_some(dest, static_cast<std::size_t>(size),
+			[this, stream, generation, dest, chunk](boost::system::error_code const& ec, std::size_t bytes)
+		{
+			body_read(stream, generation, dest, ec, bytes);
+		});
+
+		return true;
+	}
+
+	void input_plugin_http::body_read(item_shared const& stream, uint64_t generation, buffer_elem_t * dest,
+		boost::system::error_code const& ec, std::size_t bytes)
+	{
+		if (generation != stream->_generation)
+			return;
+
+		stream->_reading = false;
+		stream->_response_bytes += bytes;
+
+		auto used = take_body(stream, dest, static_cast<size_type>(bytes));
+		auto is_finished = stream->_body.finished() || stream->_body.error() || ec;
+		stream->_cache_buf->commit_cache_ptr(used, is_finished);
+
+		if (stream->_body.error())
+		{
+			BOOST_LOG_TRIVIAL(error) << "bad chunked body from: " << stream->_location.str();
+			fail_stream(stream);
+		}
+		else if (stream->_body.finished() ||
+			(ec == boost::asio::error::eof && stream->_body.body_framing() == http_body_decoder::framing::close))
+		{
+			finish_stream(stream);
+		}
+		else if (ec)
+		{
+			// a broken download goes on from where it stopped
+			if (stream->_seekable && stream->_resumes++ < _max_resumes)
+			{
+				BOOST_LOG_TRIVIAL(debug) << "http read error: " << ec.message() << " resuming at: " << stream->_position;
+				release_connection(*stream);
+				stream->_request_pos = stream->_position;
+				stream->_state = http_stream_details::stream_state::idle;
+			}
+			else
+			{
+				BOOST_LOG_TRIVIAL(error) << "http read error: " << stream->_location.str() << " " << ec.message();
+				fail_stream(stream);
+				return;
+			}
+		}
+
+		if (plugin_states::play == _current_state)
+		{
+			// the next read is queued right away instead of on the next timer
+			wake_reader();
+		}
+	}
+
+	void input_plugin_http::finish_stream(item_shared const& stream)
+	{
+		BOOST_LOG_TRIVIAL(debug) << "http stream finished: " << stream->_url
+			<< " bytes: " << stream->_response_bytes
+			<< " kB/s: " << stream->_response_bytes / std::max(msecs_since(stream->_request_time), 1.0);
+
+		release_connection(*stream);
+
+		if (stream->_cache_buf)
+		{
+			stream->_cache_buf->sync_cache();
+		}
+		stream->_state = http_stream_details::stream_state::finished;
+		close_file(stream);
+	}
+
+	void input_plugin_http::fail_stream(item_shared const& stream)
+	{
+		release_connection(*stream);
+
+		if (stream->_opened)
+		{
+			// the decoder gets to the end of what it has
+			if (stream->_cache_buf)
+			{
+				stream->_cache_buf->sync_cache();
+			}
+			stream->_state = http_stream_details::stream_state::finished;
+			close_file(stream);
+			return;
+		}
+
+		report_opened(stream, false);
+		_files.remove(stream);
+	}
+
+	void input_plugin_http::release_connection(http_stream_details & stream)
+	{
+		auto conn = std::move(stream._conn);
+		if (!conn)
+			return;
+
+		// only a connection whose response has been read to the end can take the next request
+		if (stream._state == http_stream_details::stream_state::reading &&
+			stream._body.finished() &&
+			stream._response.keep_alive())
+		{
+			conn->response_done();
+			_pool->give_back(conn);
+		}
+		else
+		{
+			conn->close();
+		}
+	}
+
+	void input_plugin_http::release_item(http_stream_details & stream)
+	{
+		// the handlers still running are forgotten, a read into the cache keeps its chunk
+		++stream._generation;
+		if (stream._reading && stream._cache_buf)
+		{
+			stream._cache_buf->detach_cache_ptr();
+		}
+		stream._reading = false;
+
+		release_connection(stream);
+	}
+
+	std::chrono::microseconds input_plugin_http::read_step()
+	{
+		if (_finished_files.size() >= static_cast<std::size_t>(_max_finish_files))
+		{
+			return std::chrono::milliseconds(1000);
+		}
+
+		auto stream_iter = _files.begin();
+		if (stream_iter == _files.end())
+		{
+			return std::chrono::microseconds(1000);
+		}
+
+		auto stream = *stream_iter;
+
+		if (stream->is_busy())
+		{
+			// a server which stops answering is given up, a seekable download resumes
+			if (http_stream_details::clock_type::now() - stream->_busy_since > _timeout)
+			{
+				BOOST_LOG_TRIVIAL(error) << "http timeout: " << stream->_location.str();
+				if (stream->_conn)
+				{
+					stream->_conn->close();
+				}
+			}
+
+			return std::chrono::milliseconds(100);
+		}
+
+		switch (stream->_state)
+		{
+		case http_stream_details::stream_state::idle:
+			start_request(stream);
+			return std::chrono::milliseconds(100);
+
+		case http_stream_details::stream_state::reading:
+			break;
+
+		default:
+			return std::chrono::microseconds(1000);
+		}
+
+		if (!stream->_cache_buf)
+		{
+			return std::chrono::microseconds(1000);
+		}
+
+		if (!flush_pending(stream))
+		{
+			return _full_wait;
+		}
+
+		// the head brought the whole body
+		if (http_stream_details::stream_state::reading != stream->_state)
+		{
+			return std::chrono::microseconds(0);
+		}
+
+		if (!start_body_read(stream))
+		{
+			return _full_wait;
+		}
+
+		return std::chrono::milliseconds(100);
+	}
+
+	void input_plugin_http::quit_internal()
+	{
+		for (auto & stream : _files)
+		{
+			release_item(*stream);
+		}
+
+		_pool->clear();
+	}
+
+	bool input_plugin_http::seek_item(http_stream_details & stream, size_type seek_point)
+	{
+		if (!stream._seekable)
+		{
+			BOOST_LOG_TRIVIAL(debug) << "stream is not seekable: " << stream._url;
+			return false;
+		}
+
+		// the rest of the old response is not waited for, a range request is sent at once
+		release_item(stream);
+		stream._cache_buf->clear_cache();
+		stream._request_pos = seek_point;
+		stream._resumes = 0;
+		stream._state = http_stream_details::stream_state::idle;
+
+		return true;
+	}
+}
+
+// Factory method. Returns *simple pointer*!
+std::unique_ptr<refcounting_plugin_api> create() {
+	return std::make_unique<mprt::input_plugin_http>();
+}
+
+
+BOOST_DLL_ALIAS(create, create_refc_plugin)
@@ -0,0 +1,130 @@
+#ifndef input_plugin_http_h__
+#define input_plugin_http_h__
+
+#include <vector>
+#include <memory>
+#include <chrono>
+
+#include "common/input_plugin_api.h"
+
+#include "input_plugin_base.h"
+#include "http_protocol.h"
+#include "http_connection.h"
+
+namespace mprt {
+
+	struct http_stream_details {
+		using clock_type = std::chrono::steady_clock;
+
+		enum class stream_state { idle, requesting, reading, finished };
+
+		std::string _url;
+		size_type _url_id;
+		cache_buffer_shared _cache_buf;
+
+		http_url _location; // after the redirects
+		http_connection_shared _conn;
+		stream_state _state;
+		bool _opened; // reported to the decoder
+
+		// handlers of an old request or position are dropped when they are called
+		uint64_t _generation;
+		size_type _redirects;
+		size_type _resumes; // reconnects after a broken body read
+		bool _fresh_conn; // a pooled connection failed, the retry opens a new one
+
+		std::vector<unsigned char> _head_buf;
+		std::string _head;
+		std::string _pending; // body bytes read together with the head
+		http_response _response;
+		http_body_decoder _body;
+		icy_demuxer _icy;
+		std::string _title;
+
+		size_type _stream_length; // -1 for live streams
+		bool _seekable;
+		size_type _request_pos;
+		size_type _position; // stream position of the next byte put into the cache
+		size_type _skip; // the server did not take the range, the bytes up to it are dropped
+		bool _reading; // a read into the reserved cache bytes is running
+
+		clock_type::time_point _request_time;
+		clock_type::time_point _busy_since;
+		size_type _response_bytes;
+
+		http_stream_details(std::string const& url, size_type url_id)
+			: _url(url)
+			, _url_id(url_id)
+			, _location(http_url::parse(url))
+			, _state(stream_state::idle)
+			, _opened(false)
+			, _generation(0)
+			, _redirects(0)
+			, _resumes(0)
+			, _fresh_conn(false)
+			, _stream_length(-1)
+			, _seekable(false)
+			, _request_pos(0)
+			, _position(0)
+			, _skip(0)
+			, _reading(false)
+			, _response_bytes(0)
+		{}
+
+		bool is_busy() const { return _state == stream_state::requesting || _reading; }
+	};
+
+	class input_plugin_http : public input_plugin_base<http_stream_details>
+	{
+	private:
+		size_type _read_size;
+		size_type _max_redirects;
+		size_type _max_resumes;
+		bool _use_icy_metadata;
+		std::string _user_agent;
+		std::chrono::milliseconds _timeout;
+		std::chrono::milliseconds _full_wait;
+
+		std::unique_ptr<tls_context> _tls_context;
+		std::unique_ptr<http_connection_pool> _pool;
+
+		// request and response head
+		void start_request(item_shared const& stream);
+		void send_request(item_shared const& stream, uint64_t generation);
+		void read_head(item_shared const& stream, uint64_t generation);
+		void handle_response(item_shared const& stream, std::string::size_type head_end);
+		void request_failed(item_shared const& stream, boost::system::error_code const& ec);
+		std::string build_request(item_shared const& stream) const;
+		void report_opened(item_shared const& stream, bool is_opened);
+		void report_metadata(item_shared const& stream, std::string tag_name, std::string tag_value);
+
+		// body
+		bool flush_pending(item_shared const& stream);
+		bool start_body_read(item_shared const& stream);
+		void body_read(item_shared const& stream, uint64_t generation, buffer_elem_t * dest,
+			boost::system::error_code const& ec, std::size_t bytes);
+		size_type take_body(item_shared const& stream, buffer_elem_t * data, size_type len);
+		void finish_stream(item_shared const& stream);
+		void fail_stream(item_shared const& stream);
+		void release_connection(http_stream_details & stream);
+
+		virtual item_shared make_item(std::string const& url, url_id_t url_id) override;
+		virtual std::chrono::microseconds read_step() override;
+		virtual bool seek_item(http_stream_details & stream, size_type seek_point) override;
+		virtual void release_item(http_stream_details & stream) override;
+
+		virtual void quit_internal() override;
+
+	public:
+		input_plugin_http();
+		virtual ~input_plugin_http();
+
+		// ref plugin functions
+		virtual boost::filesystem::path location() const override;
+		virtual std::string plugin_name() const override;
+		virtual plugin_types plugin_type() const override;
+		virtual void init(void * arguments = nullptr) override;
+	};
+}
+
+#endif // input_plugin_http_h__
@@ -0,0 +1,253 @@
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <limits>
+#include <algorithm>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <boost/dll/runtime_symbol_info.hpp>
+#include <boost/log/trivial.hpp>
+#include <boost/circular_buffer.hpp>
+#include <boost/asio.hpp>
+
+#include "core/config.h"
+#include "common/refcounting_plugin_api.h"
+#include "common/job_type_enums.h"
+#include "common/utils.h"
+
+#include "input_plugin_mmap.h"
+
+namespace mprt {
+
+	mmap_file_details::~mmap_file_details()
+	{
+#ifndef _WIN32
+		if (_fd >= 0)
+		{
+			::close(_fd);
+		}
+#endif
+	}
+
+	size_type mmap_file_details::read(size_type pos, buffer_elem_t * dest, size_type size)
+	{
+#ifndef _WIN32
+		// the pages of a file cut short under the mapping give SIGBUS, the size is checked
+		// before every copy and the rest of such a file is read with pread
+		struct stat st;
+		if (!_truncated && (::fstat(_fd, &st) != 0 || static_cast<size_type>(st.st_size) < _file_size))
+		{
+			BOOST_LOG_TRIVIAL(info) << "file is cut short, reading it without the mapping: " << _filename;
+			_truncated = true;
+		}
+
+		if (_truncated)
+		{
+			auto read_bytes = ::pread(_fd, dest, static_cast<std::size_t>(size), static_cast<off_t>(pos));
+			if (read_bytes < 0)
+				return -1;
+
+			_read_pos = pos + read_bytes;
+			return read_bytes;
+		}
+#endif
+
+		size = std::min<size_type>(size, _file_size - pos);
+		if (size <= 0)
+			return 0;
+
+		std::memcpy(dest, data() + pos, static_cast<std::size_t>(size));
+		_read_pos = pos + size;
+
+		return size;
+	}
+
+	input_plugin_mmap::input_plugin_mmap()
+	{
+
+	}
+
+	input_plugin_mmap::~input_plugin_mmap()
+	{
+		BOOST_LOG_TRIVIAL(trace) << "input_plugin_mmap::~input_plugin_mmap() called";
+	}
+
+	boost::filesystem::path input_plugin_mmap::location() const
+	{
+		return boost::dll::this_line_location(); // location of this plugin
+	}
+
+	std::string input_plugin_mmap::plugin_name() const
+	{
+		return "input_mmap_plugin";
+	}
+
+	plugin_types input_plugin_mmap::plugin_type() const
+	{
+		return plugin_types::input_plugin;
+	}
+
+	void input_plugin_mmap::init(void *)
+	{
+		config::instance().init("../config/config_input_plugin_mmap.xml");
+		auto pt = config::instance().get_ptree_node("mprt.input_plugin_mmap");
+		_max_finish_files = pt.get<size_type>("max_finish_files", 3);
+		_page_size = static_cast<size_type>(boost::interprocess::mapped_region::get_page_size());
+		_readahead_size = std::max<size_type>(pt.get<size_type>("readahead_size", 2048) * 1024, 2 * _page_size);
+		_keep_behind_size = pt.get<size_type>("keep_behind_size", 512) * 1024;
+		_drop_behind = pt.get<std::string>("drop_behind", "true") == "true";
+
+		_async_task = std::make_shared<async_tasker>(pt.get<std::size_t>("max_free_timer_count", 10));
+	}
+
+	input_plugin_mmap::item_shared input_plugin_mmap::make_item(std::string const& url, url_id_t url_id)
+	{
+		if (!boost::filesystem::exists(url)) {
+			BOOST_LOG_TRIVIAL(error) << plugin_name() << " file does not exist: " << url;
+			return nullptr;
+		}
+
+		return std::make_shared<mmap_file_details>(url, url_id);
+	}
+
+	bool input_plugin_mmap::open_file(item_shared const& file)
+	{
+		_STATE_CHECK_(plugin_states::play, false);
+
+		auto & filename = file->_filename;
+
+		try
+		{
+#ifndef _WIN32
+			file->_fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+			if (file->_fd < 0)
+			{
+				throw std::runtime_error(std::strerror(errno));
+			}
+#endif
+			file->_file_size =
+				static_cast<size_type>(boost::filesystem::file_size(boost::filesystem::path(filename)));
+
+			// an empty file cannot be mapped, there is nothing to read anyway
+			if (file->_file_size > 0)
+			{
+				boost::interprocess::file_mapping(filename.c_str(), boost::interprocess::read_only).swap(file->_mapping);
+				boost::interprocess::mapped_region(file->_mapping, boost::interprocess::read_only).swap(file->_region);
+				file->_region.advise(boost::interprocess::mapped_region::advice_sequential);
+			}
+
+			file->_opened = true;
+		}
+		catch (std::exception const& e)
+		{
+			BOOST_LOG_TRIVIAL(error) << "file open error: " << filename << " " << e.what() << " removing from queue";
+			drop_file(file);
+		}
+
+		auto cur_decoder_detail = make_decoder_details(*file, filename, file->_opened, file->_file_size);
+		if (file->_opened)
+		{
+			// the decoder reads the mapping itself, no chunks are filled
+			cur_decoder_detail->_input_view = file;
+		}
+
+		_input_opened_register_func(cur_decoder_detail);
+
+		BOOST_LOG_TRIVIAL(trace) << "filename mapped: " << filename;
+
+		return file->_opened;
+	}
+
+	void input_plugin_mmap::advise(mmap_file_details & file)
+	{
+#ifndef _WIN32
+		auto base = const_cast<unsigned char *>(file.data());
+		if (!base)
+			return;
+
+		auto cursor = file._current_read_so_far;
+		auto page_floor = [this](size_type pos) { return pos / _page_size * _page_size; };
+
+		// the kernel is asked for the next readahead_size bytes, half of it at a time
+		auto ahead_target = std::min<size_type>(cursor + _readahead_size, file._file_size);
+		if (ahead_target > file._advised_ahead &&
+			(ahead_target - file._advised_ahead >= _readahead_size / 2 || ahead_target == file._file_size))
+		{
+			auto from = page_floor(std::max<size_type>(file._advised_ahead, cursor));
+			(void)::madvise(base + from, static_cast<std::size_t>(ahead_target - from), MADV_WILLNEED);
+			file._advised_ahead = ahead_target;
+		}
+
+		// the pages left behind go out of the process, a short seek back finds them in the page cache
+		if (_drop_behind && cursor > _keep_behind_size)
+		{
+			auto drop_to = page_floor(cursor - _keep_behind_size);
+			if (drop_to - file._dropped_behind >= _readahead_size / 2)
+			{
+				(void)::madvise(base + file._dropped_behind, static_cast<std::size_t>(drop_to - file._dropped_behind), MADV_DONTNEED);
+				file._dropped_behind = drop_to;
+			}
+		}
+#endif
+	}
+
+	std::chrono::microseconds input_plugin_mmap::read_step()
+	{
+		if (_finished_files.size() >= static_cast<std::size_t>(_max_finish_files))
+		{
+			return std::chrono::milliseconds(1000);
+		}
+
+		auto file_iter = _files.begin();
+		if (file_iter == _files.end())
+		{
+			return std::chrono::microseconds(1000);
+		}
+
+		auto file = *file_iter;
+		if (!file->_opened && !open_file(file))
+		{
+			return std::chrono::microseconds(1000);
+		}
+
+		// the decoder moves on or seeks, the pages around it follow
+		auto read_pos = std::min<size_type>(file->_read_pos, file->_file_size);
+		if (read_pos < file->_current_read_so_far || read_pos > file->_advised_ahead)
+		{
+			file->_advised_ahead = read_pos;
+			file->_dropped_behind = std::min<size_type>(file->_dropped_behind, read_pos / _page_size * _page_size);
+		}
+		file->_current_read_so_far = read_pos;
+
+		advise(*file);
+
+		if (file->_current_read_so_far >= file->_file_size) {
+			close_file(file);
+			return std::chrono::microseconds(0);
+		}
+
+		return std::chrono::milliseconds(100);
+	}
+
+	bool input_plugin_mmap::seek_item(mmap_file_details & file, size_type seek_point)
+	{
+		// a seek only moves the cursor, the readahead starts again from there on the next step
+		file._read_pos = std::min<size_type>(seek_point, file._file_size);
+
+		return true;
+	}
+}
+
+// Factory method. Returns *simple pointer*!
+std::unique_ptr<refcounting_plugin_api> create() {
+	return std::make_unique<mprt::input_plugin_mmap>();
+}
+
+
+BOOST_DLL_ALIAS(create, create_refc_plugin)
@@ -0,0 +1,83 @@
+#ifndef input_plugin_mmap_h__
+#define input_plugin_mmap_h__
+
+#include <memory>
+#include <atomic>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include "common/input_plugin_api.h"
+
+#include "input_plugin_base.h"
+
+namespace mprt {
+
+	// the decoder reads the mapping in place, the plugin only looks after the pages around
+	// the position it has got to
+	struct mmap_file_details : public input_view {
+		std::string _filename;
+		size_type _url_id;
+		boost::interprocess::file_mapping _mapping;
+		boost::interprocess::mapped_region _region;
+		int _fd; // for the size checks and the reads of a file cut short
+		bool _opened;
+		bool _truncated; // read with pread from then on, the mapping is past the end
+		size_type _file_size;
+		size_type _current_read_so_far;
+		std::atomic<size_type> _read_pos; // set by the decoder reads
+		cache_buffer_shared _cache_buf;
+
+		// pages up to here are asked for, from here on they are given back
+		size_type _advised_ahead;
+		size_type _dropped_behind;
+
+		mmap_file_details(std::string const& filename, size_type url_id)
+			: _filename(filename)
+			, _url_id(url_id)
+			, _fd(-1)
+			, _opened(false)
+			, _truncated(false)
+			, _file_size(0)
+			, _current_read_so_far(0)
+			, _read_pos(0)
+			, _advised_ahead(0)
+			, _dropped_behind(0)
+		{}
+
+		~mmap_file_details();
+
+		unsigned char const* data() const { return static_cast<unsigned char const*>(_region.get_address()); }
+
+		// decoder thread
+		virtual size_type read(size_type pos, buffer_elem_t * dest, size_type size) override;
+	};
+
+	class input_plugin_mmap : public input_plugin_base<mmap_file_details>
+	{
+	private:
+		size_type _readahead_size;
+		size_type _keep_behind_size;
+		bool _drop_behind;
+		size_type _page_size;
+
+		bool open_file(item_shared const& file);
+		void advise(mmap_file_details & file);
+
+		virtual item_shared make_item(std::string const& url, url_id_t url_id) override;
+		virtual std::chrono::microseconds read_step() override;
+		virtual bool seek_item(mmap_file_details & file, size_type seek_point) override;
+
+	public:
+		input_plugin_mmap();
+		virtual ~input_plugin_mmap();
+
+		// ref plugin functions
+		virtual boost::filesystem::path location() const override;
+		virtual std::string plugin_name() const override;
+		virtual plugin_types plugin_type() const override;
+		virtual void init(void * arguments = nullptr) override;
+	};
+}
+
+#endif // input_plugin_mmap_h__
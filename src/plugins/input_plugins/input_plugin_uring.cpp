@@ -0,0 +1,374 @@
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/dll/runtime_symbol_info.hpp>
+#include <boost/log/trivial.hpp>
+#include <boost/circular_buffer.hpp>
+#include <boost/asio.hpp>
+
+#include "core/config.h"
+#include "common/refcounting_plugin_api.h"
+#include "common/job_type_enums.h"
+#include "common/utils.h"
+
+#include "input_plugin_uring.h"
+
+namespace mprt {
+
+	uring_file_details::~uring_file_details()
+	{
+		// running reads hold the details, the descriptor is never closed under them
+		if (_fd >= 0)
+		{
+			::close(_fd);
+		}
+	}
+
+	input_plugin_uring::input_plugin_uring()
+		: _next_tag(0)
+	{
+
+	}
+
+	input_plugin_uring::~input_plugin_uring()
+	{
+		BOOST_LOG_TRIVIAL(trace) << "input_plugin_uring::~input_plugin_uring() called";
+	}
+
+	boost::filesystem::path input_plugin_uring::location() const
+	{
+		return boost::dll::this_line_location(); // location of this plugin
+	}
+
+	std::string input_plugin_uring::plugin_name() const
+	{
+		return "input_uring_plugin";
+	}
+
+	plugin_types input_plugin_uring::plugin_type() const
+	{
+		return plugin_types::input_plugin;
+	}
+
+	void input_plugin_uring::init(void *)
+	{
+		config::instance().init("../config/config_input_plugin_uring.xml");
+		auto pt = config::instance().get_ptree_node("mprt.input_plugin_uring");
+		_max_file_chunk_size = pt.get<size_type>("max_file_chunk_size", 128) * 1024;
+		_max_finish_files = pt.get<size_type>("max_finish_files", 3);
+		_use_direct_io = pt.get<std::string>("use_direct_io", "false") == "true";
+		_alignment = std::max<size_type>(pt.get<size_type>("direct_io_alignment", 4096), 512);
+
+		// a chunk is read with queue_depth reads, each a multiple of the direct io alignment
+		auto queue_depth = std::max<size_type>(pt.get<size_type>("queue_depth", 4), 1);
+		_block_size = (_max_file_chunk_size + queue_depth - 1) / queue_depth;
+		_block_size = std::max<size_type>((_block_size + _alignment - 1) / _alignment * _alignment, _alignment);
+
+		_async_task = std::make_shared<async_tasker>(pt.get<std::size_t>("max_free_timer_count", 10));
+
+		// room for the reads of a seek which are still running next to the new ones
+		_backend = async_read_backend::create(
+			pt.get<std::string>("backend", "auto"),
+			static_cast<std::size_t>(queue_depth * 4),
+			pt.get<std::size_t>("pread_threads", 2),
+			[this] { add_job([this] { reads_finished(); }); });
+
+		BOOST_LOG_TRIVIAL(info) << plugin_name() << " read backend: " << _backend->name();
+	}
+
+	input_plugin_uring::item_shared input_plugin_uring::make_item(std::string const& url, url_id_t url_id)
+	{
+		if (!boost::filesystem::exists(url)) {
+			BOOST_LOG_TRIVIAL(error) << plugin_name() << " file does not exist: " << url;
+			return nullptr;
+		}
+
+		return std::make_shared<uring_file_details>(url, url_id);
+	}
+
+	bool input_plugin_uring::open_file(item_shared const& file)
+	{
+		_STATE_CHECK_(plugin_states::play, false);
+
+		auto & filename = file->_filename;
+
+		int flags = O_RDONLY | O_CLOEXEC;
+		file->_direct_io = _use_direct_io;
+		file->_fd = ::open(filename.c_str(), flags | (file->_direct_io ? O_DIRECT : 0));
+		if (file->_fd < 0 && file->_direct_io && errno == EINVAL)
+		{
+			// tmpfs and some fuse filesystems refuse O_DIRECT
+			BOOST_LOG_TRIVIAL(debug) << "direct io is not supported for: " << filename;
+			file->_direct_io = false;
+			file->_fd = ::open(filename.c_str(), flags);
+		}
+
+		bool is_opened = false;
+		struct stat st;
+
+		if (file->_fd < 0 || ::fstat(file->_fd, &st) != 0) {
+			BOOST_LOG_TRIVIAL(error) << "file open error: " << filename << " " << std::strerror(errno) << " removing from queue";
+			drop_file(file);
+		}
+		else
+		{
+			file->_file_size = static_cast<size_type>(st.st_size);
+
+			if (!file->_direct_io)
+			{
+				(void)::posix_fadvise(file->_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+			}
+
+			is_opened = true;
+		}
+
+		_input_opened_register_func(make_decoder_details(*file, filename, is_opened, file->_file_size));
+
+		BOOST_LOG_TRIVIAL(trace) << "filename opened: " << filename << " direct io: " << file->_direct_io;
+
+		return is_opened;
+	}
+
+	void input_plugin_uring::release_item(uring_file_details & file)
+	{
+		if (!file.is_reading())
+			return;
+
+		// running reads cannot be taken back, they are forgotten and their buffers are
+		// left to them. the reads of the new position go into fresh ones
+		++file._generation;
+		file._cache_buf->detach_cache_ptr();
+		file._bounce_buf.reset();
+		file._in_flight = 0;
+		file._batch_dest = nullptr;
+		file._blocks.clear();
+	}
+
+	bool input_plugin_uring::alloc_bounce_buffer(item_shared const& file)
+	{
+		// a chunk plus the alignment at both ends
+		void * buf = nullptr;
+		auto bounce_size = static_cast<std::size_t>(_max_file_chunk_size + 2 * _alignment);
+		if (::posix_memalign(&buf, static_cast<std::size_t>(_alignment), bounce_size) != 0)
+		{
+			BOOST_LOG_TRIVIAL(error) << "cannot allocate the direct io buffer for: " << file->_filename;
+			return false;
+		}
+
+		file->_bounce_buf.reset(static_cast<unsigned char *>(buf), [](unsigned char * ptr) { std::free(ptr); });
+		return true;
+	}
+
+	bool input_plugin_uring::start_batch(item_shared const& file)
+	{
+		auto remaining = file->_file_size - file->_current_read_so_far;
+		if (remaining <= 0)
+		{
+			file->_cache_buf->sync_cache();
+			close_file(file);
+			return true;
+		}
+
+		if (file->_direct_io && !file->_bounce_buf && !alloc_bounce_buffer(file))
+		{
+			return false;
+		}
+
+		auto length = std::min<size_type>(_max_file_chunk_size, remaining);
+		auto dest = file->_cache_buf->reserve_cache_ptr(length, file->_current_read_so_far);
+		if (!dest)
+		{
+			// no cache means full data
+			return false;
+		}
+
+		file->_batch_offset = file->_current_read_so_far;
+		file->_batch_length = length;
+		file->_batch_dest = dest;
+		file->_batch_head = 0;
+
+		auto read_offset = file->_batch_offset;
+		auto read_length = length;
+		auto read_dest = dest;
+		std::shared_ptr<void> read_buffer = *file->_cache_buf->get_cache_ptr();
+
+		if (file->_direct_io)
+		{
+			// O_DIRECT needs aligned offsets, lengths and memory, the chunk memory is not aligned
+			file->_batch_head = read_offset % _alignment;
+			read_offset -= file->_batch_head;
+			read_length = (file->_batch_head + length + _alignment - 1) / _alignment * _alignment;
+			read_dest = file->_bounce_buf.get();
+			read_buffer = file->_bounce_buf;
+		}
+
+		file->_blocks.clear();
+		for (size_type block_offset = 0; block_offset < read_length; block_offset += _block_size)
+		{
+			auto block_length = std::min<size_type>(_block_size, read_length - block_offset);
+			auto tag = ++_next_tag;
+
+			if (!_backend->submit(file->_fd, read_dest + block_offset, block_length, read_offset + block_offset, tag))
+				break;
+
+			_requests.emplace(tag, read_request{ file, file->_generation, file->_blocks.size(), read_buffer });
+			file->_blocks.emplace_back(block_length, -1);
+		}
+
+		_backend->flush();
+
+		file->_in_flight = static_cast<size_type>(file->_blocks.size());
+
+		if (file->_blocks.empty())
+		{
+			BOOST_LOG_TRIVIAL(error) << "cannot queue a read for: " << file->_filename;
+			file->_cache_buf->commit_cache_ptr(0, false);
+			return false;
+		}
+
+		return true;
+	}
+
+	void input_plugin_uring::finish_batch(item_shared const& file)
+	{
+		// only the bytes up to the first short or failed read are used
+		size_type read_bytes = 0;
+		size_type error = 0;
+
+		for (auto const& block : file->_blocks)
+		{
+			if (block.second < 0)
+			{
+				error = block.second;
+				break;
+			}
+
+			read_bytes += block.second;
+			if (block.second < block.first)
+				break;
+		}
+
+		auto used = std::min<size_type>(std::max<size_type>(read_bytes - file->_batch_head, 0), file->_batch_length);
+
+		if (file->_direct_io && used > 0)
+		{
+			std::memcpy(file->_batch_dest, file->_bounce_buf.get() + file->_batch_head, static_cast<std::size_t>(used));
+		}
+
+		if (used == 0 && error < 0)
+		{
+			BOOST_LOG_TRIVIAL(error) << "file read error: " << file->_filename << " " << std::strerror(static_cast<int>(-error));
+		}
+
+		file->_current_read_so_far += used;
+		file->_batch_dest = nullptr;
+		file->_blocks.clear();
+
+		bool is_file_finished = file->_current_read_so_far >= file->_file_size || used == 0;
+		file->_cache_buf->commit_cache_ptr(used, is_file_finished);
+
+		if (is_file_finished) {
+			close_file(file);
+		}
+	}
+
+	void input_plugin_uring::reads_finished()
+	{
+		_completions.clear();
+		_backend->reap(_completions);
+
+		for (auto const& comp : _completions)
+		{
+			auto iter = _requests.find(comp._tag);
+			if (iter == _requests.end())
+				continue;
+
+			auto request = std::move(iter->second);
+			_requests.erase(iter);
+
+			auto & file = request._file;
+			if (request._generation != file->_generation)
+				continue;
+
+			file->_blocks[request._block].second = comp._result;
+			if (--file->_in_flight == 0)
+			{
+				finish_batch(file);
+			}
+		}
+
+		if (!_completions.empty() && plugin_states::play == _current_state)
+		{
+			// the next chunk is queued right away instead of on the next timer
+			schedule_read(read_step());
+		}
+	}
+
+	std::chrono::microseconds input_plugin_uring::read_step()
+	{
+		if (_finished_files.size() >= static_cast<std::size_t>(_max_finish_files))
+		{
+			return std::chrono::milliseconds(1000);
+		}
+
+		auto file_iter = _files.begin();
+		if (file_iter == _files.end())
+		{
+			return std::chrono::microseconds(1000);
+		}
+
+		auto file = *file_iter;
+		if (!file->is_open() && !open_file(file))
+		{
+			return std::chrono::microseconds(1000);
+		}
+
+		if (!file->_cache_buf)
+		{
+			return std::chrono::microseconds(1000);
+		}
+
+		// the completions move the reading on, the timer only looks after it
+		if (file->is_reading())
+		{
+			return std::chrono::milliseconds(100);
+		}
+
+		if (!start_batch(file))
+		{
+			return std::chrono::seconds(1);
+		}
+
+		return file->is_reading() ? std::chrono::milliseconds(100) : std::chrono::microseconds(0);
+	}
+
+	bool input_plugin_uring::seek_item(uring_file_details & file, size_type seek_point)
+	{
+		// no waiting for the reads of the old position
+		release_item(file);
+		file._cache_buf->clear_cache();
+
+		BOOST_LOG_TRIVIAL(debug)
+			<< "FILE address: " << file._cache_buf
+			<< " FILE cache size: " << file._cache_buf->cache_size_guess()
+			<< " data size: " << file._cache_buf->data_size_guess()
+			<< " total data: " << file._cache_buf->total_bytes_in_buffer_guess();
+
+		file._current_read_so_far = seek_point;
+		return true;
+	}
+}
+
+// Factory method. Returns *simple pointer*!
+std::unique_ptr<refcounting_plugin_api> create() {
+	return std::make_unique<mprt::input_plugin_uring>();
+}
+
+
+BOOST_DLL_ALIAS(create, create_refc_plugin)
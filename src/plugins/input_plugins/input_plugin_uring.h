@@ -0,0 +1,103 @@
+#ifndef input_plugin_uring_h__
+#define input_plugin_uring_h__
+
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+#include "common/input_plugin_api.h"
+
+#include "input_plugin_base.h"
+#include "async_read_backend.h"
+
+namespace mprt {
+
+	// the reads of a chunk are all in flight together, a chunk is handed to the decoder
+	// when the last of them has finished
+	struct uring_file_details {
+		std::string _filename;
+		size_type _url_id;
+		int _fd;
+		bool _direct_io;
+		size_type _file_size;
+		size_type _current_read_so_far;
+		cache_buffer_shared _cache_buf;
+
+		// reads of an old position are dropped when they finish
+		uint64_t _generation;
+
+		// current batch
+		size_type _in_flight;
+		size_type _batch_offset;
+		size_type _batch_length;
+		size_type _batch_head; // bytes read before _batch_offset for the alignment
+		buffer_elem_t * _batch_dest;
+		std::vector<std::pair<size_type /*length*/, size_type /*result*/>> _blocks;
+		std::shared_ptr<unsigned char> _bounce_buf; // direct io
+
+		uring_file_details(std::string const& filename, size_type url_id)
+			: _filename(filename)
+			, _url_id(url_id)
+			, _fd(-1)
+			, _direct_io(false)
+			, _file_size(0)
+			, _current_read_so_far(0)
+			, _generation(0)
+			, _in_flight(0)
+			, _batch_offset(0)
+			, _batch_length(0)
+			, _batch_head(0)
+			, _batch_dest(nullptr)
+		{}
+
+		~uring_file_details();
+
+		bool is_open() const { return _fd >= 0; }
+		bool is_reading() const { return _in_flight > 0; }
+	};
+
+	class input_plugin_uring : public input_plugin_base<uring_file_details>
+	{
+	private:
+		struct read_request {
+			item_shared _file;
+			uint64_t _generation;
+			std::size_t _block;
+			std::shared_ptr<void> _buffer; // kept until the read has finished
+		};
+
+		size_type _max_file_chunk_size;
+		size_type _block_size;
+		size_type _alignment;
+		bool _use_direct_io;
+
+		uint64_t _next_tag;
+		std::unordered_map<uint64_t, read_request> _requests;
+		std::vector<async_read_backend::completion> _completions;
+		// destroyed first, no read may finish into a released buffer
+		std::unique_ptr<async_read_backend> _backend;
+
+		bool open_file(item_shared const& file);
+		bool alloc_bounce_buffer(item_shared const& file);
+		bool start_batch(item_shared const& file);
+		void finish_batch(item_shared const& file);
+		void reads_finished();
+
+		virtual item_shared make_item(std::string const& url, url_id_t url_id) override;
+		virtual std::chrono::microseconds read_step() override;
+		virtual bool seek_item(uring_file_details & file, size_type seek_point) override;
+		virtual void release_item(uring_file_details & file) override;
+
+	public:
+		input_plugin_uring();
+		virtual ~input_plugin_uring();
+
+		// ref plugin functions
+		virtual boost::filesystem::path location() const override;
+		virtual std::string plugin_name() const override;
+		virtual plugin_types plugin_type() const override;
+		virtual void init(void * arguments = nullptr) override;
+	};
+}
+
+#endif // input_plugin_uring_h__
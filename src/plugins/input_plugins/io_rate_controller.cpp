@@ -0,0 +1,181 @@
+#include <algorithm>
+#include <functional>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+#include <boost/filesystem/path.hpp>
+
+#include "io_rate_controller.h"
+
+namespace mprt
+{
+	namespace
+	{
+		constexpr double _SMOOTHING_ = 0.2;
+		// the consumer rate is not measured over shorter spans, the decoder reads in bursts
+		constexpr double _MIN_RATE_SPAN_SECS_ = 0.25;
+
+		double to_secs(io_rate_controller::clock_type::duration dur)
+		{
+			return std::chrono::duration<double>(dur).count();
+		}
+
+		double smooth(double old_val, double new_val)
+		{
+			return old_val + _SMOOTHING_ * (new_val - old_val);
+		}
+	}
+
+	io_rate_controller::io_rate_controller(double target_buffer_secs, double low_buffer_secs, double read_time_secs,
+		size_type min_read_size, std::chrono::microseconds max_sleep)
+		: _target_buffer_secs(std::max(target_buffer_secs, 0.5))
+		, _low_buffer_secs(std::min(low_buffer_secs, _target_buffer_secs * 0.9))
+		, _read_time_secs(read_time_secs)
+		, _min_read_size(min_read_size)
+		, _max_sleep(max_sleep)
+	{
+	}
+
+	size_type io_rate_controller::device_of(std::string const& path)
+	{
+#ifdef _WIN32
+		return static_cast<size_type>(std::hash<std::string>()(boost::filesystem::path(path).root_name().string()));
+#else
+		struct stat st;
+		return ::stat(path.c_str(), &st) == 0 ? static_cast<size_type>(st.st_dev) : 0;
+#endif
+	}
+
+	io_rate_controller::device_stats & io_rate_controller::device(size_type device_id)
+	{
+		auto iter = _devices.find(device_id);
+		if (iter == _devices.end())
+		{
+			iter = _devices.emplace(device_id, device_stats{ 0, 0, false }).first;
+		}
+
+		return iter->second;
+	}
+
+	void io_rate_controller::start_track(track_state & track, std::string const& path, size_type buffered_bytes)
+	{
+		track = track_state();
+		track._device = device_of(path);
+		track._last_time = clock_type::now();
+		track._last_buffered = buffered_bytes;
+	}
+
+	void io_rate_controller::restart_track(track_state & track, size_type buffered_bytes)
+	{
+		track._refilling = true;
+		track._last_time = clock_type::now();
+		track._last_buffered = buffered_bytes;
+		track._produced = 0;
+	}
+
+	double io_rate_controller::low_buffer_secs(track_state const& track)
+	{
+		auto & dev = device(track._device);
+		if (!dev._measured || dev._bytes_per_sec <= 0)
+			return _low_buffer_secs;
+
+		// a device which is slow to answer or hardly faster than the track starts refilling earlier
+		auto refill_secs = _target_buffer_secs * track._byte_rate / dev._bytes_per_sec;
+		return std::min(std::max(_low_buffer_secs, 4 * dev._read_latency_secs + refill_secs), _target_buffer_secs * 0.9);
+	}
+
+	size_type io_rate_controller::bytes_wanted(track_state & track, size_type buffered_bytes, size_type capacity_bytes)
+	{
+		auto now = clock_type::now();
+		auto span = to_secs(now - track._last_time);
+
+		if (span >= _MIN_RATE_SPAN_SECS_)
+		{
+			auto consumed = std::max<size_type>(track._produced + track._last_buffered - buffered_bytes, 0);
+			auto rate = consumed / span;
+
+			if (track._rate_known)
+			{
+				track._byte_rate = smooth(track._byte_rate, rate);
+			}
+			else if (consumed > 0)
+			{
+				track._byte_rate = rate;
+				track._rate_known = true;
+			}
+
+			track._last_time = now;
+			track._last_buffered = buffered_bytes;
+			track._produced = 0;
+		}
+
+		auto free_bytes = std::max<size_type>(capacity_bytes - buffered_bytes, 0);
+
+		// nothing is known before the decoder starts taking, the buffer is filled
+		if (!track._rate_known || track._byte_rate <= 0)
+			return free_bytes;
+
+		if (buffered_bytes < track._byte_rate * low_buffer_secs(track))
+		{
+			track._refilling = true;
+		}
+
+		auto target_bytes = std::min(static_cast<size_type>(track._byte_rate * _target_buffer_secs), capacity_bytes);
+		if (!track._refilling || buffered_bytes >= target_bytes)
+		{
+			track._refilling = false;
+			return 0;
+		}
+
+		return target_bytes - buffered_bytes;
+	}
+
+	size_type io_rate_controller::read_size(track_state const& track, size_type max_size)
+	{
+		auto iter = _devices.find(track._device);
+		if (iter == _devices.end() || !iter->second._measured)
+			return max_size;
+
+		// a read should not keep the input thread longer than read_time
+		auto size = static_cast<size_type>(iter->second._bytes_per_sec * _read_time_secs);
+		return std::max<size_type>(std::min(size, max_size), std::min(_min_read_size, max_size));
+	}
+
+	void io_rate_controller::read_done(track_state & track, size_type bytes, clock_type::duration took, bool from_device)
+	{
+		track._produced += bytes;
+
+		auto secs = to_secs(took);
+		if (!from_device || bytes <= 0 || secs <= 0)
+			return;
+
+		auto & dev = device(track._device);
+		auto bytes_per_sec = bytes / secs;
+
+		if (dev._measured)
+		{
+			dev._bytes_per_sec = smooth(dev._bytes_per_sec, bytes_per_sec);
+			dev._read_latency_secs = smooth(dev._read_latency_secs, secs);
+		}
+		else
+		{
+			dev._bytes_per_sec = bytes_per_sec;
+			dev._read_latency_secs = secs;
+			dev._measured = true;
+		}
+	}
+
+	std::chrono::microseconds io_rate_controller::sleep_time(track_state const& track, size_type buffered_bytes)
+	{
+		if (!track._rate_known || track._byte_rate <= 0)
+			return _max_sleep;
+
+		// until the buffer is down to the low mark
+		auto secs_left = buffered_bytes / track._byte_rate - low_buffer_secs(track);
+		auto sleep = std::chrono::microseconds(static_cast<std::chrono::microseconds::rep>(std::max(secs_left, 0.0) * 1e6));
+
+		return std::min(std::max(sleep, std::chrono::microseconds(1000)), _max_sleep);
+	}
+}
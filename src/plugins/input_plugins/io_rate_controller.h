@@ -0,0 +1,82 @@
+#ifndef io_rate_controller_h__
+#define io_rate_controller_h__
+
+#include <chrono>
+#include <string>
+#include <unordered_map>
+
+#include "common/common_defs.h"
+
+namespace mprt
+{
+	// paces the reads of the input plugin: the buffer of a track is refilled up to
+	// target_buffer seconds of audio when it falls below low_buffer seconds, the reads are
+	// sized from the measured throughput of the storage device and the wait in between
+	// comes from the byte rate the decoder takes out of the buffer
+	class io_rate_controller
+	{
+	public:
+		using clock_type = std::chrono::steady_clock;
+
+		struct device_stats
+		{
+			double _bytes_per_sec;
+			double _read_latency_secs;
+			bool _measured;
+		};
+
+		struct track_state
+		{
+			size_type _device;
+			double _byte_rate; // taken out by the decoder
+			bool _rate_known;
+			bool _refilling;
+			clock_type::time_point _last_time;
+			size_type _last_buffered;
+			size_type _produced;
+
+			track_state()
+				: _device(0)
+				, _byte_rate(0)
+				, _rate_known(false)
+				, _refilling(true)
+				, _last_buffered(0)
+				, _produced(0)
+			{}
+		};
+
+	private:
+		double _target_buffer_secs;
+		double _low_buffer_secs;
+		double _read_time_secs;
+		size_type _min_read_size;
+		std::chrono::microseconds _max_sleep;
+
+		std::unordered_map<size_type, device_stats> _devices;
+
+		device_stats & device(size_type device_id);
+		double low_buffer_secs(track_state const& track);
+
+	public:
+		io_rate_controller(double target_buffer_secs, double low_buffer_secs, double read_time_secs,
+			size_type min_read_size, std::chrono::microseconds max_sleep);
+
+		// files on the same device share the throughput figures
+		static size_type device_of(std::string const& path);
+
+		void start_track(track_state & track, std::string const& path, size_type buffered_bytes);
+		// a seek empties the buffer, the consumer rate is kept
+		void restart_track(track_state & track, size_type buffered_bytes);
+
+		// bytes to read now, 0 if the buffer holds enough
+		size_type bytes_wanted(track_state & track, size_type buffered_bytes, size_type capacity_bytes);
+		// size of the next single read
+		size_type read_size(track_state const& track, size_type max_size);
+		// from_device false: a cache hit, it counts as produced but says nothing of the storage
+		void read_done(track_state & track, size_type bytes, clock_type::duration took, bool from_device = true);
+		// wait until the next read is needed
+		std::chrono::microseconds sleep_time(track_state const& track, size_type buffered_bytes);
+	};
+}
+
+#endif // io_rate_controller_h__
@@ -0,0 +1,211 @@
+#include <algorithm>
+
+#include <boost/filesystem/operations.hpp>
+#include <boost/log/trivial.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/xml_parser.hpp>
+
+#include "alsa_auto_tuner.h"
+
+namespace mprt
+{
+	namespace
+	{
+		constexpr double _GROW_FACTOR_ = 1.5;
+		constexpr double _SHRINK_FACTOR_ = 0.8;
+		// the worst lateness has to fit this many times in the headroom of the smaller buffer
+		constexpr double _LATENESS_MARGIN_ = 2.;
+	}
+
+	alsa_auto_tuner::alsa_auto_tuner(settings const& sets, std::string const& device)
+		: _settings(sets)
+		, _device(device)
+		, _buffer_ms(static_cast<double>(sets._min_buffer_ms))
+		, _floor_ms(0.)
+	{
+		_settings._periods = std::max<size_type>(_settings._periods, 2);
+		_settings._max_buffer_ms = std::max(_settings._max_buffer_ms, _settings._min_buffer_ms);
+
+		load();
+		reset_window();
+
+		BOOST_LOG_TRIVIAL(debug) << "alsa auto tune: " << _device << " buffer: " << buffer_ms() << " ms period: " << period_ms() << " ms";
+	}
+
+	size_type alsa_auto_tuner::buffer_ms() const
+	{
+		return static_cast<size_type>(_buffer_ms + 0.5);
+	}
+
+	size_type alsa_auto_tuner::period_ms() const
+	{
+		return std::max<size_type>(buffer_ms() / _settings._periods, 1);
+	}
+
+	void alsa_auto_tuner::reset_window()
+	{
+		_xruns = 0;
+		_wakeups = 0;
+		_played = std::chrono::microseconds(0);
+		_max_lateness = std::chrono::microseconds(0);
+		_last_evaluate = clock_type::now();
+	}
+
+	double alsa_auto_tuner::xruns_per_hour() const
+	{
+		// a single xrun in a short window counts as a full hour of them
+		auto hours = std::max(std::chrono::duration<double>(_played).count(), 1.) / 3600.;
+		return _xruns / hours;
+	}
+
+	void alsa_auto_tuner::on_xrun()
+	{
+		++_xruns;
+		BOOST_LOG_TRIVIAL(debug) << "alsa auto tune: xrun with buffer: " << buffer_ms() << " ms";
+	}
+
+	void alsa_auto_tuner::on_wakeup(std::chrono::microseconds headroom, std::chrono::microseconds buffer, std::chrono::microseconds period)
+	{
+		// the device asks for data when a period is free, anything less queued is lateness
+		auto lateness = (buffer - period) - headroom;
+		_max_lateness = std::max(_max_lateness, lateness);
+		++_wakeups;
+	}
+
+	void alsa_auto_tuner::on_played(std::chrono::microseconds played)
+	{
+		_played += played;
+	}
+
+	bool alsa_auto_tuner::needs_growing() const
+	{
+		return _xruns && xruns_per_hour() > _settings._max_xruns_per_hour && _buffer_ms < _settings._max_buffer_ms;
+	}
+
+	bool alsa_auto_tuner::is_due() const
+	{
+		return _settings._interval.count() > 0 && clock_type::now() - _last_evaluate >= _settings._interval;
+	}
+
+	bool alsa_auto_tuner::evaluate(bool allow_shrink)
+	{
+		auto old_ms = _buffer_ms;
+
+		if (needs_growing())
+		{
+			_floor_ms = std::max(_floor_ms, _buffer_ms);
+			_buffer_ms = std::min(_buffer_ms * _GROW_FACTOR_, static_cast<double>(_settings._max_buffer_ms));
+		}
+		else if (allow_shrink && !_xruns && _wakeups && _played >= _settings._min_observe)
+		{
+			auto new_ms = std::max(_buffer_ms * _SHRINK_FACTOR_, static_cast<double>(_settings._min_buffer_ms));
+			auto new_headroom_ms = new_ms - new_ms / _settings._periods;
+			auto lateness_ms = std::chrono::duration<double, std::milli>(_max_lateness).count();
+
+			if (new_ms > _floor_ms && lateness_ms * _LATENESS_MARGIN_ < new_headroom_ms)
+			{
+				_buffer_ms = new_ms;
+			}
+		}
+		else if (!allow_shrink || _played < _settings._min_observe)
+		{
+			// keep on collecting
+			return false;
+		}
+
+		BOOST_LOG_TRIVIAL(debug) << "alsa auto tune: " << _device
+			<< " played: " << std::chrono::duration_cast<std::chrono::seconds>(_played).count() << " s"
+			<< " xruns: " << _xruns
+			<< " max lateness: " << _max_lateness.count() << " us"
+			<< " buffer: " << static_cast<size_type>(old_ms + 0.5) << " -> " << buffer_ms() << " ms";
+
+		reset_window();
+
+		if (old_ms == _buffer_ms)
+		{
+			return false;
+		}
+
+		save();
+		return true;
+	}
+
+	void alsa_auto_tuner::load()
+	{
+		boost::system::error_code ec;
+		if (_settings._file.empty() || !boost::filesystem::exists(_settings._file, ec))
+			return;
+
+		try
+		{
+			boost::property_tree::ptree pt;
+			boost::property_tree::read_xml(_settings._file.string(), pt);
+
+			for (auto & device_node : pt.get_child("mprt.alsa_auto_tune"))
+			{
+				auto const& device_pt = device_node.second;
+				if (device_pt.get<std::string>("name") != _device)
+					continue;
+
+				_buffer_ms = std::min(
+					std::max(device_pt.get<double>("buffer_ms"), static_cast<double>(_settings._min_buffer_ms)),
+					static_cast<double>(_settings._max_buffer_ms));
+				_floor_ms = device_pt.get<double>("floor_ms", 0.);
+				break;
+			}
+		}
+		catch (std::exception const& e)
+		{
+			BOOST_LOG_TRIVIAL(error) << "cannot load alsa auto tune values: " << _settings._file << " " << e.what();
+		}
+	}
+
+	void alsa_auto_tuner::save() const
+	{
+		if (_settings._file.empty())
+			return;
+
+		// the other devices are kept as they are
+		boost::property_tree::ptree pt;
+		try
+		{
+			boost::system::error_code ec;
+			if (boost::filesystem::exists(_settings._file, ec))
+			{
+				boost::property_tree::read_xml(_settings._file.string(), pt, boost::property_tree::xml_parser::trim_whitespace);
+			}
+		}
+		catch (std::exception const&)
+		{
+			pt.clear();
+		}
+
+		auto & devices_pt = pt.put_child("mprt.alsa_auto_tune", pt.get_child("mprt.alsa_auto_tune", boost::property_tree::ptree()));
+		for (auto iter = devices_pt.begin(); iter != devices_pt.end();)
+		{
+			iter = iter->second.get<std::string>("name", "") == _device ? devices_pt.erase(iter) : std::next(iter);
+		}
+
+		boost::property_tree::ptree device_pt;
+		device_pt.put("name", _device);
+		device_pt.put("buffer_ms", _buffer_ms);
+		device_pt.put("floor_ms", _floor_ms);
+		devices_pt.add_child("device", device_pt);
+
+		try
+		{
+			boost::system::error_code ec;
+			boost::filesystem::create_directories(_settings._file.parent_path(), ec);
+
+			auto tmp_file = _settings._file;
+			tmp_file += ".tmp";
+			boost::property_tree::write_xml(tmp_file.string(), pt, std::locale(),
+				boost::property_tree::xml_writer_make_settings<std::string>('\t', 1));
+			boost::filesystem::rename(tmp_file, _settings._file);
+		}
+		catch (std::exception const& e)
+		{
+			BOOST_LOG_TRIVIAL(error) << "cannot save alsa auto tune values: " << _settings._file << " " << e.what();
+		}
+	}
+}
@@ -0,0 +1,81 @@
+#ifndef alsa_auto_tuner_h__
+#define alsa_auto_tuner_h__
+
+#include <chrono>
+#include <string>
+
+#include <boost/filesystem/path.hpp>
+
+#include "common/common_defs.h"
+
+namespace mprt
+{
+	// picks the alsa buffer time from what the playback shows: it starts low, grows when
+	// the xruns go over the target and shrinks while the wakeups keep enough headroom.
+	// the chosen values are kept per device. used from the output job thread only
+	class alsa_auto_tuner
+	{
+	public:
+		struct settings
+		{
+			size_type _min_buffer_ms;
+			size_type _max_buffer_ms;
+			size_type _periods; // periods in a buffer
+			double _max_xruns_per_hour;
+			std::chrono::seconds _min_observe; // of playing before shrinking
+			std::chrono::seconds _interval; // 0: only when the device is set up anyway
+			boost::filesystem::path _file;
+
+			settings()
+				: _min_buffer_ms(40)
+				, _max_buffer_ms(500)
+				, _periods(4)
+				, _max_xruns_per_hour(1.)
+				, _min_observe(300)
+				, _interval(0)
+			{}
+		};
+
+	private:
+		using clock_type = std::chrono::steady_clock;
+
+		settings _settings;
+		std::string _device;
+		double _buffer_ms;
+		double _floor_ms; // the highest buffer which had xruns, not gone down to again
+
+		// the current observation
+		size_type _xruns;
+		size_type _wakeups;
+		std::chrono::microseconds _played;
+		std::chrono::microseconds _max_lateness;
+		clock_type::time_point _last_evaluate;
+
+		void reset_window();
+		double xruns_per_hour() const;
+		void load();
+		void save() const;
+
+	public:
+		alsa_auto_tuner(settings const& sets, std::string const& device);
+
+		size_type buffer_ms() const;
+		size_type period_ms() const;
+
+		// an underrun while the data was there
+		void on_xrun();
+		// headroom: what was still queued in the device when the writer woke up
+		void on_wakeup(std::chrono::microseconds headroom, std::chrono::microseconds buffer, std::chrono::microseconds period);
+		void on_played(std::chrono::microseconds played);
+
+		// the xruns are over the target already, worth a reconfigure in the middle of an item
+		bool needs_growing() const;
+		// the interval passed
+		bool is_due() const;
+
+		// true if the buffer changed, the device has to be set up again
+		bool evaluate(bool allow_shrink);
+	};
+}
+
+#endif // alsa_auto_tuner_h__
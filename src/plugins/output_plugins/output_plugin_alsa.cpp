@@ -1,3 +1,11 @@
+#include <cstring>
+#include <algorithm>
+#include <sstream>
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
 #include <alsa/asoundlib.h>
 
 #include <boost/dll/runtime_symbol_info.hpp>
@@ -19,6 +27,34 @@ extern "C" snd_pcm_hw_params_t * m_snd(size_t /*size*/)
 
 namespace mprt
 {
+	namespace
+	{
+		// the decoded data is not linearized for mmap writes, the ring parts are copied one by one
+		template <typename Buffer>
+		void copy_pcm(Buffer const& buf, std::size_t from, unsigned char * dest, std::size_t len)
+		{
+			auto one = buf.array_one();
+			auto two = buf.array_two();
+
+			if (from < one.second)
+			{
+				auto count = std::min(len, one.second - from);
+				std::memcpy(dest, one.first + from, count);
+				dest += count;
+				len -= count;
+				from = 0;
+			}
+			else
+			{
+				from -= one.second;
+			}
+
+			if (len)
+			{
+				std::memcpy(dest, two.first + from, len);
+			}
+		}
+	}
 
 	// please note that what alsa called a frame we call sample, 
 	// alsa says a sample for a channel, their nomenclature is more correct
@@ -38,12 +74,16 @@ namespace mprt
 
 	void output_plugin_alsa::init(void *)
 	{
+		std::string soft_volume = "auto";
+		bool auto_tune = false;
+		alsa_auto_tuner::settings tune_sets;
 		try
 		{	
 			config::instance().init("../config/config_output_plugin_alsa.xml");
 			auto pt = config::instance().get_ptree_node("mprt.output_plugin_alsa");
 
 			_async_task = std::make_shared<async_tasker>(pt.get<std::size_t>("max_free_timer_count", 10));
+			_enabled = (pt.get<std::string>("enable", "true") == "true");
 			_preffered_device_name = pt.get<std::string>("preffered_device_name", "default");
 			_mixer_device = pt.get<std::string>("mixer_device", "default");
 			_mixer_name = pt.get<std::string>("mixer_name", "Master");
@@ -56,6 +96,31 @@ namespace mprt
 			_next_diff_item_drain_time_msecs = pt.get<size_type>("next_diff_item_drain_time_msecs", 300);
 			_use_poll = (pt.get<std::string>("use_poll", "true") == "true");
 			_use_drain = (pt.get<std::string>("use_drain", "true") == "true");
+			_use_mmap = (pt.get<std::string>("use_mmap", "true") == "true");
+			_crossfade_mode = crossfade::mode_from_string(pt.get<std::string>("crossfade_mode", "off"));
+			_crossfade_msecs = pt.get<size_type>("crossfade_msecs", 5000);
+			set_progress_rate(pt.get<double>("progress_rate_hz", 10.));
+			_crossfade.set_curve(crossfade::curve_from_string(pt.get<std::string>("crossfade_curve", "equal_power")));
+			auto keep_open_format = pt.get<std::string>("keep_open_format", "format");
+			_keep_open_format =
+				keep_open_format == "all" ? open_format_policy::all :
+				keep_open_format == "format" ? open_format_policy::format :
+				open_format_policy::off;
+			soft_volume = pt.get<std::string>("soft_volume", "auto");
+			_replay_gain_mode = replay_gain::mode_from_string(pt.get<std::string>("replaygain_mode", "off"));
+			_replay_gain_preamp_db = pt.get<double>("replaygain_preamp_db", 0.);
+			_no_replay_gain_preamp_db = pt.get<double>("replaygain_no_gain_preamp_db", 0.);
+			_replay_gain_prevent_clip = (pt.get<std::string>("replaygain_prevent_clip", "true") == "true");
+			_soft_gain_ramp_msecs = pt.get<size_type>("soft_gain_ramp_msecs", 30);
+			_soft_gain.set_dither(pt.get<std::string>("soft_gain_dither", "true") == "true");
+			auto_tune = (pt.get<std::string>("auto_tune", "false") == "true");
+			tune_sets._min_buffer_ms = pt.get<size_type>("auto_tune_min_buffer_msecs", 40);
+			tune_sets._max_buffer_ms = pt.get<size_type>("auto_tune_max_buffer_msecs", _use_buffer_duration_size ? 500 : _max_buffer);
+			tune_sets._periods = pt.get<size_type>("auto_tune_periods", 4);
+			tune_sets._max_xruns_per_hour = pt.get<double>("auto_tune_max_xruns_per_hour", 1.);
+			tune_sets._min_observe = std::chrono::seconds(pt.get<size_type>("auto_tune_min_observe_secs", 300));
+			tune_sets._interval = std::chrono::seconds(pt.get<size_type>("auto_tune_interval_secs", 0));
+			tune_sets._file = pt.get<std::string>("auto_tune_file", "../cache/alsa_tuning.xml");
 			_use_duration = pt.get<std::string>("use_memory_size_or_durationms", "duration") == "duration";
 
 			_max_chunk_read_size = pt.get<size_type>("max_chunk_read_size", 128) * 1024;
@@ -77,31 +142,61 @@ namespace mprt
 			std::this_thread::yield();
 		}
 
-		add_job([this]() { 
-			int op_mode = SND_PCM_NONBLOCK; // | SND_PCM_NO_AUTO_RESAMPLE | SND_PCM_NO_AUTO_FORMAT | SND_PCM_NO_AUTO_CHANNELS /*| SND_PCM_NONBLOCK*/;
-							 //op_mode |= SND_PCM_NO_AUTO_RESAMPLE;
-			if ((_pcm_handle = snd_pcm_open(
-				&_playback_handle,
-				_preffered_device_name.c_str(),
-				SND_PCM_STREAM_PLAYBACK,
-				op_mode)) < 0) {
-				BOOST_LOG_TRIVIAL(error)
-					<< "cannot open alsa driver: " << _preffered_device_name
-					<< " error: " << snd_strerror(_pcm_handle);
-				return;
-			}
+		if (!_enabled)
+		{
+			return;
+		}
 
-			_init_open = true;
-			_init_poll = _use_poll ? init_poll_params() : false;
+		if (auto_tune)
+		{
+			_auto_tuner = std::make_unique<alsa_auto_tuner>(tune_sets, _preffered_device_name);
+		}
 
-			init_mixer();
-		});
+		// opened here, the caps are known before the first item is negotiated
+		int op_mode = SND_PCM_NONBLOCK; // | SND_PCM_NO_AUTO_RESAMPLE | SND_PCM_NO_AUTO_FORMAT | SND_PCM_NO_AUTO_CHANNELS /*| SND_PCM_NONBLOCK*/;
+						 //op_mode |= SND_PCM_NO_AUTO_RESAMPLE;
+		if ((_pcm_handle = snd_pcm_open(
+			&_playback_handle,
+			_preffered_device_name.c_str(),
+			SND_PCM_STREAM_PLAYBACK,
+			op_mode)) < 0) {
+			BOOST_LOG_TRIVIAL(error)
+				<< "cannot open alsa driver: " << _preffered_device_name
+				<< " error: " << snd_strerror(_pcm_handle);
+			return;
+		}
+
+		_init_open = true;
+		_init_poll = _use_poll ? init_poll_params() : false;
+		_event_loop = _init_poll && init_event_loop();
+		if (_use_poll && !_event_loop)
+		{
+			BOOST_LOG_TRIVIAL(error) << "alsa poll descriptors cannot be waited on, using timed writes: " << _preffered_device_name;
+		}
+
+		probe_format_caps();
+
+		init_mixer();
+
+		// auto: the mixer is used when the device has one
+		_soft_volume = soft_volume == "true" || (soft_volume == "auto" && !_is_mixer_open);
+		BOOST_LOG_TRIVIAL(debug) << "alsa volume: " << (_soft_volume ? "software" : "mixer");
 
 	
 	}
 
 	void output_plugin_alsa::stop_internal()
 	{
+		cancel_waits();
+
+		if (_draining)
+		{
+			// the finished item is given back when the drain ends, which is not waited for now
+			_draining = false;
+			snd_pcm_drop(_playback_handle);
+			give_cache_buf_back(_prev_sound_details._url_id);
+		}
+
 		for (auto & sound_det : _sound_details_queue)
 		{
 			sound_det._decoder_play_finished_callback(sound_det._url_id);
@@ -110,6 +205,12 @@ namespace mprt
 		}
 
 		_init_api = false;
+		_soft_gain_url_id = _INVALID_URL_ID_;
+		_soft_gain_jump = true;
+		_tune_data_starved = true;
+		_crossfade_active = false;
+		_played_out_url_id = _INVALID_URL_ID_;
+		_resample_ratio = 0.;
 
 		output_plugin_api::stop_internal();
 		sound_plugin_api::reset_buffers();
@@ -120,11 +221,15 @@ namespace mprt
 	{
 		BOOST_LOG_TRIVIAL(debug) << "alsa pause called";
 
+		cancel_waits();
 		pause_alsa();
+		hold_position();
+		_tune_data_starved = true;
 	}
 
 	void output_plugin_alsa::quit_internal()
 	{
+		close_event_loop();
 	}
 
 	void output_plugin_alsa::set_volume(size_type volume)
@@ -166,8 +271,14 @@ namespace mprt
 	{
 		BOOST_LOG_TRIVIAL(debug) << "stream recovery";
 
+		restart_device_clock();
+
 		if (err == -EPIPE) {
 			BOOST_LOG_TRIVIAL(debug) << "alsa underrun recovery";
+			if (_auto_tuner && !_tune_data_starved)
+			{
+				_auto_tuner->on_xrun();
+			}
 			err = snd_pcm_prepare(_playback_handle);
 			if (err < 0)
 				BOOST_LOG_TRIVIAL(debug)
@@ -217,6 +328,8 @@ namespace mprt
 		_use_db_vol ? 
 			snd_mixer_selem_get_playback_dB_range(_mixer_elem, &_mixer_min, &_mixer_max) : 
 			snd_mixer_selem_get_playback_volume_range(_mixer_elem, &_mixer_min, &_mixer_max);
+
+		_is_mixer_open = true;
 	}
 
 	void output_plugin_alsa::pause_alsa()
@@ -233,7 +346,6 @@ namespace mprt
 			else if (state == SND_PCM_STATE_RUNNING) {
 				BOOST_LOG_TRIVIAL(debug) << "pause OK";
 
-				snd_pcm_wait(_playback_handle, -1);
 				snd_pcm_pause(_playback_handle, 1);
 			}
 			else {
@@ -245,6 +357,7 @@ namespace mprt
 		}
 
 		_paused = true;
+		restart_device_clock();
 	}
 
 	void output_plugin_alsa::unpause_alsa()
@@ -258,7 +371,6 @@ namespace mprt
 				// state is PREPARED -> no need to unpause
 			}
 			else if (state == SND_PCM_STATE_PAUSED) {
-				snd_pcm_wait(_playback_handle, -1);
 				snd_pcm_pause(_playback_handle, 0);
 			}
 			else {
@@ -270,6 +382,7 @@ namespace mprt
 		}
 
 		_paused = false;
+		restart_device_clock();
 	}
 
 	void output_plugin_alsa::set_alsa_volume(long volume)
@@ -292,14 +405,29 @@ namespace mprt
 
 	size_type output_plugin_alsa::fill_drain(size_type bytes, sound_details const& sound_dets)
 	{
+		if (_event_loop)
+		{
+			// no waiting for room in the event loop, the silence goes in as far as it fits
+			bytes = std::min(bytes, std::max<size_type>(alsa_available_bytes_to_write(), 0));
+		}
+
 		auto drain_sample_size = bytes_to_samples(bytes, sound_dets);
-		std::vector<uint8_t> drain_buf(bytes, 0);
 
-		auto written_samples =
-			_use_poll ?
-			poll_write(drain_buf.data(), drain_sample_size, sound_dets._bps / 8, sound_dets._channels)
-			:
-			direct_write(drain_buf.data(), drain_sample_size, sound_dets._bps / 8, sound_dets._channels);
+		snd_pcm_sframes_t written_samples = 0;
+		if (_mmap_access)
+		{
+			auto frame_bytes = samples_to_bytes(1, sound_dets);
+			written_samples = mmap_write(drain_sample_size,
+				[frame_bytes](unsigned char * dest, snd_pcm_uframes_t, snd_pcm_uframes_t frames)
+			{
+				std::memset(dest, 0, static_cast<std::size_t>(frames * frame_bytes));
+			});
+
+			return samples_to_bytes(written_samples, sound_dets);
+		}
+
+		std::vector<uint8_t> drain_buf(bytes, 0);
+		written_samples = direct_write(drain_buf.data(), drain_sample_size, sound_dets._bps / 8, sound_dets._channels);
 
 		return samples_to_bytes(written_samples, sound_dets);
 	}
@@ -335,17 +463,158 @@ namespace mprt
 		_prev_sound_details = new_sound_dets;
 		BOOST_LOG_TRIVIAL(debug) << "alsa changing current cache";
 
+		// a new buffer is taken when the device is set up anyway or nothing is queued in it,
+		// a gapless item of the same format is not cut for it
+		bool retune = _auto_tuner &&
+			(!is_same_before || snd_pcm_state(_playback_handle) != SND_PCM_STATE_RUNNING) &&
+			_auto_tuner->evaluate(true);
+
 		// check for previous ...
-		if (is_same_before) {
+		if (is_same_before && !retune) {
 			BOOST_LOG_TRIVIAL(debug) << "alsa same as before";
 
 			return (_init_api = true);
 		}
 
+		if (retune)
+		{
+			BOOST_LOG_TRIVIAL(info) << "alsa auto tune: " << _preffered_device_name
+				<< " buffer: " << _auto_tuner->buffer_ms() << " ms period: " << _auto_tuner->period_ms() << " ms";
+		}
+
 		_prev_sound_details = new_sound_dets;
 		auto init_hw = init_hw_params();
 		auto init_sw = init_sw_params();
-		return (_init_api = _use_poll ? (init_hw && init_sw && _init_poll) : (init_hw && init_sw));
+		return (_init_api = init_hw && init_sw);
+	}
+
+	bool output_plugin_alsa::retune_alsa()
+	{
+		BOOST_LOG_TRIVIAL(info) << "alsa auto tune: " << _preffered_device_name
+			<< " buffer: " << _auto_tuner->buffer_ms() << " ms period: " << _auto_tuner->period_ms() << " ms"
+			<< ", the queued audio is dropped";
+
+		// the device is dropped and prepared again, the poll descriptors stay the same
+		auto init_hw = init_hw_params();
+		auto init_sw = init_sw_params();
+		_tune_data_starved = true;
+		return (_init_api = init_hw && init_sw);
+	}
+
+	void output_plugin_alsa::probe_format_caps()
+	{
+		snd_pcm_hw_params_t *probe_params = nullptr;
+		if (snd_pcm_hw_params_malloc(&probe_params) < 0)
+			return;
+
+		SCOPE_EXIT_REF(
+			snd_pcm_hw_params_free(probe_params);
+		);
+
+		if (snd_pcm_hw_params_any(_playback_handle, probe_params) < 0)
+			return;
+
+		// the rates are the ones the device takes as they are set later
+		snd_pcm_hw_params_set_rate_resample(_playback_handle, probe_params, static_cast<int>(_hw_resampling));
+
+		output_format_caps caps;
+		unsigned int min_val = 0, max_val = 0;
+		int dir = 0;
+
+		caps._s16 = snd_pcm_hw_params_test_format(_playback_handle, probe_params, SND_PCM_FORMAT_S16_LE) == 0;
+		caps._s32 = snd_pcm_hw_params_test_format(_playback_handle, probe_params, SND_PCM_FORMAT_S32_LE) == 0;
+		caps._float = snd_pcm_hw_params_test_format(_playback_handle, probe_params,
+			is_big_endian() ? SND_PCM_FORMAT_FLOAT_BE : SND_PCM_FORMAT_FLOAT_LE) == 0;
+
+		if (snd_pcm_hw_params_get_rate_min(probe_params, &min_val, &dir) == 0 &&
+			snd_pcm_hw_params_get_rate_max(probe_params, &max_val, &dir) == 0)
+		{
+			caps._min_rate = min_val;
+			caps._max_rate = max_val;
+		}
+
+		if (snd_pcm_hw_params_get_channels_min(probe_params, &min_val) == 0 &&
+			snd_pcm_hw_params_get_channels_max(probe_params, &max_val) == 0)
+		{
+			caps._min_channels = min_val;
+			caps._max_channels = max_val;
+		}
+
+		// a hw device takes only some of the rates in its range
+		for (unsigned int rate : { 8000, 11025, 16000, 22050, 32000, 44100, 48000, 88200, 96000, 176400, 192000, 352800, 384000 })
+		{
+			if (rate < caps._min_rate || rate > caps._max_rate)
+				continue;
+
+			if (snd_pcm_hw_params_test_rate(_playback_handle, probe_params, rate, 0) == 0)
+			{
+				caps._rates.push_back(rate);
+			}
+			else
+			{
+				caps._continuous_rates = false;
+			}
+		}
+
+		for (size_type channels = caps._min_channels; channels <= std::min<size_type>(caps._max_channels, 8); ++channels)
+		{
+			if (snd_pcm_hw_params_test_channels(_playback_handle, probe_params, static_cast<unsigned int>(channels)) == 0)
+			{
+				caps._channel_counts.push_back(channels);
+			}
+		}
+		if (caps._max_channels > 8)
+		{
+			// not listed one by one
+			caps._channel_counts.clear();
+		}
+
+		if (snd_pcm_hw_params_get_buffer_time_min(probe_params, &min_val, &dir) == 0 &&
+			snd_pcm_hw_params_get_buffer_time_max(probe_params, &max_val, &dir) == 0)
+		{
+			caps._min_buffer_time = std::chrono::microseconds(min_val);
+			caps._max_buffer_time = std::chrono::microseconds(max_val);
+		}
+
+		if (snd_pcm_hw_params_get_period_time_min(probe_params, &min_val, &dir) == 0 &&
+			snd_pcm_hw_params_get_period_time_max(probe_params, &max_val, &dir) == 0)
+		{
+			caps._min_period_time = std::chrono::microseconds(min_val);
+			caps._max_period_time = std::chrono::microseconds(max_val);
+		}
+
+		// the items are mixed only in the same format
+		caps._open_policy = _crossfade_mode != crossfade_mode::off ? open_format_policy::all : _keep_open_format;
+		caps._valid = true;
+
+		std::ostringstream rates_os;
+		for (auto rate : caps._rates)
+		{
+			rates_os << " " << rate;
+		}
+
+		BOOST_LOG_TRIVIAL(debug) << "alsa device: " << _preffered_device_name
+			<< " s16: " << caps._s16 << " s32: " << caps._s32 << " float: " << caps._float
+			<< " rate: " << caps._min_rate << "-" << caps._max_rate
+			<< (caps._continuous_rates ? " (continuous)" : " (only" + rates_os.str() + ")")
+			<< " channels: " << caps._min_channels << "-" << caps._max_channels
+			<< " buffer: " << caps._min_buffer_time.count() << "-" << caps._max_buffer_time.count() << " usecs"
+			<< " period: " << caps._min_period_time.count() << "-" << caps._max_period_time.count() << " usecs";
+
+		if (auto chmaps = snd_pcm_query_chmaps(_playback_handle))
+		{
+			char map_buf[128];
+			for (auto chmap = chmaps; *chmap; ++chmap)
+			{
+				if (snd_pcm_chmap_print(&(*chmap)->map, sizeof(map_buf), map_buf) > 0)
+				{
+					BOOST_LOG_TRIVIAL(debug) << "alsa device: " << _preffered_device_name << " channel map: " << map_buf;
+				}
+			}
+			snd_pcm_free_chmaps(chmaps);
+		}
+
+		set_format_caps(caps);
 	}
 
 	bool output_plugin_alsa::init_hw_params()
@@ -357,6 +626,9 @@ namespace mprt
 		int err, dir = SND_PCM_STREAM_PLAYBACK;
 
 		snd_pcm_drop(_playback_handle);
+		restart_device_clock();
+		// what the resampler holds back is of the item before
+		_resample_ratio = 0.;
 
 		auto const& sound_dets = sound_details_top();
 
@@ -368,6 +640,50 @@ namespace mprt
 				return false;
 			}
 		}
+
+		// the probe knows already what the device cannot take
+		auto caps = format_caps();
+		if (!caps.accepts_format(sound_dets._bps, sound_dets._is_float) || !caps.accepts_channels(sound_dets._channels))
+		{
+			BOOST_LOG_TRIVIAL(debug) << "alsa device cannot play bps: " << sound_dets._bps << " float: " << sound_dets._is_float
+				<< " channels: " << sound_dets._channels;
+			return false;
+		}
+
+		auto max_buffer = _max_buffer;
+		auto max_period = _max_period;
+		auto use_buffer_size = _use_buffer_duration_size;
+		if (_auto_tuner)
+		{
+			max_buffer = _auto_tuner->buffer_ms();
+			max_period = _auto_tuner->period_ms();
+			use_buffer_size = false;
+		}
+
+		// a configuration negotiated before is set in one go
+		auto config_key = std::make_tuple(
+			static_cast<int>(get_pcm_format()), sound_dets._channels, sound_dets._sample_rate, max_buffer, max_period, use_buffer_size);
+		auto cached_config = _hw_configs.find(config_key);
+		if (cached_config != _hw_configs.end())
+		{
+			snd_pcm_hw_params_copy(_hw_params, cached_config->second._params.get());
+			if ((err = snd_pcm_hw_params(_playback_handle, _hw_params)) == 0)
+			{
+				auto const& config = cached_config->second;
+				_mmap_access = config._mmap_access;
+				_buffer_size = config._buffer_size;
+				_period_size = config._period_size;
+				_alsa_can_pause = config._can_pause;
+				_alsa_buffer_size_bytes = samples_to_bytes(_buffer_size, sound_dets);
+				set_open_format(sound_dets);
+
+				BOOST_LOG_TRIVIAL(debug) << "alsa hw params from the cache, buffer size: " << _buffer_size << " period size: " << _period_size;
+				return true;
+			}
+
+			BOOST_LOG_TRIVIAL(debug) << "alsa cached hw params are not taken: " << snd_strerror(err);
+			_hw_configs.erase(cached_config);
+		}
 		
 		/* choose all parameters */
 		err = snd_pcm_hw_params_any(_playback_handle, _hw_params);
@@ -383,12 +699,23 @@ namespace mprt
 				<< "Resampling setup failed for playback: " << snd_strerror(err);*/
 			// return false;
 		}
-		/* set the interleaved read/write format */
-		err = snd_pcm_hw_params_set_access(_playback_handle, _hw_params, SND_PCM_ACCESS_RW_INTERLEAVED);
-		if (err < 0) {
-			/*BOOST_LOG_TRIVIAL(debug) <<
-				"Access type not available for playback: " << snd_strerror(err);*/
-			return false;
+		/* set the interleaved mmap access, the decoded data is copied straight into the device ring */
+		_mmap_access = _use_mmap &&
+			snd_pcm_hw_params_set_access(_playback_handle, _hw_params, SND_PCM_ACCESS_MMAP_INTERLEAVED) == 0;
+		if (!_mmap_access)
+		{
+			if (_use_mmap)
+			{
+				BOOST_LOG_TRIVIAL(debug) << "alsa device cannot mmap, using rw access: " << _preffered_device_name;
+			}
+
+			/* set the interleaved read/write format */
+			err = snd_pcm_hw_params_set_access(_playback_handle, _hw_params, SND_PCM_ACCESS_RW_INTERLEAVED);
+			if (err < 0) {
+				/*BOOST_LOG_TRIVIAL(debug) <<
+					"Access type not available for playback: " << snd_strerror(err);*/
+				return false;
+			}
 		}
 		/* set the sample format */
 		err = snd_pcm_hw_params_set_format(_playback_handle, _hw_params, get_pcm_format());
@@ -416,10 +743,10 @@ namespace mprt
 			//return false;
 		}
 
-		if (_use_buffer_duration_size)
+		if (use_buffer_size)
 		{
 			/* set the buffer time */
-			snd_pcm_uframes_t buf_size = static_cast<unsigned int>(_max_buffer);
+			snd_pcm_uframes_t buf_size = static_cast<unsigned int>(max_buffer);
 			err = snd_pcm_hw_params_set_buffer_size(_playback_handle, _hw_params, buf_size);
 			if (err < 0) {
 				/*BOOST_LOG_TRIVIAL(debug)
@@ -428,7 +755,7 @@ namespace mprt
 			}
 
 			/* set the period time */
-			snd_pcm_uframes_t period_size = static_cast<unsigned int>(_max_period);
+			snd_pcm_uframes_t period_size = static_cast<unsigned int>(max_period);
 			err = snd_pcm_hw_params_set_period_size(_playback_handle, _hw_params, period_size, 0);
 			if (err < 0) {
 				//BOOST_LOG_TRIVIAL(debug) << "Unable to set period size: " << period_size << " for playback: " << snd_strerror(err);
@@ -438,7 +765,7 @@ namespace mprt
 		else
 		{
 			/* set the buffer time */
-			unsigned int buffer_time = static_cast<unsigned int>(_max_buffer * 1000);
+			unsigned int buffer_time = static_cast<unsigned int>(max_buffer * 1000);
 			err = snd_pcm_hw_params_set_buffer_time_near(_playback_handle, _hw_params, &buffer_time, &dir);
 			if (err < 0) {
 				/*BOOST_LOG_TRIVIAL(debug)
@@ -447,7 +774,7 @@ namespace mprt
 			}
 
 			/* set the period time */
-			unsigned int period_time = static_cast<unsigned int>(_max_period * 1000);
+			unsigned int period_time = static_cast<unsigned int>(max_period * 1000);
 			err = snd_pcm_hw_params_set_period_time_near(_playback_handle, _hw_params, &period_time, &dir);
 			if (err < 0) {
 			 	//BOOST_LOG_TRIVIAL(debug) <<"Unable to set period time: " << period_time << " for playback: %s\n" << snd_strerror(err);
@@ -489,6 +816,22 @@ namespace mprt
 			return false;
 		}
 
+		snd_pcm_hw_params_t *cached_params = nullptr;
+		if (snd_pcm_hw_params_malloc(&cached_params) == 0)
+		{
+			snd_pcm_hw_params_copy(cached_params, _hw_params);
+
+			alsa_hw_config config;
+			config._params.reset(cached_params, snd_pcm_hw_params_free);
+			config._mmap_access = _mmap_access;
+			config._buffer_size = _buffer_size;
+			config._period_size = _period_size;
+			config._can_pause = _alsa_can_pause;
+			_hw_configs[config_key] = config;
+		}
+
+		set_open_format(sound_dets);
+
 		return true;
 	}
 
@@ -534,6 +877,11 @@ namespace mprt
 			return false;
 		}
 		
+		// the status is stamped at the update of the hw pointer, on the clock of the steady clock
+		_device_tstamp =
+			snd_pcm_sw_params_set_tstamp_mode(_playback_handle, _sw_params, SND_PCM_TSTAMP_ENABLE) >= 0 &&
+			snd_pcm_sw_params_set_tstamp_type(_playback_handle, _sw_params, SND_PCM_TSTAMP_TYPE_MONOTONIC) >= 0;
+
 		/* write the parameters to the playback device */
 		err = snd_pcm_sw_params(_playback_handle, _sw_params);
 		if (err < 0) {
@@ -567,7 +915,6 @@ namespace mprt
 			return false;
 		}
 
-		_poll_init = true;
 		return true;
 	}
 
@@ -575,9 +922,40 @@ namespace mprt
 	{
 		_volume = volume;
 
+		if (_soft_volume)
+		{
+			// the next write ramps to it
+			_soft_gain_url_id = _INVALID_URL_ID_;
+			return;
+		}
+
 		set_alsa_volume(volume);
 	}
 
+	double output_plugin_alsa::item_soft_gain(sound_details const& sound_dets)
+	{
+		double gain = 1.;
+		if (_soft_volume)
+		{
+			gain = _volume ? get_soft_vol_gain(static_cast<int>(_volume * 2)) : 0.;
+		}
+
+		return gain * replay_gain::linear_gain(sound_dets._replay_gain, _replay_gain_mode,
+			_replay_gain_preamp_db, _no_replay_gain_preamp_db, _replay_gain_prevent_clip);
+	}
+
+	void output_plugin_alsa::update_soft_gain(sound_details const& sound_dets)
+	{
+		auto gain = item_soft_gain(sound_dets);
+
+		_soft_gain.set_ramp_frames(static_cast<std::size_t>(_soft_gain_ramp_msecs * sound_dets._sample_rate / 1000));
+		_soft_gain.set_valid_bits(static_cast<std::size_t>(
+			(!sound_dets._is_float && sound_dets._orig_bps > 0 && sound_dets._orig_bps < sound_dets._bps) ? sound_dets._orig_bps : sound_dets._bps));
+		_soft_gain_jump ? _soft_gain.reset_gain(static_cast<float>(gain)) : _soft_gain.set_gain(static_cast<float>(gain));
+		_soft_gain_jump = false;
+		_soft_gain_url_id = sound_dets._url_id;
+	}
+
 	snd_pcm_sframes_t output_plugin_alsa::direct_write(const void *buffer, snd_pcm_uframes_t size, int sample_width, int channels)
 	{
 		snd_pcm_sframes_t written_samples = 0;
@@ -610,176 +988,470 @@ namespace mprt
 			
 			buf += err * channels * sample_width;
 			written_samples += err;
+			_device_frames_written += err;
 			size -= err;
 		}
 
 		return written_samples;
 	}
 
-	int output_plugin_alsa::wait_for_poll()
+	void alsa_data_waker::notify()
 	{
-		unsigned short revents;
+		if (!_wanted.exchange(false))
+			return;
 
-		while (1) {
-			poll(_poll_ufds, _poll_count, -1);
-			snd_pcm_poll_descriptors_revents(_playback_handle, _poll_ufds, _poll_count, &revents);
-			if (revents & POLLERR)
-				return -EIO;
-			if (revents & POLLOUT)
-				return 0;
+		int fd = _fd;
+		if (fd >= 0)
+		{
+			uint64_t one = 1;
+			(void)::write(fd, &one, sizeof(one));
 		}
 	}
 
-	snd_pcm_sframes_t output_plugin_alsa::poll_write(const void *buffer, snd_pcm_uframes_t size, int sample_width, int channels)
+	bool output_plugin_alsa::init_event_loop()
 	{
-		int err;
-		unsigned char *buf = (unsigned char *)buffer;
-		if (!_poll_init)
+		auto & io = _async_task->get_io_context();
+		boost::system::error_code ec;
+
+		int event_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (event_fd < 0)
+			return false;
+
+		_data_event = std::make_unique<descriptor_t>(io);
+		_data_event->assign(event_fd, ec);
+		if (ec)
 		{
-			err = wait_for_poll();
-			if (err < 0) {
-				if (snd_pcm_state(_playback_handle) == SND_PCM_STATE_XRUN ||
-					snd_pcm_state(_playback_handle) == SND_PCM_STATE_SUSPENDED) {
-					err = snd_pcm_state(_playback_handle) == SND_PCM_STATE_XRUN ? -EPIPE : -ESTRPIPE;
-					if (xrun_recovery(err) < 0) {
-						//BOOST_LOG_TRIVIAL(error) << "wait_for_poll Write error: " << snd_strerror(err);
-						return -1;
-					}
-					_poll_init = true;
-				}
-				else {
-					//BOOST_LOG_TRIVIAL(error) << "Wait for poll failed";
-					return -1;
-				}
-			}
+			::close(event_fd);
+			_data_event.reset();
+			return false;
 		}
 
-		snd_pcm_sframes_t written_samples = 0;
-		while (size > 0)
-		{
-			err = snd_pcm_writei(_playback_handle, buf, size);
-			if (err < 0) {
-				if (xrun_recovery(err) < 0) {
-					BOOST_LOG_TRIVIAL(error) << "Write error: " << snd_strerror(err);
-					return -1;
-				}
-				_poll_init = true;
-				break;	/* skip one period */
-			}
+		_data_waker = std::make_shared<alsa_data_waker>();
+		_data_waker->_fd = event_fd;
 
-			if (snd_pcm_state(_playback_handle) == SND_PCM_STATE_RUNNING)
+		for (int i = 0; i < _poll_count; ++i)
+		{
+			_pcm_fds.push_back(std::make_unique<descriptor_t>(io));
+			_pcm_fds.back()->assign(_poll_ufds[i].fd, ec);
+			if (ec)
 			{
-				_poll_init = false;
-			}
-			
-			written_samples += err;
-			buf += err * channels * sample_width;
-			size -= err;
-
-			/* it is possible, that the initial buffer cannot store */
-			/* all data from the last period, so wait awhile */
-			if (size)
-			{
-				err = wait_for_poll();
-				if (err < 0) {
-					if (snd_pcm_state(_playback_handle) == SND_PCM_STATE_XRUN ||
-						snd_pcm_state(_playback_handle) == SND_PCM_STATE_SUSPENDED) {
-						err = snd_pcm_state(_playback_handle) == SND_PCM_STATE_XRUN ? -EPIPE : -ESTRPIPE;
-						if (xrun_recovery(err) < 0) {
-							//BOOST_LOG_TRIVIAL(error) << "wait_for_poll 2 Write error: " << snd_strerror(err);
-							return -1;
-						}
-						_poll_init = true;
-					}
-					else {
-						//BOOST_LOG_TRIVIAL(error) << "Wait for poll 2 failed";
-						return err;
-					}
-				}
+				BOOST_LOG_TRIVIAL(error) << "alsa poll descriptor cannot be added: " << ec.message();
+				close_event_loop();
+				return false;
 			}
-
 		}
 
-		return written_samples;
+		return true;
 	}
 
-	void output_plugin_alsa::play()
+	void output_plugin_alsa::close_event_loop()
 	{
-		//BOOST_LOG_TRIVIAL(debug) << "alsa play state" << _current_state;
+		cancel_waits();
 
-		_STATE_CHECK_(plugin_states::play);
+		// the pcm descriptors are closed by alsa
+		for (auto & fd : _pcm_fds)
+		{
+			fd->release();
+		}
+		_pcm_fds.clear();
 
-		if (_play_timer && is_active_timer(_play_timer))
+		if (_data_waker)
 		{
-			return;
+			_data_waker->_fd = -1;
 		}
 
-		std::chrono::microseconds next_duration(1000);
+		_data_event.reset();
+		_event_loop = false;
+	}
 
-		size_type avail_bytes_to_write = _alsa_buffer_size_bytes;
+	void output_plugin_alsa::cancel_waits()
+	{
+		boost::system::error_code ec;
 
-		SCOPE_EXIT_REF(
-			if (!is_no_job() && _current_state == plugin_states::play) {
-				next_duration = 
-				bytes_to_time_duration(_alsa_buffer_size_bytes - avail_bytes_to_write,
-					sound_details_top()) / 4;
+		if (_device_wait_armed)
+		{
+			++_device_wait_gen;
+			_device_wait_armed = false;
 
-				_play_timer = add_job_thread_internal(
-					[this, next_duration]() {
-						play(); 
-					}, next_duration);
-				/*BOOST_LOG_TRIVIAL(debug)
-					<< "play called with: " << next_duration.count() << " usecs"
-					<< " alsa_buf: " << _alsa_buffer_size_bytes
-					<< " write avail: " << avail_bytes_to_write;*/
+			for (auto & fd : _pcm_fds)
+			{
+				fd->cancel(ec);
 			}
-			//else {
-			//	BOOST_LOG_TRIVIAL(debug) << "stopping alsa scope exit job: " << is_no_job();
-
-				//_current_state = to_underlying(plugin_states::stop);
-				//_init_api = false;
-			//}
-			);
-
-		if (_current_state != plugin_states::play) {
-			//BOOST_LOG_TRIVIAL(debug) << "alsa state not play";
+		}
 
-			return;
+		if (_data_wait_armed)
+		{
+			++_data_wait_gen;
+			_data_wait_armed = false;
+			_data_waker->_wanted = false;
+			_data_event->cancel(ec);
 		}
+	}
 
-		if (_sound_details_queue.empty())
+	void output_plugin_alsa::wait_for_device()
+	{
+		if (_device_wait_armed)
 			return;
 
-		auto & current_sound_dets = sound_details_top_ref();
+		_device_wait_armed = true;
+		auto generation = _device_wait_gen;
 
-		if (!_init_api) {
-			BOOST_LOG_TRIVIAL(debug) << "starting new alsa sound parameters";
+		// plugins like dmix wait on other descriptors and events, alsa tells which ones
+		for (int i = 0; i < _poll_count; ++i)
+		{
+			auto wait_type = (_poll_ufds[i].events & POLLOUT) ? descriptor_t::wait_write : descriptor_t::wait_read;
+			_pcm_fds[i]->async_wait(wait_type, [this, generation](boost::system::error_code const& ec)
+			{
+				device_ready(generation, ec);
+			});
+		}
+	}
 
-			auto is_init_ok = init_alsa();
+	void output_plugin_alsa::device_ready(uint64_t generation, boost::system::error_code const& ec)
+	{
+		if (ec == boost::asio::error::operation_aborted || generation != _device_wait_gen)
+			return;
 
-			if (!is_init_ok)
-			{
-				BOOST_LOG_TRIVIAL(debug) <<
-					"cannot initialize the direct sound with the current sound parameters";
-				current_sound_dets._current_cache_buffer->clear_data();
-				current_sound_dets._decoder_play_finished_callback(current_sound_dets._url_id);
+		// the waits on the other descriptors are dropped
+		cancel_waits();
 
-				sound_details_pop();
+		unsigned short revents = 0;
+		(void)::poll(_poll_ufds, _poll_count, 0);
+		snd_pcm_poll_descriptors_revents(_playback_handle, _poll_ufds, _poll_count, &revents);
 
-				return;
+		if (revents & POLLERR)
+		{
+			auto state = snd_pcm_state(_playback_handle);
+			if (state == SND_PCM_STATE_XRUN || state == SND_PCM_STATE_SUSPENDED)
+			{
+				xrun_recovery(state == SND_PCM_STATE_XRUN ? -EPIPE : -ESTRPIPE);
 			}
 		}
 
-		if (!current_sound_dets._current_cache_buffer)
-		{
-			sound_details_pop();
-			return;
-		}
+		play();
+	}
+
+	void output_plugin_alsa::wait_for_data()
+	{
+		if (_data_wait_armed || _sound_details_queue.empty())
+			return;
+
+		auto const* wait_dets = &sound_details_top();
+		// in a fade the incoming item may be the one without data
+		if (_crossfade_active && _sound_details_queue.size() > 1 && !wait_dets->_current_cache_buffer->is_data_empty())
+		{
+			wait_dets = &*std::next(_sound_details_queue.begin());
+		}
+
+		auto & cache_buf = wait_dets->_current_cache_buffer;
+		auto waker = _data_waker;
+		cache_buf->set_data_notify([waker]() { waker->notify(); });
+
+		_data_waker->_wanted = true;
+
+		// a chunk may have come in before it was asked for
+		if (!cache_buf->is_data_empty())
+		{
+			_data_waker->_wanted = false;
+			add_job([this]() { play(); });
+			return;
+		}
+
+		_data_wait_armed = true;
+		auto generation = _data_wait_gen;
+
+		_data_event->async_wait(descriptor_t::wait_read, [this, generation](boost::system::error_code const& ec)
+		{
+			if (ec == boost::asio::error::operation_aborted || generation != _data_wait_gen)
+				return;
+
+			uint64_t count = 0;
+			(void)::read(_data_event->native_handle(), &count, sizeof(count));
+
+			_data_wait_armed = false;
+			play();
+		});
+	}
+
+	void output_plugin_alsa::start_drain()
+	{
+		auto silence_need_bytes =
+			time_duration_to_bytes(
+				std::chrono::microseconds(_next_diff_item_drain_time_msecs * 1000),
+				_prev_sound_details);
+		if (silence_need_bytes)
+		{
+			fill_drain(silence_need_bytes, _prev_sound_details);
+		}
+
+		// a short item may not have reached the start threshold
+		if (snd_pcm_state(_playback_handle) == SND_PCM_STATE_PREPARED)
+		{
+			snd_pcm_start(_playback_handle);
+		}
+
+		snd_pcm_sframes_t delay = 0;
+		if (snd_pcm_delay(_playback_handle, &delay) < 0 || delay < 0)
+		{
+			delay = 0;
+		}
+
+		auto drain_time = samples_to_time_duration(delay, _prev_sound_details);
+
+		BOOST_LOG_TRIVIAL(debug)
+			<< "entering draining id: " << _prev_sound_details._url_id
+			<< " drain time: " << drain_time.count() << " usecs";
+
+		// played out on a timer, the jobs in between are not held up
+		_draining = true;
+		_tune_data_starved = true;
+		cancel_waits();
+		_play_timer = add_job_thread_internal([this]() { finish_drain(); }, drain_time);
+	}
+
+	void output_plugin_alsa::finish_drain()
+	{
+		if (!_draining)
+			return;
+
+		_draining = false;
+		snd_pcm_drop(_playback_handle);
+		restart_device_clock();
+
+		BOOST_LOG_TRIVIAL(debug) << "drain finished with id: " << _prev_sound_details._url_id;
+
+		give_cache_buf_back(_prev_sound_details._url_id);
+		_init_api = false;
+
+		if (is_no_job())
+		{
+			BOOST_LOG_TRIVIAL(debug) << "alsa sound play finished";
+
+			if (_current_state == plugin_states::play)
+			{
+				_current_state = plugin_states::stop;
+			}
+
+			return;
+		}
+
+		play();
+	}
+
+	snd_pcm_sframes_t output_plugin_alsa::mmap_write(snd_pcm_uframes_t size, mmap_fill_func_t const& fill)
+	{
+		snd_pcm_uframes_t written_samples = 0;
+
+		while (size > 0)
+		{
+			auto avail = snd_pcm_avail_update(_playback_handle);
+			if (avail < 0)
+			{
+				if (xrun_recovery(static_cast<int>(avail)) < 0)
+				{
+					BOOST_LOG_TRIVIAL(error) << "alsa mmap avail error: " << snd_strerror(static_cast<int>(avail));
+					return -1;
+				}
+
+				continue;
+			}
+
+			if (avail == 0)
+			{
+				// a full ring which has not reached the start threshold is started here
+				if (snd_pcm_state(_playback_handle) == SND_PCM_STATE_PREPARED)
+				{
+					snd_pcm_start(_playback_handle);
+				}
+
+				// the event loop waits on the descriptors, the rest goes in when they wake it up
+				if (_event_loop)
+				{
+					break;
+				}
+
+				auto err = snd_pcm_wait(_playback_handle, 1000);
+				if (err < 0 && xrun_recovery(err) < 0)
+				{
+					return -1;
+				}
+
+				continue;
+			}
+
+			// no more than the device takes now, nothing is left over to wait for
+			if (_event_loop)
+			{
+				size = std::min<snd_pcm_uframes_t>(size, static_cast<snd_pcm_uframes_t>(avail));
+			}
+
+			const snd_pcm_channel_area_t *areas;
+			snd_pcm_uframes_t offset;
+			snd_pcm_uframes_t frames = std::min<snd_pcm_uframes_t>(size, static_cast<snd_pcm_uframes_t>(avail));
+
+			auto err = snd_pcm_mmap_begin(_playback_handle, &areas, &offset, &frames);
+			if (err < 0)
+			{
+				if (xrun_recovery(err) < 0)
+				{
+					BOOST_LOG_TRIVIAL(error) << "alsa mmap begin error: " << snd_strerror(err);
+					return -1;
+				}
+
+				continue;
+			}
+
+			// interleaved access has one area for all the channels
+			auto dest = static_cast<unsigned char *>(areas[0].addr) + areas[0].first / 8 + offset * areas[0].step / 8;
+			fill(dest, written_samples, frames);
+
+			auto committed = snd_pcm_mmap_commit(_playback_handle, offset, frames);
+			if (committed < 0 || static_cast<snd_pcm_uframes_t>(committed) != frames)
+			{
+				// the ring is prepared again, the same frames go into it on the next round
+				if (xrun_recovery(committed < 0 ? static_cast<int>(committed) : -EPIPE) < 0)
+				{
+					BOOST_LOG_TRIVIAL(error) << "alsa mmap commit error: " << snd_strerror(static_cast<int>(committed));
+					return -1;
+				}
+
+				continue;
+			}
+
+			written_samples += frames;
+			_device_frames_written += frames;
+			size -= frames;
+		}
+
+		return static_cast<snd_pcm_sframes_t>(written_samples);
+	}
+
+	void output_plugin_alsa::play()
+	{
+		//BOOST_LOG_TRIVIAL(debug) << "alsa play state" << _current_state;
+
+		_STATE_CHECK_(plugin_states::play);
+
+		if (_event_loop)
+		{
+			// the armed device wait or the drain timer calls it
+			if (_device_wait_armed || _draining)
+			{
+				return;
+			}
+		}
+		else if (_play_timer && is_active_timer(_play_timer))
+		{
+			return;
+		}
+
+		std::chrono::microseconds next_duration(1000);
+
+		size_type avail_bytes_to_write = _alsa_buffer_size_bytes;
+		bool wait_data = false;
+
+		SCOPE_EXIT_REF(
+			if (!is_no_job() && _current_state == plugin_states::play && !_draining) {
+				if (_event_loop)
+				{
+					// woken up when the device wants a period or the decoder hands over a chunk
+					wait_data ? wait_for_data() : wait_for_device();
+					return;
+				}
+
+				next_duration = 
+				bytes_to_time_duration(_alsa_buffer_size_bytes - avail_bytes_to_write,
+					sound_details_top()) / 4;
+
+				_play_timer = add_job_thread_internal(
+					[this, next_duration]() {
+						play(); 
+					}, next_duration);
+				/*BOOST_LOG_TRIVIAL(debug)
+					<< "play called with: " << next_duration.count() << " usecs"
+					<< " alsa_buf: " << _alsa_buffer_size_bytes
+					<< " write avail: " << avail_bytes_to_write;*/
+			}
+			//else {
+			//	BOOST_LOG_TRIVIAL(debug) << "stopping alsa scope exit job: " << is_no_job();
+
+				//_current_state = to_underlying(plugin_states::stop);
+				//_init_api = false;
+			//}
+			);
+
+		if (_current_state != plugin_states::play) {
+			//BOOST_LOG_TRIVIAL(debug) << "alsa state not play";
+
+			return;
+		}
+
+		if (_sound_details_queue.empty())
+			return;
+
+		auto & current_sound_dets = sound_details_top_ref();
+
+		if (!_init_api) {
+			BOOST_LOG_TRIVIAL(debug) << "starting new alsa sound parameters";
+
+			auto is_init_ok = init_alsa();
+
+			if (!is_init_ok)
+			{
+				BOOST_LOG_TRIVIAL(debug) <<
+					"cannot initialize the direct sound with the current sound parameters";
+				current_sound_dets._current_cache_buffer->clear_data();
+				current_sound_dets._decoder_play_finished_callback(current_sound_dets._url_id);
+
+				sound_details_pop();
+
+				return;
+			}
+		}
+
+		if (!current_sound_dets._current_cache_buffer)
+		{
+			sound_details_pop();
+			return;
+		}
+
+		if (_event_loop && current_sound_dets._current_cache_buffer->is_data_empty())
+		{
+			auto now = clock_type::now();
+			if (!_data_wait_started)
+			{
+				BOOST_LOG_TRIVIAL(debug) << "sound waiting for the decoder";
+
+				_data_wait_started = true;
+				_tune_data_starved = true;
+				_data_wait_since = now;
+				// the item is given up if nothing comes
+				_play_timer = add_job_thread_internal([this]() { play(); }, _max_data_wait);
+			}
+			else if (now - _data_wait_since >= _max_data_wait)
+			{
+				_data_wait_started = false;
+				cancel_waits();
+				sound_details_pop();
+				return;
+			}
+
+			wait_data = true;
+			return;
+		}
+
+		_data_wait_started = false;
+
+		if (_soft_gain_url_id != current_sound_dets._url_id)
+		{
+			update_soft_gain(current_sound_dets);
+		}
 
 		int wait_count = 0;
 		while (current_sound_dets._current_cache_buffer->is_data_empty())
 		{
 			BOOST_LOG_TRIVIAL(debug) << "sound waiting for the decoder";
+			_tune_data_starved = true;
 			std::this_thread::sleep_for(std::chrono::milliseconds(100));
 			++wait_count;
 			if (wait_count > 20)
@@ -789,32 +1461,102 @@ namespace mprt
 			}
 		}
 
+		// too many xruns to wait for the next setup, or the schedule is due
+		if (_auto_tuner && !_tune_data_starved &&
+			(_auto_tuner->needs_growing() || _auto_tuner->is_due()) &&
+			_auto_tuner->evaluate(true) && !retune_alsa())
+		{
+			return;
+		}
+
+		apply_position_step(current_sound_dets);
+
+		auto device_avail_bytes = alsa_available_bytes_to_write();
+		if (_auto_tuner && !_tune_data_starved && device_avail_bytes >= 0)
+		{
+			_auto_tuner->on_wakeup(
+				bytes_to_time_duration(_alsa_buffer_size_bytes - device_avail_bytes, current_sound_dets),
+				samples_to_time_duration(_buffer_size, current_sound_dets),
+				samples_to_time_duration(_period_size, current_sound_dets));
+		}
+
 		auto & decoded_data_buf = *(current_sound_dets._current_cache_buffer->get_data_ptr());
-		auto begin_point = decoded_data_buf->second.linearize();
-		auto buf_size = decoded_data_buf->second.size();
+		auto & pcm_data = decoded_data_buf->second;
+		auto buf_size = pcm_data.size();
 		avail_bytes_to_write =
 			std::min<size_type>(
-				alsa_available_bytes_to_write(),
+				device_avail_bytes,
 				buf_size);
 
 		//BOOST_LOG_TRIVIAL(debug) << "avail_bytes_to_write: " << avail_bytes_to_write;
 		if (avail_bytes_to_write % samples_to_bytes(1, current_sound_dets)) {
 			// we have full buffer or byte cannot be converted to samples
+			wait_data = true;
 			return;
 		}
 
 		auto need_to_written = bytes_to_samples(avail_bytes_to_write, current_sound_dets);
-		auto written_samples = 
-			_use_poll ?
-			poll_write(begin_point, need_to_written, current_sound_dets._bps / 8, current_sound_dets._channels)
-			:
-			direct_write(begin_point, need_to_written, current_sound_dets._bps / 8, current_sound_dets._channels);
+		sound_details * fade_in_dets = nullptr;
+		if (_crossfade_mode != crossfade_mode::off)
+		{
+			need_to_written = crossfade_prepare(current_sound_dets, need_to_written);
+			if (_crossfade_active)
+			{
+				fade_in_dets = &*std::next(_sound_details_queue.begin());
+				if (fade_in_dets->_current_cache_buffer->is_data_empty())
+				{
+					// it was decoded before the fade started, only the last chunk may be on the way
+					wait_data = true;
+					return;
+				}
+			}
+		}
+
+		snd_pcm_sframes_t written_samples = 0;
+		if (fade_in_dets)
+		{
+			written_samples = crossfade_write(current_sound_dets, *fade_in_dets, need_to_written);
+		}
+		else if (update_resample_ratio(current_sound_dets))
+		{
+			written_samples = resampled_write(current_sound_dets, need_to_written,
+				device_avail_bytes / samples_to_bytes(1, current_sound_dets));
+		}
+		else if (_mmap_access)
+		{
+			auto frame_bytes = samples_to_bytes(1, current_sound_dets);
+			written_samples = mmap_write(need_to_written,
+				[this, &pcm_data, &current_sound_dets, frame_bytes](unsigned char * dest, snd_pcm_uframes_t done, snd_pcm_uframes_t frames)
+			{
+				copy_pcm(pcm_data, static_cast<std::size_t>(done * frame_bytes), dest, static_cast<std::size_t>(frames * frame_bytes));
+				// scaled in the device ring, the decoded data stays as it is
+				_soft_gain.process(dest, static_cast<std::size_t>(frames), current_sound_dets._channels,
+					current_sound_dets._bps, current_sound_dets._is_float);
+			});
+		}
+		else
+		{
+			auto begin_point = pcm_data.linearize();
+			if (!_soft_gain.is_unity())
+			{
+				_soft_gain_buf.assign(begin_point, begin_point + samples_to_bytes(need_to_written, current_sound_dets));
+				_soft_gain.process(_soft_gain_buf.data(), static_cast<std::size_t>(need_to_written), current_sound_dets._channels,
+					current_sound_dets._bps, current_sound_dets._is_float);
+				begin_point = _soft_gain_buf.data();
+			}
+			written_samples = direct_write(begin_point, need_to_written, current_sound_dets._bps / 8, current_sound_dets._channels);
+		}
 		if (written_samples < 0)
 		{
 			return;
 		}
 		current_sound_dets._current_samples_written_to_sound_buffer += written_samples;
 		auto written_bytes = samples_to_bytes(written_samples, current_sound_dets);
+		if (_auto_tuner && written_samples > 0)
+		{
+			_auto_tuner->on_played(samples_to_time_duration(written_samples, current_sound_dets));
+			_tune_data_starved = false;
+		}
 		/*BOOST_LOG_TRIVIAL(debug)
 			<< " _alsa_buffer_size_bytes" << _alsa_buffer_size_bytes
 			<< " avail_bytes_write: " << avail_bytes_to_write
@@ -838,19 +1580,38 @@ namespace mprt
 		//	//;
 		//	<< " avail_bytes_write: " << avail_bytes_to_write;
 
-		call_callback_funcs(
-			_progress_func_call_list,
-			 current_sound_dets._url_id,
-			  samples_to_time_duration(current_sound_dets._current_samples_written_to_sound_buffer, current_sound_dets).count() / 1000);
+		report_position(current_sound_dets);
 
 		if (is_play_finished)
 		{
 			BOOST_LOG_TRIVIAL(debug) << "finishing playing alsa for id: " << current_sound_dets._url_id;
 
+			_played_out_url_id = current_sound_dets._url_id;
+			_played_out_samples = current_sound_dets._current_samples_written_to_sound_buffer;
+
+			auto gain_rate = _soft_gain.take_samples_per_second();
+			if (gain_rate > 0.)
+			{
+				BOOST_LOG_TRIVIAL(debug) << "alsa soft gain: " << gain_rate / 1e6 << " Msamples/s";
+			}
+
 			current_sound_dets._decoder_play_finished_callback(current_sound_dets._url_id);
 			
 			sound_details_pop();
 
+			if (_crossfade_active)
+			{
+				// the next one is playing already, its gain is in the mix
+				_crossfade_active = false;
+				_soft_gain_jump = true;
+			}
+
+			if (_event_loop && !is_sound_details_same_as_before())
+			{
+				start_drain();
+				return;
+			}
+
 			if (!is_sound_details_same_as_before())
 			{
 				
@@ -879,6 +1640,7 @@ namespace mprt
 					std::this_thread::sleep_for(bytes_to_time_duration(avail_play, _prev_sound_details));
 					snd_pcm_drop(_playback_handle);
 				}
+				restart_device_clock();
 
 				BOOST_LOG_TRIVIAL(debug) << "drain finished with id: " <<
 					_prev_sound_details._url_id << " silence bytes: " << silence_need_bytes;
@@ -893,6 +1655,7 @@ namespace mprt
 			BOOST_LOG_TRIVIAL(debug) << "alsa sound play finished";
 
 			_current_state = plugin_states::stop;
+			_tune_data_starved = true;
 		}
 
 		return;
@@ -902,7 +1665,10 @@ namespace mprt
 	{
 		BOOST_LOG_TRIVIAL(debug) << "alsa pause called";
 
+		cancel_waits();
 		pause_alsa();
+		hold_position();
+		_tune_data_starved = true;
 	}
 
 	void output_plugin_alsa::resume_play_internal()
@@ -916,16 +1682,330 @@ namespace mprt
 
 	void output_plugin_alsa::resume_clear_play_internal()
 	{
+		// seeked, what is left in the device is not the item before
+		_played_out_url_id = _INVALID_URL_ID_;
+		_resample_ratio = 0.;
+
 		unpause_alsa();
 
 		play();
 	}
 
+	std::chrono::milliseconds output_plugin_alsa::next_item_lead_time() const
+	{
+		return std::chrono::milliseconds(_crossfade_mode != crossfade_mode::off ? _crossfade_msecs : 0);
+	}
+
+	sound_details * output_plugin_alsa::crossfade_next_item(sound_details const& current_sound_dets)
+	{
+		if (_sound_details_queue.size() < 2 ||
+			current_sound_dets._total_samples < 0 ||
+			current_sound_dets._total_samples == std::numeric_limits<size_type>::max())
+		{
+			return nullptr;
+		}
+
+		auto & next_sound_dets = *std::next(_sound_details_queue.begin());
+		if (!next_sound_dets._current_cache_buffer ||
+			next_sound_dets._bps != current_sound_dets._bps ||
+			next_sound_dets._is_float != current_sound_dets._is_float ||
+			next_sound_dets._sample_rate != current_sound_dets._sample_rate ||
+			next_sound_dets._channels != current_sound_dets._channels)
+		{
+			return nullptr;
+		}
+
+		if (_crossfade_mode == crossfade_mode::not_album && next_sound_dets._continues_album)
+		{
+			return nullptr;
+		}
+
+		return &next_sound_dets;
+	}
+
+	size_type output_plugin_alsa::crossfade_prepare(sound_details & current_sound_dets, size_type frames)
+	{
+		auto remaining = current_sound_dets._total_samples - current_sound_dets._current_samples_written_to_sound_buffer;
+		auto next_sound_dets = crossfade_next_item(current_sound_dets);
+
+		if (_crossfade_active)
+		{
+			// a seek or a new queue
+			if (!next_sound_dets || next_sound_dets->_url_id != _crossfade_url_id || remaining > _crossfade.total_frames())
+			{
+				BOOST_LOG_TRIVIAL(debug) << "alsa crossfade cancelled for id: " << current_sound_dets._url_id;
+				_crossfade_active = false;
+				return frames;
+			}
+
+			return std::min(frames, remaining);
+		}
+
+		if (!next_sound_dets || remaining <= 0)
+		{
+			return frames;
+		}
+
+		auto fade = std::min(
+			time_duration_to_samples(std::chrono::milliseconds(_crossfade_msecs), current_sound_dets),
+			current_sound_dets._total_samples / 2);
+		if (next_sound_dets->_total_samples >= 0 && next_sound_dets->_total_samples != std::numeric_limits<size_type>::max())
+		{
+			fade = std::min(fade, next_sound_dets->_total_samples / 2);
+		}
+
+		// the writes stop at the start of the fade
+		if (remaining > fade)
+		{
+			return std::min(frames, remaining - fade);
+		}
+
+		// all of the incoming part has to be decoded, a stall in the middle of the fade would be heard.
+		// when it is late the item plays to the end and the fade is shorter or none
+		if (next_sound_dets->_current_cache_buffer->total_bytes_in_buffer_guess() < samples_to_bytes(remaining, *next_sound_dets))
+		{
+			return frames;
+		}
+
+		BOOST_LOG_TRIVIAL(debug) << "alsa crossfade from id: " << current_sound_dets._url_id
+			<< " to id: " << next_sound_dets->_url_id
+			<< " frames: " << remaining;
+
+		auto out_gain = item_soft_gain(current_sound_dets);
+		_crossfade_in_gain = out_gain > 0. ? static_cast<float>(item_soft_gain(*next_sound_dets) / out_gain) : 1.f;
+		_crossfade.start(remaining);
+		_crossfade_url_id = next_sound_dets->_url_id;
+		_crossfade_active = true;
+
+		return std::min(frames, remaining);
+	}
+
+	snd_pcm_sframes_t output_plugin_alsa::crossfade_write(sound_details & current_sound_dets, sound_details & next_sound_dets, size_type frames)
+	{
+		auto & out_data_buf = *(current_sound_dets._current_cache_buffer->get_data_ptr());
+		auto & in_data_buf = *(next_sound_dets._current_cache_buffer->get_data_ptr());
+		auto frame_bytes = samples_to_bytes(1, current_sound_dets);
+
+		frames = std::min(frames, static_cast<size_type>(in_data_buf->second.size()) / frame_bytes);
+		auto bytes = static_cast<std::size_t>(frames * frame_bytes);
+
+		// the decoded data is mixed outside of the device ring, both items keep theirs until it is written
+		_crossfade_buf.resize(bytes);
+		_crossfade_in_buf.resize(bytes);
+		copy_pcm(out_data_buf->second, 0, _crossfade_buf.data(), bytes);
+		copy_pcm(in_data_buf->second, 0, _crossfade_in_buf.data(), bytes);
+
+		auto position = _crossfade.total_frames() -
+			(current_sound_dets._total_samples - current_sound_dets._current_samples_written_to_sound_buffer);
+		_crossfade.mix(_crossfade_buf.data(), _crossfade_in_buf.data(), static_cast<std::size_t>(frames),
+			current_sound_dets._channels, current_sound_dets._bps, current_sound_dets._is_float, position, _crossfade_in_gain);
+
+		snd_pcm_sframes_t written_samples = 0;
+		if (_mmap_access)
+		{
+			written_samples = mmap_write(frames,
+				[this, &current_sound_dets, frame_bytes](unsigned char * dest, snd_pcm_uframes_t done, snd_pcm_uframes_t write_frames)
+			{
+				std::memcpy(dest, _crossfade_buf.data() + done * frame_bytes, static_cast<std::size_t>(write_frames * frame_bytes));
+				_soft_gain.process(dest, static_cast<std::size_t>(write_frames), current_sound_dets._channels,
+					current_sound_dets._bps, current_sound_dets._is_float);
+			});
+		}
+		else
+		{
+			_soft_gain.process(_crossfade_buf.data(), static_cast<std::size_t>(frames), current_sound_dets._channels,
+				current_sound_dets._bps, current_sound_dets._is_float);
+			written_samples = direct_write(_crossfade_buf.data(), frames, current_sound_dets._bps / 8, current_sound_dets._channels);
+		}
+
+		if (written_samples > 0)
+		{
+			// the outgoing item is moved on by play, like for an unmixed write
+			auto written_bytes = samples_to_bytes(written_samples, next_sound_dets);
+			in_data_buf->second.erase_begin(static_cast<std::size_t>(written_bytes));
+			in_data_buf->first -= written_bytes;
+			next_sound_dets._current_samples_written_to_sound_buffer += written_samples;
+		}
+		next_sound_dets._current_cache_buffer->put_data_ptr(false);
+
+		return written_samples;
+	}
+
 	size_type output_plugin_alsa::alsa_available_bytes_to_play()
 	{
 		return _alsa_buffer_size_bytes - alsa_available_bytes_to_write();
 	}
 
+	void output_plugin_alsa::report_position(sound_details const& sound_dets)
+	{
+		if (!is_progress_due(sound_dets._url_id))
+			return;
+
+		if (!_pcm_status && snd_pcm_status_malloc(&_pcm_status) < 0)
+		{
+			_pcm_status = nullptr;
+			return;
+		}
+
+		// the delay and the state in one call
+		snd_pcm_sframes_t delay = 0;
+		bool running = false;
+		if (snd_pcm_status(_playback_handle, _pcm_status) >= 0)
+		{
+			delay = std::max<snd_pcm_sframes_t>(snd_pcm_status_get_delay(_pcm_status), 0);
+			running = snd_pcm_status_get_state(_pcm_status) == SND_PCM_STATE_RUNNING;
+		}
+
+		auto to_ms = [&sound_dets](size_type samples) { return samples_to_time_duration(samples, sound_dets).count() / 1000; };
+
+		// the resampler holds some item frames back and plays the rest at its ratio
+		auto queued = _resample_ratio > 0. ? delay / _resample_ratio + _resampler.pending_frames() : static_cast<double>(delay);
+
+		auto written = sound_dets._current_samples_written_to_sound_buffer;
+		auto heard_frames = written - queued;
+		auto heard = static_cast<size_type>(std::floor(heard_frames));
+		auto heard_url_id = sound_dets._url_id;
+		if (heard < 0 && _played_out_url_id != _INVALID_URL_ID_)
+		{
+			// the end of the item before is still being played, both have the same format
+			publish_position(_played_out_url_id, to_ms(_played_out_samples + heard), to_ms(_played_out_samples), running);
+			heard_url_id = _played_out_url_id;
+			heard_frames += _played_out_samples;
+		}
+		else
+		{
+			_played_out_url_id = _INVALID_URL_ID_;
+			publish_position(sound_dets._url_id, to_ms(heard), to_ms(written), running);
+		}
+
+		if (!running)
+			return;
+
+		int64_t time_stamp_us = 0;
+		if (_device_tstamp)
+		{
+			snd_htimestamp_t tstamp;
+			snd_pcm_status_get_htstamp(_pcm_status, &tstamp);
+			time_stamp_us = static_cast<int64_t>(tstamp.tv_sec) * 1000000 + tstamp.tv_nsec / 1000;
+		}
+		if (time_stamp_us <= 0)
+		{
+			// a plugin device without time stamps
+			time_stamp_us = std::chrono::duration_cast<std::chrono::microseconds>(clock_type::now().time_since_epoch()).count();
+		}
+
+		publish_device_clock(sound_dets._sample_rate, _device_frames_written - delay, time_stamp_us, heard_url_id, heard_frames);
+	}
+
+	bool output_plugin_alsa::update_resample_ratio(sound_details const& sound_dets)
+	{
+		// the mix of a crossfade is written as it is, the frames the resampler holds are lost
+		auto ratio = rate_correction();
+		if (ratio <= 0. || _crossfade_active || !adaptive_resampling::is_supported(sound_dets._bps, sound_dets._is_float))
+		{
+			_resample_ratio = 0.;
+			return false;
+		}
+
+		if (_resample_ratio == 0. || _resampler.channels() != static_cast<std::size_t>(sound_dets._channels))
+		{
+			_resampler.configure(static_cast<std::size_t>(sound_dets._channels));
+		}
+
+		_resample_ratio = ratio;
+		_resampler.set_ratio(ratio);
+		return true;
+	}
+
+	snd_pcm_sframes_t output_plugin_alsa::resampled_write(sound_details const& sound_dets, size_type frames, size_type device_frames)
+	{
+		// what comes out of the item frames taken has to fit into the room in the device
+		auto in_frames = std::min<size_type>(frames, static_cast<size_type>(device_frames / _resample_ratio) - 2);
+		if (in_frames <= 0)
+			return 0;
+
+		auto & pcm_data = (*sound_dets._current_cache_buffer->get_data_ptr())->second;
+		auto channels = static_cast<std::size_t>(sound_dets._channels);
+		auto frame_bytes = samples_to_bytes(1, sound_dets);
+		auto in_samples = static_cast<std::size_t>(in_frames) * channels;
+
+		_resample_buf.resize(static_cast<std::size_t>(in_frames * frame_bytes));
+		copy_pcm(pcm_data, 0, _resample_buf.data(), _resample_buf.size());
+		_resample_in.resize(in_samples);
+		adaptive_resampling::to_float(_resample_buf.data(), sound_dets._bps, sound_dets._is_float, _resample_in.data(), in_samples);
+		_resampler.push(_resample_in.data(), static_cast<std::size_t>(in_frames));
+
+		_resample_out.resize(static_cast<std::size_t>(device_frames) * channels);
+		auto out_frames = _resampler.pull(_resample_out.data(), static_cast<std::size_t>(device_frames));
+		_resample_buf.resize(out_frames * static_cast<std::size_t>(frame_bytes));
+		adaptive_resampling::from_float(_resample_out.data(), _resample_buf.data(), sound_dets._bps, sound_dets._is_float, out_frames * channels);
+		_soft_gain.process(_resample_buf.data(), out_frames, sound_dets._channels, sound_dets._bps, sound_dets._is_float);
+
+		snd_pcm_sframes_t written_samples = 0;
+		if (_mmap_access)
+		{
+			written_samples = mmap_write(out_frames,
+				[this, frame_bytes](unsigned char * dest, snd_pcm_uframes_t done, snd_pcm_uframes_t write_frames)
+			{
+				std::memcpy(dest, _resample_buf.data() + done * frame_bytes, static_cast<std::size_t>(write_frames * frame_bytes));
+			});
+		}
+		else
+		{
+			written_samples = direct_write(_resample_buf.data(), out_frames, sound_dets._bps / 8, sound_dets._channels);
+		}
+
+		// the item frames are taken, whatever the resampler keeps of them goes out with the next write
+		return written_samples < 0 ? written_samples : static_cast<snd_pcm_sframes_t>(in_frames);
+	}
+
+	void output_plugin_alsa::apply_position_step(sound_details & sound_dets)
+	{
+		auto step = take_position_step();
+		if (!step)
+			return;
+
+		if (_crossfade_active)
+		{
+			// the mix is not cut into, the step waits for the end of the fade
+			step_position(step);
+			return;
+		}
+
+		if (step < 0)
+		{
+			// held back: silence in front of the rest, as much as the device takes now
+			auto bytes = std::min(samples_to_bytes(-step, sound_dets), std::max<size_type>(alsa_available_bytes_to_write(), 0));
+			step += bytes_to_samples(fill_drain(bytes, sound_dets), sound_dets);
+		}
+		else
+		{
+			// skipped: taken out of the decoded data as if it was played
+			auto & decoded_data_buf = *(sound_dets._current_cache_buffer->get_data_ptr());
+			auto frame_bytes = samples_to_bytes(1, sound_dets);
+			auto frames = std::min<size_type>(step, static_cast<size_type>(decoded_data_buf->second.size()) / frame_bytes);
+			if (sound_dets._total_samples >= 0)
+			{
+				frames = std::max<size_type>(std::min(frames, sound_dets._total_samples - sound_dets._current_samples_written_to_sound_buffer), 0);
+			}
+
+			auto bytes = frames * frame_bytes;
+			decoded_data_buf->second.erase_begin(static_cast<std::size_t>(bytes));
+			decoded_data_buf->first -= bytes;
+			sound_dets._current_samples_written_to_sound_buffer += frames;
+			sound_dets._current_cache_buffer->put_data_ptr(false);
+			step -= frames;
+		}
+
+		BOOST_LOG_TRIVIAL(debug) << "alsa position step for id: " << sound_dets._url_id << " left: " << step << " frames";
+
+		if (step)
+		{
+			// the rest with the next write
+			step_position(step);
+		}
+	}
+
 	size_type output_plugin_alsa::alsa_available_bytes_to_write()
 	{
 		size_type frames_to_deliver = 
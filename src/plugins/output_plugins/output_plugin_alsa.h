@@ -2,6 +2,13 @@
 #define output_plugin_alsa_h__
 
 #include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <tuple>
 
 extern "C"
 {
@@ -11,15 +18,48 @@ extern "C"
 #include <boost/log/trivial.hpp>
 #include <boost/filesystem/path.hpp>
 #include <boost/optional.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
 
 #include "common/output_plugin_api.h"
+#include "common/pcm_gain.h"
+#include "common/replay_gain.h"
+#include "common/crossfade_mixer.h"
+#include "common/adaptive_resampler.h"
+
+#include "alsa_auto_tuner.h"
 
 namespace mprt
 {
-	
+	// the decoder thread writes the eventfd when a chunk comes in and the output waits for it
+	struct alsa_data_waker
+	{
+		std::atomic_bool _wanted;
+		std::atomic<int> _fd;
+
+		alsa_data_waker()
+			: _wanted(false)
+			, _fd(-1)
+		{}
+
+		void notify();
+	};
+
+	// hw params negotiated before, set again as they are
+	struct alsa_hw_config
+	{
+		std::shared_ptr<snd_pcm_hw_params_t> _params;
+		bool _mmap_access;
+		unsigned int _buffer_size;
+		unsigned int _period_size;
+		bool _can_pause;
+	};
+
 	class output_plugin_alsa : public output_plugin_api
 	{
 	private:
+		using clock_type = std::chrono::steady_clock;
+		using descriptor_t = boost::asio::posix::stream_descriptor;
+
 		size_type _max_buffer;
 		size_type _max_period;
 		bool _use_buffer_duration_size;
@@ -47,26 +87,112 @@ namespace mprt
 		bool _init_poll;
 		struct pollfd *_poll_ufds;
 		int _poll_count;
-		bool _poll_init;
 		bool _init_open;
 		bool _alsa_can_pause;
 		bool _use_drain;
 		bool _paused;
+		bool _use_mmap;
+		bool _mmap_access; // the device took mmap access with the current parameters
+		open_format_policy _keep_open_format;
+
+		// format, channels, rate, buffer, period, buffer as size
+		using hw_config_key_t = std::tuple<int, size_type, size_type, size_type, size_type, bool>;
+		std::map<hw_config_key_t, alsa_hw_config> _hw_configs;
+
+		// use_poll: the pcm descriptors and the data eventfd are waited on in the io loop of the
+		// job thread, a write happens when the device wants a period and no job is ever blocked
+		bool _event_loop;
+		std::vector<std::unique_ptr<descriptor_t>> _pcm_fds; // owned by alsa, released on close
+		std::unique_ptr<descriptor_t> _data_event;
+		std::shared_ptr<alsa_data_waker> _data_waker;
+		bool _device_wait_armed;
+		bool _data_wait_armed;
+		uint64_t _device_wait_gen;
+		uint64_t _data_wait_gen;
+		bool _data_wait_started;
+		clock_type::time_point _data_wait_since;
+		std::chrono::milliseconds _max_data_wait;
+		bool _draining;
+
+		// software gain: the volume when there is no mixer (or soft_volume is true) times the replaygain
+		bool _soft_volume;
+		replay_gain_mode _replay_gain_mode;
+		double _replay_gain_preamp_db;
+		double _no_replay_gain_preamp_db;
+		bool _replay_gain_prevent_clip;
+		size_type _soft_gain_ramp_msecs;
+		pcm_gain_stage _soft_gain;
+		url_id_t _soft_gain_url_id; // the item the gain is set for
+		bool _soft_gain_jump; // nothing was playing, no ramp
+		std::vector<buffer_elem_t> _soft_gain_buf; // the rw writes are scaled here
+
+		// crossfade: the end of an item is mixed with the start of the next one when they have the
+		// same format (the decoders convert into the open one), the next item is not drained for
+		crossfade_mode _crossfade_mode;
+		size_type _crossfade_msecs;
+		crossfade_mixer _crossfade;
+		bool _crossfade_active;
+		url_id_t _crossfade_url_id; // the incoming item
+		float _crossfade_in_gain; // the replaygain of the incoming item against the outgoing one
+		std::vector<buffer_elem_t> _crossfade_buf; // the mix, written to the device
+		std::vector<buffer_elem_t> _crossfade_in_buf;
+
+		// the position is the written samples less the device delay. an item finished gaplessly is
+		// still in the device for a while, it is reported until the next one is heard
+		url_id_t _played_out_url_id;
+		size_type _played_out_samples;
+		snd_pcm_status_t *_pcm_status;
+
+		// output sync: the device clock is the frames written, silence too, less the delay at the
+		// time stamp of the status (a monotonic one when the device gives it). a rate correction
+		// resamples the item frames on their way into the device
+		int64_t _device_frames_written;
+		bool _device_tstamp;
+		adaptive_resampler _resampler;
+		double _resample_ratio; // the resampler runs with, 0: off
+		std::vector<float> _resample_in;
+		std::vector<float> _resample_out;
+		std::vector<buffer_elem_t> _resample_buf;
+
+		// auto_tune: the buffer and the period come from the tuner instead of max_buffer and max_period
+		std::unique_ptr<alsa_auto_tuner> _auto_tuner;
+		bool _tune_data_starved; // the device ran dry by the decoder or a pause, not a late wakeup
 
 		void reset_buffers() override;
 		bool init_alsa();
 		bool init_hw_params();
 		bool init_sw_params();
 		bool init_poll_params();
+		bool retune_alsa();
+		void probe_format_caps();
 		void set_volume_internal(size_type volume);
+		void update_soft_gain(sound_details const& sound_dets);
+		double item_soft_gain(sound_details const& sound_dets);
+		sound_details * crossfade_next_item(sound_details const& current_sound_dets);
+		size_type crossfade_prepare(sound_details & current_sound_dets, size_type frames);
+		snd_pcm_sframes_t crossfade_write(sound_details & current_sound_dets, sound_details & next_sound_dets, size_type frames);
+		void report_position(sound_details const& sound_dets);
+		bool update_resample_ratio(sound_details const& sound_dets);
+		snd_pcm_sframes_t resampled_write(sound_details const& sound_dets, size_type frames, size_type device_frames);
+		void apply_position_step(sound_details & sound_dets);
 		size_type alsa_available_bytes_to_write();
 		size_type alsa_available_bytes_to_play();
 		std::chrono::microseconds get_next_duration();
 
 		snd_pcm_sframes_t direct_write(const void *buffer, snd_pcm_uframes_t size, int sample_width, int channels);
 
-		int wait_for_poll();
-		snd_pcm_sframes_t poll_write(const void *buffer, snd_pcm_uframes_t size, int sample_width, int channels);
+		bool init_event_loop();
+		void close_event_loop();
+		void wait_for_device();
+		void device_ready(uint64_t generation, boost::system::error_code const& ec);
+		void wait_for_data();
+		void cancel_waits();
+		void start_drain();
+		void finish_drain();
+
+		// fills the frames [done, done + frames) of the write at dest, which is in the device ring
+		using mmap_fill_func_t = std::function<void(unsigned char * dest, snd_pcm_uframes_t done, snd_pcm_uframes_t frames)>;
+		snd_pcm_sframes_t mmap_write(snd_pcm_uframes_t size, mmap_fill_func_t const& fill);
 
 		virtual void play() override;
 		virtual void pause_play_internal() override;
@@ -95,6 +221,38 @@ namespace mprt
 			, _sw_params(nullptr)
 			, _poll_ufds(nullptr)
 			, _init_open(false)
+			, _mmap_access(false)
+			, _keep_open_format(open_format_policy::format)
+			, _event_loop(false)
+			, _device_wait_armed(false)
+			, _data_wait_armed(false)
+			, _device_wait_gen(0)
+			, _data_wait_gen(0)
+			, _data_wait_started(false)
+			, _max_data_wait(2000)
+			, _draining(false)
+			, _soft_volume(false)
+			, _replay_gain_mode(replay_gain_mode::off)
+			, _replay_gain_preamp_db(0.)
+			, _no_replay_gain_preamp_db(0.)
+			, _replay_gain_prevent_clip(true)
+			, _soft_gain_ramp_msecs(30)
+			, _soft_gain_url_id(_INVALID_URL_ID_)
+			, _soft_gain_jump(true)
+			, _tune_data_starved(true)
+			, _crossfade_mode(crossfade_mode::off)
+			, _crossfade_msecs(5000)
+			, _crossfade_active(false)
+			, _crossfade_url_id(_INVALID_URL_ID_)
+			, _crossfade_in_gain(1.f)
+			, _played_out_url_id(_INVALID_URL_ID_)
+			, _played_out_samples(0)
+			, _pcm_status(nullptr)
+			, _device_frames_written(0)
+			, _device_tstamp(false)
+			, _resample_ratio(0.)
+			, _volume(100)
+			, _mixer_elem(nullptr)
 			, _is_mixer_open(false)
 			, _sid(nullptr)
 			, _mixer_min(0)
@@ -104,9 +262,13 @@ namespace mprt
 		virtual ~output_plugin_alsa() {
 			BOOST_LOG_TRIVIAL(debug) << "output_plugin_alsa::~output_plugin_alsa() called";
 
+			close_event_loop();
+
 			delete_ptr(_hw_params, snd_pcm_hw_params_free);
 
 			delete_ptr(_sw_params, snd_pcm_sw_params_free);
+
+			delete_ptr(_pcm_status, snd_pcm_status_free);
 			
 			delete_ptr(_poll_ufds);
 
@@ -133,6 +295,10 @@ namespace mprt
 		virtual void set_volume(size_type volume) override; // 0 to 100
 		virtual size_type get_volume()  override { return _volume; }
 
+		virtual std::chrono::milliseconds next_item_lead_time() const override;
+
+		virtual bool supports_rate_correction() const override { return true; }
+
 	};
 
 }
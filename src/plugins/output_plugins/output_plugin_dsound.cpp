@@ -79,6 +79,7 @@ namespace mprt
 		config::instance().init("../config/config_output_plugin_dsound.xml");
 		auto pt = config::instance().get_ptree_node("mprt.output_plugin_dsound");
 		_async_task = std::make_shared<async_tasker>(pt.get<std::size_t>("max_free_timer_count", 10));
+		_enabled = (pt.get<std::string>("enable", "true") == "true");
 		_preffered_device_name = pt.get<std::string>("preffered_device_name", "Primary Sound Driver");
 		_max_buffer_duration_msec = pt.get<size_type>("max_buffer_duration_msec", 200);
 		_max_chunk_read_size = pt.get<size_type>("max_chunk_read_size", 128) * 1024;
@@ -532,7 +533,8 @@ namespace mprt
 				_write_offset += total_writen_bytes;
 				_write_offset %= _dsound_buffer_size;
 
-				call_callback_funcs(_progress_func_call_list, current_sound_dets._url_id, samples_to_time_duration(current_sound_dets._current_samples_written_to_sound_buffer, current_sound_dets).count() / 1000);
+				auto position_ms = samples_to_time_duration(current_sound_dets._current_samples_written_to_sound_buffer, current_sound_dets).count() / 1000;
+				publish_position(current_sound_dets._url_id, position_ms, position_ms, true);
 
 				if (current_sound_dets._current_samples_written_to_sound_buffer == current_sound_dets._total_samples) {
 					BOOST_LOG_TRIVIAL(debug) << "direct sound play finished for: " << current_sound_dets._url_id;
@@ -559,7 +561,8 @@ namespace mprt
 							BOOST_LOG_TRIVIAL(debug) << "drain bytes: " << write_play_bytes;
 
 							_prev_sound_details._current_samples_written_to_sound_buffer += bytes_to_samples(real_written_bytes, _prev_sound_details);
-							call_callback_funcs(_progress_func_call_list, _prev_sound_details._url_id, samples_to_time_duration(_prev_sound_details._current_samples_written_to_sound_buffer, _prev_sound_details).count() / 1000);
+							auto drain_position_ms = samples_to_time_duration(_prev_sound_details._current_samples_written_to_sound_buffer, _prev_sound_details).count() / 1000;
+							publish_position(_prev_sound_details._url_id, drain_position_ms, drain_position_ms, true);
 						}
 
 						// play the remaining
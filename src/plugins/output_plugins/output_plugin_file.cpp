@@ -0,0 +1,237 @@
+#include <limits>
+
+#include <boost/dll/runtime_symbol_info.hpp>
+#include <boost/filesystem/operations.hpp>
+
+#include "core/config.h"
+
+#include "output_plugin_file.h"
+
+namespace mprt
+{
+	namespace
+	{
+		// wav is little endian whatever the host is
+		void write_le(std::ofstream & os, uint64_t val, int bytes)
+		{
+			for (int i = 0; i != bytes; ++i)
+			{
+				os.put(static_cast<char>((val >> (8 * i)) & 0xff));
+			}
+		}
+
+		constexpr size_type _WAV_HEADER_SIZE_ = 68; // the extensible one, the plain fmt chunk is padded with a junk chunk
+	}
+
+	// Must be instantiated in plugin
+	boost::filesystem::path output_plugin_file::location() const {
+		return boost::dll::this_line_location(); // location of this plugin
+	}
+
+	std::string output_plugin_file::plugin_name() const {
+		return "output_plugin_file";
+	}
+
+	plugin_types output_plugin_file::plugin_type() const {
+		return plugin_types::output_plugin;
+	}
+
+	void output_plugin_file::init(void * /*arguments*/)
+	{
+		try
+		{
+			config::instance().init("../config/config_output_plugin_file.xml");
+			auto pt = config::instance().get_ptree_node("mprt.output_plugin_file");
+
+			_async_task = std::make_shared<async_tasker>(pt.get<std::size_t>("max_free_timer_count", 10));
+			init_offline(pt);
+			_output_dir = pt.get<std::string>("output_dir", ".");
+			_file_prefix = pt.get<std::string>("file_prefix", "mprt_render");
+			_wav = (pt.get<std::string>("format", "wav") == "wav");
+			_file_per_item = (pt.get<std::string>("file_per_item", "true") == "true");
+		}
+		catch (std::exception const& e) {
+			BOOST_LOG_TRIVIAL(error) << "error: " << e.what();
+		}
+
+		while (!_async_task->is_ready()) {
+			std::this_thread::yield();
+		}
+	}
+
+	void output_plugin_file::write_wav_header(sound_details const& sound_dets, size_type data_bytes)
+	{
+		// the sizes do not fit past 4GB, the players read till the end of the file then
+		auto data_size = static_cast<uint64_t>(std::min<size_type>(data_bytes, std::numeric_limits<uint32_t>::max() - _WAV_HEADER_SIZE_));
+		auto channels = static_cast<uint64_t>(sound_dets._channels);
+		auto bps = static_cast<uint64_t>(sound_dets._bps);
+		auto block_align = channels * bps / 8;
+		// 24 bit samples are sent in 32 bits
+		auto valid_bits = static_cast<uint64_t>(
+			(!sound_dets._is_float && sound_dets._orig_bps > 0 && sound_dets._orig_bps < sound_dets._bps) ? sound_dets._orig_bps : sound_dets._bps);
+		bool extensible = channels > 2 || bps > 16;
+		uint64_t format_tag = sound_dets._is_float ? 3 : 1;
+
+		_os.seekp(0);
+		_os.write("RIFF", 4);
+		write_le(_os, data_size + _WAV_HEADER_SIZE_ - 8, 4);
+		_os.write("WAVE", 4);
+		_os.write("fmt ", 4);
+		if (extensible)
+		{
+			write_le(_os, 40, 4);
+			write_le(_os, 0xfffe, 2);
+		}
+		else
+		{
+			write_le(_os, 16, 4);
+			write_le(_os, format_tag, 2);
+		}
+		write_le(_os, channels, 2);
+		write_le(_os, static_cast<uint64_t>(sound_dets._sample_rate), 4);
+		write_le(_os, static_cast<uint64_t>(sound_dets._sample_rate) * block_align, 4);
+		write_le(_os, block_align, 2);
+		write_le(_os, bps, 2);
+		if (extensible)
+		{
+			write_le(_os, 22, 2);
+			write_le(_os, valid_bits, 2);
+			write_le(_os, 0, 4); // no speaker positions
+			// KSDATAFORMAT_SUBTYPE_PCM / _IEEE_FLOAT
+			write_le(_os, format_tag, 4);
+			static char const guid_tail[] = "\x00\x00\x10\x00\x80\x00\x00\xaa\x00\x38\x9b\x71";
+			_os.write(guid_tail, 12);
+		}
+		else
+		{
+			_os.write("JUNK", 4);
+			write_le(_os, 16, 4);
+			write_le(_os, 0, 8);
+			write_le(_os, 0, 8);
+		}
+		_os.write("data", 4);
+		write_le(_os, data_size, 4);
+	}
+
+	bool output_plugin_file::open_file(sound_details const& sound_dets)
+	{
+		boost::system::error_code ec;
+		boost::filesystem::create_directories(_output_dir, ec);
+
+		_file_path = _output_dir / (_file_prefix + "_" + std::to_string(_file_seq++) + (_wav ? ".wav" : ".raw"));
+		auto part_path = _file_path;
+		part_path += ".part";
+
+		_os.open(part_path.string(), std::ios::binary | std::ios::trunc);
+		if (!_os)
+		{
+			BOOST_LOG_TRIVIAL(error) << "cannot open the output file: " << part_path;
+			return false;
+		}
+
+		_file_format = sound_dets;
+		_data_bytes = 0;
+
+		if (_wav)
+		{
+			write_wav_header(sound_dets, 0);
+		}
+
+		BOOST_LOG_TRIVIAL(debug) << "file output: " << _file_path
+			<< " sample rate: " << sound_dets._sample_rate
+			<< " channels: " << sound_dets._channels
+			<< " bps: " << sound_dets._bps;
+
+		return static_cast<bool>(_os);
+	}
+
+	void output_plugin_file::close_file()
+	{
+		if (!_os.is_open())
+		{
+			return;
+		}
+
+		if (_wav)
+		{
+			write_wav_header(_file_format, _data_bytes);
+		}
+
+		bool ok = static_cast<bool>(_os);
+		_os.close();
+
+		auto part_path = _file_path;
+		part_path += ".part";
+
+		boost::system::error_code ec;
+		if (ok && !_os.fail())
+		{
+			boost::filesystem::rename(part_path, _file_path, ec);
+		}
+
+		if (!ok || ec)
+		{
+			BOOST_LOG_TRIVIAL(error) << "cannot finish the output file: " << _file_path;
+			boost::filesystem::remove(part_path, ec);
+		}
+	}
+
+	bool output_plugin_file::open_item(sound_details const& sound_dets)
+	{
+		bool same_format =
+			_os.is_open() &&
+			_file_format._bps == sound_dets._bps &&
+			_file_format._is_float == sound_dets._is_float &&
+			_file_format._channels == sound_dets._channels &&
+			_file_format._sample_rate == sound_dets._sample_rate;
+
+		if (same_format && !_file_per_item)
+		{
+			return true;
+		}
+
+		close_file();
+
+		return open_file(sound_dets);
+	}
+
+	bool output_plugin_file::write_pcm(unsigned char const* data, std::size_t bytes, sound_details const& sound_dets)
+	{
+		if (_wav && sound_dets._bps == 8 && !sound_dets._is_float)
+		{
+			// 8 bit wav is unsigned
+			for (std::size_t i = 0; i != bytes; ++i)
+			{
+				_os.put(static_cast<char>(data[i] ^ 0x80));
+			}
+		}
+		else
+		{
+			_os.write(reinterpret_cast<char const*>(data), static_cast<std::streamsize>(bytes));
+		}
+
+		_data_bytes += static_cast<size_type>(bytes);
+
+		return static_cast<bool>(_os);
+	}
+
+	void output_plugin_file::close_item(sound_details const& /*sound_dets*/)
+	{
+		if (_file_per_item)
+		{
+			close_file();
+		}
+	}
+
+	void output_plugin_file::close_sink()
+	{
+		close_file();
+	}
+}
+
+// Factory method. Returns *simple pointer*!
+std::unique_ptr<refcounting_plugin_api> create() {
+	return std::make_unique<mprt::output_plugin_file>();
+}
+
+BOOST_DLL_ALIAS(create, create_refc_plugin)
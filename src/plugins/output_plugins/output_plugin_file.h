@@ -0,0 +1,59 @@
+#ifndef output_plugin_file_h__
+#define output_plugin_file_h__
+
+#include <fstream>
+#include <string>
+
+#include <boost/log/trivial.hpp>
+#include <boost/filesystem/path.hpp>
+
+#include "output_plugin_offline.h"
+
+namespace mprt
+{
+	// renders the items into wav or raw pcm files. a file is written as <name>.part and
+	// renamed when it is complete, items of the same format go into the same file
+	// unless file_per_item is set
+	class output_plugin_file : public output_plugin_offline
+	{
+	private:
+		boost::filesystem::path _output_dir;
+		std::string _file_prefix;
+		bool _wav;
+		bool _file_per_item;
+
+		std::ofstream _os;
+		boost::filesystem::path _file_path;
+		sound_details _file_format;
+		size_type _file_seq;
+		size_type _data_bytes;
+
+		bool open_file(sound_details const& sound_dets);
+		void close_file();
+		void write_wav_header(sound_details const& sound_dets, size_type data_bytes);
+
+		virtual bool open_item(sound_details const& sound_dets) override;
+		virtual bool write_pcm(unsigned char const* data, std::size_t bytes, sound_details const& sound_dets) override;
+		virtual void close_item(sound_details const& sound_dets) override;
+		virtual void close_sink() override;
+
+	public:
+		output_plugin_file()
+			: _wav(true)
+			, _file_per_item(true)
+			, _file_seq(0)
+			, _data_bytes(0)
+		{}
+
+		virtual ~output_plugin_file() {
+			BOOST_LOG_TRIVIAL(debug) << "output_plugin_file::~output_plugin_file() called";
+		}
+
+		virtual boost::filesystem::path location() const override;
+		virtual std::string plugin_name() const override;
+		virtual plugin_types plugin_type() const override;
+		virtual void init(void * arguments = nullptr) override;
+	};
+}
+
+#endif // output_plugin_file_h__
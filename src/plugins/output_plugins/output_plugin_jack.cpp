@@ -0,0 +1,268 @@
+#include <algorithm>
+
+#include <boost/dll/runtime_symbol_info.hpp>
+
+#include "core/config.h"
+
+#include "output_plugin_jack.h"
+
+namespace mprt
+{
+	namespace
+	{
+		// the process callback pulls in pieces of this many frames, any jack period fits
+		constexpr std::size_t _PULL_CHUNK_FRAMES_ = 1024;
+	}
+
+	output_plugin_jack::~output_plugin_jack()
+	{
+		BOOST_LOG_TRIVIAL(debug) << "output_plugin_jack::~output_plugin_jack() called";
+
+		close_client();
+	}
+
+	// Must be instantiated in plugin
+	boost::filesystem::path output_plugin_jack::location() const {
+		return boost::dll::this_line_location(); // location of this plugin
+	}
+
+	std::string output_plugin_jack::plugin_name() const {
+		return "output_plugin_jack";
+	}
+
+	plugin_types output_plugin_jack::plugin_type() const {
+		return plugin_types::output_plugin;
+	}
+
+	void output_plugin_jack::init(void * /*arguments*/)
+	{
+		try
+		{
+			config::instance().init("../config/config_output_plugin_jack.xml");
+			auto pt = config::instance().get_ptree_node("mprt.output_plugin_jack");
+
+			_async_task = std::make_shared<async_tasker>(pt.get<std::size_t>("max_free_timer_count", 10));
+			init_pull(pt);
+			_client_name = pt.get<std::string>("client_name", "mprt");
+			_channels = std::max<size_type>(pt.get<size_type>("channels", 2), 1);
+			_auto_connect = (pt.get<std::string>("auto_connect", "true") == "true");
+		}
+		catch (std::exception const& e) {
+			BOOST_LOG_TRIVIAL(error) << "error: " << e.what();
+		}
+
+		while (!_async_task->is_ready()) {
+			std::this_thread::yield();
+		}
+
+		// the rate of the server is needed before the decoders open the items
+		if (_enabled && !open_client())
+		{
+			BOOST_LOG_TRIVIAL(error) << "jack output is disabled, no jack server";
+			_enabled = false;
+		}
+	}
+
+	int output_plugin_jack::process_callback(jack_nframes_t frames, void * arg)
+	{
+		static_cast<output_plugin_jack*>(arg)->process(frames);
+		return 0;
+	}
+
+	// jack1 may call these two on the realtime thread, no job is posted from there (it allocates
+	// and locks), the job thread finds the flags with its next fill
+
+	int output_plugin_jack::buffer_size_callback(jack_nframes_t frames, void * arg)
+	{
+		static_cast<output_plugin_jack*>(arg)->_new_buffer_size.store(frames, std::memory_order_relaxed);
+		return 0;
+	}
+
+	int output_plugin_jack::xrun_callback(void * arg)
+	{
+		static_cast<output_plugin_jack*>(arg)->_xruns.fetch_add(1, std::memory_order_relaxed);
+		return 0;
+	}
+
+	void output_plugin_jack::handle_device_events()
+	{
+		auto frames = _new_buffer_size.exchange(0, std::memory_order_relaxed);
+		if (frames)
+		{
+			BOOST_LOG_TRIVIAL(debug) << "jack buffer size: " << frames;
+			set_period_frames(frames);
+			log_latency();
+		}
+
+		auto xruns = _xruns.load(std::memory_order_relaxed);
+		if (xruns != _logged_xruns)
+		{
+			BOOST_LOG_TRIVIAL(info) << "jack xruns: " << xruns - _logged_xruns << " (total: " << xruns << ")"
+				<< " ring: " << ring_frames() << " frames"
+				<< " underruns: " << underruns();
+			_logged_xruns = xruns;
+		}
+	}
+
+	void output_plugin_jack::shutdown_callback(void * arg)
+	{
+		auto self = static_cast<output_plugin_jack*>(arg);
+		self->add_job([self]() {
+			BOOST_LOG_TRIVIAL(error) << "jack server is gone";
+			self->close_client();
+			self->stream_lost();
+		});
+	}
+
+	void output_plugin_jack::process(jack_nframes_t frames)
+	{
+		auto channels = _port_buffers.size();
+		for (std::size_t ch = 0; ch != channels; ++ch)
+		{
+			_port_buffers[ch] = static_cast<float*>(jack_port_get_buffer(_ports[ch], frames));
+		}
+
+		for (std::size_t done = 0; done < frames;)
+		{
+			auto count = std::min<std::size_t>(_PULL_CHUNK_FRAMES_, frames - done);
+			pull(_interleaved.data(), count);
+
+			auto in = _interleaved.data();
+			for (std::size_t frame = done; frame != done + count; ++frame)
+			{
+				for (std::size_t ch = 0; ch != channels; ++ch)
+				{
+					_port_buffers[ch][frame] = *in++;
+				}
+			}
+
+			done += count;
+		}
+	}
+
+	bool output_plugin_jack::open_client()
+	{
+		jack_status_t status;
+		_client = jack_client_open(_client_name.c_str(), JackNoStartServer, &status);
+		if (!_client)
+		{
+			BOOST_LOG_TRIVIAL(error) << "cannot open jack client: " << _client_name << " status: " << status;
+			return false;
+		}
+
+		jack_set_process_callback(_client, &output_plugin_jack::process_callback, this);
+		jack_set_buffer_size_callback(_client, &output_plugin_jack::buffer_size_callback, this);
+		jack_set_xrun_callback(_client, &output_plugin_jack::xrun_callback, this);
+		jack_on_shutdown(_client, &output_plugin_jack::shutdown_callback, this);
+
+		_ports.clear();
+		for (size_type ch = 0; ch != _channels; ++ch)
+		{
+			auto port_name = "out_" + std::to_string(ch + 1);
+			auto port = jack_port_register(_client, port_name.c_str(), JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
+			if (!port)
+			{
+				BOOST_LOG_TRIVIAL(error) << "cannot register jack port: " << port_name;
+				close_client();
+				return false;
+			}
+			_ports.push_back(port);
+		}
+
+		_port_buffers.assign(_ports.size(), nullptr);
+		_interleaved.assign(_PULL_CHUNK_FRAMES_ * _ports.size(), 0.f);
+
+		BOOST_LOG_TRIVIAL(debug) << "jack client: " << jack_get_client_name(_client)
+			<< " sample rate: " << jack_get_sample_rate(_client)
+			<< " buffer size: " << jack_get_buffer_size(_client);
+
+		set_stream_format(jack_get_sample_rate(_client), _channels, jack_get_buffer_size(_client));
+
+		return true;
+	}
+
+	void output_plugin_jack::close_client()
+	{
+		if (_client)
+		{
+			jack_client_close(_client);
+			_client = nullptr;
+			_ports.clear();
+		}
+	}
+
+	void output_plugin_jack::connect_ports()
+	{
+		auto physical_ports = jack_get_ports(_client, nullptr, JACK_DEFAULT_AUDIO_TYPE, JackPortIsPhysical | JackPortIsInput);
+		if (!physical_ports)
+		{
+			BOOST_LOG_TRIVIAL(debug) << "no physical jack playback ports to connect to";
+			return;
+		}
+
+		for (std::size_t ch = 0; ch != _ports.size() && physical_ports[ch]; ++ch)
+		{
+			if (jack_connect(_client, jack_port_name(_ports[ch]), physical_ports[ch]))
+			{
+				BOOST_LOG_TRIVIAL(error) << "cannot connect jack port: " << jack_port_name(_ports[ch]) << " to: " << physical_ports[ch];
+			}
+		}
+
+		jack_free(physical_ports);
+	}
+
+	void output_plugin_jack::log_latency()
+	{
+		if (!_client || _ports.empty())
+			return;
+
+		jack_latency_range_t range;
+		jack_port_get_latency_range(_ports.front(), JackPlaybackLatency, &range);
+
+		auto sample_rate = std::max<size_type>(jack_get_sample_rate(_client), 1);
+		auto period = jack_get_buffer_size(_client);
+		BOOST_LOG_TRIVIAL(info) << "jack period: " << period << " frames (" << period * 1000. / sample_rate << " ms)"
+			<< " playback latency: " << range.min << " - " << range.max << " frames"
+			<< " ring: " << ring_frames() << " frames";
+	}
+
+	bool output_plugin_jack::start_stream()
+	{
+		if (!_client && !open_client())
+		{
+			return false;
+		}
+
+		if (jack_activate(_client))
+		{
+			BOOST_LOG_TRIVIAL(error) << "cannot activate jack client: " << _client_name;
+			close_client();
+			return false;
+		}
+
+		if (_auto_connect)
+		{
+			connect_ports();
+		}
+
+		log_latency();
+		return true;
+	}
+
+	void output_plugin_jack::stop_stream()
+	{
+		if (_client)
+		{
+			jack_deactivate(_client);
+		}
+
+		close_client();
+	}
+}
+
+// Factory method. Returns *simple pointer*!
+std::unique_ptr<refcounting_plugin_api> create() {
+	return std::make_unique<mprt::output_plugin_jack>();
+}
+
+BOOST_DLL_ALIAS(create, create_refc_plugin)
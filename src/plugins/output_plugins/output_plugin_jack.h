@@ -0,0 +1,75 @@
+#ifndef output_plugin_jack_h__
+#define output_plugin_jack_h__
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+extern "C"
+{
+#include <jack/jack.h>
+}
+
+#include <boost/log/trivial.hpp>
+#include <boost/filesystem/path.hpp>
+
+#include "output_plugin_pull.h"
+
+namespace mprt
+{
+	// plays through a jack server, the process callback of jack takes a period at a time
+	// from the ring of output_plugin_pull. the server is not started by the plugin
+	class output_plugin_jack : public output_plugin_pull
+	{
+	private:
+		std::string _client_name;
+		size_type _channels;
+		bool _auto_connect; // to the physical playback ports
+
+		jack_client_t * _client;
+		std::vector<jack_port_t*> _ports;
+
+		// used in the process callback only, set up before the client is activated
+		std::vector<float*> _port_buffers;
+		std::vector<float> _interleaved;
+
+		// set by the jack callbacks, which may run on the realtime thread, taken by the job thread
+		std::atomic<uint64_t> _xruns;
+		std::atomic<jack_nframes_t> _new_buffer_size; // 0: no change
+		uint64_t _logged_xruns;
+
+		static int process_callback(jack_nframes_t frames, void * arg);
+		static int buffer_size_callback(jack_nframes_t frames, void * arg);
+		static int xrun_callback(void * arg);
+		static void shutdown_callback(void * arg);
+
+		void process(jack_nframes_t frames);
+		bool open_client();
+		void close_client();
+		void connect_ports();
+		void log_latency();
+
+		virtual bool start_stream() override;
+		virtual void stop_stream() override;
+		virtual void handle_device_events() override;
+
+	public:
+		output_plugin_jack()
+			: _channels(2)
+			, _auto_connect(true)
+			, _client(nullptr)
+			, _xruns(0)
+			, _new_buffer_size(0)
+			, _logged_xruns(0)
+		{}
+
+		virtual ~output_plugin_jack();
+
+		virtual boost::filesystem::path location() const override;
+		virtual std::string plugin_name() const override;
+		virtual plugin_types plugin_type() const override;
+		virtual void init(void * arguments = nullptr) override;
+	};
+}
+
+#endif // output_plugin_jack_h__
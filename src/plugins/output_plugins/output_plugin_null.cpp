@@ -0,0 +1,70 @@
+#include <boost/dll/runtime_symbol_info.hpp>
+
+#include "core/config.h"
+
+#include "output_plugin_null.h"
+
+namespace mprt
+{
+	// Must be instantiated in plugin
+	boost::filesystem::path output_plugin_null::location() const {
+		return boost::dll::this_line_location(); // location of this plugin
+	}
+
+	std::string output_plugin_null::plugin_name() const {
+		return "output_plugin_null";
+	}
+
+	plugin_types output_plugin_null::plugin_type() const {
+		return plugin_types::output_plugin;
+	}
+
+	void output_plugin_null::init(void * /*arguments*/)
+	{
+		try
+		{
+			config::instance().init("../config/config_output_plugin_null.xml");
+			auto pt = config::instance().get_ptree_node("mprt.output_plugin_null");
+
+			_async_task = std::make_shared<async_tasker>(pt.get<std::size_t>("max_free_timer_count", 10));
+			init_offline(pt);
+		}
+		catch (std::exception const& e) {
+			BOOST_LOG_TRIVIAL(error) << "error: " << e.what();
+		}
+
+		while (!_async_task->is_ready()) {
+			std::this_thread::yield();
+		}
+	}
+
+	bool output_plugin_null::open_item(sound_details const& sound_dets)
+	{
+		BOOST_LOG_TRIVIAL(debug) << "null output id: " << sound_dets._url_id
+			<< " sample rate: " << sound_dets._sample_rate
+			<< " channels: " << sound_dets._channels
+			<< " bps: " << sound_dets._bps;
+
+		return true;
+	}
+
+	bool output_plugin_null::write_pcm(unsigned char const* /*data*/, std::size_t /*bytes*/, sound_details const& /*sound_dets*/)
+	{
+		return true;
+	}
+
+	void output_plugin_null::close_item(sound_details const& /*sound_dets*/)
+	{
+	}
+
+	void output_plugin_null::close_sink()
+	{
+	}
+}
+
+// Factory method. Returns *simple pointer*!
+std::unique_ptr<refcounting_plugin_api> create() {
+	return std::make_unique<mprt::output_plugin_null>();
+}
+
+BOOST_DLL_ALIAS(create, create_refc_plugin)
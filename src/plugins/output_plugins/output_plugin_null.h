@@ -0,0 +1,34 @@
+#ifndef output_plugin_null_h__
+#define output_plugin_null_h__
+
+#include <boost/log/trivial.hpp>
+#include <boost/filesystem/path.hpp>
+
+#include "output_plugin_offline.h"
+
+namespace mprt
+{
+	// throws the decoded data away, for measuring the input and decoder throughput
+	class output_plugin_null : public output_plugin_offline
+	{
+	private:
+		virtual bool open_item(sound_details const& sound_dets) override;
+		virtual bool write_pcm(unsigned char const* data, std::size_t bytes, sound_details const& sound_dets) override;
+		virtual void close_item(sound_details const& sound_dets) override;
+		virtual void close_sink() override;
+
+	public:
+		output_plugin_null() {}
+
+		virtual ~output_plugin_null() {
+			BOOST_LOG_TRIVIAL(debug) << "output_plugin_null::~output_plugin_null() called";
+		}
+
+		virtual boost::filesystem::path location() const override;
+		virtual std::string plugin_name() const override;
+		virtual plugin_types plugin_type() const override;
+		virtual void init(void * arguments = nullptr) override;
+	};
+}
+
+#endif // output_plugin_null_h__
@@ -0,0 +1,405 @@
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+#include "output_plugin_offline.h"
+
+namespace mprt
+{
+	namespace
+	{
+		double seconds(std::chrono::steady_clock::duration dur)
+		{
+			return std::chrono::duration<double>(dur).count();
+		}
+	}
+
+	void output_plugin_offline::init_offline(boost::property_tree::ptree const& pt)
+	{
+		_enabled = (pt.get<std::string>("enable", "true") == "true");
+		_rate_multiple = std::max(pt.get<double>("rate_multiple", 0.), 0.);
+		_max_data_wait = std::chrono::milliseconds(pt.get<size_type>("max_data_wait_msecs", 2000));
+		set_progress_rate(pt.get<double>("progress_rate_hz", 10.));
+		_max_chunk_read_size = pt.get<size_type>("max_chunk_read_size", 128) * 1024;
+		_use_duration = pt.get<std::string>("use_memory_size_or_durationms", "duration") == "duration";
+		if (!_use_duration)
+		{
+			_max_memory_size_per_file = pt.get<size_type>("max_memory_size_per_file_duration", 4096) * 1024;
+		}
+		else
+		{
+			_max_memory_size_per_file = pt.get<size_type>("max_memory_size_per_file_duration", 20000);
+		}
+	}
+
+	void output_plugin_offline::set_volume(size_type volume)
+	{
+		add_job([this, volume]() { _volume = volume; });
+	}
+
+	void output_plugin_offline::post_play(std::chrono::microseconds delay)
+	{
+		if (_play_posted)
+		{
+			return;
+		}
+
+		_play_posted = true;
+		auto job = [this]() {
+			_play_posted = false;
+			play();
+		};
+
+		if (delay.count() > 0)
+		{
+			add_job_thread_internal(job, delay);
+		}
+		else
+		{
+			add_job(job);
+		}
+	}
+
+	void output_plugin_offline::wait_for_data()
+	{
+		_data_waiting = true;
+		_data_wait_since = clock_type::now();
+		auto generation = ++_data_wait_gen;
+
+		auto & cache_buf = sound_details_top()._current_cache_buffer;
+		cache_buf->set_data_notify([this, generation]() {
+			if (_data_wanted.exchange(false))
+			{
+				add_job([this, generation]() { data_arrived(generation); });
+			}
+		});
+		_data_wanted = true;
+
+		// the item is given up if nothing comes
+		add_job_thread_internal([this, generation]() { data_timeout(generation); }, _max_data_wait);
+
+		// a chunk may have come in before it was asked for
+		if (!cache_buf->is_data_empty() && _data_wanted.exchange(false))
+		{
+			add_job([this, generation]() { data_arrived(generation); });
+		}
+	}
+
+	void output_plugin_offline::data_arrived(uint64_t generation)
+	{
+		if (!_data_waiting || generation != _data_wait_gen)
+		{
+			return;
+		}
+
+		_data_waiting = false;
+		_data_wanted = false;
+		_item_stats._data_wait += clock_type::now() - _data_wait_since;
+
+		// a decoder stall is not caught up with a burst, like a device would underrun
+		reset_pace();
+
+		play();
+	}
+
+	void output_plugin_offline::data_timeout(uint64_t generation)
+	{
+		if (!_data_waiting || generation != _data_wait_gen || _sound_details_queue.empty())
+		{
+			return;
+		}
+
+		auto & sound_dets = sound_details_top_ref();
+		if (!sound_dets._current_cache_buffer->is_data_empty())
+		{
+			data_arrived(generation);
+			return;
+		}
+
+		_data_waiting = false;
+		_data_wanted = false;
+		_item_stats._data_wait += clock_type::now() - _data_wait_since;
+
+		BOOST_LOG_TRIVIAL(debug) << plugin_name() << " gave up waiting for the decoder: " << sound_dets._url_id;
+		finish_item(sound_dets);
+		continue_play();
+	}
+
+	void output_plugin_offline::continue_play()
+	{
+		if (is_no_job())
+		{
+			BOOST_LOG_TRIVIAL(debug) << plugin_name() << " play finished";
+
+			finish_run();
+			_current_state = plugin_states::stop;
+			return;
+		}
+
+		post_play(std::chrono::microseconds(0));
+	}
+
+	void output_plugin_offline::reset_pace()
+	{
+		_pace_origin = clock_type::now();
+		_pace_audio = std::chrono::microseconds(0);
+	}
+
+	bool output_plugin_offline::init_item()
+	{
+		if (_sound_details_queue.empty())
+		{
+			return false;
+		}
+
+		auto const& sound_dets = sound_details_top();
+		_prev_sound_details = sound_dets;
+
+		if (!_running)
+		{
+			_running = true;
+			_run_stats = offline_output_stats();
+			reset_pace();
+		}
+
+		_item_stats = offline_output_stats();
+		_item_start = clock_type::now();
+
+		return (_init_api = open_item(sound_dets));
+	}
+
+	void output_plugin_offline::init_api()
+	{
+		init_item();
+	}
+
+	void output_plugin_offline::finish_item(sound_details & sound_dets)
+	{
+		BOOST_LOG_TRIVIAL(debug) << "finishing offline output for id: " << sound_dets._url_id;
+
+		close_item(sound_dets);
+
+		_item_stats._items = 1;
+		_item_stats._wall = clock_type::now() - _item_start;
+		log_stats("item " + std::to_string(sound_dets._url_id), _item_stats);
+		_run_stats.add(_item_stats);
+		_item_stats = offline_output_stats();
+
+		sound_dets._current_cache_buffer->set_data_notify(nullptr);
+		sound_dets._decoder_play_finished_callback(sound_dets._url_id);
+
+		auto url_id = sound_dets._url_id;
+		sound_details_pop();
+		give_cache_buf_back(url_id);
+		_init_api = false;
+	}
+
+	void output_plugin_offline::finish_run()
+	{
+		if (!_running)
+		{
+			return;
+		}
+
+		_running = false;
+		close_sink();
+
+		if (_run_stats._items)
+		{
+			log_stats("total", _run_stats);
+		}
+	}
+
+	void output_plugin_offline::log_stats(std::string const& what, offline_output_stats const& stats)
+	{
+		auto wall = seconds(stats._wall);
+		auto audio = std::chrono::duration<double>(stats._audio).count();
+
+		std::ostringstream os;
+		os << std::fixed << std::setprecision(3)
+			<< plugin_name() << " " << what << ": "
+			<< audio << " s of audio in " << wall << " s"
+			<< ", realtime x" << (wall > 0. ? audio / wall : 0.)
+			<< ", " << (wall > 0. ? stats._bytes / wall / (1024. * 1024.) : 0.) << " MB/s"
+			<< ", decoder wait " << seconds(stats._data_wait) << " s"
+			<< ", write " << seconds(stats._write) << " s"
+			<< ", pacing " << seconds(stats._pace) << " s";
+		BOOST_LOG_TRIVIAL(info) << os.str();
+	}
+
+	void output_plugin_offline::play()
+	{
+		_STATE_CHECK_(plugin_states::play);
+
+		if (_play_posted || _data_waiting || _sound_details_queue.empty())
+		{
+			return;
+		}
+
+		if (!_init_api && !init_item())
+		{
+			BOOST_LOG_TRIVIAL(debug) << "cannot open the offline output with the current sound parameters";
+
+			auto & sound_dets = sound_details_top_ref();
+			if (sound_dets._current_cache_buffer)
+			{
+				sound_dets._current_cache_buffer->clear_data();
+			}
+			sound_dets._decoder_play_finished_callback(sound_dets._url_id);
+			sound_details_pop();
+
+			continue_play();
+			return;
+		}
+
+		auto & current_sound_dets = sound_details_top_ref();
+		if (!current_sound_dets._current_cache_buffer)
+		{
+			sound_details_pop();
+			_init_api = false;
+			continue_play();
+			return;
+		}
+
+		if (current_sound_dets._current_cache_buffer->is_data_empty())
+		{
+			wait_for_data();
+			return;
+		}
+
+		auto now = clock_type::now();
+		if (_rate_multiple > 0.)
+		{
+			auto due = _pace_origin + std::chrono::duration_cast<clock_type::duration>(_pace_audio / _rate_multiple);
+			if (now < due)
+			{
+				_item_stats._pace += due - now;
+				post_play(std::chrono::duration_cast<std::chrono::microseconds>(due - now));
+				return;
+			}
+		}
+
+		auto & decoded_data_buf = *(current_sound_dets._current_cache_buffer->get_data_ptr());
+		auto & pcm_data = decoded_data_buf->second;
+		auto frame_bytes = samples_to_bytes(1, current_sound_dets);
+		auto bytes = static_cast<size_type>(pcm_data.size()) / frame_bytes * frame_bytes;
+
+		// the decoder may hand over more than the known length
+		if (current_sound_dets._total_samples >= 0 &&
+			current_sound_dets._total_samples != std::numeric_limits<size_type>::max())
+		{
+			bytes = std::min(bytes,
+				samples_to_bytes(current_sound_dets._total_samples - current_sound_dets._current_samples_written_to_sound_buffer, current_sound_dets));
+		}
+
+		// the ring parts are written one by one, no linearize
+		auto write_start = clock_type::now();
+		auto one = pcm_data.array_one();
+		auto two = pcm_data.array_two();
+		auto first = std::min<std::size_t>(one.second, static_cast<std::size_t>(bytes));
+		bool write_ok =
+			(!first || write_pcm(reinterpret_cast<unsigned char const*>(one.first), first, current_sound_dets)) &&
+			(static_cast<std::size_t>(bytes) == first ||
+				write_pcm(reinterpret_cast<unsigned char const*>(two.first), static_cast<std::size_t>(bytes) - first, current_sound_dets));
+		_item_stats._write += clock_type::now() - write_start;
+
+		if (!write_ok)
+		{
+			BOOST_LOG_TRIVIAL(error) << plugin_name() << " write failed, stopping the item: " << current_sound_dets._url_id;
+			current_sound_dets._current_cache_buffer->put_data_ptr(false);
+			current_sound_dets._current_cache_buffer->clear_data();
+			finish_item(current_sound_dets);
+			continue_play();
+			return;
+		}
+
+		auto written_samples = bytes_to_samples(bytes, current_sound_dets);
+		auto written_duration = samples_to_time_duration(written_samples, current_sound_dets);
+		current_sound_dets._current_samples_written_to_sound_buffer += written_samples;
+		_item_stats._bytes += bytes;
+		_item_stats._audio += written_duration;
+		_pace_audio += written_duration;
+
+		pcm_data.erase_begin(static_cast<std::size_t>(bytes));
+		decoded_data_buf->first -= bytes;
+		auto is_play_finished = (
+			current_sound_dets._current_samples_written_to_sound_buffer == current_sound_dets._total_samples);
+		current_sound_dets._current_cache_buffer->put_data_ptr(is_play_finished);
+
+		// nothing is buffered after the sink, written is heard
+		auto position_ms = samples_to_time_duration(current_sound_dets._current_samples_written_to_sound_buffer, current_sound_dets).count() / 1000;
+		publish_position(current_sound_dets._url_id, position_ms, position_ms, true);
+
+		if (is_play_finished)
+		{
+			finish_item(current_sound_dets);
+		}
+
+		continue_play();
+	}
+
+	void output_plugin_offline::pause_play_internal()
+	{
+		BOOST_LOG_TRIVIAL(debug) << plugin_name() << " pause called";
+	}
+
+	void output_plugin_offline::resume_play_internal()
+	{
+		reset_pace();
+
+		play();
+	}
+
+	void output_plugin_offline::resume_clear_play_internal()
+	{
+		reset_pace();
+
+		play();
+	}
+
+	void output_plugin_offline::stop_internal()
+	{
+		_data_waiting = false;
+		_data_wanted = false;
+		++_data_wait_gen;
+
+		for (auto & sound_det : _sound_details_queue)
+		{
+			if (sound_det._current_cache_buffer)
+			{
+				sound_det._current_cache_buffer->set_data_notify(nullptr);
+			}
+			sound_det._decoder_play_finished_callback(sound_det._url_id);
+
+			give_cache_buf_back(sound_det._url_id);
+		}
+
+		if (_init_api)
+		{
+			close_item(_prev_sound_details);
+			_run_stats.add(_item_stats);
+			_item_stats = offline_output_stats();
+		}
+
+		_init_api = false;
+		finish_run();
+
+		output_plugin_api::stop_internal();
+		sound_plugin_api::reset_buffers();
+	}
+
+	void output_plugin_offline::pause_internal()
+	{
+		pause_play_internal();
+	}
+
+	void output_plugin_offline::quit_internal()
+	{
+		finish_run();
+	}
+
+	void output_plugin_offline::fill_drain_internal()
+	{
+		// nothing is buffered in a device
+	}
+}
@@ -0,0 +1,132 @@
+#ifndef output_plugin_offline_h__
+#define output_plugin_offline_h__
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+#include <boost/log/trivial.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include "common/output_plugin_api.h"
+
+namespace mprt
+{
+	// where the time of an offline output goes
+	struct offline_output_stats
+	{
+		using duration_t = std::chrono::steady_clock::duration;
+
+		size_type _items;
+		size_type _bytes;
+		std::chrono::microseconds _audio; // the duration of the consumed samples
+		duration_t _wall;
+		duration_t _data_wait; // nothing was decoded yet
+		duration_t _write; // the sink was writing
+		duration_t _pace; // held back by the rate multiple
+
+		offline_output_stats()
+			: _items(0)
+			, _bytes(0)
+			, _audio(0)
+			, _wall(duration_t::zero())
+			, _data_wait(duration_t::zero())
+			, _write(duration_t::zero())
+			, _pace(duration_t::zero())
+		{}
+
+		void add(offline_output_stats const& other)
+		{
+			_items += other._items;
+			_bytes += other._bytes;
+			_audio += other._audio;
+			_wall += other._wall;
+			_data_wait += other._data_wait;
+			_write += other._write;
+			_pace += other._pace;
+		}
+	};
+
+	// an output without a device: the decoded data is consumed as fast as it comes in,
+	// or at rate_multiple times the realtime. the sinks (file, null) only write the bytes
+	class output_plugin_offline : public output_plugin_api
+	{
+	private:
+		using clock_type = std::chrono::steady_clock;
+
+		size_type _volume;
+		double _rate_multiple; // 0: no pacing
+		std::chrono::milliseconds _max_data_wait;
+
+		// a play job or a pacing timer is posted, play is not called again until it runs
+		bool _play_posted;
+		bool _data_waiting;
+		uint64_t _data_wait_gen;
+		clock_type::time_point _data_wait_since;
+		std::atomic_bool _data_wanted;
+
+		clock_type::time_point _pace_origin;
+		std::chrono::microseconds _pace_audio; // consumed since the origin
+
+		bool _running;
+		clock_type::time_point _item_start;
+		offline_output_stats _item_stats;
+		offline_output_stats _run_stats;
+
+		void post_play(std::chrono::microseconds delay);
+		void wait_for_data();
+		void data_arrived(uint64_t generation);
+		void data_timeout(uint64_t generation);
+		void continue_play();
+		void reset_pace();
+		bool init_item();
+		void finish_item(sound_details & sound_dets);
+		void finish_run();
+		void log_stats(std::string const& what, offline_output_stats const& stats);
+
+		virtual void play() override;
+		virtual void pause_play_internal() override;
+		virtual void resume_play_internal() override;
+		virtual void resume_clear_play_internal() override;
+		virtual void stop_internal() override;
+		virtual void pause_internal() override;
+		virtual void quit_internal() override;
+		virtual void fill_drain_internal() override;
+		virtual void init_api() override;
+
+	protected:
+		// the keys shared by the offline outputs, called from init of the plugin
+		void init_offline(boost::property_tree::ptree const& pt);
+
+		// the sink, called on the job thread
+		// an item starts, the previous one (if any) is finished already
+		virtual bool open_item(sound_details const& sound_dets) = 0;
+		virtual bool write_pcm(unsigned char const* data, std::size_t bytes, sound_details const& sound_dets) = 0;
+		virtual void close_item(sound_details const& sound_dets) = 0;
+		// nothing more is coming (stop, quit or the last item is finished)
+		virtual void close_sink() = 0;
+
+	public:
+		output_plugin_offline()
+			: _volume(100)
+			, _rate_multiple(0.)
+			, _max_data_wait(2000)
+			, _play_posted(false)
+			, _data_waiting(false)
+			, _data_wait_gen(0)
+			, _data_wanted(false)
+			, _pace_audio(0)
+			, _running(false)
+		{}
+
+		virtual ~output_plugin_offline() {
+			BOOST_LOG_TRIVIAL(debug) << "output_plugin_offline::~output_plugin_offline() called";
+		}
+
+		// job thread functions
+		virtual void set_volume(size_type volume) override; // 0 to 100, not applied
+		virtual size_type get_volume() override { return _volume; }
+	};
+}
+
+#endif // output_plugin_offline_h__
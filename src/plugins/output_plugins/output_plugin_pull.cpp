@@ -0,0 +1,455 @@
+#include <algorithm>
+#include <cstring>
+
+#include "output_plugin_pull.h"
+
+namespace mprt
+{
+	namespace
+	{
+		// the volume ramp
+		constexpr size_type _GAIN_RAMP_MSECS_ = 20;
+
+		template <typename T>
+		float sample_to_float(unsigned char const* in, float scale)
+		{
+			T sample;
+			std::memcpy(&sample, in, sizeof(T));
+			return static_cast<float>(sample) * scale;
+		}
+
+		// packed frames to interleaved float with the channels of the stream: mono goes to every
+		// channel, the missing ones are silent and the extra ones are dropped
+		template <typename T>
+		void convert_frames(unsigned char const* in, float * out, std::size_t frames,
+			std::size_t in_channels, std::size_t out_channels, float scale)
+		{
+			for (std::size_t frame = 0; frame != frames; ++frame)
+			{
+				auto in_frame = in + frame * in_channels * sizeof(T);
+				for (std::size_t ch = 0; ch != out_channels; ++ch)
+				{
+					auto src = in_channels == 1 ? 0 : ch;
+					*out++ = src < in_channels ? sample_to_float<T>(in_frame + src * sizeof(T), scale) : 0.f;
+				}
+			}
+		}
+	}
+
+	void output_plugin_pull::init_pull(boost::property_tree::ptree const& pt)
+	{
+		_enabled = (pt.get<std::string>("enable", "true") == "true");
+		_ring_periods = std::max<size_type>(pt.get<size_type>("ring_periods", 3), 2);
+		_max_period_frames = std::max<size_type>(pt.get<size_type>("max_period_frames", 8192), 16);
+		_max_chunk_read_size = pt.get<size_type>("max_chunk_read_size", 128) * 1024;
+		set_progress_rate(pt.get<double>("progress_rate_hz", 10.));
+		_use_duration = pt.get<std::string>("use_memory_size_or_durationms", "duration") == "duration";
+		if (!_use_duration)
+		{
+			_max_memory_size_per_file = pt.get<size_type>("max_memory_size_per_file_duration", 4096) * 1024;
+		}
+		else
+		{
+			_max_memory_size_per_file = pt.get<size_type>("max_memory_size_per_file_duration", 20000);
+		}
+	}
+
+	void output_plugin_pull::set_stream_format(size_type sample_rate, size_type channels, size_type period_frames)
+	{
+		_stream_rate = sample_rate;
+		_stream_channels = channels;
+		set_period_frames(period_frames);
+
+		// the period can grow later, the ring is not reallocated while the device runs
+		_ring.allocate(static_cast<std::size_t>(_ring_periods * std::max(_max_period_frames, period_frames) * channels));
+		_gain.set_ramp_frames(static_cast<std::size_t>(_GAIN_RAMP_MSECS_ * sample_rate / 1000));
+		_gain.reset_gain(static_cast<float>(_volume ? get_soft_vol_gain(static_cast<int>(_volume * 2)) : 0.));
+
+		// the decoders convert into exactly what the device runs with
+		output_format_caps caps;
+		caps._valid = true;
+		caps._s16 = false;
+		caps._s32 = false;
+		caps._float = true;
+		caps._min_rate = caps._max_rate = sample_rate;
+		caps._continuous_rates = false;
+		caps._rates = { sample_rate };
+		caps._min_channels = 1;
+		caps._max_channels = channels;
+		caps._open_policy = open_format_policy::all;
+		set_format_caps(caps);
+
+		sound_details open_format;
+		open_format._bps = 32;
+		open_format._is_float = true;
+		open_format._sample_rate = sample_rate;
+		open_format._channels = channels;
+		set_open_format(open_format);
+
+		BOOST_LOG_TRIVIAL(debug) << plugin_name() << " stream rate: " << sample_rate << " channels: " << channels
+			<< " ring: " << _ring.capacity() / channels << " frames";
+	}
+
+	void output_plugin_pull::set_period_frames(size_type period_frames)
+	{
+		if (period_frames > _max_period_frames)
+		{
+			BOOST_LOG_TRIVIAL(error) << plugin_name() << " period of " << period_frames
+				<< " frames is over max_period_frames: " << _max_period_frames << ", the ring stays smaller";
+		}
+
+		_period_frames = period_frames;
+	}
+
+	void output_plugin_pull::stream_lost()
+	{
+		BOOST_LOG_TRIVIAL(error) << plugin_name() << " stream is lost";
+
+		// nothing pulls any more, the item is set up again on a new stream
+		_stream_started = false;
+		_init_api = false;
+		_ring.reset();
+	}
+
+	size_type output_plugin_pull::ring_frames() const
+	{
+		return _stream_channels > 0 ? static_cast<size_type>(_ring.readable()) / _stream_channels : 0;
+	}
+
+	std::size_t output_plugin_pull::pull(float * dest, std::size_t frames)
+	{
+		auto samples = frames * static_cast<std::size_t>(_stream_channels);
+		std::size_t got = 0;
+
+		if (_ring.is_flushing())
+		{
+			// dropped on the read, the silence is not an underrun
+			_ring.read(dest, 0);
+		}
+		else if (_running.load(std::memory_order_acquire))
+		{
+			got = _ring.read(dest, samples);
+			if (got < samples && _feeding.load(std::memory_order_relaxed))
+			{
+				_underruns.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+
+		std::fill(dest + got, dest + samples, 0.f);
+
+		return got / static_cast<std::size_t>(_stream_channels);
+	}
+
+	void output_plugin_pull::set_volume(size_type volume)
+	{
+		add_job([this, volume]() {
+			_volume = volume;
+			_gain.set_gain(static_cast<float>(_volume ? get_soft_vol_gain(static_cast<int>(_volume * 2)) : 0.));
+		});
+	}
+
+	void output_plugin_pull::post_fill()
+	{
+		if (_fill_posted)
+		{
+			return;
+		}
+
+		// twice a period keeps the ring from going under its target by more than half a period
+		auto period_us = _stream_rate > 0 ? _period_frames * 1000000 / _stream_rate : 0;
+		auto delay = std::chrono::microseconds(std::max<size_type>(period_us / 2, 1000));
+
+		_fill_posted = true;
+		add_job_thread_internal([this]() {
+			_fill_posted = false;
+			play();
+		}, delay);
+	}
+
+	void output_plugin_pull::continue_play()
+	{
+		_feeding = !_sound_details_queue.empty();
+
+		if (is_no_job())
+		{
+			BOOST_LOG_TRIVIAL(debug) << plugin_name() << " play finished";
+
+			_current_state = plugin_states::stop;
+			return;
+		}
+
+		post_fill();
+	}
+
+	bool output_plugin_pull::init_item()
+	{
+		if (_sound_details_queue.empty())
+		{
+			return false;
+		}
+
+		if (!_stream_started && !(_stream_started = start_stream()))
+		{
+			BOOST_LOG_TRIVIAL(error) << plugin_name() << " cannot start the stream";
+			return false;
+		}
+
+		auto const& sound_dets = sound_details_top();
+		bool format_ok =
+			(sound_dets._is_float && sound_dets._bps == 32) ||
+			(!sound_dets._is_float && (sound_dets._bps == 16 || sound_dets._bps == 32));
+
+		// the device runs at its own rate, a resampling decoder sends the item in it
+		if (_stream_rate <= 0 || sound_dets._sample_rate != _stream_rate || !format_ok || sound_dets._channels <= 0)
+		{
+			BOOST_LOG_TRIVIAL(error) << plugin_name() << " cannot play id: " << sound_dets._url_id
+				<< " sample rate: " << sound_dets._sample_rate << " bps: " << sound_dets._bps
+				<< " float: " << sound_dets._is_float << " channels: " << sound_dets._channels
+				<< ", the stream runs at: " << _stream_rate;
+			return false;
+		}
+
+		_prev_sound_details = sound_dets;
+		return (_init_api = true);
+	}
+
+	void output_plugin_pull::init_api()
+	{
+		init_item();
+	}
+
+	void output_plugin_pull::finish_item(sound_details & sound_dets)
+	{
+		BOOST_LOG_TRIVIAL(debug) << "finishing pull output for id: " << sound_dets._url_id;
+
+		sound_dets._decoder_play_finished_callback(sound_dets._url_id);
+
+		auto url_id = sound_dets._url_id;
+		sound_details_pop();
+		give_cache_buf_back(url_id);
+		_init_api = false;
+	}
+
+	void output_plugin_pull::skip_item(sound_details & sound_dets)
+	{
+		if (sound_dets._current_cache_buffer)
+		{
+			sound_dets._current_cache_buffer->clear_data();
+		}
+
+		finish_item(sound_dets);
+	}
+
+	size_type output_plugin_pull::fill_from(sound_details & sound_dets, size_type max_frames)
+	{
+		auto data_ptr = sound_dets._current_cache_buffer->get_data_ptr();
+		if (!data_ptr)
+		{
+			return 0;
+		}
+
+		auto & decoded_data_buf = *data_ptr;
+		auto & pcm_data = decoded_data_buf->second;
+		auto frame_bytes = samples_to_bytes(1, sound_dets);
+		auto frames = std::min(static_cast<size_type>(pcm_data.size()) / frame_bytes, max_frames);
+
+		// the decoder may hand over more than the known length
+		if (sound_dets._total_samples >= 0 &&
+			sound_dets._total_samples != std::numeric_limits<size_type>::max())
+		{
+			frames = std::min(frames, sound_dets._total_samples - sound_dets._current_samples_written_to_sound_buffer);
+		}
+		frames = std::max<size_type>(frames, 0);
+
+		auto out_samples = static_cast<std::size_t>(frames * _stream_channels);
+		if (_convert_buf.size() < out_samples)
+		{
+			_convert_buf.resize(out_samples);
+		}
+
+		auto bytes = frames * frame_bytes;
+		auto in_channels = static_cast<std::size_t>(sound_dets._channels);
+		auto out_channels = static_cast<std::size_t>(_stream_channels);
+		auto one = pcm_data.array_one();
+
+		// a frame may be split over the two parts of the ring
+		unsigned char const* in = reinterpret_cast<unsigned char const*>(one.first);
+		if (one.second < static_cast<std::size_t>(bytes))
+		{
+			in = reinterpret_cast<unsigned char const*>(pcm_data.linearize());
+		}
+
+		if (sound_dets._is_float && in_channels == out_channels)
+		{
+			std::memcpy(_convert_buf.data(), in, out_samples * sizeof(float));
+		}
+		else if (sound_dets._is_float)
+		{
+			convert_frames<float>(in, _convert_buf.data(), static_cast<std::size_t>(frames), in_channels, out_channels, 1.f);
+		}
+		else if (sound_dets._bps == 16)
+		{
+			convert_frames<int16_t>(in, _convert_buf.data(), static_cast<std::size_t>(frames), in_channels, out_channels, 1.f / 32768.f);
+		}
+		else
+		{
+			convert_frames<int32_t>(in, _convert_buf.data(), static_cast<std::size_t>(frames), in_channels, out_channels, 1.f / 2147483648.f);
+		}
+
+		_gain.process(_convert_buf.data(), static_cast<std::size_t>(frames), out_channels, 32, true);
+		// fits, only this thread writes and the room was asked for before
+		_ring.write(_convert_buf.data(), out_samples);
+
+		sound_dets._current_samples_written_to_sound_buffer += frames;
+		pcm_data.erase_begin(static_cast<std::size_t>(bytes));
+		decoded_data_buf->first -= bytes;
+		auto is_play_finished = (sound_dets._current_samples_written_to_sound_buffer == sound_dets._total_samples);
+		sound_dets._current_cache_buffer->put_data_ptr(is_play_finished);
+
+		// the ring is still to be played, an earlier item in it is not told apart
+		if (is_progress_due(sound_dets._url_id))
+		{
+			auto to_ms = [&sound_dets](size_type samples) { return samples_to_time_duration(samples, sound_dets).count() / 1000; };
+			publish_position(sound_dets._url_id,
+				to_ms(sound_dets._current_samples_written_to_sound_buffer - ring_frames()),
+				to_ms(sound_dets._current_samples_written_to_sound_buffer),
+				_running.load());
+		}
+
+		return frames;
+	}
+
+	void output_plugin_pull::log_underruns()
+	{
+		auto underruns = _underruns.load(std::memory_order_relaxed);
+		if (underruns == _logged_underruns)
+		{
+			return;
+		}
+
+		BOOST_LOG_TRIVIAL(info) << plugin_name() << " underruns: " << underruns - _logged_underruns
+			<< " (total: " << underruns << ") ring: " << ring_frames() << " frames"
+			<< " period: " << _period_frames << " frames";
+		_logged_underruns = underruns;
+	}
+
+	void output_plugin_pull::play()
+	{
+		_STATE_CHECK_(plugin_states::play);
+
+		handle_device_events();
+		log_underruns();
+
+		// a seek or a stop is still being dropped by the device thread
+		if (_ring.is_flushing())
+		{
+			post_fill();
+			return;
+		}
+
+		auto capacity_frames = static_cast<size_type>(_ring.capacity()) / std::max<size_type>(_stream_channels, 1);
+		auto target_frames = std::min(_ring_periods * _period_frames, capacity_frames);
+
+		// the items follow each other in the ring without a gap
+		while (!_sound_details_queue.empty())
+		{
+			if (!_init_api && !init_item())
+			{
+				skip_item(sound_details_top_ref());
+				continue;
+			}
+
+			auto & current_sound_dets = sound_details_top_ref();
+			if (!current_sound_dets._current_cache_buffer)
+			{
+				sound_details_pop();
+				_init_api = false;
+				continue;
+			}
+
+			auto room = target_frames - ring_frames();
+			if (room <= 0 || current_sound_dets._current_cache_buffer->is_data_empty())
+			{
+				// full or the decoder is behind, the timer comes back
+				break;
+			}
+
+			auto written = fill_from(current_sound_dets, room);
+			if (current_sound_dets._current_samples_written_to_sound_buffer == current_sound_dets._total_samples)
+			{
+				finish_item(current_sound_dets);
+			}
+			else if (!written)
+			{
+				break;
+			}
+		}
+
+		continue_play();
+	}
+
+	void output_plugin_pull::pause_play_internal()
+	{
+		BOOST_LOG_TRIVIAL(debug) << plugin_name() << " pause called";
+
+		// the device keeps calling, the ring is kept for the resume
+		_running = false;
+		hold_position();
+	}
+
+	void output_plugin_pull::resume_play_internal()
+	{
+		_running = true;
+
+		play();
+	}
+
+	void output_plugin_pull::resume_clear_play_internal()
+	{
+		_ring.request_flush();
+		_running = true;
+
+		play();
+	}
+
+	void output_plugin_pull::stop_internal()
+	{
+		_running = false;
+		_feeding = false;
+		_ring.request_flush();
+
+		for (auto & sound_det : _sound_details_queue)
+		{
+			sound_det._decoder_play_finished_callback(sound_det._url_id);
+
+			give_cache_buf_back(sound_det._url_id);
+		}
+
+		_init_api = false;
+
+		output_plugin_api::stop_internal();
+		sound_plugin_api::reset_buffers();
+	}
+
+	void output_plugin_pull::pause_internal()
+	{
+		pause_play_internal();
+	}
+
+	void output_plugin_pull::quit_internal()
+	{
+		_running = false;
+		_feeding = false;
+
+		if (_stream_started)
+		{
+			_stream_started = false;
+			stop_stream();
+		}
+	}
+
+	void output_plugin_pull::fill_drain_internal()
+	{
+		// the device plays the ring out by itself
+	}
+}
@@ -0,0 +1,117 @@
+#ifndef output_plugin_pull_h__
+#define output_plugin_pull_h__
+
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+#include <boost/log/trivial.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include "common/output_plugin_api.h"
+#include "common/pcm_gain.h"
+#include "common/pcm_ring.h"
+
+namespace mprt
+{
+	// an output whose device asks for the data from its own realtime thread (jack and the like).
+	// the job thread converts the decoded items into interleaved float and keeps a ring of a few
+	// device periods filled, the device callback only takes from the ring with pull()
+	class output_plugin_pull : public output_plugin_api
+	{
+	private:
+		using clock_type = std::chrono::steady_clock;
+
+		pcm_ring _ring;
+		size_type _ring_periods; // the fill target, in device periods
+		size_type _max_period_frames; // the ring is sized for this, set up once
+
+		// the stream, set by the plugin
+		size_type _stream_rate;
+		size_type _stream_channels;
+		std::atomic<size_type> _period_frames;
+		bool _stream_started;
+
+		// realtime side
+		std::atomic_bool _running; // false: pull gives silence and keeps the ring as it is
+		std::atomic_bool _feeding; // there is an item, an empty ring is an underrun
+		std::atomic<uint64_t> _underruns;
+
+		// job thread side
+		uint64_t _logged_underruns;
+		bool _fill_posted;
+		std::vector<float> _convert_buf;
+		size_type _volume;
+		pcm_gain_stage _gain;
+
+		void post_fill();
+		void continue_play();
+		bool init_item();
+		void finish_item(sound_details & sound_dets);
+		void skip_item(sound_details & sound_dets);
+		// converts and queues what fits, the frames written to the ring
+		size_type fill_from(sound_details & sound_dets, size_type max_frames);
+		void log_underruns();
+
+		virtual void play() override;
+		virtual void pause_play_internal() override;
+		virtual void resume_play_internal() override;
+		virtual void resume_clear_play_internal() override;
+		virtual void stop_internal() override;
+		virtual void pause_internal() override;
+		virtual void quit_internal() override;
+		virtual void fill_drain_internal() override;
+		virtual void init_api() override;
+
+	protected:
+		// the keys shared by the pull outputs, called from init of the plugin before the stream is set
+		void init_pull(boost::property_tree::ptree const& pt);
+
+		// the device format, before the device starts calling pull; the period may change later
+		void set_stream_format(size_type sample_rate, size_type channels, size_type period_frames);
+		void set_period_frames(size_type period_frames);
+
+		// the device went away by itself (the server quit), it is started again for the next item played
+		void stream_lost();
+
+		size_type ring_frames() const;
+		uint64_t underruns() const { return _underruns.load(std::memory_order_relaxed); }
+
+		// realtime safe, called from the device thread only. fills dest with interleaved frames,
+		// what is missing is silence. returns the frames taken from the ring
+		std::size_t pull(float * dest, std::size_t frames);
+
+		// the device, called on the job thread. started with the first item that is played
+		virtual bool start_stream() = 0;
+		virtual void stop_stream() = 0;
+
+		// called on the job thread before every fill, for what the device thread only flagged
+		virtual void handle_device_events() {}
+
+	public:
+		output_plugin_pull()
+			: _ring_periods(3)
+			, _max_period_frames(8192)
+			, _stream_rate(0)
+			, _stream_channels(0)
+			, _period_frames(0)
+			, _stream_started(false)
+			, _running(false)
+			, _feeding(false)
+			, _underruns(0)
+			, _logged_underruns(0)
+			, _fill_posted(false)
+			, _volume(100)
+		{}
+
+		virtual ~output_plugin_pull() {
+			BOOST_LOG_TRIVIAL(debug) << "output_plugin_pull::~output_plugin_pull() called";
+		}
+
+		// job thread functions
+		virtual void set_volume(size_type volume) override; // 0 to 100, a software gain
+		virtual size_type get_volume() override { return _volume; }
+	};
+}
+
+#endif // output_plugin_pull_h__
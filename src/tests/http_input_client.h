@@ -0,0 +1,221 @@
+#ifndef http_input_client_h__
+#define http_input_client_h__
+
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <boost/log/core.hpp>
+#include <boost/log/expressions.hpp>
+#include <boost/log/trivial.hpp>
+
+#include "plugins/input_plugins/input_plugin_http.h"
+
+#include "http_loopback_server.h"
+
+namespace mprt
+{
+	namespace test
+	{
+		// drives input_plugin_http the way the decoder manager does: the opened callback is
+		// answered with a cache buffer, the data chunks are taken whole and seeks drop the
+		// chunks up to the one starting at the seek point
+		class http_input_client
+		{
+		public:
+			using clock_type = std::chrono::steady_clock;
+			using details_shared = std::shared_ptr<current_decoder_details>;
+
+			struct stream
+			{
+				url_id_t _url_id;
+				details_shared _details;
+				cache_buffer_shared _cache_buf;
+
+				bool ok() const { return _details && _details->_sound_details._ok; }
+			};
+
+		private:
+			input_plugin_http _plugin;
+
+			std::mutex _mutex;
+			std::condition_variable _cond;
+			std::map<url_id_t, details_shared> _opened;
+			std::map<url_id_t, std::vector<std::string>> _metadata;
+			bool _data_ready;
+
+			size_type _cache_size;
+			size_type _chunk_size;
+			std::chrono::milliseconds _timeout;
+
+			void wait_data(std::chrono::milliseconds dur)
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				_cond.wait_for(lock, dur, [this] { return _data_ready; });
+				_data_ready = false;
+			}
+
+		public:
+			http_input_client(size_type cache_size, size_type chunk_size)
+				: _data_ready(false)
+				, _cache_size(cache_size)
+				, _chunk_size(chunk_size)
+				, _timeout(10000)
+			{
+				boost::log::core::get()->set_filter(boost::log::trivial::severity >= boost::log::trivial::warning);
+
+				_plugin.init();
+				_plugin.set_input_opened_cb([this](details_shared details)
+				{
+					std::lock_guard<std::mutex> lock(_mutex);
+					_opened[details->_sound_details._url_id] = details;
+					_cond.notify_all();
+				});
+				_plugin.set_input_metadata_cb([this](url_id_t url_id, std::string tag_name, std::string tag_value)
+				{
+					std::lock_guard<std::mutex> lock(_mutex);
+					_metadata[url_id].push_back(tag_name + "=" + tag_value);
+				});
+				_plugin.cont();
+			}
+
+			~http_input_client()
+			{
+				// the connections are closed on the job thread before the plugin goes
+				std::promise<void> done;
+				_plugin.quit();
+				_plugin.add_job([&done] { done.set_value(); });
+				done.get_future().wait();
+			}
+
+			http_input_client(http_input_client const&) = delete;
+			http_input_client & operator=(http_input_client const&) = delete;
+
+			// the stream is not ok if the plugin reported a failure or nothing came in time
+			stream open(std::string const& url)
+			{
+				stream result;
+				result._url_id = _plugin.add_input_item(url);
+
+				{
+					std::unique_lock<std::mutex> lock(_mutex);
+					if (!_cond.wait_for(lock, _timeout, [this, &result] { return _opened.count(result._url_id) != 0; }))
+						return result;
+
+					result._details = _opened[result._url_id];
+				}
+
+				if (!result.ok())
+					return result;
+
+				result._cache_buf = std::make_shared<cache_buffer_t>(_cache_size, _chunk_size);
+				result._cache_buf->set_data_notify([this]
+				{
+					std::lock_guard<std::mutex> lock(_mutex);
+					_data_ready = true;
+					_cond.notify_all();
+				});
+				result._details->_set_input_cache_buf_callback(result._url_id, result._cache_buf);
+
+				return result;
+			}
+
+			void close(stream & s)
+			{
+				if (s._details)
+				{
+					s._details->_decoder_finish_callback(_plugin.plugin_name(), s._url_id);
+				}
+				s = stream();
+			}
+
+			void seek(stream const& s, size_type seek_point)
+			{
+				s._details->_seek_callback(s._url_id, seek_point);
+			}
+
+			// the data chunks from pos up to end are handed to on_chunk (start position, bytes, length),
+			// the last one may run past end. false on a gap, a timeout or if on_chunk returns false
+			template <typename Func>
+			bool read(stream const& s, size_type pos, size_type end, Func on_chunk)
+			{
+				auto deadline = clock_type::now() + _timeout;
+				while (pos < end)
+				{
+					auto data_ptr = s._cache_buf->get_data_ptr();
+					if (!data_ptr)
+					{
+						if (clock_type::now() > deadline)
+							return false;
+
+						wait_data(std::chrono::milliseconds(10));
+						continue;
+					}
+
+					auto & chunk = **data_ptr;
+					auto len = static_cast<size_type>(chunk.second.size());
+					bool ok = chunk.first == pos && on_chunk(chunk.first, chunk.second.linearize(), len);
+
+					chunk.second.clear();
+					s._cache_buf->put_data_ptr(true);
+
+					if (!ok)
+						return false;
+
+					pos += len;
+					deadline = clock_type::now() + _timeout;
+				}
+
+				return true;
+			}
+
+			// drops the chunks of the old position, the first chunk at seek_point is left in the buffer
+			bool wait_seek(stream const& s, size_type seek_point)
+			{
+				auto deadline = clock_type::now() + _timeout;
+				while (clock_type::now() < deadline)
+				{
+					auto data_ptr = s._cache_buf->get_data_ptr();
+					if (!data_ptr)
+					{
+						wait_data(std::chrono::milliseconds(10));
+						continue;
+					}
+
+					if ((*data_ptr)->first == seek_point)
+						return true;
+
+					(*data_ptr)->second.clear();
+					s._cache_buf->put_data_ptr(true);
+				}
+
+				return false;
+			}
+
+			std::vector<std::string> metadata(url_id_t url_id)
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				return _metadata[url_id];
+			}
+		};
+
+		// the bytes of a chunk against the body the loopback server sends
+		inline bool check_body(size_type pos, buffer_elem_t const* data, size_type len)
+		{
+			for (size_type i = 0; i != len; ++i)
+			{
+				if (static_cast<unsigned char>(data[i]) != body_byte(pos + i))
+					return false;
+			}
+
+			return true;
+		}
+	}
+}
+
+#endif // http_input_client_h__
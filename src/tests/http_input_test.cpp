@@ -0,0 +1,205 @@
+// input_plugin_http against a loopback server: content length and chunked bodies, icy metadata,
+// range seeks, resuming a broken download and redirects over a kept alive connection.
+// run from the source directory, the plugin reads ../config/config_input_plugin_http.xml
+
+#include <cstdio>
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "http_input_client.h"
+
+namespace
+{
+	using namespace mprt;
+	using namespace mprt::test;
+
+	int _failures = 0;
+
+#define CHECK(_cond_) \
+	do { \
+		if (!(_cond_)) { \
+			std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #_cond_); \
+			++_failures; \
+		} \
+	} while (false)
+
+	constexpr size_type _CACHE_SIZE_ = 1024 * 1024;
+	constexpr size_type _CHUNK_SIZE_ = 64 * 1024;
+
+	bool read_body(http_input_client & client, http_input_client::stream const& s, size_type pos, size_type end)
+	{
+		return client.read(s, pos, end, check_body);
+	}
+
+	bool has_tag(std::vector<std::string> const& tags, std::string const& tag)
+	{
+		return std::find(tags.begin(), tags.end(), tag) != tags.end();
+	}
+
+	void test_content_length(http_input_client & client)
+	{
+		http_loopback_server server(3 * 1024 * 1024 + 17);
+
+		auto s = client.open(server.url("/file"));
+		CHECK(s.ok());
+		if (!s.ok())
+			return;
+
+		CHECK(s._details->_stream_length == server._file_size);
+		CHECK(s._details->_length_supported);
+		CHECK(s._details->_seek_supported);
+		CHECK(read_body(client, s, 0, server._file_size));
+		client.close(s);
+
+		CHECK(1 == server._connections);
+		CHECK(0 == server._range_requests);
+	}
+
+	void test_chunked(http_input_client & client)
+	{
+		http_loopback_server server(1024 * 1024 + 5);
+
+		auto s = client.open(server.url("/chunked"));
+		CHECK(s.ok());
+		if (!s.ok())
+			return;
+
+		// no length, the stream is read like a live one
+		CHECK(!s._details->_length_supported);
+		CHECK(!s._details->_seek_supported);
+		CHECK(read_body(client, s, 0, server._file_size));
+		client.close(s);
+
+		// the last chunk and the trailer are read, the connection takes the next request
+		s = client.open(server.url("/chunked"));
+		CHECK(s.ok());
+		if (!s.ok())
+			return;
+
+		CHECK(read_body(client, s, 0, server._file_size));
+		client.close(s);
+
+		CHECK(1 == server._connections);
+		CHECK(2 == server._requests);
+	}
+
+	void test_icy(http_input_client & client)
+	{
+		http_loopback_server server(200 * 1024 + 3);
+
+		auto s = client.open(server.url("/icy"));
+		CHECK(s.ok());
+		if (!s.ok())
+			return;
+
+		// the metadata blocks are not passed on with the audio bytes
+		CHECK(!s._details->_seek_supported);
+		CHECK(read_body(client, s, 0, server._file_size));
+
+		auto tags = client.metadata(s._url_id);
+		CHECK(has_tag(tags, "TITLE=loopback radio"));
+		CHECK(has_tag(tags, "TITLE=" + server._icy_title));
+		// the same title in the following blocks is reported once
+		CHECK(2 == tags.size());
+		client.close(s);
+	}
+
+	void test_resume(http_input_client & client)
+	{
+		http_loopback_server server(2 * 1024 * 1024 + 1);
+
+		auto s = client.open(server.url("/drop"));
+		CHECK(s.ok());
+		if (!s.ok())
+			return;
+
+		// the server breaks the download after a third, the rest comes with a range request
+		CHECK(read_body(client, s, 0, server._file_size));
+		client.close(s);
+
+		CHECK(1 == server._range_requests);
+		CHECK(server._last_range_start > 0);
+		CHECK(server._last_range_start <= server._drop_at);
+	}
+
+	void test_seek(http_input_client & client)
+	{
+		http_loopback_server server(4 * 1024 * 1024);
+
+		auto s = client.open(server.url("/file"));
+		CHECK(s.ok());
+		if (!s.ok())
+			return;
+
+		CHECK(read_body(client, s, 0, 256 * 1024));
+
+		// forward, to the end and back again
+		std::vector<size_type> seek_points = { 3000001, 12345 };
+		for (auto seek_point : seek_points)
+		{
+			client.seek(s, seek_point);
+			CHECK(client.wait_seek(s, seek_point));
+			CHECK(read_body(client, s, seek_point, std::min<size_type>(seek_point + 600 * 1024, server._file_size)));
+		}
+		CHECK(2 == server._range_requests);
+		CHECK(12345 == server._last_range_start);
+
+		// near the end, the stream is read to its last byte
+		client.seek(s, 4000000);
+		CHECK(client.wait_seek(s, 4000000));
+		CHECK(read_body(client, s, 4000000, server._file_size));
+		client.close(s);
+	}
+
+	void test_redirect(http_input_client & client)
+	{
+		http_loopback_server server(512 * 1024);
+
+		auto s = client.open(server.url("/redirect"));
+		CHECK(s.ok());
+		if (!s.ok())
+			return;
+
+		CHECK(s._details->_stream_length == server._file_size);
+		CHECK(read_body(client, s, 0, server._file_size));
+		client.close(s);
+
+		// the empty redirect body leaves the connection for the request to its location
+		CHECK(1 == server._connections);
+		CHECK(2 == server._requests);
+	}
+
+	void test_not_found(http_input_client & client)
+	{
+		http_loopback_server server(1024);
+
+		auto s = client.open(server.url("/missing"));
+		CHECK(s._details);
+		CHECK(!s.ok());
+	}
+}
+
+int main()
+{
+	std::vector<std::pair<char const*, std::function<void (http_input_client &)>>> tests = {
+		{ "content_length", test_content_length },
+		{ "chunked", test_chunked },
+		{ "icy", test_icy },
+		{ "resume", test_resume },
+		{ "seek", test_seek },
+		{ "redirect", test_redirect },
+		{ "not_found", test_not_found },
+	};
+
+	http_input_client client(_CACHE_SIZE_, _CHUNK_SIZE_);
+	for (auto & test : tests)
+	{
+		auto failures = _failures;
+		test.second(client);
+		std::printf("%-16s %s\n", test.first, failures == _failures ? "ok" : "FAILED");
+	}
+
+	return _failures == 0 ? 0 : 1;
+}
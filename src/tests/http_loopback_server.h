@@ -0,0 +1,364 @@
+#ifndef http_loopback_server_h__
+#define http_loopback_server_h__
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+#include <boost/asio.hpp>
+#include <boost/algorithm/string.hpp>
+
+#include "common/common_defs.h"
+
+namespace mprt
+{
+	namespace test
+	{
+		// the byte at a body position, the same on every request so that ranges and resumes can be checked
+		inline unsigned char body_byte(size_type pos)
+		{
+			return static_cast<unsigned char>(pos * 131 + (pos >> 8) * 7 + (pos >> 16));
+		}
+
+		inline void fill_body(unsigned char * dest, size_type pos, size_type len)
+		{
+			for (size_type i = 0; i != len; ++i)
+			{
+				dest[i] = body_byte(pos + i);
+			}
+		}
+
+		// a blocking http/1.1 server on 127.0.0.1 with one thread per connection. the routes:
+		//   /file      _file_size bytes, Content-Length, keep-alive, honours "Range: bytes=N-" with 206
+		//   /chunked   _file_size bytes in chunks of varying size with extensions and a trailer
+		//   /icy       _file_size audio bytes with icy metadata every _icy_metaint bytes, ended by close
+		//   /redirect  302 to /file with an empty body on the same keep-alive connection
+		//   /drop      like /file, but a response without a range is cut off after _drop_at bytes
+		class http_loopback_server
+		{
+		private:
+			using tcp = boost::asio::ip::tcp;
+
+			boost::asio::io_context _io;
+			tcp::acceptor _acceptor;
+			std::thread _accept_thread;
+			std::atomic_bool _stopped;
+
+			std::mutex _mutex;
+			std::vector<std::shared_ptr<tcp::socket>> _sockets;
+			std::vector<std::thread> _threads;
+
+			struct request
+			{
+				std::string _target;
+				size_type _range_start; // -1 without a range
+
+				request()
+					: _range_start(-1)
+				{}
+			};
+
+			void accept_loop()
+			{
+				while (!_stopped)
+				{
+					auto socket = std::make_shared<tcp::socket>(_io);
+					boost::system::error_code ec;
+					_acceptor.accept(*socket, ec);
+					if (ec || _stopped)
+						break;
+
+					++_connections;
+
+					std::lock_guard<std::mutex> lock(_mutex);
+					_sockets.push_back(socket);
+					_threads.emplace_back([this, socket] { serve(*socket); });
+				}
+			}
+
+			bool read_request(tcp::socket & socket, std::string & buffered, request & req)
+			{
+				std::string::size_type head_end;
+				while ((head_end = buffered.find("\r\n\r\n")) == std::string::npos)
+				{
+					char data[4096];
+					boost::system::error_code ec;
+					auto len = socket.read_some(boost::asio::buffer(data), ec);
+					if (ec)
+						return false;
+
+					buffered.append(data, len);
+				}
+
+				std::vector<std::string> lines;
+				auto head = buffered.substr(0, head_end);
+				buffered.erase(0, head_end + 4);
+				boost::split(lines, head, boost::is_any_of("\n"));
+
+				std::vector<std::string> request_line;
+				boost::split(request_line, boost::trim_copy(lines[0]), boost::is_any_of(" "));
+				if (request_line.size() < 2)
+					return false;
+
+				req = request();
+				req._target = request_line[1];
+
+				for (std::size_t i = 1; i < lines.size(); ++i)
+				{
+					auto line = boost::trim_copy(lines[i]);
+					auto colon = line.find(':');
+					if (colon == std::string::npos)
+						continue;
+
+					auto name = boost::to_lower_copy(line.substr(0, colon));
+					auto value = boost::trim_copy(line.substr(colon + 1));
+					if (name == "range" && boost::starts_with(value, "bytes="))
+					{
+						req._range_start = std::stoll(value.substr(6));
+						++_range_requests;
+						_last_range_start = req._range_start;
+					}
+				}
+
+				++_requests;
+				return true;
+			}
+
+			bool write(tcp::socket & socket, std::string const& data)
+			{
+				boost::system::error_code ec;
+				boost::asio::write(socket, boost::asio::buffer(data), ec);
+				return !ec;
+			}
+
+			// the body from pos up to end, false if the client went away
+			bool write_body(tcp::socket & socket, size_type pos, size_type end)
+			{
+				std::vector<unsigned char> block(64 * 1024);
+				while (pos < end)
+				{
+					auto len = std::min<size_type>(static_cast<size_type>(block.size()), end - pos);
+					fill_body(block.data(), pos, len);
+
+					boost::system::error_code ec;
+					boost::asio::write(socket, boost::asio::buffer(block.data(), static_cast<std::size_t>(len)), ec);
+					if (ec)
+						return false;
+
+					pos += len;
+				}
+
+				return true;
+			}
+
+			bool serve_file(tcp::socket & socket, request const& req, bool drop)
+			{
+				auto start = std::max<size_type>(req._range_start, 0);
+				if (start > _file_size)
+				{
+					return write(socket, "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Length: 0\r\n\r\n");
+				}
+
+				std::string head = req._range_start >= 0 ? "HTTP/1.1 206 Partial Content\r\n" : "HTTP/1.1 200 OK\r\n";
+				head += "Content-Type: audio/mpeg\r\n";
+				head += "Accept-Ranges: bytes\r\n";
+				head += "Content-Length: " + std::to_string(_file_size - start) + "\r\n";
+				if (req._range_start >= 0)
+				{
+					head += "Content-Range: bytes " + std::to_string(start) + "-" + std::to_string(_file_size - 1) + "/" + std::to_string(_file_size) + "\r\n";
+				}
+				head += "\r\n";
+
+				if (!write(socket, head))
+					return false;
+
+				if (drop && req._range_start < 0)
+				{
+					// the connection breaks in the middle of the body
+					write_body(socket, 0, std::min(_drop_at, _file_size));
+					return false;
+				}
+
+				return write_body(socket, start, _file_size);
+			}
+
+			bool serve_chunked(tcp::socket & socket)
+			{
+				if (!write(socket, "HTTP/1.1 200 OK\r\nContent-Type: audio/mpeg\r\nTransfer-Encoding: chunked\r\n\r\n"))
+					return false;
+
+				std::vector<unsigned char> chunk;
+				size_type pos = 0;
+				size_type chunk_size = 1;
+				while (pos < _file_size)
+				{
+					auto len = std::min(chunk_size, _file_size - pos);
+					chunk.resize(static_cast<std::size_t>(len));
+					fill_body(chunk.data(), pos, len);
+
+					std::ostringstream size_line;
+					size_line << std::hex << len << (len % 3 ? ";ext=1" : "") << "\r\n";
+
+					if (!write(socket, size_line.str()) ||
+						!write(socket, std::string(chunk.begin(), chunk.end()) + "\r\n"))
+						return false;
+
+					pos += len;
+					// 1, 4, 13 ... bytes, the sizes straddle the reads of the client
+					chunk_size = chunk_size * 3 + 1;
+					if (chunk_size > 70000)
+						chunk_size = 5;
+				}
+
+				return write(socket, "0\r\nX-Trailer: done\r\n\r\n");
+			}
+
+			bool serve_icy(tcp::socket & socket)
+			{
+				std::string head = "HTTP/1.1 200 OK\r\nContent-Type: audio/mpeg\r\n";
+				head += "icy-name: loopback radio\r\n";
+				head += "icy-metaint: " + std::to_string(_icy_metaint) + "\r\n";
+				head += "Connection: close\r\n\r\n";
+
+				if (!write(socket, head))
+					return false;
+
+				std::string data;
+				size_type pos = 0;
+				size_type block = 0;
+				while (pos < _file_size)
+				{
+					auto len = std::min(_icy_metaint, _file_size - pos);
+					auto start = data.size();
+					data.resize(start + static_cast<std::size_t>(len));
+					fill_body(reinterpret_cast<unsigned char *>(&data[start]), pos, len);
+					pos += len;
+
+					if (len == _icy_metaint)
+					{
+						// every other block has a title, the rest an empty metadata block
+						std::string meta = (block++ % 2) ? "" : "StreamTitle='" + _icy_title + "';";
+						meta.resize((meta.size() + 15) / 16 * 16, '\0');
+						data += static_cast<char>(meta.size() / 16);
+						data += meta;
+					}
+				}
+
+				write(socket, data);
+				return false;
+			}
+
+			void serve(tcp::socket & socket)
+			{
+				std::string buffered;
+				request req;
+				while (!_stopped && read_request(socket, buffered, req))
+				{
+					bool keep_open = false;
+					if (req._target == "/file")
+					{
+						keep_open = serve_file(socket, req, false);
+					}
+					else if (req._target == "/drop")
+					{
+						keep_open = serve_file(socket, req, true);
+					}
+					else if (req._target == "/chunked")
+					{
+						keep_open = serve_chunked(socket);
+					}
+					else if (req._target == "/icy")
+					{
+						keep_open = serve_icy(socket);
+					}
+					else if (req._target == "/redirect")
+					{
+						keep_open = write(socket, "HTTP/1.1 302 Found\r\nLocation: /file\r\nContent-Length: 0\r\n\r\n");
+					}
+					else
+					{
+						keep_open = write(socket, "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n");
+					}
+
+					if (!keep_open)
+						break;
+				}
+
+				// the socket is closed with the server, stop() may still shut it down
+				boost::system::error_code ec;
+				socket.shutdown(tcp::socket::shutdown_both, ec);
+			}
+
+		public:
+			size_type _file_size;
+			size_type _drop_at;
+			size_type _icy_metaint;
+			std::string _icy_title;
+
+			std::atomic<size_type> _connections;
+			std::atomic<size_type> _requests;
+			std::atomic<size_type> _range_requests;
+			std::atomic<size_type> _last_range_start;
+
+			http_loopback_server(size_type file_size)
+				: _acceptor(_io, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0))
+				, _stopped(false)
+				, _file_size(file_size)
+				, _drop_at(file_size / 3)
+				, _icy_metaint(8192)
+				, _icy_title("loopback title")
+				, _connections(0)
+				, _requests(0)
+				, _range_requests(0)
+				, _last_range_start(-1)
+			{
+				_accept_thread = std::thread([this] { accept_loop(); });
+			}
+
+			~http_loopback_server()
+			{
+				stop();
+			}
+
+			http_loopback_server(http_loopback_server const&) = delete;
+			http_loopback_server & operator=(http_loopback_server const&) = delete;
+
+			std::string url(std::string const& target) const
+			{
+				return "http://127.0.0.1:" + std::to_string(_acceptor.local_endpoint().port()) + target;
+			}
+
+			void stop()
+			{
+				if (_stopped.exchange(true))
+					return;
+
+				// the blocking accept is woken up by one last connection
+				{
+					boost::system::error_code ec;
+					tcp::socket wake(_io);
+					wake.connect(_acceptor.local_endpoint(), ec);
+				}
+				_accept_thread.join();
+
+				std::lock_guard<std::mutex> lock(_mutex);
+				for (auto & socket : _sockets)
+				{
+					boost::system::error_code ec;
+					socket->shutdown(tcp::socket::shutdown_both, ec);
+				}
+				for (auto & th : _threads)
+				{
+					th.join();
+				}
+			}
+		};
+	}
+}
+
+#endif // http_loopback_server_h__